@@ -14,10 +14,11 @@
 //-----------------------------------------------------------------------------
 // Linker 
 //-----------------------------------------------------------------------------
-#ifdef LIB_DS4_AUTO_LINK
+#if defined(LIB_DS4_AUTO_LINK) && defined(_WIN32)
 #pragma comment(lib, "hid.lib")
 #pragma comment(lib, "setupapi.lib")
 #pragma comment(lib, "Bthprops.lib")
+#pragma comment(lib, "cfgmgr32.lib")
 #endif//LIB_DS4_AUTO_LINK
 
 
@@ -26,12 +27,28 @@
 //-----------------------------------------------------------------------------
 struct PadHandle;
 struct PadRawInput;
+struct PadManager;
+struct PadEventQueue;
+struct PadStickTable;
+struct PadHotplug;
 
 
 //-----------------------------------------------------------------------------
 // Constant Value.
 //-----------------------------------------------------------------------------
-static const uint8_t kPadMaxTouchCount = 2;
+static const uint8_t  kPadMaxTouchCount   = 2;
+static const uint32_t kPadMaxManagedCount = 16;
+static const uint32_t kPadMaxDevicePath   = 256;
+static const uint32_t kPadMaxReportSize   = 78;
+static const uint32_t kPadConnectionMask  = 0x0f;  // 接続タイプ(DualSenseフラグを除く)のマスク.
+static const uint32_t kPadHistogramBuckets = 24;
+static const uint32_t kPadMaxGestureCount  = 2;     // 1レポートで認識されるジェスチャーの最大数.
+static const uint32_t kPadCaptureMagic      = 0x43345344;   // キャプチャファイルの識別子("DS4C").
+static const uint32_t kPadCaptureIndexMagic = 0x49345344;   // キャプチャファイルの索引の識別子("DS4I").
+static const uint16_t kPadCaptureVersion    = 1;            // キャプチャファイルのバージョン.
+static const uint32_t kPadCaptureChunkSize  = 1024;         // キャプチャファイルの索引1つあたりのレコード数.
+static const uint32_t kPadDeltaMaxRecordSize = 100;         // 差分符号化した1レポートの最大サイズ.
+static const uint32_t kPadDeltaGroupCount    = (kPadMaxReportSize + 7) / 8;    // 差分符号化の8バイト単位のグループ数.
 
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -46,6 +63,15 @@ enum PAD_CONNECTION_TYPE
     PAD_CONNECTION_DUAL_SENSE   = 0x10, //!< DualSense Controller.
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// PAD_DEVICE_EVENT enum
+///////////////////////////////////////////////////////////////////////////////
+enum PAD_DEVICE_EVENT
+{
+    PAD_DEVICE_ADDED    = 0,    //!< 接続.
+    PAD_DEVICE_REMOVED  = 1,    //!< 切断.
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // PAD_BUTTON_OFFSET enum
 ///////////////////////////////////////////////////////////////////////////////
@@ -71,14 +97,14 @@ enum PAD_BUTTON_OFFSET
 enum PAD_BUTTON_DPAD
 {
     PAD_BUTTON_DPAD_NONE        = 0x8,  // None.
-    PAD_BUTTON_DPAD_NORTHWEST   = 0x7,  // .
-    PAD_BUTTON_DPAD_WEST        = 0x6,  // .
-    PAD_BUTTON_DPAD_SOUTHWEST   = 0x5,  // .
-    PAD_BUTTON_DPAD_SOUTH       = 0x4,  // 
-    PAD_BUTTON_DPAD_SOUTHEAST   = 0x3,  // 
-    PAD_BUTTON_DPAD_EAST        = 0x2,  // .
-    PAD_BUTTON_DPAD_NORTHEAST   = 0x1,  // .
-    PAD_BUTTON_DPAD_NORTH       = 0x0   // .
+    PAD_BUTTON_DPAD_NORTHWEST   = 0x7,  // ↑←.
+    PAD_BUTTON_DPAD_WEST        = 0x6,  // ←.
+    PAD_BUTTON_DPAD_SOUTHWEST   = 0x5,  // ↓←.
+    PAD_BUTTON_DPAD_SOUTH       = 0x4,  // ↓
+    PAD_BUTTON_DPAD_SOUTHEAST   = 0x3,  // ↓→
+    PAD_BUTTON_DPAD_EAST        = 0x2,  // →.
+    PAD_BUTTON_DPAD_NORTHEAST   = 0x1,  // ↑→.
+    PAD_BUTTON_DPAD_NORTH       = 0x0   // ↑.
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -86,9 +112,9 @@ enum PAD_BUTTON_DPAD
 ///////////////////////////////////////////////////////////////////////////////
 enum PAD_SPECIAL_BUTTON_OFFSET
 {
-    PAD_SPECIAL_BUTTON_PS       = 1 << 0,   // PlayStation{^.
-    PAD_SPECIAL_BUTTON_TPAD     = 1 << 1,   // ^b`pbh.
-    PAD_SPECIAL_BUTTON_MUTE     = 1 << 2,   // }CN~[g{^(DualSensê).
+    PAD_SPECIAL_BUTTON_PS       = 1 << 0,   // PlayStationボタン.
+    PAD_SPECIAL_BUTTON_TPAD     = 1 << 1,   // タッチパッド.
+    PAD_SPECIAL_BUTTON_MUTE     = 1 << 2,   // マイクミュートボタン(DualSenseのみ).
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -96,10 +122,79 @@ enum PAD_SPECIAL_BUTTON_OFFSET
 ///////////////////////////////////////////////////////////////////////////////
 enum PAD_PLUG_OFFSET
 {
-    PAD_PLUG_BATTERY_CHARGED    = 1 << 3,   // [d.
-    PAD_PLUG_USB                = 1 << 4,   // USBڑ.
-    PAD_PLUG_AUDIO              = 1 << 5,   // wbhzڑ.
-    PAD_PLUG_MIC                = 1 << 6,   // }CNڑ.
+    PAD_PLUG_BATTERY_CHARGED    = 1 << 3,   // 充電中.
+    PAD_PLUG_USB                = 1 << 4,   // USB接続.
+    PAD_PLUG_AUDIO              = 1 << 5,   // ヘッドホン接続.
+    PAD_PLUG_MIC                = 1 << 6,   // マイク接続.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PAD_FIELD enum
+///////////////////////////////////////////////////////////////////////////////
+enum PAD_FIELD
+{
+    PAD_FIELD_STICK_L           = 1 << 0,   // 左スティック.
+    PAD_FIELD_STICK_R           = 1 << 1,   // 右スティック.
+    PAD_FIELD_ANALOG_BUTTONS    = 1 << 2,   // アナログボタン.
+    PAD_FIELD_BUTTONS           = 1 << 3,   // ボタン(DPadを含む).
+    PAD_FIELD_SPECIAL_BUTTONS   = 1 << 4,   // 特殊ボタン.
+    PAD_FIELD_TIMESTAMP         = 1 << 5,   // タイムスタンプ.
+    PAD_FIELD_BATTERY           = 1 << 6,   // バッテリーレベル.
+    PAD_FIELD_GYRO              = 1 << 7,   // 角速度.
+    PAD_FIELD_ACCEL             = 1 << 8,   // 加速度.
+    PAD_FIELD_TOUCH             = 1 << 9,   // タッチパッド.
+    PAD_FIELD_ALL               = 0x3ff,
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PAD_EDGE_BUTTON enum
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  PadChanges のボタンのビットです.
+//!
+//! @note   ビット4~15は PAD_BUTTON_OFFSET と同じです.
+enum PAD_EDGE_BUTTON
+{
+    PAD_EDGE_DPAD_UP            = 1 << 0,   // ↑.
+    PAD_EDGE_DPAD_RIGHT         = 1 << 1,   // →.
+    PAD_EDGE_DPAD_DOWN          = 1 << 2,   // ↓.
+    PAD_EDGE_DPAD_LEFT          = 1 << 3,   // ←.
+    PAD_EDGE_PS                 = PAD_SPECIAL_BUTTON_PS   << 16,    // PlayStationボタン.
+    PAD_EDGE_TPAD               = PAD_SPECIAL_BUTTON_TPAD << 16,    // タッチパッド.
+    PAD_EDGE_MUTE               = PAD_SPECIAL_BUTTON_MUTE << 16,    // マイクミュートボタン(DualSenseのみ).
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PAD_EVENT_TYPE enum
+///////////////////////////////////////////////////////////////////////////////
+enum PAD_EVENT_TYPE
+{
+    PAD_EVENT_BUTTON_DOWN       = 0,    //!< ボタンが押された.
+    PAD_EVENT_BUTTON_UP         = 1,    //!< ボタンが離された.
+    PAD_EVENT_TRIGGER           = 2,    //!< L2/R2トリガーの値が変化した.
+    PAD_EVENT_TOUCH_DOWN        = 3,    //!< タッチパッドに触れた.
+    PAD_EVENT_TOUCH_MOVE        = 4,    //!< タッチ位置が移動した.
+    PAD_EVENT_TOUCH_UP          = 5,    //!< タッチパッドから離れた.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PAD_GESTURE_TYPE enum
+///////////////////////////////////////////////////////////////////////////////
+enum PAD_GESTURE_TYPE
+{
+    PAD_GESTURE_TAP             = 0,    //!< 短時間触れて, 動かさずに離した(全ての指が離れた時に通知).
+    PAD_GESTURE_SWIPE           = 1,    //!< 1本の指で払った(離した時に通知).
+    PAD_GESTURE_PINCH           = 2,    //!< 2本の指の間隔を変えた(変化するたびに通知).
+    PAD_GESTURE_SCROLL          = 3,    //!< 2本の指を揃えて動かした(移動するたびに通知).
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PAD_SIMD_LEVEL enum
+///////////////////////////////////////////////////////////////////////////////
+enum PAD_SIMD_LEVEL
+{
+    PAD_SIMD_NONE               = 0,    //!< スカラー実装.
+    PAD_SIMD_SSE41              = 1,    //!< SSE4.1.
+    PAD_SIMD_AVX2               = 2,    //!< AVX2.
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -107,8 +202,8 @@ enum PAD_PLUG_OFFSET
 ///////////////////////////////////////////////////////////////////////////////
 struct PadAnalogStick
 {
-    uint8_t     X;      //!< X([0ŁCE[255).
-    uint8_t     Y;      //!< Y([0ŁC[255).
+    uint8_t     X;      //!< X成分(左端が0で，右端が255).
+    uint8_t     Y;      //!< Y成分(下端が0で，上端が255).
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -116,8 +211,8 @@ struct PadAnalogStick
 ///////////////////////////////////////////////////////////////////////////////
 struct PadAnalogButtons
 {
-    uint8_t     L2;     //!< L2gK[.
-    uint8_t     R2;     //!< R2gK[.
+    uint8_t     L2;     //!< L2トリガー.
+    uint8_t     R2;     //!< R2トリガー.
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -140,13 +235,28 @@ struct PadAccelaration
     int16_t     Z;      // positive : toward player.
 };
 
+///////////////////////////////////////////////////////////////////////////////
+// PadQuaternion structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  パッドの姿勢です.
+//!
+//! @note   軸は PadAccelaration と同じで, パッドを水平に置き奥に向けた状態を単位クォータニオンとします.
+//!         鉛直軸(Y)周りの回転は角速度の積分のみで求めるため, 時間とともにずれます.
+struct PadQuaternion
+{
+    float       W;
+    float       X;
+    float       Y;
+    float       Z;
+};
+
 ///////////////////////////////////////////////////////////////////////////////
 // PadVibrationParam structure
 ///////////////////////////////////////////////////////////////////////////////
 struct PadVibrationParam
 {
-    uint8_t     LargeMotor; //!< [^[.
-    uint8_t     SmallMotor; //!< [^[E.
+    uint8_t     LargeMotor; //!< モーター左.
+    uint8_t     SmallMotor; //!< モーター右.
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -154,9 +264,36 @@ struct PadVibrationParam
 ///////////////////////////////////////////////////////////////////////////////
 struct PadColor
 {
-    uint8_t     R;      //!< R.
-    uint8_t     G;      //!< G.
-    uint8_t     B;      //!< B.
+    uint8_t     R;      //!< R成分.
+    uint8_t     G;      //!< G成分.
+    uint8_t     B;      //!< B成分.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadFlashParam structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadFlashParam
+{
+    uint8_t     OnTime;     //!< 点灯時間(10ms単位).
+    uint8_t     OffTime;    //!< 消灯時間(10ms単位).
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PAD_TRIGGER enum
+///////////////////////////////////////////////////////////////////////////////
+enum PAD_TRIGGER
+{
+    PAD_TRIGGER_LEFT    = 0,    //!< L2.
+    PAD_TRIGGER_RIGHT   = 1,    //!< R2.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadTriggerEffect structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadTriggerEffect
+{
+    uint8_t     Mode;           //!< エフェクトの種類(0x00 : 無効).
+    uint8_t     Params[10];     //!< エフェクトのパラメータ.
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -164,9 +301,9 @@ struct PadColor
 ///////////////////////////////////////////////////////////////////////////////
 struct PadTouch
 {
-    uint16_t    X;      //!< XW.
-    uint16_t    Y;      //!< YW.
-    uint8_t     Id;     //!< ʔԍ.
+    uint16_t    X;      //!< X座標.
+    uint16_t    Y;      //!< Y座標.
+    uint8_t     Id;     //!< 識別番号.
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -174,8 +311,8 @@ struct PadTouch
 ///////////////////////////////////////////////////////////////////////////////
 struct PadTouchData
 {
-    uint8_t     Count;                      //!< ^b`.
-    PadTouch    Touch[kPadMaxTouchCount];   //!< ^b`f[^.
+    uint8_t     Count;                      //!< タッチ数.
+    PadTouch    Touch[kPadMaxTouchCount];   //!< タッチデータ.
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -183,17 +320,18 @@ struct PadTouchData
 ///////////////////////////////////////////////////////////////////////////////
 struct PadState
 {
-    PAD_CONNECTION_TYPE     Type;               //!< ڑ^Cv.
-    PadAnalogStick          StickL;             //!< XeBbN.
-    PadAnalogStick          StickR;             //!< EXeBbN.
-    uint16_t                Buttons;            //!< {^(4bitDPad).
-    uint8_t                 SpecialButtons;     //!< {^.
-    PadAnalogButtons        AnalogButtons;      //!< AiO{^.
-    uint16_t                TimeStamp;          //!< ^CX^v.
-    uint8_t                 BatteryLevel;       //!< obe[x.
-    PadAngularVelocity      Gyro;               //!< px(␳).
-    PadAccelaration         Accel;              //!< x(␳).
-    PadTouchData            TouchData;          //!< ^b`pbhf[^.
+    PAD_CONNECTION_TYPE     Type;               //!< 接続タイプ.
+    PadAnalogStick          StickL;             //!< 左スティック.
+    PadAnalogStick          StickR;             //!< 右スティック.
+    uint16_t                Buttons;            //!< ボタン(下位4bitがDPad).
+    uint8_t                 SpecialButtons;     //!< 特殊ボタン.
+    PadAnalogButtons        AnalogButtons;      //!< アナログボタン.
+    uint16_t                TimeStamp;          //!< タイムスタンプ.
+    uint8_t                 BatteryLevel;       //!< バッテリーレベル.
+    PadAngularVelocity      Gyro;               //!< 角速度(補正無し, PadCalibrate() で物理単位に変換).
+    PadAccelaration         Accel;              //!< 加速度(補正無し, PadCalibrate() で物理単位に変換).
+    PadTouchData            TouchData;          //!< タッチパッドデータ.
+    PadQuaternion           Orientation;        //!< 姿勢(PadEnableFusion() で有効にした場合のみ更新).
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -202,121 +340,1346 @@ struct PadState
 struct PadRawInput
 {
     uint32_t    Type;
-    uint8_t     Bytes[64];
+    uint8_t     Bytes[kPadMaxReportSize];   //!< 入力レポート. USB : 64バイト, Bluetooth : 78バイト(CRC32検証済み).
+    uint64_t    HostTime;                   //!< 受信時刻(PadGetHostTime() と同じ時間軸, マイクロ秒).
+    uint64_t    DeviceTime;                 //!< デバイスのタイムスタンプを64bitに拡張した時刻(マイクロ秒, 接続時を0とする).
+    uint64_t    CaptureTime;                //!< DeviceTime をホストの時間軸に変換した入力時刻の推定値(マイクロ秒).
+    PadQuaternion Orientation;              //!< このレポートまでの角速度と加速度から推定した姿勢(無効時は単位クォータニオン).
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadClockEstimate structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  デバイス時刻からホスト時刻への変換パラメータです.
+//!
+//! @note   ホスト時刻 = HostTime + (デバイス時刻 - DeviceTime) * Rate で変換します.
+struct PadClockEstimate
+{
+    uint64_t    DeviceTime;     //!< 基準点のデバイス時刻(マイクロ秒).
+    uint64_t    HostTime;       //!< 基準点のホスト時刻の推定値(マイクロ秒).
+    double      Rate;           //!< デバイス時刻1マイクロ秒あたりのホスト時刻の進み.
+    uint64_t    Samples;        //!< 推定に使用したレポート数.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadIoStats structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadIoStats
+{
+    uint64_t    ReadCalls;      //!< 読み取りシステムコール回数(read / ReadFile).
+    uint64_t    WaitCalls;      //!< 待機システムコール回数(epoll_wait / GetOverlappedResultEx).
+    uint64_t    Reports;        //!< 受信したレポート数.
+    uint64_t    CrcErrors;      //!< CRC32が一致せず破棄したレポート数(Bluetooth).
+    uint64_t    WriteCalls;     //!< 出力レポートの書き込み回数(write / WriteFile).
+    uint64_t    WriteErrors;    //!< 書き込みに失敗した回数.
+    uint64_t    Coalesced;      //!< 未送信のレポートにまとめられた設定変更の数.
+    uint64_t    WriteLatencySum;    //!< 設定変更から書き込み完了までの時間の合計(マイクロ秒).
+    uint64_t    WriteLatencyMax;    //!< 設定変更から書き込み完了までの時間の最大値(マイクロ秒).
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadHistogram structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  マイクロ秒単位の時間のヒストグラムです.
+//!
+//! @note   Buckets[0] は1マイクロ秒未満, Buckets[i] は 2^(i-1) 以上 2^i 未満です.
+//!         最後のバケットは上限がありません.
+struct PadHistogram
+{
+    uint64_t    Count;                          //!< 記録数.
+    uint64_t    Sum;                            //!< 合計(マイクロ秒).
+    uint64_t    Max;                            //!< 最大値(マイクロ秒).
+    uint64_t    Buckets[kPadHistogramBuckets];  //!< バケットごとの記録数.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadInputStats structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadInputStats
+{
+    uint64_t        Reports;        //!< フレームカウンターを確認したレポート数.
+    uint64_t        Lost;           //!< フレームカウンターの欠番から検出した未受信のレポート数.
+    uint64_t        Repeated;       //!< フレームカウンターが進まなかったレポート数.
+    uint64_t        Overflow;       //!< 読み取りスレッドのリングバッファ溢れで破棄したレポート数.
+    PadHistogram    Interval;       //!< レポートの受信間隔.
+    PadHistogram    Latency;        //!< 受信から PadRead() などで取り出されるまでの時間.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadStateStream structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  PadMapBatch() の出力先です(フィールドごとの配列).
+//!
+//! @note   各配列には変換するレポート数以上の要素を確保してください.
+//!         nullptrの配列は出力を省略します.
+struct PadStateStream
+{
+    uint8_t*    Valid;                          //!< マッピングに成功した場合は1, 失敗した場合は0.
+    uint8_t*    StickLX;                        //!< 左スティックX成分.
+    uint8_t*    StickLY;                        //!< 左スティックY成分.
+    uint8_t*    StickRX;                        //!< 右スティックX成分.
+    uint8_t*    StickRY;                        //!< 右スティックY成分.
+    uint8_t*    L2;                             //!< L2トリガー.
+    uint8_t*    R2;                             //!< R2トリガー.
+    uint16_t*   Buttons;                        //!< ボタン(下位4bitがDPad).
+    uint8_t*    SpecialButtons;                 //!< 特殊ボタン.
+    uint16_t*   TimeStamp;                      //!< タイムスタンプ.
+    uint8_t*    BatteryLevel;                   //!< バッテリーレベル(DualSenseは常に0).
+    int16_t*    GyroX;                          //!< 角速度X成分(補正無し).
+    int16_t*    GyroY;                          //!< 角速度Y成分(補正無し).
+    int16_t*    GyroZ;                          //!< 角速度Z成分(補正無し).
+    int16_t*    AccelX;                         //!< 加速度X成分(補正無し).
+    int16_t*    AccelY;                         //!< 加速度Y成分(補正無し).
+    int16_t*    AccelZ;                         //!< 加速度Z成分(補正無し).
+    uint8_t*    TouchCount;                     //!< タッチ数.
+    uint8_t*    TouchId[kPadMaxTouchCount];     //!< タッチの識別番号.
+    uint16_t*   TouchX[kPadMaxTouchCount];      //!< タッチのX座標.
+    uint16_t*   TouchY[kPadMaxTouchCount];      //!< タッチのY座標.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadChanges structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadChanges
+{
+    uint32_t    Fields;         //!< 値が変化したフィールド(PAD_FIELD の組み合わせ).
+    uint32_t    Buttons;        //!< 押されているボタン(PAD_EDGE_BUTTON, PAD_BUTTON_OFFSET の組み合わせ).
+    uint32_t    Pressed;        //!< 今回押されたボタン.
+    uint32_t    Released;       //!< 今回離されたボタン.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadCalibration structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  IMUの補正係数です.
+//!
+//! @note   補正値 = (生データ - Bias) * Scale / 65536 で求めます.
+//!         補正値の単位は角速度が 1/16 deg/s, 加速度が 1/8192 G です.
+struct PadCalibration
+{
+    int32_t     GyroBias[3];    //!< 角速度のオフセット(X, Y, Z).
+    int32_t     GyroScale[3];   //!< 角速度の倍率(16bit固定小数).
+    int32_t     AccelBias[3];   //!< 加速度のオフセット(X, Y, Z).
+    int32_t     AccelScale[3];  //!< 加速度の倍率(16bit固定小数).
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadMotion structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadMotion
+{
+    float       GyroX;          //!< 角速度X成分(deg/s).
+    float       GyroY;          //!< 角速度Y成分(deg/s).
+    float       GyroZ;          //!< 角速度Z成分(deg/s).
+    float       AccelX;         //!< 加速度X成分(G).
+    float       AccelY;         //!< 加速度Y成分(G).
+    float       AccelZ;         //!< 加速度Z成分(G).
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadMotionStream structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  PadFuseBatch() で処理する1つの記録です.
+struct PadMotionStream
+{
+    const PadMotion*    pMotions;       //!< 補正済みの角速度と加速度(Count 個).
+    const float*        pDeltaTimes;    //!< 前のサンプルからの経過時間(秒, Count 個).
+    PadQuaternion*      pOrientations;  //!< 各サンプルを処理した後の姿勢の格納先(Count 個, nullptrの場合は省略).
+    uint32_t            Count;          //!< サンプル数.
+    PadQuaternion       Orientation;    //!< 初期姿勢(全て0の場合は最初の加速度から求める). 処理後は最後の姿勢に更新されます.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadStickProfile structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  スティックの入力の整形方法です.
+//!
+//! @note   値はスティックの中心から端までを1.0とする半径で指定します(斜め方向の端は約1.41).
+//!         出力の大きさ = AntiDeadzone + (1 - AntiDeadzone) * t ^ Exponent,
+//!         t = (入力の大きさ - InnerDeadzone) / (OuterDeadzone - InnerDeadzone) で求め,
+//!         入力の大きさが InnerDeadzone 以下の場合は0とします. 方向は入力と同じです.
+struct PadStickProfile
+{
+    float       InnerDeadzone;  //!< 内側のデッドゾーン(0.0以上).
+    float       OuterDeadzone;  //!< 外側のデッドゾーン(InnerDeadzone より大きく1.5以下). これ以上の入力は最大値になります.
+    float       AntiDeadzone;   //!< デッドゾーンを抜けた直後の出力の大きさ(0.0以上1.0未満).
+    float       Exponent;       //!< 応答曲線の指数(1.0で線形, 大きいほど中心付近が緩やか).
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadStickVector structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadStickVector
+{
+    int16_t     X;      //!< 右が正(-32767 - 32767).
+    int16_t     Y;      //!< 下が正(-32767 - 32767).
 };
 
 //-----------------------------------------------------------------------------
-//! @brief      pbhڑ܂.
+//! @brief      パッドを接続します.
 //!
-//! @param[in]      userId      [U[ID.
-//! @param[out]     pHandle     nh̊i[ł.
-//! @retval true    ڑɐ.
-//! @retval false   ڑɎs.
+//! @param[in]      userId      ユーザーID.
+//! @param[out]     pHandle     ハンドルの格納先です.
+//! @retval true    接続に成功.
+//! @retval false   接続に失敗.
 //-----------------------------------------------------------------------------
 bool PadOpen(PadHandle** ppHandle);
 
 //-----------------------------------------------------------------------------
-//! @brief      pbhؒf܂.
+//! @brief      デバイスパスを指定してパッドを接続します.
 //!
-//! @param[in]      pHandle      pbhnh.
-//! @retval true    ؒfɐ.
-//! @retval false   ؒfɎs.
+//! @param[in]      devicePath  デバイスパス(Linuxの場合は /dev/hidrawN).
+//! @param[in]      type        接続タイプ. PAD_CONNECTION_NONE の場合はデバイスから判定します.
+//! @param[out]     ppHandle    ハンドルの格納先です.
+//! @retval true    接続に成功.
+//! @retval false   接続に失敗.
+//-----------------------------------------------------------------------------
+bool PadOpen(const char* devicePath, uint32_t type, PadHandle** ppHandle);
+
+//-----------------------------------------------------------------------------
+//! @brief      キャプチャファイルを再生するパッドハンドルを開きます.
+//!
+//! @param[in]      path        キャプチャファイルのパス(PadStartCapture() で記録したもの).
+//! @param[in]      speed       再生速度. 1.0で記録時と同じ間隔, 2.0で2倍速, 0.0で待たずに全て返します.
+//! @param[out]     ppHandle    ハンドルの格納先です.
+//! @retval true    オープンに成功.
+//! @retval false   オープンに失敗.
+//! @note   ファイルはメモリマップされ, PadRead(), PadReadBatch(), PadGetState() などはシステムコール無しで
+//!         レコードを直接読み取ります. PadRawInput::HostTime は再生速度に依らず記録時の受信間隔を保ちます.
+//!         最後まで再生すると PadIsConnected() がfalseを返します.
+//!         出力, 読み取りスレッド, PadManager には対応していません.
+//-----------------------------------------------------------------------------
+bool PadOpenReplay(const char* path, float speed, PadHandle** ppHandle);
+
+//-----------------------------------------------------------------------------
+//! @brief      パッドを切断します.
+//!
+//! @param[in]      pHandle      パッドハンドル.
+//! @retval true    切断に成功.
+//! @retval false   切断に失敗.
 //-----------------------------------------------------------------------------
 bool PadClose(PadHandle*& pHandle);
 
 //-----------------------------------------------------------------------------
-//! @brief      pbhf[^ǂݎ܂.
+//! @brief      パッド生データを読み取ります.
 //!
-//! @param[in]      pHandle     pbhnh.
-//! @param[out]     pResult     pbhf[^̊i[.
-//! @retval true    ǂݎɐ.
-//! @retval false   ǂݎɎs.
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[out]     pResult     パッド生データの格納先.
+//! @retval true    読み取りに成功.
+//! @retval false   読み取りに失敗.
 //-----------------------------------------------------------------------------
 bool PadRead(PadHandle* handle, PadRawInput& result);
 
 //-----------------------------------------------------------------------------
-//! @brief      pbhf[^₷`Ƀ}bsO܂.
+//! @brief      読み取りタイムアウトを設定します.
 //!
-//! @param[in]      pRawData        pbhf[^.
-//! @param[out]     state           pbhf[^.
-//! @retval true    }bsOɐ.
-//! @retval false   }bsOɎs.
+//! @param[in]      pHandle         パッドハンドル.
+//! @param[in]      milliseconds    タイムアウト時間(ミリ秒). 0の場合は待機せず, 負値の場合は無制限に待機します.
+//! @retval true    設定に成功.
+//! @retval false   設定に失敗.
+//! @note   ゲームループから呼び出す場合は0を設定すると, PadRead()内で停止しなくなります.
+//-----------------------------------------------------------------------------
+bool PadSetReadTimeout(PadHandle* pHandle, int32_t milliseconds);
+
+//-----------------------------------------------------------------------------
+//! @brief      読み取りスレッドの有効/無効を切り替えます.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[in]      enable      trueで読み取りスレッドを開始, falseで停止します.
+//! @retval true    切り替えに成功.
+//! @retval false   切り替えに失敗.
+//! @note   有効時はハンドル専用のスレッドが受信したレポートをリングバッファに蓄積し,
+//!         PadRead()はロックやシステムコールを伴わずにそこから1件ずつ取り出します.
+//!         バッファが空の場合, PadRead()は待機せずにfalseを返します.
+//-----------------------------------------------------------------------------
+bool PadEnableReaderThread(PadHandle* pHandle, bool enable);
+
+//-----------------------------------------------------------------------------
+//! @brief      溜まっているパッド生データをまとめて読み取ります.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[out]     pResults    パッド生データの格納先配列.
+//! @param[in]      count       格納先配列の要素数.
+//! @return     読み取ったレポート数を返却します.
+//! @note   1件も溜まっていない場合のみ PadSetReadTimeout() の設定に従って待機します.
+//!         Windows版では1回のReadFile()で複数レポートを取り出し, 読み取りスレッド有効時は
+//!         システムコールを発行しません.
+//-----------------------------------------------------------------------------
+uint32_t PadReadBatch(PadHandle* pHandle, PadRawInput* pResults, uint32_t count);
+
+//-----------------------------------------------------------------------------
+//! @brief      入出力統計を取得します.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[out]     stats       入出力統計の格納先.
+//! @retval true    取得に成功.
+//! @retval false   取得に失敗.
+//-----------------------------------------------------------------------------
+bool PadGetIoStats(PadHandle* pHandle, PadIoStats& stats);
+
+//-----------------------------------------------------------------------------
+//! @brief      入力の欠落と遅延の統計を取得します.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[out]     stats       統計の格納先.
+//! @retval true    取得に成功.
+//! @retval false   取得に失敗.
+//! @note   値は接続時からの累計です. 他のスレッドが読み取り中でもロック無しで取得できます.
+//-----------------------------------------------------------------------------
+bool PadGetInputStats(PadHandle* pHandle, PadInputStats& stats);
+
+//-----------------------------------------------------------------------------
+//! @brief      デバイス時刻からホスト時刻への変換パラメータを取得します.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[out]     result      変換パラメータの格納先.
+//! @retval true    取得に成功.
+//! @retval false   まだタイムスタンプ付きのレポートを受信していない.
+//! @note   推定値はレポートを受信するたびに更新されます.
+//-----------------------------------------------------------------------------
+bool PadGetClockEstimate(PadHandle* pHandle, PadClockEstimate& result);
+
+//-----------------------------------------------------------------------------
+//! @brief      デバイス時刻をホスト時刻に変換します.
+//!
+//! @param[in]      clock       PadGetClockEstimate() で取得した変換パラメータ.
+//! @param[in]      deviceTime  デバイス時刻(PadRawInput::DeviceTime).
+//! @return     ホスト時刻(PadGetHostTime() と同じ時間軸, マイクロ秒)を返却します.
+//-----------------------------------------------------------------------------
+uint64_t PadConvertDeviceTime(const PadClockEstimate& clock, uint64_t deviceTime);
+
+//-----------------------------------------------------------------------------
+//! @brief      IMUの補正係数を取得します.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[out]     result      補正係数の格納先.
+//! @retval true    デバイスから読み取った補正係数を取得.
+//! @retval false   補正データが無いため, 既定の係数(オフセット無し, 等倍)を取得.
+//! @note   補正データは接続時に一度だけ読み取り, デバイスごとにキャッシュされます.
+//-----------------------------------------------------------------------------
+bool PadGetCalibration(PadHandle* pHandle, PadCalibration& result);
+
+//-----------------------------------------------------------------------------
+//! @brief      角速度と加速度を補正し, 物理単位に変換します.
+//!
+//! @param[in]      calibration PadGetCalibration() で取得した補正係数.
+//! @param[in]      state       パッドデータ.
+//! @param[out]     result      変換結果の格納先.
+//! @retval true    変換に成功.
+//! @retval false   変換に失敗.
+//-----------------------------------------------------------------------------
+bool PadCalibrate(const PadCalibration& calibration, const PadState& state, PadMotion& result);
+
+//-----------------------------------------------------------------------------
+//! @brief      姿勢推定の有効/無効を切り替えます.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[in]      enable      trueの場合は有効, falseの場合は無効.
+//! @retval true    切り替えに成功.
+//! @retval false   切り替えに失敗.
+//! @note   有効にすると受信したレポートごとに補正済みの角速度と加速度で姿勢を更新し,
+//!         PadRawInput::Orientation と PadState::Orientation に格納します.
+//!         有効にした直後のレポートの加速度から初期姿勢を求めます.
+//-----------------------------------------------------------------------------
+bool PadEnableFusion(PadHandle* pHandle, bool enable);
+
+//-----------------------------------------------------------------------------
+//! @brief      姿勢推定のゲインを設定します.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[in]      gain        加速度による補正の強さ(Madgwickフィルタのβ, rad/s). 既定値は0.1です.
+//! @retval true    設定に成功.
+//! @retval false   設定に失敗.
+//-----------------------------------------------------------------------------
+bool PadSetFusionGain(PadHandle* pHandle, float gain);
+
+//-----------------------------------------------------------------------------
+//! @brief      記録した角速度と加速度から姿勢をまとめて推定します.
+//!
+//! @param[in]      gain        加速度による補正の強さ(Madgwickフィルタのβ, rad/s).
+//! @param[in,out]  pStreams    記録の配列.
+//! @param[in]      count       記録の数.
+//! @return     処理したサンプル数を返却します.
+//! @note   複数の記録をSIMD命令で並列に処理します. 1つの記録のサンプルは順番に処理します.
+//-----------------------------------------------------------------------------
+uint32_t PadFuseBatch(float gain, PadMotionStream* pStreams, uint32_t count);
+
+//-----------------------------------------------------------------------------
+//! @brief      スティックの整形テーブルを生成します.
+//!
+//! @param[in]      profile     整形方法.
+//! @param[out]     ppTable     整形テーブルの格納先.
+//! @retval true    生成に成功.
+//! @retval false   生成に失敗.
+//! @note   全ての入力値に対する出力を事前に計算します(64KB). 複数のパッドで共有できます.
+//-----------------------------------------------------------------------------
+bool PadStickTableOpen(const PadStickProfile& profile, PadStickTable** ppTable);
+
+//-----------------------------------------------------------------------------
+//! @brief      スティックの整形テーブルを破棄します.
+//!
+//! @param[in,out]  pTable      整形テーブル.
+//! @retval true    破棄に成功.
+//! @retval false   破棄に失敗.
+//-----------------------------------------------------------------------------
+bool PadStickTableClose(PadStickTable*& pTable);
+
+//-----------------------------------------------------------------------------
+//! @brief      スティックの入力を整形します.
+//!
+//! @param[in]      pTable      整形テーブル.
+//! @param[in]      stick       スティックの入力.
+//! @param[out]     result      整形結果の格納先.
+//! @retval true    整形に成功.
+//! @retval false   整形に失敗.
+//-----------------------------------------------------------------------------
+bool PadShapeStick(const PadStickTable* pTable, const PadAnalogStick& stick, PadStickVector& result);
+
+//-----------------------------------------------------------------------------
+//! @brief      複数のスティックの入力をまとめて整形します.
+//!
+//! @param[in]      pTable      整形テーブル.
+//! @param[in]      pX          入力のX成分の配列(PadStateStream::StickLX など).
+//! @param[in]      pY          入力のY成分の配列.
+//! @param[in]      count       入力数.
+//! @param[out]     pResultX    整形結果のX成分の格納先.
+//! @param[out]     pResultY    整形結果のY成分の格納先.
+//! @return     整形した入力数を返却します.
+//-----------------------------------------------------------------------------
+uint32_t PadShapeSticks(const PadStickTable* pTable, const uint8_t* pX, const uint8_t* pY, uint32_t count, int16_t* pResultX, int16_t* pResultY);
+
+//-----------------------------------------------------------------------------
+//! @brief      パッドが接続中かどうかチェックします.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @retval true    接続中.
+//! @retval false   切断済み.
+//! @note   読み書き時にデバイスエラーを検出した時点で切断済みとなります.
+//-----------------------------------------------------------------------------
+bool PadIsConnected(PadHandle* pHandle);
+
+//-----------------------------------------------------------------------------
+//! @brief      パッド生データを扱いやすい形にマッピングします.
+//!
+//! @param[in]      pRawData        パッド生データ.
+//! @param[out]     state           パッドデータ.
+//! @retval true    マッピングに成功.
+//! @retval false   マッピングに失敗.
 //-----------------------------------------------------------------------------
 bool PadMap(const PadRawInput* pRawData, PadState& state);
 
 //-----------------------------------------------------------------------------
-//! @brief      pbhf[^擾܂.
+//! @brief      複数のパッド生データをフィールドごとの配列にまとめてマッピングします.
+//!
+//! @param[in]      pRawData        パッド生データの配列.
+//! @param[in]      count           パッド生データの数.
+//! @param[out]     stream          出力先の配列.
+//! @return     マッピングに成功したレポート数を返却します.
+//! @note       各要素は PadMap() と同じ値になります. 失敗したレポートの要素は0で埋めます.
+//!             同じ接続タイプのレポートが16個以上並んでいる区間はSIMD命令で処理します.
+//-----------------------------------------------------------------------------
+uint32_t PadMapBatch(const PadRawInput* pRawData, uint32_t count, const PadStateStream& stream);
+
+//-----------------------------------------------------------------------------
+//! @brief      PadMapBatch() などの一括処理が使用する命令セットを取得します.
+//!
+//! @return     使用する命令セットを返却します.
+//! @note       初期値はCPUが対応する最上位の命令セットです.
+//-----------------------------------------------------------------------------
+PAD_SIMD_LEVEL PadGetSimdLevel();
+
+//-----------------------------------------------------------------------------
+//! @brief      PadMapBatch() などの一括処理が使用する命令セットを設定します.
+//!
+//! @param[in]      level       使用する命令セット.
+//! @retval true    設定に成功.
+//! @retval false   CPUが対応していないため設定に失敗.
+//-----------------------------------------------------------------------------
+bool PadSetSimdLevel(PAD_SIMD_LEVEL level);
+
+//-----------------------------------------------------------------------------
+//! @brief      2つのパッド生データを比較し, 変化したフィールドとボタンを求めます.
 //!
-//! @param[in]      pHandle         pbhnh.
-//! @param[out]     state           pbhf[^̊i[.
-//! @retval true    ǂݎɐ.
-//! @retval false   ǂݎɎs.
+//! @param[in]      pPrevious       前回のパッド生データ(nullptrの場合は全フィールドが変化したとみなします).
+//! @param[in]      pCurrent        今回のパッド生データ.
+//! @param[out]     changes         比較結果.
+//! @retval true    比較に成功.
+//! @retval false   今回のパッド生データがマッピングできないため失敗.
+//! @note       前回のデータがマッピングできない場合や接続タイプが異なる場合は全フィールドが変化したとみなします.
+//-----------------------------------------------------------------------------
+bool PadDiff(const PadRawInput* pPrevious, const PadRawInput* pCurrent, PadChanges& changes);
+
+//-----------------------------------------------------------------------------
+//! @brief      パッドデータを取得します.
+//!
+//! @param[in]      pHandle         パッドハンドル.
+//! @param[out]     state           パッドデータの格納先.
+//! @retval true    読み取りに成功.
+//! @retval false   読み取りに失敗.
 //-----------------------------------------------------------------------------
 bool PadGetState(PadHandle* pHandle, PadState& state);
 
 //-----------------------------------------------------------------------------
-//! @brief      oCu[Vݒ肵܂.
+//! @brief      パッドデータを読み取り, 前回このAPIで読み取ったデータからの変化を求めます.
+//!
+//! @param[in]      pHandle         パッドハンドル.
+//! @param[out]     state           パッドデータの格納先.
+//! @param[out]     changes         変化の格納先.
+//! @retval true    読み取りに成功.
+//! @retval false   読み取りに失敗.
+//! @note       最初の呼び出しでは全フィールドが変化し, 押されているボタンは全て Pressed になります.
+//-----------------------------------------------------------------------------
+bool PadGetStateChanges(PadHandle* pHandle, PadState& state, PadChanges& changes);
+
+//-----------------------------------------------------------------------------
+//! @brief      バイブレーションを設定します.
 //!
-//! @param[in]      handle      pbhnh.
-//! @param[in]      param      oCu[Vf[^.
-//! @retval true    ݒɐ.
-//! @retval false   ݒɎs.
+//! @param[in]      handle      パッドハンドル.
+//! @param[in]      param      バイブレーションデータ.
+//! @retval true    設定に成功.
+//! @retval false   設定に失敗.
 //-----------------------------------------------------------------------------
 bool PadSetVibration(PadHandle* handle, const PadVibrationParam& param);
 
 //-----------------------------------------------------------------------------
-//! @brief      Cgo[J[ݒ肵܂.
+//! @brief      ライトバーカラーを設定します.
 //!
-//! @param[in]      handle      pbhnh.
-//! @param[in]      pParam      Cgo[J[.
-//! @retval true    ݒɐ.
-//! @retval fasle   ݒɎs.
+//! @param[in]      handle      パッドハンドル.
+//! @param[in]      pParam      ライトバーカラー.
+//! @retval true    設定に成功.
+//! @retval fasle   設定に失敗.
 //-----------------------------------------------------------------------------
 bool PadSetLightBarColor(PadHandle* handle, const PadColor& param);
 
+//-----------------------------------------------------------------------------
+//! @brief      ライトバーの点滅を設定します.
+//!
+//! @param[in]      handle      パッドハンドル.
+//! @param[in]      param       点滅データ. 点灯時間と消灯時間が0の場合は点滅しません.
+//! @retval true    設定に成功.
+//! @retval false   設定に失敗, またはDualSense.
+//-----------------------------------------------------------------------------
+bool PadSetLightBarFlash(PadHandle* handle, const PadFlashParam& param);
+
+//-----------------------------------------------------------------------------
+//! @brief      アダプティブトリガーのエフェクトを設定します.
+//!
+//! @param[in]      handle      パッドハンドル.
+//! @param[in]      trigger     対象のトリガー.
+//! @param[in]      param       エフェクトデータ.
+//! @retval true    設定に成功.
+//! @retval false   設定に失敗, またはDualShock4.
+//-----------------------------------------------------------------------------
+bool PadSetTriggerEffect(PadHandle* handle, PAD_TRIGGER trigger, const PadTriggerEffect& param);
+
+//-----------------------------------------------------------------------------
+//! @brief      出力レポートの最大送信レートを設定します.
+//!
+//! @param[in]      handle      パッドハンドル.
+//! @param[in]      maxRate     1秒あたりの最大送信回数. 0の場合は制限しません.
+//! @retval true    設定に成功.
+//! @retval false   設定に失敗.
+//! @note   既定値は0です. 制限中に変更された設定は次回の PadFlushOutput() でまとめて送信されます.
+//-----------------------------------------------------------------------------
+bool PadSetOutputRate(PadHandle* handle, uint32_t maxRate);
+
+//-----------------------------------------------------------------------------
+//! @brief      未送信の出力設定を1つのレポートにまとめて送信します.
+//!
+//! @param[in]      handle      パッドハンドル.
+//! @retval true    送信に成功, または送信不要.
+//! @retval false   送信に失敗.
+//! @note   バイブレーション, ライトバー, 点滅, トリガーの設定関数は変更された項目を記録するだけで,
+//!         最大送信レートの範囲内であればその場で送信します. 値が変化していない設定は送信しません.
+//!         最大送信レートを設定した場合は毎フレーム呼び出してください.
+//-----------------------------------------------------------------------------
+bool PadFlushOutput(PadHandle* handle);
+
+//-----------------------------------------------------------------------------
+//! @brief      出力レポートを書き込みスレッドから送信するかどうか設定します.
+//!
+//! @param[in]      handle      パッドハンドル.
+//! @param[in]      enable      trueで書き込みスレッドを開始, falseで停止します.
+//! @retval true    設定に成功.
+//! @retval false   設定に失敗.
+//! @note   有効にすると設定関数は書き込みの完了を待たずに戻ります.
+//!         送信待ちの設定は最新の状態にまとめられるため, キューは溢れません.
+//!         最大送信レートも書き込みスレッドが守るため PadFlushOutput() の呼び出しは不要です.
+//-----------------------------------------------------------------------------
+bool PadEnableAsyncOutput(PadHandle* handle, bool enable);
+
 
 
 //-----------------------------------------------------------------------------
-//! @brief      pbhf[^擾܂.
+//! @brief      パッドデータを取得します.
 //!
-//! @param[in]      pHandle         pbhnh.
-//! @param[out]     state           pbhf[^̊i[.
-//! @retval true    ǂݎɐ.
-//! @retval false   ǂݎɎs.
-//! @note   PadOpen()PadClose()ŌĂяo܂.
+//! @param[in]      pHandle         パッドハンドル.
+//! @param[out]     state           パッドデータの格納先.
+//! @retval true    読み取りに成功.
+//! @retval false   読み取りに失敗.
+//! @note   初回呼び出し時に PadOpen() で接続したハンドルを以降の呼び出しで使い回します.
+//!         切断を検出した場合は自動的に再接続します.
 //-----------------------------------------------------------------------------
 bool PadGetState(PadState& state);
 
 //-----------------------------------------------------------------------------
-//! @brief      pbhf[^ǂݎ܂.
+//! @brief      パッド生データを読み取ります.
 //!
-//! @param[in]      pHandle     pbhnh.
-//! @param[out]     pResult     pbhf[^̊i[.
-//! @retval true    ǂݎɐ.
-//! @retval false   ǂݎɎs.
-//! @note   PadOpen()PadClose()ŌĂяo܂.
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[out]     pResult     パッド生データの格納先.
+//! @retval true    読み取りに成功.
+//! @retval false   読み取りに失敗.
+//! @note   初回呼び出し時に PadOpen() で接続したハンドルを以降の呼び出しで使い回します.
+//!         切断を検出した場合は自動的に再接続します.
 //-----------------------------------------------------------------------------
 bool PadGetRawInput(PadRawInput& state);
 
 //-----------------------------------------------------------------------------
-//! @brief      oCu[Vݒ肵܂.
+//! @brief      バイブレーションを設定します.
 //!
-//! @param[in]      handle      pbhnh.
-//! @param[in]      param      oCu[Vf[^.
-//! @retval true    ݒɐ.
-//! @retval false   ݒɎs.
-//! @note   PadOpen()PadClose()ŌĂяo܂.
+//! @param[in]      handle      パッドハンドル.
+//! @param[in]      param      バイブレーションデータ.
+//! @retval true    設定に成功.
+//! @retval false   設定に失敗.
+//! @note   初回呼び出し時に PadOpen() で接続したハンドルを以降の呼び出しで使い回します.
+//!         切断を検出した場合は自動的に再接続します.
 //-----------------------------------------------------------------------------
 bool PadSetVibration(const PadVibrationParam& param);
 
 //-----------------------------------------------------------------------------
-//! @brief      Cgo[J[ݒ肵܂.
+//! @brief      ライトバーカラーを設定します.
 //!
-//! @param[in]      handle      pbhnh.
-//! @param[in]      pParam      Cgo[J[.
-//! @retval true    ݒɐ.
-//! @retval fasle   ݒɎs.
-//! @note   PadOpen()PadClose()ŌĂяo܂.
+//! @param[in]      handle      パッドハンドル.
+//! @param[in]      pParam      ライトバーカラー.
+//! @retval true    設定に成功.
+//! @retval fasle   設定に失敗.
+//! @note   初回呼び出し時に PadOpen() で接続したハンドルを以降の呼び出しで使い回します.
+//!         切断を検出した場合は自動的に再接続します.
 //-----------------------------------------------------------------------------
 bool PadSetLightBarColor(const PadColor& param);
 
+
+
+//-----------------------------------------------------------------------------
+//! @brief      パッドマネージャーを生成し, 接続されている全てのパッドを開きます.
+//!
+//! @param[out]     ppManager   パッドマネージャーの格納先です.
+//! @retval true    生成に成功.
+//! @retval false   生成に失敗.
+//! @note   全パッドの読み取りは1つの入出力スレッドでまとめて待機します.
+//!         パッドが1つも接続されていない場合も生成に成功します.
+//-----------------------------------------------------------------------------
+bool PadManagerOpen(PadManager** ppManager);
+
+//-----------------------------------------------------------------------------
+//! @brief      パッドマネージャーを破棄します.
+//!
+//! @param[in]      pManager    パッドマネージャー.
+//! @retval true    破棄に成功.
+//! @retval false   破棄に失敗.
+//! @note   管理している全てのパッドハンドルも切断されます.
+//-----------------------------------------------------------------------------
+bool PadManagerClose(PadManager*& pManager);
+
+//-----------------------------------------------------------------------------
+//! @brief      パッドマネージャーにパッドを追加します.
+//!
+//! @param[in]      pManager    パッドマネージャー.
+//! @param[in]      pHandle     追加するパッドハンドル. 所有権はマネージャーに移ります.
+//! @return     割り当てられたスロット番号を返却します. 失敗した場合は-1を返却します.
+//! @note   追加したハンドルに対して PadRead() を呼び出さないでください.
+//-----------------------------------------------------------------------------
+int32_t PadManagerAdd(PadManager* pManager, PadHandle* pHandle);
+
+//-----------------------------------------------------------------------------
+//! @brief      管理しているパッド数を取得します.
+//!
+//! @param[in]      pManager    パッドマネージャー.
+//! @return     スロット数を返却します.
+//-----------------------------------------------------------------------------
+uint32_t PadManagerGetCount(PadManager* pManager);
+
+//-----------------------------------------------------------------------------
+//! @brief      スロット番号に対応するパッドハンドルを取得します.
+//!
+//! @param[in]      pManager    パッドマネージャー.
+//! @param[in]      slot        スロット番号.
+//! @return     パッドハンドルを返却します. 存在しない場合はnullptrを返却します.
+//! @note   バイブレーションやライトバーカラーの設定に使用します.
+//-----------------------------------------------------------------------------
+PadHandle* PadManagerGetHandle(PadManager* pManager, uint32_t slot);
+
+//-----------------------------------------------------------------------------
+//! @brief      スロット番号に対応するパッドが接続中かどうかチェックします.
+//!
+//! @param[in]      pManager    パッドマネージャー.
+//! @param[in]      slot        スロット番号.
+//! @retval true    接続中.
+//! @retval false   切断済み, または存在しないスロット.
+//-----------------------------------------------------------------------------
+bool PadManagerIsConnected(PadManager* pManager, uint32_t slot);
+
+//-----------------------------------------------------------------------------
+//! @brief      スロット番号に対応するパッドの最新の生データを取得します.
+//!
+//! @param[in]      pManager    パッドマネージャー.
+//! @param[in]      slot        スロット番号.
+//! @param[out]     result      パッド生データの格納先.
+//! @retval true    取得に成功.
+//! @retval false   まだ受信していない, または存在しないスロット.
+//-----------------------------------------------------------------------------
+bool PadManagerGetRawInput(PadManager* pManager, uint32_t slot, PadRawInput& result);
+
+//-----------------------------------------------------------------------------
+//! @brief      スロット番号に対応するパッドの最新のパッドデータを取得します.
+//!
+//! @param[in]      pManager    パッドマネージャー.
+//! @param[in]      slot        スロット番号.
+//! @param[out]     state       パッドデータの格納先.
+//! @retval true    取得に成功.
+//! @retval false   まだ受信していない, または存在しないスロット.
+//-----------------------------------------------------------------------------
+bool PadManagerGetState(PadManager* pManager, uint32_t slot, PadState& state);
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PadEvent structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadEvent
+{
+    uint64_t    HostTime;       //!< 受信時刻(PadGetHostTime() と同じ時間軸, マイクロ秒).
+    uint64_t    CaptureTime;    //!< 入力時刻の推定値(PadRawInput::CaptureTime).
+    uint32_t    Source;         //!< PadAttachEventQueue() で指定した識別子.
+    uint32_t    Button;         //!< ボタン(PAD_EDGE_BUTTON, PAD_BUTTON_OFFSET のいずれか1つ). ボタンイベント以外は0.
+    uint16_t    DeviceTime;     //!< デバイスのタイムスタンプ(PadState::TimeStamp).
+    uint8_t     Type;           //!< イベントの種類(PAD_EVENT_TYPE).
+    uint8_t     Index;          //!< トリガー番号(0 : L2, 1 : R2), またはタッチ番号.
+    uint16_t    X;              //!< トリガーの値, またはタッチのX座標.
+    uint16_t    Y;              //!< タッチのY座標.
+};
+
+//-----------------------------------------------------------------------------
+//! @brief      ホストの現在時刻を取得します.
+//!
+//! @return     単調増加する時刻をマイクロ秒単位で返却します.
+//! @note   PadRawInput::HostTime, PadEvent::HostTime と同じ時間軸です.
+//-----------------------------------------------------------------------------
+uint64_t PadGetHostTime();
+
+//-----------------------------------------------------------------------------
+//! @brief      入力イベントキューを生成します.
+//!
+//! @param[in]      capacity    格納できるイベント数. 2のべき乗に切り上げます.
+//! @param[out]     ppQueue     入力イベントキューの格納先です.
+//! @retval true    生成に成功.
+//! @retval false   生成に失敗.
+//! @note   複数のパッドから同時に追加でき, 取り出しは1つのスレッドから行います.
+//-----------------------------------------------------------------------------
+bool PadEventQueueOpen(uint32_t capacity, PadEventQueue** ppQueue);
+
+//-----------------------------------------------------------------------------
+//! @brief      入力イベントキューを破棄します.
+//!
+//! @param[in]      pQueue      入力イベントキュー.
+//! @retval true    破棄に成功.
+//! @retval false   破棄に失敗.
+//! @note   破棄する前に全てのパッドハンドルから切り離してください.
+//-----------------------------------------------------------------------------
+bool PadEventQueueClose(PadEventQueue*& pQueue);
+
+//-----------------------------------------------------------------------------
+//! @brief      パッドハンドルに入力イベントキューを接続します.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[in]      pQueue      入力イベントキュー. nullptrを指定すると切り離します.
+//! @param[in]      source      イベントに設定する識別子(PadEvent::Source).
+//! @retval true    接続に成功.
+//! @retval false   接続に失敗.
+//! @note   イベントはレポートを受信したスレッド(読み取りスレッド, マネージャーの入出力スレッド,
+//!         または PadRead() の呼び出し元)で生成されます.
+//-----------------------------------------------------------------------------
+bool PadAttachEventQueue(PadHandle* pHandle, PadEventQueue* pQueue, uint32_t source);
+
+//-----------------------------------------------------------------------------
+//! @brief      入力イベントをまとめて取り出します.
+//!
+//! @param[in]      pQueue      入力イベントキュー.
+//! @param[out]     pEvents     イベントの格納先.
+//! @param[in]      count       格納先の要素数.
+//! @return     取り出したイベント数を返却します.
+//! @note   同時に呼び出せるのは1つのスレッドのみです.
+//-----------------------------------------------------------------------------
+uint32_t PadEventQueuePop(PadEventQueue* pQueue, PadEvent* pEvents, uint32_t count);
+
+//-----------------------------------------------------------------------------
+//! @brief      キューが満杯のため破棄したイベント数を取得します.
+//!
+//! @param[in]      pQueue      入力イベントキュー.
+//! @return     破棄したイベント数を返却します.
+//-----------------------------------------------------------------------------
+uint64_t PadEventQueueGetDropCount(PadEventQueue* pQueue);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PadGestureParam structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  ジェスチャー認識の閾値です.
+//!
+//! @note   距離はタッチパッドの座標(DualShock4 : 1920 x 942, DualSense : 1920 x 1080)で指定します.
+struct PadGestureParam
+{
+    uint32_t    TapTime;            //!< タップとみなす最大の接触時間(マイクロ秒).
+    float       TapSlop;            //!< タップとみなす最大の移動量.
+    float       SwipeDistance;      //!< スワイプとみなす最小の移動量.
+    float       SwipeVelocity;      //!< スワイプとみなす離した時の最小の速度(座標/秒).
+    float       PinchDistance;      //!< ピンチとみなす2点間の距離の最小の変化量.
+    float       ScrollDistance;     //!< スクロールとみなす2点の中心の最小の移動量.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadGesture structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadGesture
+{
+    uint64_t    DeviceTime;     //!< 認識したレポートのデバイス時刻(PadRawInput::DeviceTime).
+    uint8_t     Type;           //!< ジェスチャーの種類(PAD_GESTURE_TYPE).
+    uint8_t     Fingers;        //!< 指の本数.
+    float       X;              //!< 位置(タップ : 最初に触れた位置, スワイプ : 離した位置, ピンチ・スクロール : 2点の中心).
+    float       Y;
+    float       DeltaX;         //!< 移動量(スワイプ : 触れてから離すまで, スクロール : 前回の通知から).
+    float       DeltaY;
+    float       VelocityX;      //!< 速度(座標/秒, スワイプ : 離した時, スクロール : 前回の通知から).
+    float       VelocityY;
+    float       Scale;          //!< ピンチ : 前回の通知からの2点間の距離の比. その他は1.
+    float       SpreadVelocity; //!< ピンチ : 2点間の距離の変化速度(座標/秒). その他は0.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadGestureFinger structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadGestureFinger
+{
+    uint8_t     Active;         //!< 触れているかどうか.
+    uint8_t     Id;             //!< タッチの識別番号.
+    float       X;              //!< 現在の位置.
+    float       Y;
+    float       StartX;         //!< 触れた位置.
+    float       StartY;
+    float       RefX;           //!< 速度を求める基準の位置.
+    float       RefY;
+    float       VelocityX;      //!< 速度(座標/秒).
+    float       VelocityY;
+    uint64_t    RefTime;        //!< 速度を求める基準の時刻.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadGestureState structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  ジェスチャー認識の状態です.
+//!
+//! @note   ヒープを使用しない固定サイズの構造体です. PadGestureInit() で初期化し, メンバは変更しないでください.
+struct PadGestureState
+{
+    PadGestureParam     Param;                          //!< 閾値.
+    PadGestureFinger    Fingers[kPadMaxTouchCount];     //!< タッチごとの状態.
+    uint64_t            StartTime;                      //!< 最初の指が触れた時刻.
+    uint64_t            EventTime;                      //!< 前回ピンチ・スクロールを通知した時刻.
+    float               OriginX;                        //!< 最初の指が触れた位置.
+    float               OriginY;
+    float               StartDistance;                  //!< 2本目の指が触れた時の2点間の距離.
+    float               StartCenterX;                   //!< 2本目の指が触れた時の2点の中心.
+    float               StartCenterY;
+    float               LastDistance;                   //!< 前回通知した2点間の距離.
+    float               LastCenterX;                    //!< 前回通知した2点の中心.
+    float               LastCenterY;
+    uint8_t             Phase;                          //!< 認識の段階.
+    uint8_t             MaxFingers;                     //!< 最初の指が触れてから同時に触れた指の最大数.
+    uint8_t             TwoFingers;                     //!< 前回のレポートで2本の指が触れていたかどうか.
+    uint8_t             LastFinger;                     //!< 最後に離れた指.
+};
+
+//-----------------------------------------------------------------------------
+//! @brief      ジェスチャー認識の状態を初期化します.
+//!
+//! @param[out]     state       初期化する状態.
+//! @param[in]      pParam      閾値(nullptrの場合は既定値).
+//! @retval true    初期化に成功.
+//! @retval false   初期化に失敗.
+//-----------------------------------------------------------------------------
+bool PadGestureInit(PadGestureState& state, const PadGestureParam* pParam);
+
+//-----------------------------------------------------------------------------
+//! @brief      パッド生データのタッチ情報からジェスチャーを認識します.
+//!
+//! @param[in,out]  state       認識の状態.
+//! @param[in]      pRawData    パッド生データ(受信順に1つずつ渡してください).
+//! @param[out]     pGestures   認識したジェスチャーの格納先(kPadMaxGestureCount 個あれば不足しません).
+//! @param[in]      count       格納先の要素数.
+//! @return     格納したジェスチャーの数を返却します.
+//! @note   時間はデバイス時刻(PadRawInput::DeviceTime)で計測します.
+//-----------------------------------------------------------------------------
+uint32_t PadGestureUpdate(PadGestureState& state, const PadRawInput* pRawData, PadGesture* pGestures, uint32_t count);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PadCaptureHeader structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  キャプチャファイルのヘッダです.
+//!
+//! @note   キャプチャファイルは追記のみで書き込まれ, 次の構成になります(リトルエンディアン).
+//!         - PadCaptureHeader.
+//!         - チャンクの繰り返し. チャンクは RecordStride バイトのレコードを最大 ChunkSize 個並べ, 末尾に PadCaptureIndex を置きます.
+//!         レコードは受信時刻(uint64_t, PadRawInput::HostTime)とレポート(ReportSize バイト)で, 8バイト境界に揃えます.
+//!         最後以外のチャンクは全て ChunkSize 個のレコードを持つので, 索引の位置はファイル先頭から計算できます.
+//!         最後のチャンクに索引が無い場合(記録中の異常終了など)は, ファイルサイズからレコード数を求めてください.
+struct PadCaptureHeader
+{
+    uint32_t        Magic;              //!< 識別子(kPadCaptureMagic).
+    uint16_t        Version;            //!< バージョン(kPadCaptureVersion).
+    uint16_t        HeaderSize;         //!< ヘッダのサイズ(バイト).
+    uint32_t        Type;               //!< 接続タイプ(PadRawInput::Type).
+    uint16_t        ReportSize;         //!< レコード内のレポートのサイズ(バイト).
+    uint16_t        RecordStride;       //!< レコードのサイズ(バイト).
+    uint32_t        ChunkSize;          //!< チャンクあたりのレコード数.
+    uint32_t        Calibrated;         //!< デバイスから補正データを取得できた場合は1.
+    uint64_t        StartTime;          //!< 記録を開始したホスト時刻(マイクロ秒).
+    PadCalibration  Calibration;        //!< IMUの補正係数(PadGetCalibration() と同じ値).
+    char            MacAddress[24];     //!< MACアドレス(取得できない場合は空文字列).
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadCaptureIndex structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadCaptureIndex
+{
+    uint32_t    Magic;          //!< 識別子(kPadCaptureIndexMagic).
+    uint32_t    Count;          //!< チャンク内のレコード数.
+    uint64_t    FirstRecord;    //!< チャンク先頭のレコードの通し番号(欠落したチャンクがあると飛びます).
+    uint64_t    FirstTime;      //!< チャンク先頭のレコードの受信時刻(マイクロ秒).
+    uint64_t    LastTime;       //!< チャンク末尾のレコードの受信時刻(マイクロ秒).
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadCaptureStats structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadCaptureStats
+{
+    uint64_t    Records;        //!< ファイルに書き込んだレコード数.
+    uint64_t    Dropped;        //!< 書き込みが追いつかず破棄したレコード数.
+    uint64_t    Chunks;         //!< ファイルに書き込んだチャンク数.
+    uint64_t    WriteCalls;     //!< ファイルへの書き込み回数.
+    uint64_t    WriteErrors;    //!< ファイルへの書き込みに失敗した回数.
+};
+
+//-----------------------------------------------------------------------------
+//! @brief      受信したレポートのファイルへの記録を開始します.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[in]      path        記録先のファイルパス(既存のファイルは上書きします).
+//! @retval true    開始に成功.
+//! @retval false   開始に失敗.
+//! @note   受信スレッドはチャンク単位のバッファに追記するだけで, ファイルへの書き込みは専用のスレッドが
+//!         チャンクごとに1回行います. 記録中のファイルを変更する場合は先に PadStopCapture() を呼んでください.
+//-----------------------------------------------------------------------------
+bool PadStartCapture(PadHandle* pHandle, const char* path);
+
+//-----------------------------------------------------------------------------
+//! @brief      ファイルへの記録を終了します.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @retval true    終了に成功.
+//! @retval false   終了に失敗(記録中でない場合を含む).
+//! @note   書き込み待ちのチャンクを全て書き込んでから戻ります. PadClose() でも終了します.
+//-----------------------------------------------------------------------------
+bool PadStopCapture(PadHandle* pHandle);
+
+//-----------------------------------------------------------------------------
+//! @brief      ファイルへの記録の統計を取得します.
+//!
+//! @param[in]      pHandle     パッドハンドル.
+//! @param[out]     stats       統計の格納先.
+//! @retval true    取得に成功.
+//! @retval false   取得に失敗.
+//! @note   値は最後に開始した記録の累計です. 記録の終了後も取得できます.
+//-----------------------------------------------------------------------------
+bool PadGetCaptureStats(PadHandle* pHandle, PadCaptureStats& stats);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PadDeltaEncoder structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  レポート列の差分符号化の状態です.
+//!
+//! @note   各レポートは1つ前のレポートとのXORを取り, 変化したバイトのみをビットマップとともに記録します.
+//!         KeyframeInterval 個ごとにレポート全体を記録するキーフレームを置きます.
+//!         ヒープを使用しない固定サイズの構造体です. PadDeltaEncoderInit() で初期化し, メンバは変更しないでください.
+struct PadDeltaEncoder
+{
+    uint64_t    Previous[kPadDeltaGroupCount];  //!< 前回のレポート.
+    uint64_t    PreviousTime;                   //!< 前回の受信時刻.
+    uint32_t    PreviousType;                   //!< 前回の接続タイプ.
+    uint32_t    ReportSize;                     //!< レポートのサイズ(バイト).
+    uint32_t    KeyframeInterval;               //!< キーフレームの間隔(レポート数).
+    uint32_t    Count;                          //!< 前回のキーフレームからのレポート数.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadDeltaDecoder structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  差分符号化したレポート列の復号の状態です.
+//!
+//! @note   ヒープを使用しない固定サイズの構造体です. PadDeltaDecoderInit() で初期化し, メンバは変更しないでください.
+struct PadDeltaDecoder
+{
+    uint64_t    Previous[kPadDeltaGroupCount];  //!< 前回のレポート.
+    uint64_t    PreviousTime;                   //!< 前回の受信時刻.
+    uint32_t    PreviousType;                   //!< 前回の接続タイプ.
+    uint32_t    ReportSize;                     //!< レポートのサイズ(0の場合はキーフレーム待ち).
+    uint32_t    Error;                          //!< 不正なデータを検出した場合は1.
+};
+
+//-----------------------------------------------------------------------------
+//! @brief      差分符号化の状態を初期化します.
+//!
+//! @param[out]     encoder             初期化する状態.
+//! @param[in]      reportSize          レポートのサイズ(1 - kPadMaxReportSize, USB : 64, Bluetooth : 78).
+//! @param[in]      keyframeInterval    キーフレームの間隔(レポート数, 1以上).
+//! @retval true    初期化に成功.
+//! @retval false   初期化に失敗.
+//-----------------------------------------------------------------------------
+bool PadDeltaEncoderInit(PadDeltaEncoder& encoder, uint32_t reportSize, uint32_t keyframeInterval);
+
+//-----------------------------------------------------------------------------
+//! @brief      パッド生データを1つ差分符号化します.
+//!
+//! @param[in,out]  encoder     符号化の状態.
+//! @param[in]      input       パッド生データ(Type, HostTime, Bytes を記録します).
+//! @param[out]     pOutput     符号化結果の格納先.
+//! @param[in]      capacity    格納先のサイズ(kPadDeltaMaxRecordSize 以上).
+//! @return     書き込んだバイト数を返却します. 失敗した場合は0を返却します.
+//! @note   受信時刻が戻った場合と接続タイプが変わった場合もキーフレームになります.
+//!         符号化結果の先頭バイトの最下位ビットが1の場合はキーフレームで, そこから復号を開始できます.
+//-----------------------------------------------------------------------------
+uint32_t PadDeltaEncode(PadDeltaEncoder& encoder, const PadRawInput& input, uint8_t* pOutput, uint32_t capacity);
+
+//-----------------------------------------------------------------------------
+//! @brief      差分符号化の復号の状態を初期化します.
+//!
+//! @param[out]     decoder     初期化する状態.
+//! @retval true    初期化に成功.
+//! @retval false   初期化に失敗.
+//-----------------------------------------------------------------------------
+bool PadDeltaDecoderInit(PadDeltaDecoder& decoder);
+
+//-----------------------------------------------------------------------------
+//! @brief      差分符号化したレポート列をまとめて復号します.
+//!
+//! @param[in,out]  decoder     復号の状態.
+//! @param[in]      pInput      符号化したデータ.
+//! @param[in]      size        符号化したデータのサイズ.
+//! @param[out]     consumed    復号に使用したバイト数の格納先.
+//! @param[out]     pResults    パッド生データの格納先(Type, HostTime, Bytes のみ設定します).
+//! @param[in]      count       格納先の要素数.
+//! @return     復号したレポート数を返却します.
+//! @note   末尾の途中までのレポートは復号せずに残すので, 続きのデータと連結して再度渡してください.
+//!         最初のキーフレームまでのデータは読み飛ばします. 不正なデータを検出した場合は
+//!         PadDeltaDecoder::Error を1にして止まります.
+//-----------------------------------------------------------------------------
+uint32_t PadDeltaDecode(PadDeltaDecoder& decoder, const uint8_t* pInput, uint32_t size, uint32_t& consumed, PadRawInput* pResults, uint32_t count);
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PadDeviceInfo structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadDeviceInfo
+{
+    char        Path[kPadMaxDevicePath];    //!< デバイスパス. PadOpen() にそのまま渡せます.
+    uint16_t    VendorId;                   //!< ベンダーID.
+    uint16_t    ProductId;                  //!< プロダクトID.
+    uint32_t    Type;                       //!< 接続タイプ.
+};
+
+//-----------------------------------------------------------------------------
+//! @brief      デバイスの接続・切断を通知するコールバック関数です.
+//!
+//! @param[in]      pUser       PadHotplugOpen() に渡したユーザーデータ.
+//! @param[in]      event       イベントの種類.
+//! @param[in]      info        デバイス情報.
+//-----------------------------------------------------------------------------
+typedef void (*PadHotplugCallback)(void* pUser, PAD_DEVICE_EVENT event, const PadDeviceInfo& info);
+
+//-----------------------------------------------------------------------------
+//! @brief      デバイスの接続・切断の監視を開始します.
+//!
+//! @param[in]      callback    接続・切断を通知するコールバック関数.
+//! @param[in]      pUser       コールバック関数に渡すユーザーデータ.
+//! @param[out]     ppHotplug   監視ハンドルの格納先です.
+//! @retval true    開始に成功.
+//! @retval false   開始に失敗.
+//! @note   Linuxではudevのnetlink, WindowsではCM_Register_Notification() を使用します.
+//!         開始時に接続済みのパッドは初回の PadHotplugUpdate() で接続イベントとして通知されます.
+//-----------------------------------------------------------------------------
+bool PadHotplugOpen(PadHotplugCallback callback, void* pUser, PadHotplug** ppHotplug);
+
+//-----------------------------------------------------------------------------
+//! @brief      デバイスの接続・切断の監視を終了します.
+//!
+//! @param[in]      pHotplug    監視ハンドル.
+//! @retval true    終了に成功.
+//! @retval false   終了に失敗.
+//-----------------------------------------------------------------------------
+bool PadHotplugClose(PadHotplug*& pHotplug);
+
+//-----------------------------------------------------------------------------
+//! @brief      溜まっている接続・切断イベントをコールバック関数に通知します.
+//!
+//! @param[in]      pHotplug    監視ハンドル.
+//! @return     通知したイベント数を返却します.
+//! @note   ブロックしません. コールバック関数は呼び出し元のスレッドで実行されます.
+//!         フレームループから毎フレーム呼び出しても列挙処理は発生しません.
+//-----------------------------------------------------------------------------
+uint32_t PadHotplugUpdate(PadHotplug* pHotplug);
+
+//-----------------------------------------------------------------------------
+//! @brief      接続中のパッドのデバイス情報を取得します.
+//!
+//! @param[in]      pHotplug    監視ハンドル.
+//! @param[out]     pInfos      デバイス情報の格納先. nullptrの場合は個数のみ返却します.
+//! @param[in]      count       格納先の要素数.
+//! @return     接続中のパッド数を返却します.
+//-----------------------------------------------------------------------------
+uint32_t PadHotplugGetDevices(PadHotplug* pHotplug, PadDeviceInfo* pInfos, uint32_t count);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PadReportLayout structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  入力レポート内のフィールドの位置です.
+//!
+//! @note   Base以外の位置は入力データの開始位置からの相対位置で, USB接続時のレポートIDが0になります.
+//!         PadMap(), PadMapBatch(), PadDiff(), PadReportView は全てこのレイアウトからデコードします.
+struct PadReportLayout
+{
+    uint8_t     Base;           //!< 入力データの開始位置.
+    uint8_t     ReportId;       //!< 受け付けるレポートID(0なら検査しない).
+    uint8_t     StickL;         //!< 左スティック(X, Y).
+    uint8_t     StickR;         //!< 右スティック(X, Y).
+    uint8_t     L2;             //!< L2トリガー.
+    uint8_t     R2;             //!< R2トリガー.
+    uint8_t     Buttons;        //!< ボタン(16bit).
+    uint8_t     Special;        //!< 特殊ボタン.
+    uint8_t     SpecialMask;    //!< 特殊ボタンの有効ビット.
+    uint8_t     TimeStamp;      //!< タイムスタンプ(16bit).
+    uint8_t     Battery;        //!< バッテリーレベル(0なら無し).
+    uint8_t     Gyro;           //!< 角速度(16bit x 3).
+    uint8_t     Accel;          //!< 加速度(16bit x 3).
+    uint8_t     Touch;          //!< タッチ(4バイト x 2).
+    uint8_t     TouchCount;     //!< タッチ数(0なら識別番号の最上位ビットから数える).
+};
+
+// Dual Shock4 (USB : 64 bytes).
+constexpr PadReportLayout kPadDualShock4Layout = { 0, 0, 1, 3, 8, 9, 5, 7, 0x3, 10, 12, 13, 19, 35, 0 };
+
+/* Dual Sense (USB : 64 bytes) Memo :
+* input[7] →　タイマーカウンターっぽい挙動.
+* input[11] →　常にゼロ.
+* input[12]~[15]　→　タイムスタンプっぽい.
+* input[16]~　→　ジャイロか加速度.
+* input[30]~[32]　→ タイムスタンプっぽい.
+*/
+constexpr PadReportLayout kPadDualSenseLayout = { 0, 0, 1, 3, 5, 6, 8, 10, 0xf, 12, 0, 16, 22, 33, 41 };
+
+//-----------------------------------------------------------------------------
+//! @brief      入力レポートを解釈できる接続タイプかどうかチェックします.
+//!
+//! @param[in]      type        接続タイプ.
+//! @retval true    解釈できる.
+//! @retval false   解釈できない.
+//! @note   DualSense にはワイヤレスアダプタが存在しないため, その組み合わせは解釈しません.
+//-----------------------------------------------------------------------------
+constexpr bool PadIsSupportedType(uint32_t type)
+{
+    return (type & kPadConnectionMask) == PAD_CONNECTION_USB
+        || (type & kPadConnectionMask) == PAD_CONNECTION_BT
+        || ((type & kPadConnectionMask) == PAD_CONNECTION_WIRELESS && !(type & PAD_CONNECTION_DUAL_SENSE));
+}
+
+//-----------------------------------------------------------------------------
+//! @brief      接続タイプに対応する入力レポートのレイアウトを取得します.
+//!
+//! @param[in]      type        接続タイプ.
+//! @return     入力レポートのレイアウトを返却します.
+//-----------------------------------------------------------------------------
+constexpr PadReportLayout PadGetReportLayout(uint32_t type)
+{
+    const auto dualSense = !!(type & PAD_CONNECTION_DUAL_SENSE);
+    auto layout = dualSense ? kPadDualSenseLayout : kPadDualShock4Layout;
+
+    // Bluetooth (78 bytes) は先頭にヘッダが付く. 接続直後の簡易レポート(0x01)は扱わない.
+    if ((type & kPadConnectionMask) == PAD_CONNECTION_BT)
+    {
+        layout.Base     = dualSense ? 1 : 2;
+        layout.ReportId = dualSense ? 0x31 : 0x11;
+    }
+
+    return layout;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// PadReportView class
+///////////////////////////////////////////////////////////////////////////////
+class PadReportView
+{
+public:
+    //-------------------------------------------------------------------------
+    //! @brief      パッド生データを参照するビューを生成します.
+    //!
+    //! @param[in]      input       パッド生データ. ビューより長く生存している必要があります.
+    //-------------------------------------------------------------------------
+    explicit PadReportView(const PadRawInput& input)
+    : PadReportView(input.Type, input.Bytes)
+    { /* DO_NOTHING */ }
+
+    //-------------------------------------------------------------------------
+    //! @brief      入力レポートのバイト列を参照するビューを生成します.
+    //!
+    //! @param[in]      type        接続タイプ.
+    //! @param[in]      pBytes      入力レポート(レポートIDを含む). リングバッファ内を直接指せます.
+    //! @note   データのコピーやデコードは行いません. 各フィールドは取得時にデコードされます.
+    //-------------------------------------------------------------------------
+    PadReportView(uint32_t type, const uint8_t* pBytes)
+    : m_pInput      (nullptr)
+    , m_pLayout     ((type & PAD_CONNECTION_DUAL_SENSE) ? &kPadDualSenseLayout : &kPadDualShock4Layout)
+    , m_Type        (PAD_CONNECTION_NONE)
+    {
+        if (PadIsSupportedType(type))
+        {
+            // Bluetooth の簡易レポート(0x01)は扱わない.
+            const auto layout = PadGetReportLayout(type);
+            if (layout.ReportId == 0 || pBytes[0] == layout.ReportId)
+            {
+                m_pInput = pBytes + layout.Base;
+                m_Type   = PAD_CONNECTION_TYPE(type & kPadConnectionMask);
+            }
+        }
+    }
+
+    //-------------------------------------------------------------------------
+    //! @brief      有効なレポートかどうかチェックします.
+    //!
+    //! @retval true    有効.
+    //! @retval false   無効. この場合, 他のアクセサは呼び出さないでください.
+    //-------------------------------------------------------------------------
+    bool IsValid() const
+    { return m_pInput != nullptr; }
+
+    //-------------------------------------------------------------------------
+    //! @brief      接続タイプを取得します.
+    //-------------------------------------------------------------------------
+    PAD_CONNECTION_TYPE GetType() const
+    { return m_Type; }
+
+    //-------------------------------------------------------------------------
+    //! @brief      左スティックを取得します.
+    //-------------------------------------------------------------------------
+    PadAnalogStick GetStickL() const
+    { return PadAnalogStick{ m_pInput[m_pLayout->StickL], m_pInput[m_pLayout->StickL + 1] }; }
+
+    //-------------------------------------------------------------------------
+    //! @brief      右スティックを取得します.
+    //-------------------------------------------------------------------------
+    PadAnalogStick GetStickR() const
+    { return PadAnalogStick{ m_pInput[m_pLayout->StickR], m_pInput[m_pLayout->StickR + 1] }; }
+
+    //-------------------------------------------------------------------------
+    //! @brief      ボタンを取得します(下位4bitがDPad).
+    //-------------------------------------------------------------------------
+    uint16_t GetButtons() const
+    { return ReadU16(m_pLayout->Buttons); }
+
+    //-------------------------------------------------------------------------
+    //! @brief      特殊ボタンを取得します.
+    //-------------------------------------------------------------------------
+    uint8_t GetSpecialButtons() const
+    { return uint8_t(m_pInput[m_pLayout->Special] & m_pLayout->SpecialMask); }
+
+    //-------------------------------------------------------------------------
+    //! @brief      アナログボタンを取得します.
+    //-------------------------------------------------------------------------
+    PadAnalogButtons GetAnalogButtons() const
+    { return PadAnalogButtons{ m_pInput[m_pLayout->L2], m_pInput[m_pLayout->R2] }; }
+
+    //-------------------------------------------------------------------------
+    //! @brief      タイムスタンプを取得します.
+    //-------------------------------------------------------------------------
+    uint16_t GetTimeStamp() const
+    { return ReadU16(m_pLayout->TimeStamp); }
+
+    //-------------------------------------------------------------------------
+    //! @brief      バッテリーレベルを取得します.
+    //!
+    //! @note   DualSense は未対応のため0を返却します.
+    //-------------------------------------------------------------------------
+    uint8_t GetBatteryLevel() const
+    { return (m_pLayout->Battery != 0) ? m_pInput[m_pLayout->Battery] : 0; }
+
+    //-------------------------------------------------------------------------
+    //! @brief      角速度を取得します(補正無し).
+    //-------------------------------------------------------------------------
+    PadAngularVelocity GetGyro() const
+    {
+        auto offset = m_pLayout->Gyro;
+        return PadAngularVelocity{ ReadS16(offset), ReadS16(offset + 2), ReadS16(offset + 4) };
+    }
+
+    //-------------------------------------------------------------------------
+    //! @brief      加速度を取得します(補正無し).
+    //-------------------------------------------------------------------------
+    PadAccelaration GetAccel() const
+    {
+        auto offset = m_pLayout->Accel;
+        return PadAccelaration{ ReadS16(offset), ReadS16(offset + 2), ReadS16(offset + 4) };
+    }
+
+    //-------------------------------------------------------------------------
+    //! @brief      タッチ数を取得します.
+    //-------------------------------------------------------------------------
+    uint8_t GetTouchCount() const
+    {
+        if (m_pLayout->TouchCount != 0)
+        { return m_pInput[m_pLayout->TouchCount]; }
+
+        auto offset = m_pLayout->Touch;
+        return uint8_t(((m_pInput[offset] & 0x80) == 0) + ((m_pInput[offset + 4] & 0x80) == 0));
+    }
+
+    //-------------------------------------------------------------------------
+    //! @brief      タッチデータを取得します.
+    //!
+    //! @param[in]      index       タッチ番号(kPadMaxTouchCount未満).
+    //-------------------------------------------------------------------------
+    PadTouch GetTouch(uint32_t index) const
+    {
+        auto p = m_pInput + m_pLayout->Touch + index * 4;
+
+        PadTouch result;
+        result.Id = uint8_t(p[0] & 0x7f);
+        result.X  = uint16_t((uint16_t(p[2] & 0xf) << 8) | p[1]);
+        result.Y  = uint16_t((uint16_t(p[3] << 4)) | ((p[2] & 0xf0) >> 4));
+        return result;
+    }
+
+private:
+    const uint8_t*          m_pInput;       //!< 入力データの先頭(USBのレポートIDの位置).
+    const PadReportLayout*  m_pLayout;      //!< フィールドの位置.
+    PAD_CONNECTION_TYPE     m_Type;         //!< 接続タイプ.
+
+    uint16_t ReadU16(uint32_t offset) const
+    { return uint16_t(m_pInput[offset] | (m_pInput[offset + 1] << 8)); }
+
+    int16_t ReadS16(uint32_t offset) const
+    { return int16_t(ReadU16(offset)); }
+};
@@ -0,0 +1,4687 @@
+//-----------------------------------------------------------------------------
+// File : bench.cpp
+// Desc : Dual Shock4 Game Pad Library Benchmark.
+// Copyright(c) Project Asura. All right reserved.
+//-----------------------------------------------------------------------------
+// Build (Linux) :
+//   g++ -std=c++14 -O2 -Iinclude src/ds4_pad.cpp project/bench.cpp -o bench -lpthread
+// Usage :
+//   bench [--hot | --test] [--json <path>]
+//     --hot         ホットパス計測のみ実行します.
+//     --test        動作確認のテストのみ実行します.
+//     --json <path> ホットパス計測の結果をJSONで出力します.
+//   検証に失敗した場合は 0 以外の終了コードを返します.
+//-----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <ds4_pad.h>
+#include "../src/ds4_pad_test.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <new>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <termios.h>
+#include <arpa/inet.h>
+#include <csignal>
+#endif
+
+
+namespace {
+
+//-----------------------------------------------------------------------------
+// Constant Values.
+//-----------------------------------------------------------------------------
+static const uint32_t kFrameCount       = 2000;    // 計測フレーム数.
+static const uint32_t kReportsPerFrame  = 7;       // 1000Hz / 144fps.
+static const uint32_t kDecoyCount       = 256;     // パッド以外のHIDデバイス数.
+static const uint32_t kStartupCount     = 100;     // 起動時間の計測回数.
+static const uint32_t kNodeOpenCost     = 20;      // デバイスノードを開く際の模擬コスト(us).
+static const uint32_t kSlowWriteCost    = 4000;    // 低速な転送路での書き込み時間(us).
+static const uint32_t kOutputFrameCount = 200;     // 出力の計測フレーム数.
+static const uint32_t kCrcReportCount   = 20000;   // CRC計測のレポート数.
+static const uint32_t kViewReportCount  = 1024;    // ビュー計測のレポート数.
+static const uint32_t kViewPassCount    = 2000;    // ビュー計測の反復回数.
+static const uint32_t kBatchReportCount = 4096;    // 一括マッピング計測のレポート数.
+static const uint32_t kBatchPassCount   = 500;     // 一括マッピング計測の反復回数.
+static const uint32_t kBatchShortReport = 97;      // 簡易レポートを混ぜる間隔(Bluetooth).
+static const uint32_t kDiffReportCount  = 1024;    // 変化検出計測のレポート数.
+static const uint32_t kDiffPassCount    = 2000;    // 変化検出計測の反復回数.
+static const uint32_t kStickSampleCount = 4096;    // スティック整形計測のサンプル数.
+static const uint32_t kStickPassCount   = 2000;    // スティック整形計測の反復回数.
+static const uint32_t kGesturePassCount = 200;     // ジェスチャー認識計測の反復回数.
+static const uint32_t kReplayReports    = 20000;   // 再生計測のレポート数(1024の倍数でない数).
+static const uint32_t kReplayPassCount  = 20;      // 最速再生の反復回数.
+static const uint32_t kReplayPaced      = 500;     // 実時間再生のレポート数(1ms間隔).
+static const char     kReplayPath[]     = "libds4_bench_replay.cap";
+static const uint32_t kDeltaReports     = 65536;   // 差分符号化計測のレポート数.
+static const uint32_t kDeltaPassCount   = 20;      // 差分符号化計測の反復回数.
+static const uint32_t kDeltaKeyframe    = 1024;    // 差分符号化計測のキーフレーム間隔.
+static const uint32_t kEventReportCount = 7000;    // 入力イベント計測のパッドごとのレポート数.
+static const uint32_t kEventPadCount    = 4;       // 入力イベント計測の最大パッド数.
+static const uint32_t kClockFrameCount  = 400;     // 時刻推定計測のフレーム数.
+static const uint32_t kClockWarmup      = 1000;    // 時刻推定計測で集計から除くレポート数.
+static const uint32_t kClockPauseFrame  = 200;     // 送信を一時停止するフレーム.
+static const uint32_t kClockPauseTime   = 400;     // 送信の一時停止時間(ms, DualShock4のタイムスタンプの周期以上).
+static const double   kClockDrift       = 100e-6;  // 模擬デバイスの時計の進み(100ppm).
+static const uint32_t kStatsReportCount = 7000;    // 欠落検出計測のレポート数.
+static const uint32_t kStatsLongGap     = 150;     // 欠落検出計測で1度に欠落させるレポート数(フレームカウンターの周期以上).
+static const uint32_t kStatsSnapshots   = 100000;  // 統計取得の計測回数.
+static const uint32_t kCalibSampleCount = 4096;    // IMU補正計測のサンプル数.
+static const uint32_t kCalibPassCount   = 500;     // IMU補正計測の反復回数.
+static const uint32_t kCalibOpenCount   = 50;      // 補正データキャッシュ計測の接続回数.
+static const uint32_t kFeatureCost      = 1000;    // フィーチャーレポート読み取りの模擬コスト(us, USBのコントロール転送相当).
+static const uint32_t kFusionFrameCount = 1440;    // 姿勢推定計測のフレーム数(144fpsで10秒).
+static const uint32_t kFusionStreams    = 64;      // 一括姿勢推定計測の記録数.
+static const uint32_t kFusionSamples    = 4096;    // 一括姿勢推定計測の記録ごとのサンプル数.
+static const uint32_t kFusionPassCount  = 10;      // 一括姿勢推定計測の反復回数.
+static const uint32_t kCaptureReports   = 3500;    // キャプチャ計測のレポート数(1024の倍数でない数).
+static const char     kCapturePath[]    = "/tmp/libds4_bench.cap";
+static const uint32_t kHotMapReports    = 1024;    // ホットパス計測(PadMap)のレポート数.
+static const uint32_t kHotMapPassCount  = 2000;    // ホットパス計測(PadMap)の反復回数.
+static const uint32_t kHotOutputCount   = 100000;  // ホットパス計測(出力)の設定回数.
+static const uint32_t kHotReadFrames    = 50000;   // ホットパス計測(読み取り)のフレーム数.
+static const uint32_t kHotReadPool      = 64;      // ホットパス計測(読み取り)で循環させるレポート数.
+static const char     kFakeRoot[]       = "/tmp/libds4_fake";
+static const char     kFakeDev[]        = "/tmp/libds4_fake/dev/";
+
+volatile uint32_t       g_Sink = 0;         // 計測結果の書き込み先.
+std::atomic<uint64_t>   g_AllocCount(0);    // operator new の呼び出し回数.
+uint32_t                g_Failures = 0;     // 失敗した検証の数.
+
+//-----------------------------------------------------------------------------
+//      検証の失敗を記録します.
+//-----------------------------------------------------------------------------
+void ReportFailure(const char* message)
+{
+    printf("%s\n", message);
+    g_Failures++;
+}
+
+//-----------------------------------------------------------------------------
+//      条件が成立しない場合に検証の失敗を記録します.
+//-----------------------------------------------------------------------------
+void Expect(bool condition, const char* name)
+{
+    if (condition)
+    { return; }
+
+    printf("FAILED : %s\n", name);
+    g_Failures++;
+}
+
+//-----------------------------------------------------------------------------
+//      計測用のパッド生データを生成します.
+//-----------------------------------------------------------------------------
+void MakeRandomInputs(PadRawInput* pInputs, uint32_t count, uint32_t type)
+{
+    uint32_t seed = 12345;
+    for(auto i=0u; i<count; ++i)
+    {
+        pInputs[i].Type = type;
+        for(auto& byte : pInputs[i].Bytes)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            byte = uint8_t(seed >> 24);
+        }
+        pInputs[i].Bytes[0] = 0x01;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      PadReportView が PadMap() と同じ値を返すかどうかチェックします.
+//-----------------------------------------------------------------------------
+bool IsViewEqualToMap(const PadRawInput& input)
+{
+    PadState state = {};
+    PadMap(&input, state);
+
+    PadReportView view(input);
+    if (!view.IsValid())
+    { return false; }
+
+    auto touch0 = view.GetTouch(0);
+    auto touch1 = view.GetTouch(1);
+    auto gyro   = view.GetGyro();
+    auto accel  = view.GetAccel();
+    return view.GetButtons()          == state.Buttons
+        && view.GetSpecialButtons()   == state.SpecialButtons
+        && view.GetStickL().X         == state.StickL.X
+        && view.GetStickR().Y         == state.StickR.Y
+        && view.GetAnalogButtons().L2 == state.AnalogButtons.L2
+        && view.GetTimeStamp()        == state.TimeStamp
+        && gyro.Z                     == state.Gyro.Z
+        && accel.X                    == state.Accel.X
+        && view.GetTouchCount()       == state.TouchData.Count
+        && touch0.X                   == state.TouchData.Touch[0].X
+        && touch1.Y                   == state.TouchData.Touch[1].Y;
+}
+
+//-----------------------------------------------------------------------------
+//      PadMap() と PadReportView の所要時間を比較します.
+//-----------------------------------------------------------------------------
+void BenchReportView()
+{
+    printf("---- PadMap vs PadReportView (Buttons + StickL, %u reports x %u) ----\n", kViewReportCount, kViewPassCount);
+    printf("%-24s %12s\n", "mode", "ns/report");
+
+    static PadRawInput inputs[kViewReportCount];
+
+    static const uint32_t kTypes[] = {
+        PAD_CONNECTION_USB,
+        PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE,
+    };
+
+    static const char* kNames[] = {
+        "DS4 PadMap",
+        "DS4 PadReportView",
+        "DualSense PadMap",
+        "DualSense PadReportView",
+    };
+
+    for(auto model=0; model<2; ++model)
+    {
+        MakeRandomInputs(inputs, kViewReportCount, kTypes[model]);
+
+        for(auto mode=0; mode<2; ++mode)
+        {
+            uint32_t sink = 0;
+
+            auto begin = std::chrono::steady_clock::now();
+            for(auto pass=0u; pass<kViewPassCount; ++pass)
+            {
+                for(auto& input : inputs)
+                {
+                    if (mode == 0)
+                    {
+                        PadState state;
+                        PadMap(&input, state);
+                        sink += state.Buttons + state.StickL.X;
+                    }
+                    else
+                    {
+                        PadReportView view(input);
+                        sink += view.GetButtons() + view.GetStickL().X;
+                    }
+                }
+            }
+            auto end = std::chrono::steady_clock::now();
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+            printf("%-24s %12.2f\n",
+                kNames[model * 2 + mode],
+                double(elapsed) / (double(kViewReportCount) * kViewPassCount));
+
+            // 最適化で計測対象が消えないようにする.
+            g_Sink = sink;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// StateArrays structure
+///////////////////////////////////////////////////////////////////////////////
+struct StateArrays
+{
+    std::vector<uint8_t>    Bytes[12];      // Valid, スティック, トリガー, 特殊ボタン, バッテリー, タッチ.
+    std::vector<uint16_t>   Words[7];       // ボタン, タイムスタンプ, タッチ座標.
+    std::vector<int16_t>    Motion[6];      // 角速度, 加速度.
+
+    //-------------------------------------------------------------------------
+    //      配列を確保して出力先を設定します.
+    //-------------------------------------------------------------------------
+    PadStateStream Bind(uint32_t count)
+    {
+        for(auto& values : Bytes)  { values.assign(count, 0xcc); }
+        for(auto& values : Words)  { values.assign(count, 0xcccc); }
+        for(auto& values : Motion) { values.assign(count, 0x3333); }
+
+        PadStateStream stream = {};
+        stream.Valid          = Bytes[0].data();
+        stream.StickLX        = Bytes[1].data();
+        stream.StickLY        = Bytes[2].data();
+        stream.StickRX        = Bytes[3].data();
+        stream.StickRY        = Bytes[4].data();
+        stream.L2             = Bytes[5].data();
+        stream.R2             = Bytes[6].data();
+        stream.SpecialButtons = Bytes[7].data();
+        stream.BatteryLevel   = Bytes[8].data();
+        stream.TouchCount     = Bytes[9].data();
+        stream.TouchId[0]     = Bytes[10].data();
+        stream.TouchId[1]     = Bytes[11].data();
+        stream.Buttons        = Words[0].data();
+        stream.TimeStamp      = Words[1].data();
+        stream.TouchX[0]      = Words[2].data();
+        stream.TouchY[0]      = Words[3].data();
+        stream.TouchX[1]      = Words[4].data();
+        stream.TouchY[1]      = Words[5].data();
+        stream.GyroX          = Motion[0].data();
+        stream.GyroY          = Motion[1].data();
+        stream.GyroZ          = Motion[2].data();
+        stream.AccelX         = Motion[3].data();
+        stream.AccelY         = Motion[4].data();
+        stream.AccelZ         = Motion[5].data();
+        return stream;
+    }
+};
+
+//-----------------------------------------------------------------------------
+//      PadMapBatch() の結果が PadMap() と一致しないレポート数を数えます.
+//-----------------------------------------------------------------------------
+uint32_t CountBatchMismatch(const PadRawInput* pInputs, uint32_t count, const PadStateStream& stream)
+{
+    auto mismatch = 0u;
+    for(auto i=0u; i<count; ++i)
+    {
+        PadState state = {};
+        auto valid = PadMap(&pInputs[i], state);
+        if (!valid)
+        { memset(&state, 0, sizeof(state)); }
+
+        auto equal = stream.Valid[i]          == (valid ? 1 : 0)
+                  && stream.StickLX[i]        == state.StickL.X
+                  && stream.StickLY[i]        == state.StickL.Y
+                  && stream.StickRX[i]        == state.StickR.X
+                  && stream.StickRY[i]        == state.StickR.Y
+                  && stream.L2[i]             == state.AnalogButtons.L2
+                  && stream.R2[i]             == state.AnalogButtons.R2
+                  && stream.Buttons[i]        == state.Buttons
+                  && stream.SpecialButtons[i] == state.SpecialButtons
+                  && stream.TimeStamp[i]      == state.TimeStamp
+                  && stream.BatteryLevel[i]   == state.BatteryLevel
+                  && stream.GyroX[i]          == state.Gyro.X
+                  && stream.GyroY[i]          == state.Gyro.Y
+                  && stream.GyroZ[i]          == state.Gyro.Z
+                  && stream.AccelX[i]         == state.Accel.X
+                  && stream.AccelY[i]         == state.Accel.Y
+                  && stream.AccelZ[i]         == state.Accel.Z
+                  && stream.TouchCount[i]     == state.TouchData.Count;
+
+        for(auto j=0; j<kPadMaxTouchCount; ++j)
+        {
+            equal = equal
+                 && stream.TouchId[j][i] == state.TouchData.Touch[j].Id
+                 && stream.TouchX[j][i]  == state.TouchData.Touch[j].X
+                 && stream.TouchY[j][i]  == state.TouchData.Touch[j].Y;
+        }
+
+        if (!equal)
+        { mismatch++; }
+    }
+
+    return mismatch;
+}
+
+static const uint32_t kBatchTypes[] = {
+    PAD_CONNECTION_USB,
+    PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE,
+    PAD_CONNECTION_BT,
+    PAD_CONNECTION_BT  | PAD_CONNECTION_DUAL_SENSE,
+};
+
+//-----------------------------------------------------------------------------
+//      一括マッピング用のパッド生データを生成します.
+//-----------------------------------------------------------------------------
+void MakeBatchInputs(PadRawInput* pInputs, uint32_t count, uint32_t type)
+{
+    MakeRandomInputs(pInputs, count, type);
+
+    // Bluetoothは完全なレポートの間に簡易レポートを混ぜる.
+    if ((type & kPadConnectionMask) == PAD_CONNECTION_BT)
+    {
+        const uint8_t reportId = (type & PAD_CONNECTION_DUAL_SENSE) ? 0x31 : 0x11;
+        for(auto i=0u; i<count; ++i)
+        { pInputs[i].Bytes[0] = (i % kBatchShortReport == 0) ? 0x01 : reportId; }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      PadMap() と PadMapBatch() のスループットを比較します.
+//-----------------------------------------------------------------------------
+void BenchMapBatch()
+{
+    printf("---- PadMap vs PadMapBatch (%u reports x %u) ----\n", kBatchReportCount, kBatchPassCount);
+    printf("%-24s %14s\n", "mode", "Mreports/sec");
+
+    static const char* kModelNames[] = {
+        "DS4 USB",
+        "DualSense USB",
+        "DS4 BT",
+        "DualSense BT",
+    };
+
+    static const char* kLevelNames[] = {
+        "scalar",
+        "SSE4.1",
+        "AVX2",
+    };
+
+    std::vector<PadRawInput> inputs(kBatchReportCount);
+    std::vector<PadState>    states(kBatchReportCount);
+    StateArrays              arrays;
+
+    const auto supported = PadGetSimdLevel();
+
+    for(auto model=0; model<4; ++model)
+    {
+        MakeBatchInputs(inputs.data(), kBatchReportCount, kBatchTypes[model]);
+
+        // 基準 : PadMap() を1レポートずつ呼び出す.
+        {
+            uint32_t sink = 0;
+            auto begin = std::chrono::steady_clock::now();
+            for(auto pass=0u; pass<kBatchPassCount; ++pass)
+            {
+                for(auto i=0u; i<kBatchReportCount; ++i)
+                { PadMap(&inputs[i], states[i]); }
+                sink += states[pass % kBatchReportCount].Buttons;
+            }
+            auto end = std::chrono::steady_clock::now();
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+            char name[64];
+            sprintf(name, "%s PadMap", kModelNames[model]);
+            printf("%-24s %14.1f\n", name,
+                double(kBatchReportCount) * kBatchPassCount * 1e3 / double(elapsed));
+
+            g_Sink = sink;
+        }
+
+        for(auto level=0; level<=int(supported); ++level)
+        {
+            PadSetSimdLevel(PAD_SIMD_LEVEL(level));
+
+            auto stream = arrays.Bind(kBatchReportCount);
+
+            uint32_t sink = 0;
+            auto begin = std::chrono::steady_clock::now();
+            for(auto pass=0u; pass<kBatchPassCount; ++pass)
+            { sink += PadMapBatch(inputs.data(), kBatchReportCount, stream); }
+            auto end = std::chrono::steady_clock::now();
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+            char name[64];
+            sprintf(name, "%s %s", kModelNames[model], kLevelNames[level]);
+            printf("%-24s %14.1f\n", name,
+                double(kBatchReportCount) * kBatchPassCount * 1e3 / double(elapsed));
+
+            g_Sink = sink;
+        }
+
+        PadSetSimdLevel(supported);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      PadState のボタンを PAD_EDGE_BUTTON のビットに変換します(比較用).
+//-----------------------------------------------------------------------------
+uint32_t ToEdgeButtons(const PadState& state)
+{
+    uint32_t dpad = 0;
+    switch(state.Buttons & 0xf)
+    {
+    case PAD_BUTTON_DPAD_NORTH:     dpad = PAD_EDGE_DPAD_UP; break;
+    case PAD_BUTTON_DPAD_NORTHEAST: dpad = PAD_EDGE_DPAD_UP   | PAD_EDGE_DPAD_RIGHT; break;
+    case PAD_BUTTON_DPAD_EAST:      dpad = PAD_EDGE_DPAD_RIGHT; break;
+    case PAD_BUTTON_DPAD_SOUTHEAST: dpad = PAD_EDGE_DPAD_DOWN | PAD_EDGE_DPAD_RIGHT; break;
+    case PAD_BUTTON_DPAD_SOUTH:     dpad = PAD_EDGE_DPAD_DOWN; break;
+    case PAD_BUTTON_DPAD_SOUTHWEST: dpad = PAD_EDGE_DPAD_DOWN | PAD_EDGE_DPAD_LEFT; break;
+    case PAD_BUTTON_DPAD_WEST:      dpad = PAD_EDGE_DPAD_LEFT; break;
+    case PAD_BUTTON_DPAD_NORTHWEST: dpad = PAD_EDGE_DPAD_UP   | PAD_EDGE_DPAD_LEFT; break;
+    default:                        dpad = 0; break;
+    }
+
+    return (state.Buttons & 0xfff0u) | dpad | (uint32_t(state.SpecialButtons) << 16);
+}
+
+//-----------------------------------------------------------------------------
+//      2つの PadState を比較して変化を求めます(手書きの比較).
+//-----------------------------------------------------------------------------
+void DiffByHand(const PadState& prev, const PadState& curr, PadChanges& changes)
+{
+    uint32_t fields = 0;
+    if (prev.StickL.X != curr.StickL.X || prev.StickL.Y != curr.StickL.Y) { fields |= PAD_FIELD_STICK_L; }
+    if (prev.StickR.X != curr.StickR.X || prev.StickR.Y != curr.StickR.Y) { fields |= PAD_FIELD_STICK_R; }
+    if (prev.AnalogButtons.L2 != curr.AnalogButtons.L2
+     || prev.AnalogButtons.R2 != curr.AnalogButtons.R2) { fields |= PAD_FIELD_ANALOG_BUTTONS; }
+    if (prev.Buttons        != curr.Buttons)            { fields |= PAD_FIELD_BUTTONS; }
+    if (prev.SpecialButtons != curr.SpecialButtons)     { fields |= PAD_FIELD_SPECIAL_BUTTONS; }
+    if (prev.TimeStamp      != curr.TimeStamp)          { fields |= PAD_FIELD_TIMESTAMP; }
+    if (prev.BatteryLevel   != curr.BatteryLevel)       { fields |= PAD_FIELD_BATTERY; }
+    if (memcmp(&prev.Gyro,  &curr.Gyro,  sizeof(curr.Gyro))  != 0) { fields |= PAD_FIELD_GYRO; }
+    if (memcmp(&prev.Accel, &curr.Accel, sizeof(curr.Accel)) != 0) { fields |= PAD_FIELD_ACCEL; }
+
+    auto touch = prev.TouchData.Count != curr.TouchData.Count;
+    for(auto i=0; i<kPadMaxTouchCount; ++i)
+    {
+        touch |= prev.TouchData.Touch[i].Id != curr.TouchData.Touch[i].Id
+              || prev.TouchData.Touch[i].X  != curr.TouchData.Touch[i].X
+              || prev.TouchData.Touch[i].Y  != curr.TouchData.Touch[i].Y;
+    }
+    if (touch)
+    { fields |= PAD_FIELD_TOUCH; }
+
+    auto prevButtons = ToEdgeButtons(prev);
+    changes.Fields   = fields;
+    changes.Buttons  = ToEdgeButtons(curr);
+    changes.Pressed  = changes.Buttons & ~prevButtons;
+    changes.Released = prevButtons & ~changes.Buttons;
+}
+
+//-----------------------------------------------------------------------------
+//      変化検出用のパッド生データを生成します.
+//-----------------------------------------------------------------------------
+void MakeDiffInputs(PadRawInput* pInputs, uint32_t count, uint32_t type, int scenario)
+{
+    // 0 : 前回と同じレポート, 1 : センサーだけ変化, 2 : 全バイト変化.
+    MakeRandomInputs(pInputs, count, type);
+    for(auto i=1u; i<count && scenario < 2; ++i)
+    {
+        auto& input = pInputs[i];
+        memcpy(input.Bytes, pInputs[i - 1].Bytes, sizeof(input.Bytes));
+        if (scenario == 1)
+        {
+            // タイムスタンプから加速度までを更新する.
+            for(auto j=10u; j<28u; ++j)
+            { input.Bytes[j] = uint8_t(input.Bytes[j] + i + j); }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      PadDiff() の結果が手書きの比較と一致しないレポート数を数えます.
+//-----------------------------------------------------------------------------
+uint32_t CountDiffMismatch(const PadRawInput* pInputs, uint32_t count)
+{
+    auto mismatch = 0u;
+    for(auto i=1u; i<count; ++i)
+    {
+        // DualSense は BatteryLevel を書き込まないのでゼロクリアしておく.
+        PadState prev = {};
+        PadState curr = {};
+        PadMap(&pInputs[i - 1], prev);
+        PadMap(&pInputs[i], curr);
+
+        PadChanges expected = {};
+        PadChanges actual   = {};
+        DiffByHand(prev, curr, expected);
+        PadDiff(&pInputs[i - 1], &pInputs[i], actual);
+        if (memcmp(&expected, &actual, sizeof(actual)) != 0)
+        { mismatch++; }
+    }
+
+    return mismatch;
+}
+
+//-----------------------------------------------------------------------------
+//      PadDiff() と手書きの比較の所要時間を比較します.
+//-----------------------------------------------------------------------------
+void BenchDiff()
+{
+    printf("---- PadDiff vs diff by hand (%u reports x %u) ----\n", kDiffReportCount, kDiffPassCount);
+    printf("%-28s %12s\n", "mode", "ns/report");
+
+    static const uint32_t kTypes[] = {
+        PAD_CONNECTION_USB,
+        PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE,
+    };
+
+    static const char* kModelNames[] = {
+        "DS4",
+        "DualSense",
+    };
+
+    static const char* kScenarioNames[] = {
+        "idle",
+        "sensor",
+        "random",
+    };
+
+    std::vector<PadRawInput> inputs(kDiffReportCount);
+
+    for(auto model=0; model<2; ++model)
+    {
+        for(auto scenario=0; scenario<3; ++scenario)
+        {
+            MakeDiffInputs(inputs.data(), kDiffReportCount, kTypes[model], scenario);
+
+            for(auto mode=0; mode<2; ++mode)
+            {
+                uint32_t sink = 0;
+                auto begin = std::chrono::steady_clock::now();
+                for(auto pass=0u; pass<kDiffPassCount; ++pass)
+                {
+                    for(auto i=1u; i<kDiffReportCount; ++i)
+                    {
+                        PadChanges changes;
+                        if (mode == 0)
+                        {
+                            // 手書き : 毎回マッピングしてフィールドごとに比較する.
+                            PadState prev = {};
+                            PadState curr = {};
+                            PadMap(&inputs[i - 1], prev);
+                            PadMap(&inputs[i], curr);
+                            DiffByHand(prev, curr, changes);
+                        }
+                        else
+                        {
+                            PadDiff(&inputs[i - 1], &inputs[i], changes);
+                        }
+                        sink += changes.Fields + changes.Pressed;
+                    }
+                }
+                auto end = std::chrono::steady_clock::now();
+                auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+                char name[64];
+                sprintf(name, "%s %s %s", kModelNames[model], kScenarioNames[scenario], (mode == 0) ? "by hand" : "PadDiff");
+                printf("%-28s %12.2f\n", name,
+                    double(elapsed) / (double(kDiffReportCount - 1) * kDiffPassCount));
+
+                g_Sink = sink;
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      スティック入力を浮動小数演算で整形します(検証と比較用).
+//-----------------------------------------------------------------------------
+void ReferenceShapeStick(const PadStickProfile& profile, uint8_t stickX, uint8_t stickY, float& resultX, float& resultY)
+{
+    auto x = (float(stickX) - 127.5f) / 127.5f;
+    auto y = (float(stickY) - 127.5f) / 127.5f;
+    auto r = std::sqrt(x * x + y * y);
+    if (r <= profile.InnerDeadzone)
+    {
+        resultX = resultY = 0.0f;
+        return;
+    }
+
+    auto t = std::min((r - profile.InnerDeadzone) / (profile.OuterDeadzone - profile.InnerDeadzone), 1.0f);
+    auto scale = (profile.AntiDeadzone + (1.0f - profile.AntiDeadzone) * std::pow(t, profile.Exponent)) / r;
+    resultX = std::max(-1.0f, std::min(x * scale, 1.0f));
+    resultY = std::max(-1.0f, std::min(y * scale, 1.0f));
+}
+
+static const PadStickProfile kStickProfile = { 0.1f, 0.95f, 0.05f, 1.8f };
+
+//-----------------------------------------------------------------------------
+//      スティック整形用の入力を生成します.
+//-----------------------------------------------------------------------------
+void MakeStickSamples(uint8_t* pX, uint8_t* pY, uint32_t count)
+{
+    uint32_t seed = 12345;
+    for(auto i=0u; i<count; ++i)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        pX[i] = uint8_t(seed >> 24);
+        pY[i] = uint8_t(seed >> 16);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      整形結果が浮動小数演算と一致しないサンプル数を数えます.
+//-----------------------------------------------------------------------------
+uint32_t CountStickMismatch(const uint8_t* pX, const uint8_t* pY, const int16_t* pResultX, const int16_t* pResultY, uint32_t count)
+{
+    // 丸め誤差による1以下の差は許容する.
+    auto mismatch = 0u;
+    for(auto i=0u; i<count; ++i)
+    {
+        float x, y;
+        ReferenceShapeStick(kStickProfile, pX[i], pY[i], x, y);
+        auto diff = std::max(std::abs(pResultX[i] - int(std::lround(x * 32767.0f))),
+                             std::abs(pResultY[i] - int(std::lround(y * 32767.0f))));
+        if (diff > 1)
+        { mismatch++; }
+    }
+
+    return mismatch;
+}
+
+//-----------------------------------------------------------------------------
+//      スティック整形の浮動小数演算と整形テーブルの所要時間を比較します.
+//-----------------------------------------------------------------------------
+void BenchStickShaping()
+{
+    printf("---- Stick shaping (%u samples x %u) ----\n", kStickSampleCount, kStickPassCount);
+    printf("%-28s %12s\n", "mode", "ns/sample");
+
+    auto begin = std::chrono::steady_clock::now();
+    PadStickTable* pTable = nullptr;
+    if (!PadStickTableOpen(kStickProfile, &pTable))
+    {
+        ReportFailure("failed to open stick table.");
+        return;
+    }
+    auto end = std::chrono::steady_clock::now();
+    printf("%-28s %12.2f us\n", "table build",
+        double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()) * 1e-3);
+
+    std::vector<uint8_t> sticksX(kStickSampleCount);
+    std::vector<uint8_t> sticksY(kStickSampleCount);
+    std::vector<int16_t> resultX(kStickSampleCount);
+    std::vector<int16_t> resultY(kStickSampleCount);
+    MakeStickSamples(sticksX.data(), sticksY.data(), kStickSampleCount);
+
+    static const char* kNames[] = {
+        "float per sample",
+        "PadShapeStick",
+        "PadShapeSticks scalar",
+        "PadShapeSticks AVX2",
+    };
+
+    const auto supported = PadGetSimdLevel();
+    for(auto mode=0; mode<4; ++mode)
+    {
+        if (mode == 3 && supported != PAD_SIMD_AVX2)
+        { continue; }
+
+        PadSetSimdLevel((mode == 2) ? PAD_SIMD_NONE : supported);
+
+        auto sink = 0;
+        begin = std::chrono::steady_clock::now();
+        for(auto pass=0u; pass<kStickPassCount; ++pass)
+        {
+            if (mode == 0)
+            {
+                for(auto i=0u; i<kStickSampleCount; ++i)
+                {
+                    float x, y;
+                    ReferenceShapeStick(kStickProfile, sticksX[i], sticksY[i], x, y);
+                    resultX[i] = int16_t(std::lround(x * 32767.0f));
+                    resultY[i] = int16_t(std::lround(y * 32767.0f));
+                }
+            }
+            else if (mode == 1)
+            {
+                for(auto i=0u; i<kStickSampleCount; ++i)
+                {
+                    PadStickVector value;
+                    PadShapeStick(pTable, PadAnalogStick{ sticksX[i], sticksY[i] }, value);
+                    resultX[i] = value.X;
+                    resultY[i] = value.Y;
+                }
+            }
+            else
+            {
+                PadShapeSticks(pTable, sticksX.data(), sticksY.data(), kStickSampleCount, resultX.data(), resultY.data());
+            }
+            sink += resultX[pass % kStickSampleCount];
+        }
+        end = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+        printf("%-28s %12.2f\n", kNames[mode],
+            double(elapsed) / (double(kStickSampleCount) * kStickPassCount));
+        g_Sink = uint32_t(sink);
+    }
+
+    PadSetSimdLevel(supported);
+    PadStickTableClose(pTable);
+}
+
+//-----------------------------------------------------------------------------
+//      ジェスチャー計測用のタッチ操作を記録します.
+//-----------------------------------------------------------------------------
+struct GestureScript
+{
+    uint32_t                    Type;       // 接続タイプ.
+    uint8_t                     Offset;     // タッチデータの位置.
+    uint64_t                    Time;       // 次のレポートのデバイス時刻(us).
+    std::vector<PadRawInput>    Inputs;     // 記録したレポート.
+
+    // タッチ操作を duration(ms) の間 1ms 間隔で記録する. position(t, index, x, y) で t(0~1) の位置を返し, 触れていない指は負の値を返す.
+    template<typename Func>
+    void Add(uint32_t duration, uint8_t id, Func position)
+    {
+        for(auto ms=0u; ms<duration; ++ms)
+        {
+            PadRawInput input = {};
+            input.Type       = Type;
+            input.DeviceTime = Time;
+            for(auto i=0u; i<kPadMaxTouchCount; ++i)
+            {
+                auto pTouch = &input.Bytes[Offset + i * 4];
+                float x, y;
+                position(float(ms) / float(duration), i, x, y);
+                if (x < 0.0f)
+                {
+                    pTouch[0] = 0x80;
+                    continue;
+                }
+
+                auto ix = uint32_t(std::lround(x));
+                auto iy = uint32_t(std::lround(y));
+                pTouch[0] = uint8_t((id + i) & 0x7f);
+                pTouch[1] = uint8_t(ix & 0xff);
+                pTouch[2] = uint8_t(((ix >> 8) & 0xf) | ((iy & 0xf) << 4));
+                pTouch[3] = uint8_t(iy >> 4);
+            }
+            Inputs.push_back(input);
+            Time += 1000;
+        }
+    }
+
+    // 何も触れていない状態を duration(ms) の間記録する.
+    void Release(uint32_t duration)
+    { Add(duration, 0, [](float, uint32_t, float& x, float& y) { x = y = -1.0f; }); }
+};
+
+//-----------------------------------------------------------------------------
+//      タップ, スワイプ, ピンチ, スクロールを含むタッチ操作を生成します.
+//-----------------------------------------------------------------------------
+void MakeGestureScript(GestureScript& script, bool dualSense)
+{
+    script.Type   = dualSense ? (PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE) : PAD_CONNECTION_USB;
+    script.Offset = dualSense ? 33 : 35;
+    script.Time   = 1000;
+
+    // 1本指のタップ.
+    script.Add(100, 1, [](float, uint32_t i, float& x, float& y)
+    { x = (i == 0) ? 500.0f : -1.0f; y = 400.0f; });
+    script.Release(50);
+
+    // 2本指のタップ.
+    script.Add(120, 2, [](float, uint32_t i, float& x, float& y)
+    { x = (i == 0) ? 600.0f : 900.0f; y = 500.0f; });
+    script.Release(50);
+
+    // スワイプ(600を300msで移動, 2000/秒).
+    script.Add(300, 4, [](float t, uint32_t i, float& x, float& y)
+    { x = (i == 0) ? 200.0f + 600.0f * t : -1.0f; y = 470.0f; });
+    script.Release(50);
+
+    // ゆっくりしたドラッグ(何も通知されない).
+    script.Add(1000, 5, [](float t, uint32_t i, float& x, float& y)
+    { x = (i == 0) ? 800.0f + 200.0f * t : -1.0f; y = 300.0f; });
+    script.Release(50);
+
+    // ピンチ(2点間の距離を200から600へ).
+    script.Add(400, 6, [](float t, uint32_t i, float& x, float& y)
+    { x = 960.0f + ((i == 0) ? -1.0f : 1.0f) * (100.0f + 200.0f * t); y = 470.0f; });
+    script.Release(50);
+
+    // スクロール(2点の中心を300移動).
+    script.Add(300, 8, [](float t, uint32_t i, float& x, float& y)
+    { x = (i == 0) ? 800.0f : 1100.0f; y = 300.0f + 300.0f * t; });
+    script.Release(50);
+
+    // 長押し(何も通知されない).
+    script.Add(600, 10, [](float, uint32_t i, float& x, float& y)
+    { x = (i == 0) ? 1200.0f : -1.0f; y = 600.0f; });
+    script.Release(50);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// GestureResult structure
+///////////////////////////////////////////////////////////////////////////////
+struct GestureResult
+{
+    std::string     Recognized;     // 認識したジェスチャー("T1 S P" など).
+    float           PinchScale;     // ピンチの拡大率の積.
+    float           ScrollDelta;    // スクロールの移動量(Y)の合計.
+    float           SwipeSpeed;     // 最後のスワイプの速度(X).
+};
+
+//-----------------------------------------------------------------------------
+//      記録したタッチ操作からジェスチャーを認識します.
+//-----------------------------------------------------------------------------
+void RecognizeGestures(const GestureScript& script, GestureResult& result)
+{
+    PadGestureState state;
+    PadGestureInit(state, nullptr);
+
+    // ピンチ・スクロールの連続する通知は1つにまとめる.
+    result.Recognized.clear();
+    result.PinchScale  = 1.0f;
+    result.ScrollDelta = 0.0f;
+    result.SwipeSpeed  = 0.0f;
+
+    auto lastType = 0xffu;
+    for(const auto& input : script.Inputs)
+    {
+        PadGesture gestures[kPadMaxGestureCount];
+        auto count = PadGestureUpdate(state, &input, gestures, kPadMaxGestureCount);
+        for(auto i=0u; i<count; ++i)
+        {
+            const auto& gesture = gestures[i];
+            if (gesture.Type == PAD_GESTURE_PINCH)
+            { result.PinchScale *= gesture.Scale; }
+            else if (gesture.Type == PAD_GESTURE_SCROLL)
+            { result.ScrollDelta += gesture.DeltaY; }
+            else if (gesture.Type == PAD_GESTURE_SWIPE)
+            { result.SwipeSpeed = gesture.VelocityX; }
+
+            auto repeated = (gesture.Type == lastType)
+                && (gesture.Type == PAD_GESTURE_PINCH || gesture.Type == PAD_GESTURE_SCROLL);
+            lastType = gesture.Type;
+            if (repeated)
+            { continue; }
+
+            static const char kTypeNames[] = "TSPS";
+            if (!result.Recognized.empty())
+            { result.Recognized += ' '; }
+            result.Recognized += kTypeNames[gesture.Type];
+            if (gesture.Type == PAD_GESTURE_TAP)
+            { result.Recognized += char('0' + gesture.Fingers); }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      タッチパッドのジェスチャー認識の所要時間を計測します.
+//-----------------------------------------------------------------------------
+void BenchGesture()
+{
+    printf("---- Touchpad gesture (state %u bytes) ----\n", uint32_t(sizeof(PadGestureState)));
+    printf("%-28s %12s\n", "model", "ns/report");
+
+    static const char* kModelNames[] = { "DualShock4", "DualSense" };
+
+    for(auto model=0; model<2; ++model)
+    {
+        GestureScript script;
+        MakeGestureScript(script, model == 1);
+
+        PadGestureState state;
+        PadGestureInit(state, nullptr);
+
+        // 全ての操作を繰り返して所要時間を計測する.
+        auto sink = 0u;
+        auto begin = std::chrono::steady_clock::now();
+        for(auto pass=0u; pass<kGesturePassCount; ++pass)
+        {
+            for(const auto& input : script.Inputs)
+            {
+                PadGesture gestures[kPadMaxGestureCount];
+                sink += PadGestureUpdate(state, &input, gestures, kPadMaxGestureCount);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+        printf("%-28s %12.2f\n", kModelNames[model],
+            double(elapsed) / (double(script.Inputs.size()) * kGesturePassCount));
+        g_Sink = sink;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      パッド生データをキャプチャファイルの形式で書き出します.
+//-----------------------------------------------------------------------------
+bool WriteCaptureFile(const char* path, const PadRawInput* pInputs, uint32_t count, uint32_t type, bool truncate)
+{
+    auto pFile = fopen(path, "wb");
+    if (pFile == nullptr)
+    { return false; }
+
+    PadCaptureHeader header = {};
+    header.Magic        = kPadCaptureMagic;
+    header.Version      = kPadCaptureVersion;
+    header.HeaderSize   = uint16_t(sizeof(header));
+    header.Type         = type;
+    header.ReportSize   = 64;
+    header.RecordStride = 72;
+    header.ChunkSize    = kPadCaptureChunkSize;
+    fwrite(&header, sizeof(header), 1, pFile);
+
+    std::vector<uint8_t> record(header.RecordStride);
+    for(auto first=0u; first<count; first+=kPadCaptureChunkSize)
+    {
+        auto last = std::min(first + kPadCaptureChunkSize, count);
+        for(auto i=first; i<last; ++i)
+        {
+            memcpy(&record[0], &pInputs[i].HostTime, sizeof(uint64_t));
+            memcpy(&record[8], pInputs[i].Bytes, header.ReportSize);
+            fwrite(record.data(), record.size(), 1, pFile);
+        }
+
+        // 異常終了を模擬する場合は最後の索引を書かない.
+        if (truncate && last == count)
+        { break; }
+
+        PadCaptureIndex index = {};
+        index.Magic       = kPadCaptureIndexMagic;
+        index.Count       = last - first;
+        index.FirstRecord = first;
+        index.FirstTime   = pInputs[first].HostTime;
+        index.LastTime    = pInputs[last - 1].HostTime;
+        fwrite(&index, sizeof(index), 1, pFile);
+    }
+
+    return fclose(pFile) == 0;
+}
+
+//-----------------------------------------------------------------------------
+//      キャプチャファイルを再生し, 記録と一致しないレポート数を返却します.
+//-----------------------------------------------------------------------------
+uint32_t ReplayCapture(const PadRawInput* pInputs, uint32_t count, float speed, uint32_t& received, double& seconds)
+{
+    received = 0;
+    seconds  = 0.0;
+
+    PadHandle* pHandle = nullptr;
+    if (!PadOpenReplay(kReplayPath, speed, &pHandle))
+    { return count; }
+
+    auto mismatch = 0u;
+    auto begin = std::chrono::steady_clock::now();
+    PadRawInput inputs[64];
+    while(PadIsConnected(pHandle))
+    {
+        auto result = PadReadBatch(pHandle, inputs, 64);
+        for(auto i=0u; i<result; ++i, ++received)
+        {
+            if (received >= count || memcmp(inputs[i].Bytes, pInputs[received].Bytes, 64) != 0)
+            { mismatch++; }
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    seconds = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()) * 1e-9;
+
+    PadClose(pHandle);
+    return mismatch + (count - std::min(received, count));
+}
+
+//-----------------------------------------------------------------------------
+//      再生用の1ms間隔のパッド生データを生成します.
+//-----------------------------------------------------------------------------
+void MakeReplayInputs(std::vector<PadRawInput>& inputs)
+{
+    MakeRandomInputs(inputs.data(), uint32_t(inputs.size()), PAD_CONNECTION_USB);
+    for(size_t i=0; i<inputs.size(); ++i)
+    { inputs[i].HostTime = 1000000 + uint64_t(i) * 1000; }
+}
+
+//-----------------------------------------------------------------------------
+//      キャプチャファイルの再生速度を計測します.
+//-----------------------------------------------------------------------------
+void BenchReplay()
+{
+    printf("---- Capture replay ----\n");
+    printf("%-28s %12s %12s %12s\n", "mode", "reports", "seconds", "ns/report");
+
+    std::vector<PadRawInput> inputs(kReplayReports);
+    MakeReplayInputs(inputs);
+
+    // 最速再生(スループットの計測).
+    if (!WriteCaptureFile(kReplayPath, inputs.data(), kReplayReports, PAD_CONNECTION_USB, false))
+    {
+        ReportFailure("failed to write capture file.");
+        return;
+    }
+
+    uint32_t received;
+    double   seconds;
+    auto total = 0.0;
+    for(auto pass=0u; pass<kReplayPassCount; ++pass)
+    {
+        ReplayCapture(inputs.data(), kReplayReports, 0.0f, received, seconds);
+        total += seconds;
+    }
+    printf("%-28s %12u %12.3f %12.2f\n", "as fast as possible", received, total / kReplayPassCount,
+        total * 1e9 / (double(kReplayReports) * kReplayPassCount));
+
+    // 実時間と倍速(記録は1ms間隔).
+    static const float kSpeeds[] = { 1.0f, 4.0f };
+    for(auto speed : kSpeeds)
+    {
+        if (!WriteCaptureFile(kReplayPath, inputs.data(), kReplayPaced, PAD_CONNECTION_USB, false))
+        { break; }
+
+        ReplayCapture(inputs.data(), kReplayPaced, speed, received, seconds);
+
+        char name[64];
+        sprintf(name, "paced x%.0f (expect %.3f s)", speed, (kReplayPaced - 1) * 1e-3 / speed);
+        printf("%-28s %12u %12.3f %12.2f\n", name, received, seconds, seconds * 1e9 / kReplayPaced);
+    }
+
+    remove(kReplayPath);
+}
+
+//-----------------------------------------------------------------------------
+//      1ms間隔の実際に近いDualShock4のレポート列を生成します.
+//-----------------------------------------------------------------------------
+void MakeRecordedInputs(PadRawInput* pInputs, uint32_t count)
+{
+    uint32_t seed = 12345;
+    auto random = [&](uint32_t range)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) % range;
+    };
+
+    static const int16_t kImuBase[6] = { -3, 5, 2, 120, 8150, -400 };
+
+    uint8_t sticks[4]  = { 128, 127, 129, 128 };
+    uint8_t buttons[2] = { 0x08, 0x00 };
+    uint64_t hostTime  = 1000000;
+    for(auto i=0u; i<count; ++i)
+    {
+        auto& input = pInputs[i];
+        memset(&input, 0, sizeof(input));
+        input.Type = PAD_CONNECTION_USB;
+
+        // スティックは時々1揺れ, ボタンはまれに変わる.
+        if (random(10) == 0)
+        { sticks[random(4)] += uint8_t(random(3) - 1); }
+        if (random(500) == 0)
+        { buttons[0] ^= uint8_t(0x10 << random(4)); }
+
+        auto bytes = input.Bytes;
+        bytes[0] = 0x01;
+        memcpy(&bytes[1], sticks, 4);
+        memcpy(&bytes[5], buttons, 2);
+        bytes[7] = uint8_t(i << 2);
+
+        auto timeStamp = uint16_t(i * 188);
+        memcpy(&bytes[10], &timeStamp, 2);
+        bytes[12] = 0x1b;
+
+        // ジャイロと加速度はノイズで下位バイトがほぼ毎回変わる.
+        for(auto axis=0; axis<6; ++axis)
+        {
+            auto value = int16_t(kImuBase[axis] + int(random(61)) - 30);
+            memcpy(&bytes[13 + axis * 2], &value, 2);
+        }
+
+        bytes[30] = 0x1b;
+        bytes[35] = 0x80;
+        bytes[39] = 0x80;
+
+        hostTime += 1000 + random(50);
+        input.HostTime = hostTime;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      差分符号化用のパッド生データを生成します(0 : 実際に近いデータ, 1 : 乱数).
+//-----------------------------------------------------------------------------
+void MakeDeltaInputs(std::vector<PadRawInput>& inputs, int data)
+{
+    if (data == 0)
+    { MakeRecordedInputs(inputs.data(), uint32_t(inputs.size())); }
+    else
+    { MakeReplayInputs(inputs); }
+}
+
+//-----------------------------------------------------------------------------
+//      パッド生データを差分符号化し, 符号化後のサイズを返却します.
+//-----------------------------------------------------------------------------
+size_t EncodeDelta(const std::vector<PadRawInput>& inputs, uint32_t keyframe, std::vector<uint8_t>& encoded, std::vector<size_t>& keyframes)
+{
+    // 受信スレッドで1つずつ行う想定.
+    PadDeltaEncoder encoder;
+    PadDeltaEncoderInit(encoder, 64, keyframe);
+
+    size_t size = 0;
+    keyframes.clear();
+    for(size_t i=0; i<inputs.size(); ++i)
+    {
+        if (i % keyframe == 0)
+        { keyframes.push_back(size); }
+        size += PadDeltaEncode(encoder, inputs[i], &encoded[size], kPadDeltaMaxRecordSize);
+    }
+    return size;
+}
+
+//-----------------------------------------------------------------------------
+//      差分符号化したデータを復号し, 元のレポートと一致しない数を返却します.
+//-----------------------------------------------------------------------------
+uint32_t CountDeltaMismatch
+(
+    const std::vector<PadRawInput>& inputs,
+    const std::vector<uint8_t>&     encoded,
+    size_t                          size,
+    const std::vector<size_t>&      keyframes,
+    uint32_t                        keyframe
+)
+{
+    const auto total = uint32_t(inputs.size());
+    std::vector<PadRawInput> outputs(total);
+
+    // まとめて復号.
+    auto mismatch = 0u;
+    {
+        PadDeltaDecoder decoder;
+        PadDeltaDecoderInit(decoder);
+
+        uint32_t consumed;
+        auto decoded = PadDeltaDecode(decoder, encoded.data(), uint32_t(size), consumed, outputs.data(), total);
+        mismatch += total - decoded;
+        for(auto i=0u; i<decoded; ++i)
+        {
+            if (outputs[i].HostTime != inputs[i].HostTime || outputs[i].Type != inputs[i].Type
+             || memcmp(outputs[i].Bytes, inputs[i].Bytes, 64) != 0)
+            { mismatch++; }
+        }
+    }
+
+    // 少しずつ渡しても同じ結果になること.
+    {
+        PadDeltaDecoder decoder;
+        PadDeltaDecoderInit(decoder);
+
+        std::vector<uint8_t> pending;
+        auto index = 0u;
+        for(size_t offset=0; offset<size; offset+=37)
+        {
+            auto piece = std::min<size_t>(37, size - offset);
+            pending.insert(pending.end(), &encoded[offset], &encoded[offset] + piece);
+
+            PadRawInput results[4];
+            uint32_t consumed;
+            uint32_t count;
+            while((count = PadDeltaDecode(decoder, pending.data(), uint32_t(pending.size()), consumed, results, 4)) > 0 || consumed > 0)
+            {
+                pending.erase(pending.begin(), pending.begin() + consumed);
+                for(auto i=0u; i<count; ++i, ++index)
+                {
+                    if (index >= total || memcmp(results[i].Bytes, inputs[index].Bytes, 64) != 0)
+                    { mismatch++; }
+                }
+            }
+        }
+        mismatch += total - std::min(index, total);
+    }
+
+    // キーフレームからの途中再生.
+    {
+        auto key = uint32_t(keyframes.size() / 2);
+        PadDeltaDecoder decoder;
+        PadDeltaDecoderInit(decoder);
+
+        uint32_t consumed;
+        auto count = PadDeltaDecode(decoder, &encoded[keyframes[key]], uint32_t(size - keyframes[key]), consumed, outputs.data(), total);
+        auto first = key * keyframe;
+        if (count != total - first)
+        { mismatch++; }
+        for(auto i=0u; i<count; ++i)
+        {
+            if (memcmp(outputs[i].Bytes, inputs[first + i].Bytes, 64) != 0)
+            { mismatch++; }
+        }
+    }
+
+    return mismatch;
+}
+
+//-----------------------------------------------------------------------------
+//      差分符号化の圧縮率と符号化・復号の速度を計測します.
+//-----------------------------------------------------------------------------
+void BenchDeltaCodec()
+{
+    printf("---- Delta codec (%u reports x %u, keyframe every %u) ----\n", kDeltaReports, kDeltaPassCount, kDeltaKeyframe);
+    printf("%-16s %10s %10s %12s %12s %12s\n",
+        "data", "bytes/rep", "ratio", "encode ns", "decode ns", "decode GB/s");
+
+    std::vector<PadRawInput> inputs(kDeltaReports);
+    std::vector<PadRawInput> outputs(kDeltaReports);
+    std::vector<uint8_t>     encoded(size_t(kDeltaReports) * kPadDeltaMaxRecordSize);
+    std::vector<size_t>      keyframes;
+
+    for(auto data=0; data<2; ++data)
+    {
+        MakeDeltaInputs(inputs, data);
+
+        size_t size = 0;
+        auto begin = std::chrono::steady_clock::now();
+        for(auto pass=0u; pass<kDeltaPassCount; ++pass)
+        { size = EncodeDelta(inputs, kDeltaKeyframe, encoded, keyframes); }
+        auto end = std::chrono::steady_clock::now();
+        auto encodeTime = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+
+        // まとめて復号.
+        auto decoded = 0u;
+        begin = std::chrono::steady_clock::now();
+        for(auto pass=0u; pass<kDeltaPassCount; ++pass)
+        {
+            PadDeltaDecoder decoder;
+            PadDeltaDecoderInit(decoder);
+
+            uint32_t consumed;
+            decoded += PadDeltaDecode(decoder, encoded.data(), uint32_t(size), consumed, outputs.data(), kDeltaReports);
+        }
+        end = std::chrono::steady_clock::now();
+        auto decodeTime = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+
+        auto reports = double(kDeltaReports) * kDeltaPassCount;
+        printf("%-16s %10.2f %10.2f %12.2f %12.2f %12.2f\n",
+            (data == 0) ? "recorded-like" : "random",
+            double(size) / kDeltaReports,
+            (8.0 + 64.0) * kDeltaReports / double(size),
+            encodeTime / reports,
+            decodeTime / reports,
+            reports * 64.0 / decodeTime);
+        g_Sink = decoded;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// HotResult structure
+///////////////////////////////////////////////////////////////////////////////
+struct HotResult
+{
+    std::string     Name;           // 計測名.
+    uint64_t        Ops;            // 計測した操作数.
+    uint64_t        Reports;        // 処理したレポート数.
+    uint64_t        Allocs;         // 計測中のメモリ確保回数.
+    double          Nanoseconds;    // 所要時間(ns).
+};
+
+std::vector<HotResult>  g_HotResults;   // ホットパス計測の結果.
+
+//-----------------------------------------------------------------------------
+//      ホットパス計測の表の見出しを表示します.
+//-----------------------------------------------------------------------------
+void PrintHotHeader(const char* title)
+{
+    printf("---- %s ----\n", title);
+    printf("%-32s %12s %12s %14s %12s\n", "case", "ops", "ns/op", "reports/sec", "allocs/op");
+}
+
+//-----------------------------------------------------------------------------
+//      操作を計測して結果を記録します(funcは処理したレポート数を返します).
+//-----------------------------------------------------------------------------
+template<typename Func>
+void RunHotCase(const char* name, uint64_t ops, Func func)
+{
+    auto allocs = g_AllocCount.load();
+    auto begin  = std::chrono::steady_clock::now();
+    uint64_t reports = func();
+    auto end    = std::chrono::steady_clock::now();
+
+    HotResult result;
+    result.Name        = name;
+    result.Ops         = ops;
+    result.Reports     = reports;
+    result.Allocs      = g_AllocCount.load() - allocs;
+    result.Nanoseconds = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+
+    printf("%-32s %12llu %12.1f %14.0f %12.3f\n",
+        name,
+        (unsigned long long)ops,
+        result.Nanoseconds / ops,
+        (result.Nanoseconds > 0.0) ? reports * 1e9 / result.Nanoseconds : 0.0,
+        double(result.Allocs) / ops);
+
+    g_HotResults.push_back(result);
+}
+
+//-----------------------------------------------------------------------------
+//      機種と接続タイプごとの入力レポートを生成します.
+//-----------------------------------------------------------------------------
+void MakeHotInputs(PadRawInput* pInputs, uint32_t count, uint32_t type)
+{
+    MakeRandomInputs(pInputs, count, type);
+
+    if ((type & 0x0f) != PAD_CONNECTION_BT)
+    { return; }
+
+    for(auto i=0u; i<count; ++i)
+    { pInputs[i].Bytes[0] = !!(type & PAD_CONNECTION_DUAL_SENSE) ? 0x31 : 0x11; }
+}
+
+//-----------------------------------------------------------------------------
+//      ホットパス計測の機種と接続タイプです.
+//-----------------------------------------------------------------------------
+struct HotTarget
+{
+    const char*     Name;
+    uint32_t        Type;
+};
+
+static const HotTarget kHotTargets[] = {
+    { "DS4 USB",        PAD_CONNECTION_USB },
+    { "DS4 BT",         PAD_CONNECTION_BT },
+    { "DualSense USB",  PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE },
+    { "DualSense BT",   PAD_CONNECTION_BT  | PAD_CONNECTION_DUAL_SENSE },
+};
+
+//-----------------------------------------------------------------------------
+//      PadMap() の機種と接続タイプごとの所要時間を計測します.
+//-----------------------------------------------------------------------------
+void BenchHotMap()
+{
+    PrintHotHeader("Hot path: PadMap");
+
+    std::vector<PadRawInput> inputs(kHotMapReports);
+    for(auto& target : kHotTargets)
+    {
+        MakeHotInputs(inputs.data(), kHotMapReports, target.Type);
+
+        auto name = std::string("PadMap/") + target.Name;
+        auto ops  = uint64_t(kHotMapReports) * kHotMapPassCount;
+        RunHotCase(name.c_str(), ops, [&]()
+        {
+            PadState state;
+            uint32_t sink = 0;
+            for(auto pass=0u; pass<kHotMapPassCount; ++pass)
+            {
+                for(auto i=0u; i<kHotMapReports; ++i)
+                {
+                    PadMap(&inputs[i], state);
+                    sink += state.Buttons + state.StickL.X;
+                }
+            }
+            g_Sink = sink;
+            return ops;
+        });
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      ホットパス計測の結果をJSONで書き出します.
+//-----------------------------------------------------------------------------
+bool WriteHotJson(const char* path)
+{
+    auto pFile = fopen(path, "w");
+    if (pFile == nullptr)
+    { return false; }
+
+    fprintf(pFile, "{\n  \"benchmarks\": [\n");
+    for(size_t i=0; i<g_HotResults.size(); ++i)
+    {
+        const auto& result = g_HotResults[i];
+        fprintf(pFile,
+            "    { \"name\": \"%s\", \"ops\": %llu, \"reports\": %llu, \"ns_per_op\": %.3f, \"reports_per_sec\": %.1f, \"allocs_per_op\": %.4f }%s\n",
+            result.Name.c_str(),
+            (unsigned long long)result.Ops,
+            (unsigned long long)result.Reports,
+            result.Nanoseconds / result.Ops,
+            (result.Nanoseconds > 0.0) ? result.Reports * 1e9 / result.Nanoseconds : 0.0,
+            double(result.Allocs) / result.Ops,
+            (i + 1 < g_HotResults.size()) ? "," : "");
+    }
+    fprintf(pFile, "  ]\n}\n");
+
+    return fclose(pFile) == 0;
+}
+
+#if !defined(_WIN32)
+std::atomic<uint32_t>   g_OpenCount(0);     // 偽のデバイスノードを開いた回数.
+std::atomic<bool>       g_SlowWrite(false); // 偽パッドへの書き込みを低速にするかどうか.
+std::atomic<bool>       g_FakeFeature(false);   // 偽パッドのフィーチャーレポートを模擬するかどうか.
+std::atomic<uint32_t>   g_FeatureCount(0);      // 補正データのフィーチャーレポートを読み取った回数.
+std::atomic<uint32_t>   g_FakeSerial(0);        // 偽パッドのMACアドレスの下位32bit.
+uint8_t                 g_FakeCalibration[41];  // 偽パッドの補正データ.
+std::atomic<bool>       g_FakeHangUp(false);    // 全ての偽パッドの切断を模擬するかどうか.
+
+///////////////////////////////////////////////////////////////////////////////
+// MemoryTransport structure
+///////////////////////////////////////////////////////////////////////////////
+struct MemoryTransport
+{
+    std::mutex      Lock;               // 読み取りスレッドと計測側の排他制御.
+    const uint8_t*  pBytes  = nullptr;  // 循環させるレポート.
+    uint32_t        Size    = 0;        // 1レポートのバイト数.
+    uint32_t        Count   = 0;        // レポート数.
+    uint32_t        Cursor  = 0;        // 次に返すレポート.
+    uint32_t        Pending = 0;        // 読み取れるレポート数(0の場合はデータ無し).
+    uint64_t        Writes  = 0;        // 書き込まれた出力レポート数.
+    uint8_t         Output[78] = {};    // 最後に書き込まれた出力レポート.
+    uint32_t        OutputSize = 0;     // 最後に書き込まれた出力レポートのバイト数.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// FakeDevice structure
+///////////////////////////////////////////////////////////////////////////////
+struct FakeDevice
+{
+    int                             Fd = -1;                // デバイスノード(FIFOまたは通常ファイル).
+    std::atomic<MemoryTransport*>   pMemory { nullptr };    // 読み書きをメモリで行う場合の転送路.
+    std::atomic<bool>               HangUp  { false };      // 切断を模擬するかどうか.
+};
+
+std::atomic<FakeDevice*>        g_LastDevice(nullptr);  // 最後に開いた偽パッド.
+std::atomic<MemoryTransport*>   g_FakeMemory(nullptr);  // 新しく開いた偽パッドに割り当てる転送路.
+
+//-----------------------------------------------------------------------------
+//      偽パッドのデバイスノードを開きます.
+//-----------------------------------------------------------------------------
+void* FakeOpen(void*, const char* path)
+{
+    // 偽のノードは通常ファイルなので, ドライバへの問い合わせに相当する時間を待つ.
+    if (strncmp(path, kFakeDev, sizeof(kFakeDev) - 1) == 0)
+    {
+        g_OpenCount++;
+        std::this_thread::sleep_for(std::chrono::microseconds(kNodeOpenCost));
+    }
+
+    auto fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    { return nullptr; }
+
+    auto pDevice = new FakeDevice();
+    pDevice->Fd      = fd;
+    pDevice->pMemory = g_FakeMemory.load();
+    g_LastDevice = pDevice;
+    return pDevice;
+}
+
+//-----------------------------------------------------------------------------
+//      偽パッドのデバイスノードを閉じます.
+//-----------------------------------------------------------------------------
+void FakeClose(void*, void* pDevice)
+{
+    auto pFake = static_cast<FakeDevice*>(pDevice);
+    auto pLast = pFake;
+    g_LastDevice.compare_exchange_strong(pLast, nullptr);
+
+    close(pFake->Fd);
+    delete pFake;
+}
+
+//-----------------------------------------------------------------------------
+//      偽パッドの入力レポートを読み取ります.
+//-----------------------------------------------------------------------------
+int32_t FakeRead(void*, void* pDevice, uint8_t* pBytes, uint32_t size, int32_t timeout)
+{
+    auto pFake = static_cast<FakeDevice*>(pDevice);
+    if (pFake->HangUp.load() || g_FakeHangUp.load())
+    { return -1; }
+
+    if (auto pMemory = pFake->pMemory.load())
+    {
+        std::lock_guard<std::mutex> locker(pMemory->Lock);
+        if (pMemory->Pending == 0)
+        { return 0; }
+
+        auto copySize = std::min(size, pMemory->Size);
+        memcpy(pBytes, pMemory->pBytes + size_t(pMemory->Cursor) * pMemory->Size, copySize);
+        pMemory->Cursor = (pMemory->Cursor + 1) % pMemory->Count;
+        pMemory->Pending--;
+        return int32_t(copySize);
+    }
+
+    pollfd fds = { pFake->Fd, POLLIN, 0 };
+    if (poll(&fds, 1, timeout) <= 0)
+    { return 0; }
+
+    auto ret = read(pFake->Fd, pBytes, size);
+    if (ret < 0)
+    { return (errno == EAGAIN || errno == EINTR) ? 0 : -1; }
+
+    // 書き込み側が閉じられた場合は切断とみなす.
+    return (ret == 0) ? -1 : int32_t(ret);
+}
+
+//-----------------------------------------------------------------------------
+//      偽パッドに出力レポートを書き込みます(低速な転送路を模擬します).
+//-----------------------------------------------------------------------------
+int32_t FakeWrite(void*, void* pDevice, const uint8_t* pBytes, uint32_t size)
+{
+    auto pFake = static_cast<FakeDevice*>(pDevice);
+    if (pFake->HangUp.load() || g_FakeHangUp.load())
+    { return -1; }
+
+    if (auto pMemory = pFake->pMemory.load())
+    {
+        std::lock_guard<std::mutex> locker(pMemory->Lock);
+        pMemory->Writes++;
+        pMemory->OutputSize = std::min(size, uint32_t(sizeof(pMemory->Output)));
+        memcpy(pMemory->Output, pBytes, pMemory->OutputSize);
+        return int32_t(size);
+    }
+
+    if (g_SlowWrite.load())
+    { std::this_thread::sleep_for(std::chrono::microseconds(kSlowWriteCost)); }
+
+    return int32_t(write(pFake->Fd, pBytes, size));
+}
+
+//-----------------------------------------------------------------------------
+//      偽パッドのフィーチャーレポート(MACアドレスと補正データ)を返します.
+//-----------------------------------------------------------------------------
+int32_t FakeGetFeature(void*, void*, uint8_t* pBytes, uint32_t size)
+{
+    if (!g_FakeFeature.load())
+    { return -1; }
+
+    if (pBytes[0] == 0x12 && size >= 7)
+    {
+        auto serial = g_FakeSerial.load();
+        for(auto i=0u; i<6; ++i)
+        { pBytes[1 + i] = uint8_t((i < 4) ? (serial >> (i * 8)) : 0xa0); }
+        return 16;
+    }
+
+    if ((pBytes[0] == 0x02 || pBytes[0] == 0x05) && size >= sizeof(g_FakeCalibration))
+    {
+        g_FeatureCount++;
+        std::this_thread::sleep_for(std::chrono::microseconds(kFeatureCost));
+        memcpy(pBytes + 1, g_FakeCalibration + 1, sizeof(g_FakeCalibration) - 1);
+        return int32_t(sizeof(g_FakeCalibration));
+    }
+
+    return -1;
+}
+
+static const PadTransport kFakeTransport = {
+    nullptr,
+    FakeOpen,
+    FakeClose,
+    FakeRead,
+    FakeWrite,
+    FakeGetFeature,
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// FakeTransportScope class
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  スコープ内で開くパッドの入出力を偽パッドに差し替えます.
+class FakeTransportScope
+{
+public:
+    FakeTransportScope()
+    {
+        if (!PadSetTransport(&kFakeTransport))
+        { ReportFailure("failed to set fake transport."); }
+    }
+
+    ~FakeTransportScope()
+    {
+        if (!PadSetTransport(nullptr))
+        { ReportFailure("failed to restore transport."); }
+    }
+};
+
+//-----------------------------------------------------------------------------
+//      メモリの転送路から読み取れるレポート数を設定します.
+//-----------------------------------------------------------------------------
+void SetMemoryPending(MemoryTransport& memory, uint32_t count)
+{
+    std::lock_guard<std::mutex> locker(memory.Lock);
+    memory.Pending = count;
+}
+
+//-----------------------------------------------------------------------------
+//      メモリの転送路に書き込まれた出力レポート数を取り出します.
+//-----------------------------------------------------------------------------
+uint64_t TakeMemoryWrites(MemoryTransport& memory)
+{
+    std::lock_guard<std::mutex> locker(memory.Lock);
+    auto writes = memory.Writes;
+    memory.Writes = 0;
+    return writes;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// FakePad structure
+///////////////////////////////////////////////////////////////////////////////
+struct FakePad
+{
+    std::string     Path;
+    int             Writer  = -1;
+    PadHandle*      pHandle = nullptr;
+    FakeDevice*     pDevice = nullptr;  // 偽パッドの入出力を使う場合のデバイス.
+};
+
+//-----------------------------------------------------------------------------
+//      FIFOをhidrawの代わりとして開きます.
+//-----------------------------------------------------------------------------
+bool OpenFakePad(const char* name, FakePad& pad, uint32_t type = PAD_CONNECTION_USB)
+{
+    pad.Path = std::string("/tmp/") + name;
+    unlink(pad.Path.c_str());
+    if (mkfifo(pad.Path.c_str(), 0600) != 0)
+    { return false; }
+
+    if (!PadOpen(pad.Path.c_str(), type, &pad.pHandle))
+    { return false; }
+
+    pad.pDevice = g_LastDevice.exchange(nullptr);
+    pad.Writer  = open(pad.Path.c_str(), O_WRONLY);
+    PadSetReadTimeout(pad.pHandle, 0);
+    return (pad.Writer >= 0);
+}
+
+//-----------------------------------------------------------------------------
+//      FIFOを閉じます.
+//-----------------------------------------------------------------------------
+void CloseFakePad(FakePad& pad)
+{
+    if (pad.pDevice != nullptr)
+    { pad.pDevice->pMemory = nullptr; }
+
+    PadClose(pad.pHandle);
+    close(pad.Writer);
+    unlink(pad.Path.c_str());
+}
+
+//-----------------------------------------------------------------------------
+//      1フレーム分のレポートを送信します.
+//-----------------------------------------------------------------------------
+void SendFrame(FakePad& pad, uint32_t frame)
+{
+    uint8_t bytes[64] = {};
+    bytes[0] = 0x01;
+    for(auto i=0u; i<kReportsPerFrame; ++i)
+    {
+        bytes[7] = uint8_t((frame * kReportsPerFrame + i) << 2);
+        auto ret = write(pad.Writer, bytes, sizeof(bytes));
+        (void)ret;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      PadRead() と PadReadBatch() のシステムコール回数を比較します.
+//-----------------------------------------------------------------------------
+void BenchReadBatch()
+{
+    printf("---- PadRead vs PadReadBatch (%u reports/frame, %u frames) ----\n", kReportsPerFrame, kFrameCount);
+    printf("%-24s %12s %12s %12s %12s\n", "mode", "reports", "read/frame", "wait/frame", "ns/frame");
+
+    for(auto mode=0; mode<3; ++mode)
+    {
+        FakePad pad;
+        if (!OpenFakePad("libds4_bench_read", pad))
+        {
+            ReportFailure("failed to open fake pad.");
+            return;
+        }
+
+        if (mode == 2)
+        { PadEnableReaderThread(pad.pHandle, true); }
+
+        PadRawInput inputs[64];
+        uint64_t received = 0;
+        uint64_t elapsed  = 0;
+
+        for(auto frame=0u; frame<kFrameCount; ++frame)
+        {
+            SendFrame(pad, frame);
+
+            // 読み取りスレッドが受信し終えるまで待つ.
+            if (mode == 2)
+            {
+                PadIoStats stats = {};
+                do { PadGetIoStats(pad.pHandle, stats); }
+                while (stats.Reports < uint64_t(frame + 1) * kReportsPerFrame);
+            }
+
+            auto begin = std::chrono::steady_clock::now();
+            if (mode == 0)
+            {
+                while(PadRead(pad.pHandle, inputs[0]))
+                { received++; }
+            }
+            else
+            {
+                received += PadReadBatch(pad.pHandle, inputs, 64);
+            }
+            auto end = std::chrono::steady_clock::now();
+            elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+        }
+
+        PadIoStats stats = {};
+        PadGetIoStats(pad.pHandle, stats);
+
+        static const char* kNames[] = {
+            "PadRead loop",
+            "PadReadBatch",
+            "PadReadBatch + thread"
+        };
+
+        // 読み取りスレッド有効時, システムコールは全て読み取りスレッド側で発行される.
+        auto readCalls = (mode == 2) ? 0.0 : double(stats.ReadCalls) / kFrameCount;
+        auto waitCalls = (mode == 2) ? 0.0 : double(stats.WaitCalls) / kFrameCount;
+
+        printf("%-24s %12llu %12.2f %12.2f %12.1f\n",
+            kNames[mode],
+            (unsigned long long)received,
+            readCalls,
+            waitCalls,
+            double(elapsed) / kFrameCount);
+
+        CloseFakePad(pad);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// EventQueueResult structure
+///////////////////////////////////////////////////////////////////////////////
+struct EventQueueResult
+{
+    uint32_t    Opened;         // 開いたパッド数.
+    uint64_t    Expected;       // 送信したイベント数.
+    uint64_t    Received;       // 受信したイベント数.
+    uint64_t    Dropped;        // キューが溢れて破棄されたイベント数.
+    uint64_t    OrderErrors;    // 順序や内容が正しくないイベント数.
+    uint64_t    AgeSum;         // 受信からの経過時間の合計(us).
+    uint64_t    AgeMax;         // 受信からの経過時間の最大値(us).
+};
+
+//-----------------------------------------------------------------------------
+//      複数パッドから1つの入力イベントキューへイベントを転送します.
+//-----------------------------------------------------------------------------
+bool RunEventQueue(uint32_t padCount, uint32_t reportCount, EventQueueResult& result)
+{
+    memset(&result, 0, sizeof(result));
+
+    PadEventQueue* pQueue = nullptr;
+    if (!PadEventQueueOpen(4096, &pQueue))
+    {
+        ReportFailure("failed to open event queue.");
+        return false;
+    }
+
+    FakePad pads[kEventPadCount];
+    auto opened = 0u;
+    for(; opened<padCount; ++opened)
+    {
+        auto name = "libds4_bench_event" + std::to_string(opened);
+        if (!OpenFakePad(name.c_str(), pads[opened]))
+        { break; }
+
+        PadAttachEventQueue(pads[opened].pHandle, pQueue, opened);
+        PadEnableReaderThread(pads[opened].pHandle, true);
+    }
+
+    // 毎レポート×ボタンを切り替え, タイムスタンプに連番を書き込む.
+    // 1ミリ秒ごとに kReportsPerFrame 個ずつ送信する.
+    std::vector<std::thread> writers;
+    for(auto i=0u; i<opened; ++i)
+    {
+        writers.emplace_back([&pads, i, reportCount]()
+        {
+            uint8_t bytes[64] = {};
+            bytes[0]  = 0x01;
+            bytes[35] = 0x80;   // タッチ無し.
+            bytes[39] = 0x80;
+            for(auto sent=0u; sent<reportCount; ++sent)
+            {
+                bytes[5]  = uint8_t(PAD_BUTTON_DPAD_NONE | ((sent & 0x1) ? 0 : PAD_BUTTON_CROSS));
+                bytes[10] = uint8_t(sent);
+                bytes[11] = uint8_t(sent >> 8);
+                auto ret = write(pads[i].Writer, bytes, sizeof(bytes));
+                (void)ret;
+
+                if ((sent % kReportsPerFrame) == kReportsPerFrame - 1)
+                { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+            }
+        });
+    }
+
+    // 1つのコンシューマーで全パッドのイベントを取り出す.
+    uint16_t lastTime[kEventPadCount] = {};
+    PadEvent events[256];
+
+    result.Opened   = opened;
+    result.Expected = uint64_t(opened) * reportCount;
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(result.Received < result.Expected && std::chrono::steady_clock::now() < deadline)
+    {
+        auto count = PadEventQueuePop(pQueue, events, 256);
+        auto now   = PadGetHostTime();
+        for(auto i=0u; i<count; ++i)
+        {
+            auto& event = events[i];
+
+            // パッドごとにタイムスタンプが連番で, 押下と解放が交互になっているか.
+            auto source = event.Source;
+            auto type   = ((event.DeviceTime & 0x1) == 0) ? PAD_EVENT_BUTTON_DOWN : PAD_EVENT_BUTTON_UP;
+            if (source >= opened)
+            {
+                result.OrderErrors++;
+                continue;
+            }
+
+            if (event.Type   != type
+             || event.Button != PAD_BUTTON_CROSS
+             || (event.DeviceTime != 0 && event.DeviceTime != uint16_t(lastTime[source] + 1)))
+            { result.OrderErrors++; }
+            lastTime[source] = event.DeviceTime;
+
+            auto age = now - event.HostTime;
+            result.AgeSum += age;
+            result.AgeMax  = std::max(result.AgeMax, age);
+        }
+        result.Received += count;
+
+        if (count == 0)
+        { std::this_thread::yield(); }
+    }
+
+    for(auto& writer : writers)
+    { writer.join(); }
+
+    result.Dropped = PadEventQueueGetDropCount(pQueue);
+    for(auto i=0u; i<opened; ++i)
+    {
+        PadAttachEventQueue(pads[i].pHandle, nullptr, 0);
+        CloseFakePad(pads[i]);
+    }
+    PadEventQueueClose(pQueue);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      複数パッドから1つの入力イベントキューへの転送を計測します.
+//-----------------------------------------------------------------------------
+void BenchEventQueue()
+{
+    printf("---- Event queue (%u reports/pad, %u reports/ms, 1 event/report) ----\n", kEventReportCount, kReportsPerFrame);
+    printf("%-24s %12s %12s %12s\n", "mode", "events", "avg age us", "max age us");
+
+    for(auto padCount=1u; padCount<=kEventPadCount; padCount*=2)
+    {
+        EventQueueResult result;
+        if (!RunEventQueue(padCount, kEventReportCount, result))
+        { return; }
+
+        char name[32];
+        sprintf(name, "%u pad(s) -> 1 queue", result.Opened);
+        printf("%-24s %12llu %12.1f %12llu\n",
+            name,
+            (unsigned long long)result.Received,
+            (result.Received > 0) ? double(result.AgeSum) / result.Received : 0.0,
+            (unsigned long long)result.AgeMax);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// TimelineResult structure
+///////////////////////////////////////////////////////////////////////////////
+struct TimelineResult
+{
+    uint64_t    Reports;        // 受信したレポート数.
+    uint64_t    DeviceErrors;   // デバイス時刻の拡張を誤ったレポート数.
+    uint64_t    Samples;        // 誤差を集計したレポート数.
+    double      AvgError[2];    // 誤差の絶対値の平均(受信時刻, 入力時刻, us).
+    double      MaxError[2];    // 誤差の絶対値の最大値(受信時刻, 入力時刻, us).
+    double      Bias[2];        // 誤差の平均(受信時刻, 入力時刻, us).
+    double      Drift;          // 推定した時計の進みの差(ppm).
+};
+
+//-----------------------------------------------------------------------------
+//      時計の進んだ偽パッドからレポートを受信し, 入力時刻の推定誤差を集計します.
+//-----------------------------------------------------------------------------
+bool RunTimeline(uint32_t type, TimelineResult& result)
+{
+    memset(&result, 0, sizeof(result));
+
+    FakePad pad;
+    if (!OpenFakePad("libds4_bench_clock", pad, type))
+    {
+        ReportFailure("failed to open fake pad.");
+        return false;
+    }
+
+    PadRawInput discard[8];
+    while(PadReadBatch(pad.pHandle, discard, 8) > 0)
+    { /* DO_NOTHING */ }
+
+    // 1ミリ秒ごとに入力されたレポートを kReportsPerFrame 個まとめて送信する.
+    std::vector<uint64_t>    truths;
+    std::vector<uint64_t>    devices;
+    std::vector<PadRawInput> received;
+    PadRawInput inputs[64];
+
+    auto next  = std::chrono::steady_clock::now();
+    auto start = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(next.time_since_epoch()).count());
+    for(auto frame=0u; frame<kClockFrameCount; ++frame)
+    {
+        if (frame == kClockPauseFrame)
+        { next += std::chrono::milliseconds(kClockPauseTime); }
+
+        next += std::chrono::milliseconds(kReportsPerFrame);
+        std::this_thread::sleep_until(next);
+
+        // 直前の kReportsPerFrame ミリ秒間に1ミリ秒間隔で入力されたとみなす.
+        auto frameEnd = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(next.time_since_epoch()).count());
+        for(auto i=0u; i<kReportsPerFrame; ++i)
+        {
+            auto truth  = frameEnd - (kReportsPerFrame - 1 - i) * 1000;
+            auto device = double(truth - start) * (1.0 + kClockDrift);
+
+            uint8_t bytes[64] = {};
+            bytes[0]  = 0x01;
+            bytes[35] = 0x80;
+            bytes[39] = 0x80;
+            if ((type & PAD_CONNECTION_DUAL_SENSE) == 0)
+            {
+                auto count = uint16_t(uint64_t(device * 3.0 / 16.0));
+                memcpy(&bytes[10], &count, sizeof(count));
+            }
+            else
+            {
+                auto count = uint32_t(uint64_t(device * 3.0));
+                memcpy(&bytes[28], &count, sizeof(count));
+            }
+
+            auto ret = write(pad.Writer, bytes, sizeof(bytes));
+            (void)ret;
+
+            truths .push_back(truth);
+            devices.push_back(uint64_t(device));
+        }
+
+        auto count = PadReadBatch(pad.pHandle, inputs, 64);
+        received.insert(received.end(), inputs, inputs + count);
+    }
+
+    // デバイス時刻の拡張誤差と, 受信時刻/入力時刻の誤差を集計する.
+    result.Reports = received.size();
+    auto count = std::min(received.size(), truths.size());
+    for(auto i=0u; i<count; ++i)
+    {
+        auto& input = received[i];
+        auto expected = devices[i] - devices[0];
+        if (std::abs(double(input.DeviceTime) - double(expected)) > 10.0)
+        { result.DeviceErrors++; }
+
+        if (i < kClockWarmup)
+        { continue; }
+
+        uint64_t times[2] = { input.HostTime, input.CaptureTime };
+        for(auto j=0; j<2; ++j)
+        {
+            auto error = double(int64_t(times[j] - truths[i]));
+            result.AvgError[j] += std::abs(error);
+            result.Bias[j]     += error;
+            result.MaxError[j]  = std::max(result.MaxError[j], std::abs(error));
+        }
+        result.Samples++;
+    }
+
+    for(auto j=0; j<2 && result.Samples > 0; ++j)
+    {
+        result.AvgError[j] /= double(result.Samples);
+        result.Bias[j]     /= double(result.Samples);
+    }
+
+    // 推定した時計の進みの差(模擬デバイスは kClockDrift だけ速い).
+    PadClockEstimate clock = {};
+    PadGetClockEstimate(pad.pHandle, clock);
+    result.Drift = (clock.Rate > 0.0) ? (1.0 / clock.Rate - 1.0) * 1e6 : 0.0;
+
+    CloseFakePad(pad);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      受信時刻と推定した入力時刻の誤差を比較します.
+//-----------------------------------------------------------------------------
+void BenchTimeline()
+{
+    printf("---- Receive time vs capture time (%u reports/%u ms, %.0f ppm drift, %u ms pause) ----\n",
+        kReportsPerFrame, kReportsPerFrame, kClockDrift * 1e6, kClockPauseTime);
+    printf("%-24s %12s %12s %12s %12s %12s\n", "mode", "reports", "avg err us", "max err us", "bias us", "drift ppm");
+
+    static const uint32_t kTypes[] = {
+        PAD_CONNECTION_USB,
+        PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE,
+    };
+
+    static const char* kModelNames[] = {
+        "DS4",
+        "DualSense",
+    };
+
+    static const char* kModes[] = {
+        "receive",
+        "capture",
+    };
+
+    for(auto model=0; model<2; ++model)
+    {
+        TimelineResult result;
+        if (!RunTimeline(kTypes[model], result))
+        { return; }
+
+        for(auto j=0; j<2; ++j)
+        {
+            char name[64];
+            sprintf(name, "%s %s", kModelNames[model], kModes[j]);
+            printf("%-24s %12llu %12.1f %12.1f %12.1f %12.1f\n",
+                name,
+                (unsigned long long)result.Reports,
+                result.AvgError[j],
+                result.MaxError[j],
+                result.Bias[j],
+                (j == 0) ? 0.0 : result.Drift);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      ヒストグラムのパーセンタイルを含むバケットの上限値を求めます.
+//-----------------------------------------------------------------------------
+uint64_t GetPercentile(const PadHistogram& histogram, double percent)
+{
+    auto target = uint64_t(double(histogram.Count) * percent / 100.0);
+    auto total  = uint64_t(0);
+    for(auto i=0u; i<kPadHistogramBuckets; ++i)
+    {
+        total += histogram.Buckets[i];
+        if (total > target)
+        { return uint64_t(1) << i; }
+    }
+
+    return uint64_t(1) << kPadHistogramBuckets;
+}
+
+//-----------------------------------------------------------------------------
+//      skip(frame) が真のレポートを欠落させて送信し, 入力統計を取得します.
+//-----------------------------------------------------------------------------
+template<typename Func>
+bool RunInputStats(uint32_t type, uint32_t reportCount, Func skip, PadInputStats& stats, uint32_t& expected, double& snapshotNs)
+{
+    FakePad pad;
+    if (!OpenFakePad("libds4_bench_stats", pad, type))
+    {
+        ReportFailure("failed to open fake pad.");
+        return false;
+    }
+
+    PadRawInput discard[8];
+    while(PadReadBatch(pad.pHandle, discard, 8) > 0)
+    { /* DO_NOTHING */ }
+
+    PadEnableReaderThread(pad.pHandle, true);
+
+    expected = 0;
+    for(auto frame=0u; frame<reportCount; ++frame)
+    {
+        if (skip(frame))
+        { expected++; }
+    }
+
+    auto writer = std::thread([&]()
+    {
+        auto next = std::chrono::steady_clock::now();
+        for(auto frame=0u; frame<reportCount; ++frame)
+        {
+            if (skip(frame))
+            { continue; }
+
+            uint8_t bytes[64] = {};
+            bytes[0] = 0x01;
+            if ((type & PAD_CONNECTION_DUAL_SENSE) == 0)
+            {
+                auto count = uint16_t(frame * 3000 / 16);
+                memcpy(&bytes[10], &count, sizeof(count));
+                bytes[7]  = uint8_t(frame << 2);
+                bytes[35] = 0x80;
+                bytes[39] = 0x80;
+            }
+            else
+            {
+                auto count = uint32_t(frame * 3000);
+                memcpy(&bytes[28], &count, sizeof(count));
+                bytes[7]  = uint8_t(frame);
+                bytes[33] = 0x80;
+                bytes[37] = 0x80;
+            }
+
+            auto ret = write(pad.Writer, bytes, sizeof(bytes));
+            (void)ret;
+
+            if (frame % kReportsPerFrame == kReportsPerFrame - 1)
+            {
+                next += std::chrono::milliseconds(kReportsPerFrame);
+                std::this_thread::sleep_until(next);
+            }
+        }
+    });
+
+    // 240Hzで溜まっているレポートを取り出す.
+    PadRawInput inputs[64];
+    auto consumed = 0u;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(consumed < reportCount - expected && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(4167));
+        consumed += PadReadBatch(pad.pHandle, inputs, 64);
+    }
+    writer.join();
+
+    auto begin = std::chrono::steady_clock::now();
+    for(auto i=0u; i<kStatsSnapshots; ++i)
+    { PadGetInputStats(pad.pHandle, stats); }
+    auto end = std::chrono::steady_clock::now();
+    snapshotNs = double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()) / kStatsSnapshots;
+
+    CloseFakePad(pad);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      欠落検出の計測で欠落させるレポートかどうか判定します.
+//-----------------------------------------------------------------------------
+bool IsStatsSkipFrame(uint32_t frame)
+{
+    // 一定間隔で1つ, 途中で数個と kStatsLongGap 個をまとめて欠落させる.
+    return (frame % 97 == 50)
+        || (frame >= 3000 && frame < 3003)
+        || (frame >= 5000 && frame < 5000 + kStatsLongGap);
+}
+
+//-----------------------------------------------------------------------------
+//      フレームカウンターによる欠落検出とヒストグラムを計測します.
+//-----------------------------------------------------------------------------
+void BenchInputStats()
+{
+    printf("---- Input stats (%u reports, 1 ms/report, 240 Hz consumer) ----\n", kStatsReportCount);
+    printf("%-12s %10s %12s %12s %12s %12s\n",
+        "mode", "reports", "interval p50", "latency p50", "latency p99", "snapshot ns");
+
+    static const uint32_t kTypes[] = {
+        PAD_CONNECTION_USB,
+        PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE,
+    };
+
+    static const char* kModelNames[] = {
+        "DS4",
+        "DualSense",
+    };
+
+    for(auto model=0; model<2; ++model)
+    {
+        PadInputStats stats = {};
+        uint32_t expected;
+        double   snapshotNs;
+        if (!RunInputStats(kTypes[model], kStatsReportCount, IsStatsSkipFrame, stats, expected, snapshotNs))
+        { return; }
+
+        printf("%-12s %10llu %12llu %12llu %12llu %12.1f\n",
+            kModelNames[model],
+            (unsigned long long)stats.Reports,
+            (unsigned long long)GetPercentile(stats.Interval, 50.0),
+            (unsigned long long)GetPercentile(stats.Latency, 50.0),
+            (unsigned long long)GetPercentile(stats.Latency, 99.0),
+            snapshotNs);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// FakeImu structure
+///////////////////////////////////////////////////////////////////////////////
+struct FakeImu
+{
+    int16_t     GyroBias[3];
+    int16_t     GyroPlus[3];
+    int16_t     GyroMinus[3];
+    int16_t     SpeedPlus;
+    int16_t     SpeedMinus;
+    int16_t     AccelPlus[3];
+    int16_t     AccelMinus[3];
+};
+
+//-----------------------------------------------------------------------------
+//      偽パッドの補正データを設定します.
+//-----------------------------------------------------------------------------
+void SetFakeCalibration(const FakeImu& imu, uint32_t type)
+{
+    auto put = [](uint32_t offset, int16_t value)
+    {
+        g_FakeCalibration[offset + 0] = uint8_t(uint16_t(value));
+        g_FakeCalibration[offset + 1] = uint8_t(uint16_t(value) >> 8);
+    };
+
+    // DualShock4 のBluetooth接続とワイヤレスアダプタは正方向と負方向をまとめて並べる.
+    memset(g_FakeCalibration, 0, sizeof(g_FakeCalibration));
+    auto grouped = (type & PAD_CONNECTION_BT) != 0 && (type & PAD_CONNECTION_DUAL_SENSE) == 0;
+    for(auto i=0u; i<3; ++i)
+    {
+        put(1 + i * 2, imu.GyroBias[i]);
+        put(grouped ?  7 + i * 2 :  7 + i * 4, imu.GyroPlus [i]);
+        put(grouped ? 13 + i * 2 :  9 + i * 4, imu.GyroMinus[i]);
+        put(23 + i * 4, imu.AccelPlus [i]);
+        put(25 + i * 4, imu.AccelMinus[i]);
+    }
+    put(19, imu.SpeedPlus);
+    put(21, imu.SpeedMinus);
+}
+
+//-----------------------------------------------------------------------------
+//      除算を使う浮動小数演算で補正します(検証と比較用).
+//-----------------------------------------------------------------------------
+void ReferenceCalibrate(const FakeImu& imu, const PadState& state, float* pGyro, float* pAccel)
+{
+    const int16_t gyro [3] = { state.Gyro.X,  state.Gyro.Y,  state.Gyro.Z  };
+    const int16_t accel[3] = { state.Accel.X, state.Accel.Y, state.Accel.Z };
+    auto speed2x = float(imu.SpeedPlus + imu.SpeedMinus);
+    for(auto i=0; i<3; ++i)
+    {
+        auto range = float(std::abs(imu.GyroPlus[i] - imu.GyroBias[i]) + std::abs(imu.GyroMinus[i] - imu.GyroBias[i]));
+        pGyro[i] = float(gyro[i]) * speed2x / range;
+
+        auto range2g = float(imu.AccelPlus[i] - imu.AccelMinus[i]);
+        auto bias    = float(imu.AccelPlus[i]) - range2g / 2.0f;
+        pAccel[i] = (float(accel[i]) - bias) * 2.0f / range2g;
+    }
+}
+
+static const FakeImu kFakeImu = {
+    {   3,    -5,     2 },
+    { 8800,  8900,  8700 },
+    { -8850, -8760, -8800 },
+    540, 540,
+    { 8200,  8150,  8300 },
+    { -8100, -8250, -8000 },
+};
+
+//-----------------------------------------------------------------------------
+//      補正前のIMUの値を生成します.
+//-----------------------------------------------------------------------------
+void MakeImuStates(PadState* pStates, uint32_t count)
+{
+    uint32_t seed = 12345;
+    for(auto i=0u; i<count; ++i)
+    {
+        auto& state = pStates[i];
+        state = {};
+        state.Type = PAD_CONNECTION_USB;
+        int16_t* values[] = { &state.Gyro.X, &state.Gyro.Y, &state.Gyro.Z, &state.Accel.X, &state.Accel.Y, &state.Accel.Z };
+        for(auto value : values)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            *value = int16_t(seed >> 16);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      偽パッドに補正データを設定して開き, 補正係数を取得します.
+//-----------------------------------------------------------------------------
+bool GetFakeCalibration(uint32_t type, PadCalibration& calibration, bool& calibrated)
+{
+    SetFakeCalibration(kFakeImu, type);
+    g_FakeSerial++;
+
+    FakePad pad;
+    if (!OpenFakePad("libds4_bench_imu", pad, type))
+    {
+        CloseFakePad(pad);
+        return false;
+    }
+
+    calibrated = PadGetCalibration(pad.pHandle, calibration);
+    CloseFakePad(pad);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      除算による浮動小数演算との最大誤差(deg/s, G)を求めます.
+//-----------------------------------------------------------------------------
+void GetCalibrationError(const PadCalibration& calibration, const PadState* pStates, uint32_t count, double& gyroError, double& accelError)
+{
+    gyroError  = 0.0;
+    accelError = 0.0;
+    for(auto i=0u; i<count; ++i)
+    {
+        float gyro[3];
+        float accel[3];
+        ReferenceCalibrate(kFakeImu, pStates[i], gyro, accel);
+
+        PadMotion motion;
+        PadCalibrate(calibration, pStates[i], motion);
+        gyroError  = std::max(gyroError,  double(std::abs(motion.GyroX - gyro[0])));
+        gyroError  = std::max(gyroError,  double(std::abs(motion.GyroY - gyro[1])));
+        gyroError  = std::max(gyroError,  double(std::abs(motion.GyroZ - gyro[2])));
+        accelError = std::max(accelError, double(std::abs(motion.AccelX - accel[0])));
+        accelError = std::max(accelError, double(std::abs(motion.AccelY - accel[1])));
+        accelError = std::max(accelError, double(std::abs(motion.AccelZ - accel[2])));
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      IMU補正の所要時間と補正データのキャッシュを計測します.
+//-----------------------------------------------------------------------------
+void BenchCalibration()
+{
+    printf("---- IMU calibration (%u samples x %u) ----\n", kCalibSampleCount, kCalibPassCount);
+    printf("%-24s %12s\n", "mode", "ns/report");
+
+    static const uint32_t kTypes[] = {
+        PAD_CONNECTION_USB,
+        PAD_CONNECTION_BT,
+        PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE,
+    };
+
+    static const char* kNames[] = {
+        "DS4 USB",
+        "DS4 Bluetooth",
+        "DualSense USB",
+    };
+
+    static PadState states[kCalibSampleCount];
+    MakeImuStates(states, kCalibSampleCount);
+
+    FakeTransportScope transport;
+    g_FakeFeature = true;
+    for(auto model=0; model<3; ++model)
+    {
+        PadCalibration calibration;
+        bool calibrated;
+        if (!GetFakeCalibration(kTypes[model], calibration, calibrated))
+        {
+            printf("%-24s failed to open fake pad.\n", kNames[model]);
+            g_Failures++;
+            continue;
+        }
+
+        for(auto mode=0; mode<2; ++mode)
+        {
+            auto sink = 0.0f;
+            auto begin = std::chrono::steady_clock::now();
+            for(auto pass=0u; pass<kCalibPassCount; ++pass)
+            {
+                for(auto& state : states)
+                {
+                    if (mode == 0)
+                    {
+                        float gyro[3];
+                        float accel[3];
+                        ReferenceCalibrate(kFakeImu, state, gyro, accel);
+                        sink += gyro[0] + gyro[1] + gyro[2] + accel[0] + accel[1] + accel[2];
+                    }
+                    else
+                    {
+                        PadMotion motion;
+                        PadCalibrate(calibration, state, motion);
+                        sink += motion.GyroX + motion.GyroY + motion.GyroZ + motion.AccelX + motion.AccelY + motion.AccelZ;
+                    }
+                }
+            }
+            auto end = std::chrono::steady_clock::now();
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+            char name[64];
+            sprintf(name, "%s %s", kNames[model], (mode == 0) ? "float div" : "PadCalibrate");
+            printf("%-24s %12.2f\n", name, double(elapsed) / (double(kCalibSampleCount) * kCalibPassCount));
+
+            g_Sink = uint32_t(sink);
+        }
+    }
+
+    // 同じデバイスを繋ぎ直した場合はキャッシュを使い, フィーチャーレポートを読み取らない.
+    printf("%-24s %12s %12s %12s\n", "reconnect", "opens", "feature", "us/open");
+    for(auto model=0; model<3; ++model)
+    {
+        SetFakeCalibration(kFakeImu, kTypes[model]);
+        g_FakeSerial++;
+        g_FeatureCount = 0;
+
+        auto elapsed = 0ll;
+        for(auto i=0u; i<kCalibOpenCount; ++i)
+        {
+            FakePad pad;
+            auto begin = std::chrono::steady_clock::now();
+            auto ret = OpenFakePad("libds4_bench_imu", pad, kTypes[model]);
+            auto end = std::chrono::steady_clock::now();
+            elapsed += std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+            CloseFakePad(pad);
+            if (!ret)
+            { break; }
+        }
+
+        printf("%-24s %12u %12u %12.1f\n", kNames[model], kCalibOpenCount, g_FeatureCount.load(),
+            double(elapsed) / kCalibOpenCount);
+    }
+    g_FakeFeature = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Quat structure
+///////////////////////////////////////////////////////////////////////////////
+struct Quat
+{
+    double W, X, Y, Z;
+};
+
+//-----------------------------------------------------------------------------
+//      2つの姿勢のなす角を度で求めます.
+//-----------------------------------------------------------------------------
+double GetAngleError(const Quat& a, const PadQuaternion& b)
+{
+    auto dot = std::abs(a.W * b.W + a.X * b.X + a.Y * b.Y + a.Z * b.Z);
+    return 2.0 * std::acos(std::min(dot, 1.0)) * 180.0 / 3.14159265358979;
+}
+
+//-----------------------------------------------------------------------------
+//      模擬パッドの角速度(deg/s)を求めます.
+//-----------------------------------------------------------------------------
+void GetTrueRate(double t, double* w)
+{
+    const auto pi2 = 2.0 * 3.14159265358979;
+    w[0] = 120.0 * std::sin(pi2 * 0.70 * t);
+    w[1] =  90.0 * std::sin(pi2 * 0.45 * t + 1.0);
+    w[2] = 150.0 * std::sin(pi2 * 1.10 * t);
+}
+
+//-----------------------------------------------------------------------------
+//      模擬パッドの姿勢を dt 秒進めます.
+//-----------------------------------------------------------------------------
+void AdvanceTruth(Quat& q, double t, double dt)
+{
+    // 細かく分割して積分する.
+    const auto steps = 32;
+    const auto h     = dt / steps;
+    for(auto i=0; i<steps; ++i)
+    {
+        double w[3];
+        GetTrueRate(t + (i + 0.5) * h, w);
+        auto x = w[0] * 3.14159265358979 / 180.0 * 0.5 * h;
+        auto y = w[1] * 3.14159265358979 / 180.0 * 0.5 * h;
+        auto z = w[2] * 3.14159265358979 / 180.0 * 0.5 * h;
+
+        Quat r = {
+            q.W - q.X * x - q.Y * y - q.Z * z,
+            q.X + q.W * x + q.Y * z - q.Z * y,
+            q.Y + q.W * y - q.X * z + q.Z * x,
+            q.Z + q.W * z + q.X * y - q.Y * x,
+        };
+        auto n = std::sqrt(r.W * r.W + r.X * r.X + r.Y * r.Y + r.Z * r.Z);
+        q = { r.W / n, r.X / n, r.Y / n, r.Z / n };
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      姿勢 q のパッドが静止状態で計測する加速度(G, 上向きが正)を求めます.
+//-----------------------------------------------------------------------------
+void GetTrueAccel(const Quat& q, double* a)
+{
+    // 鉛直上向き(0, 1, 0)をパッドの座標系に変換する.
+    a[0] = 2.0 * (q.X * q.Y + q.W * q.Z);
+    a[1] = q.W * q.W - q.X * q.X + q.Y * q.Y - q.Z * q.Z;
+    a[2] = 2.0 * (q.Y * q.Z - q.W * q.X);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// FusionRecording structure
+///////////////////////////////////////////////////////////////////////////////
+struct FusionRecording
+{
+    std::vector<Quat>           Truth;      // 真の姿勢.
+    std::vector<PadMotion>      Motions;    // 送信したIMUの値(単位変換済み).
+    std::vector<PadQuaternion>  Fused;      // 受信スレッドで推定した姿勢.
+};
+
+//-----------------------------------------------------------------------------
+//      回転する偽パッドのIMUの値を1ms間隔で送信し, 受信スレッドで推定した姿勢を記録します.
+//-----------------------------------------------------------------------------
+bool RecordFusion(FusionRecording& recording)
+{
+    const auto count = kFusionFrameCount * kReportsPerFrame;
+    recording.Truth  .assign(count, Quat());
+    recording.Motions.assign(count, PadMotion());
+    recording.Fused  .assign(count, PadQuaternion());
+
+    FakePad pad;
+    if (!OpenFakePad("libds4_bench_fusion", pad, PAD_CONNECTION_USB))
+    {
+        ReportFailure("failed to open fake pad.");
+        CloseFakePad(pad);
+        return false;
+    }
+    PadEnableFusion(pad.pHandle, true);
+
+    // 少し傾けた状態から開始する.
+    Quat q = { std::cos(0.3), std::sin(0.3), 0.0, 0.0 };
+    auto ticks = 0.0;
+    auto index = 0u;
+    for(auto frame=0u; frame<kFusionFrameCount; ++frame)
+    {
+        for(auto i=0u; i<kReportsPerFrame; ++i, ++index)
+        {
+            auto t = index * 0.001;
+            if (index > 0)
+            { AdvanceTruth(q, t - 0.001, 0.001); }
+            recording.Truth[index] = q;
+
+            double w[3];
+            double a[3];
+            GetTrueRate(t, w);
+            GetTrueAccel(q, a);
+
+            uint8_t bytes[64] = {};
+            bytes[0]  = 0x01;
+            bytes[7]  = uint8_t(index << 2);
+            bytes[35] = 0x80;
+            bytes[39] = 0x80;
+
+            // タイムスタンプは16/3マイクロ秒単位.
+            auto stamp = uint16_t(uint64_t(ticks));
+            bytes[10] = uint8_t(stamp);
+            bytes[11] = uint8_t(stamp >> 8);
+            ticks += 1000.0 * 3.0 / 16.0;
+
+            int16_t raw[6];
+            for(auto j=0; j<3; ++j)
+            {
+                raw[j + 0] = int16_t(std::lround(w[j] * 16.0));
+                raw[j + 3] = int16_t(std::lround(a[j] * 8192.0));
+            }
+            for(auto j=0; j<6; ++j)
+            {
+                bytes[13 + j * 2] = uint8_t(uint16_t(raw[j]));
+                bytes[14 + j * 2] = uint8_t(uint16_t(raw[j]) >> 8);
+            }
+
+            recording.Motions[index] = PadMotion{
+                raw[0] / 16.0f,   raw[1] / 16.0f,   raw[2] / 16.0f,
+                raw[3] / 8192.0f, raw[4] / 8192.0f, raw[5] / 8192.0f };
+
+            auto ret = write(pad.Writer, bytes, sizeof(bytes));
+            (void)ret;
+        }
+
+        PadRawInput inputs[kReportsPerFrame];
+        auto read = PadReadBatch(pad.pHandle, inputs, kReportsPerFrame);
+        for(auto i=0u; i<read; ++i)
+        { recording.Fused[frame * kReportsPerFrame + i] = inputs[i].Orientation; }
+    }
+    CloseFakePad(pad);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      step 個おきに推定した姿勢と真の姿勢の誤差(度)を求めます.
+//-----------------------------------------------------------------------------
+void GetFusionError(const std::vector<Quat>& truth, const std::vector<PadQuaternion>& values, uint32_t step, double& avg, double& max)
+{
+    auto sum = 0.0;
+    auto num = 0u;
+    max = 0.0;
+    for(auto i=step - 1; i<truth.size(); i += step)
+    {
+        auto error = GetAngleError(truth[i], values[i / step]);
+        sum += error;
+        max  = std::max(max, error);
+        num++;
+    }
+    avg = (num > 0) ? sum / num : 0.0;
+}
+
+//-----------------------------------------------------------------------------
+//      記録したIMUの値を PadFuseBatch() でまとめて推定します.
+//-----------------------------------------------------------------------------
+void FuseRecording(const std::vector<PadMotion>& motions, uint32_t step, std::vector<PadQuaternion>& results)
+{
+    // step 個おきの値だけを使う場合はアプリケーションのフレームごとの推定に相当する.
+    std::vector<PadMotion> picked;
+    for(auto i=step - 1; i<motions.size(); i += step)
+    { picked.push_back(motions[i]); }
+
+    std::vector<float> deltas(picked.size(), step * 0.001f);
+    results.assign(picked.size(), PadQuaternion());
+
+    PadMotionStream stream = {};
+    stream.pMotions      = picked.data();
+    stream.pDeltaTimes   = deltas.data();
+    stream.pOrientations = results.data();
+    stream.Count         = uint32_t(picked.size());
+    PadFuseBatch(0.1f, &stream, 1);
+}
+
+//-----------------------------------------------------------------------------
+//      複数の記録を PadFuseBatch() でまとめて推定し, 処理したサンプル数を返却します.
+//-----------------------------------------------------------------------------
+uint32_t FuseStreams(std::vector<PadMotion>& motions, std::vector<float>& deltas, std::vector<PadQuaternion>& results)
+{
+    // 端数の処理を確認するため, 記録ごとに長さを変える.
+    PadMotionStream streams[kFusionStreams];
+    for(auto i=0u; i<kFusionStreams; ++i)
+    {
+        streams[i] = {};
+        streams[i].pMotions      = &motions[size_t(i) * kFusionSamples];
+        streams[i].pDeltaTimes   = &deltas [size_t(i) * kFusionSamples];
+        streams[i].pOrientations = &results[size_t(i) * kFusionSamples];
+        streams[i].Count         = kFusionSamples - (i % 5);
+    }
+    return PadFuseBatch(0.1f, streams, kFusionStreams);
+}
+
+//-----------------------------------------------------------------------------
+//      一括姿勢推定用の複数の記録を作成します.
+//-----------------------------------------------------------------------------
+void MakeFusionStreams(const std::vector<PadMotion>& source, std::vector<PadMotion>& motions, std::vector<float>& deltas)
+{
+    motions.resize(size_t(kFusionStreams) * kFusionSamples);
+    deltas.assign(motions.size(), 0.001f);
+    for(auto i=0u; i<motions.size(); ++i)
+    { motions[i] = source[(i * 7 + i / kFusionSamples * 131) % source.size()]; }
+}
+
+//-----------------------------------------------------------------------------
+//      一括姿勢推定のスカラー実装とSIMD実装の所要時間を比較します.
+//-----------------------------------------------------------------------------
+void BenchFusion()
+{
+    printf("---- Orientation fusion (%u streams x %u samples) ----\n", kFusionStreams, kFusionSamples);
+    printf("%-28s %12s %12s\n", "mode", "samples", "ns/sample");
+
+    FusionRecording recording;
+    if (!RecordFusion(recording))
+    { return; }
+
+    std::vector<PadMotion>      motions;
+    std::vector<float>          deltas;
+    std::vector<PadQuaternion>  results(size_t(kFusionStreams) * kFusionSamples);
+    MakeFusionStreams(recording.Motions, motions, deltas);
+
+    const auto simd = PadGetSimdLevel();
+    for(auto mode=0; mode<2; ++mode)
+    {
+        PadSetSimdLevel((mode == 0) ? PAD_SIMD_NONE : simd);
+
+        auto elapsed = 0ll;
+        auto samples = 0u;
+        for(auto pass=0u; pass<kFusionPassCount; ++pass)
+        {
+            auto begin = std::chrono::steady_clock::now();
+            samples = FuseStreams(motions, deltas, results);
+            auto end = std::chrono::steady_clock::now();
+            elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+        }
+
+        char name[64];
+        sprintf(name, "%u streams %s", kFusionStreams, (mode == 0) ? "scalar" : "SIMD");
+        printf("%-28s %12u %12.2f\n", name, samples, double(elapsed) / (double(samples) * kFusionPassCount));
+    }
+    PadSetSimdLevel(simd);
+}
+
+//-----------------------------------------------------------------------------
+//      プロセスの書き込みシステムコール回数を取得します.
+//-----------------------------------------------------------------------------
+uint64_t GetWriteSyscalls()
+{
+    // 標準ライブラリ内部の write() は差し替えられないので, カーネルの集計を使う.
+    auto pFile = fopen("/proc/self/io", "r");
+    if (pFile == nullptr)
+    { return 0; }
+
+    unsigned long long result = 0;
+    char line[128];
+    while(fgets(line, sizeof(line), pFile) != nullptr)
+    {
+        if (sscanf(line, "syscw: %llu", &result) == 1)
+        { break; }
+    }
+    fclose(pFile);
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      キャプチャファイルを読み込み, 受信したレポートと一致しないレコード数を返却します.
+//-----------------------------------------------------------------------------
+uint32_t VerifyCapture(const char* path, const std::vector<PadRawInput>& inputs, uint32_t type, uint32_t& chunks)
+{
+    chunks = 0;
+
+    auto pFile = fopen(path, "rb");
+    if (pFile == nullptr)
+    { return uint32_t(inputs.size()); }
+
+    std::vector<uint8_t> bytes;
+    uint8_t block[4096];
+    size_t size;
+    while((size = fread(block, 1, sizeof(block), pFile)) > 0)
+    { bytes.insert(bytes.end(), block, block + size); }
+    fclose(pFile);
+
+    PadCaptureHeader header;
+    if (bytes.size() < sizeof(header))
+    { return uint32_t(inputs.size()); }
+
+    memcpy(&header, bytes.data(), sizeof(header));
+    if (header.Magic != kPadCaptureMagic || header.Version != kPadCaptureVersion || header.Type != type)
+    { return uint32_t(inputs.size()); }
+
+    // 索引をたどってレコードを比較する. 最後以外のチャンクは固定サイズ.
+    auto mismatch = 0u;
+    auto record   = 0u;
+    auto offset   = size_t(header.HeaderSize);
+    auto full     = size_t(header.RecordStride) * header.ChunkSize + sizeof(PadCaptureIndex);
+    while(offset < bytes.size())
+    {
+        auto count = uint32_t(std::min<size_t>((bytes.size() - offset - sizeof(PadCaptureIndex)) / header.RecordStride, header.ChunkSize));
+
+        PadCaptureIndex index;
+        memcpy(&index, &bytes[offset + size_t(count) * header.RecordStride], sizeof(index));
+        if (index.Magic != kPadCaptureIndexMagic || index.Count != count || index.FirstRecord != record)
+        { return uint32_t(inputs.size()); }
+
+        for(auto i=0u; i<count; ++i, ++record)
+        {
+            auto pRecord = &bytes[offset + size_t(i) * header.RecordStride];
+            uint64_t hostTime;
+            memcpy(&hostTime, pRecord, sizeof(hostTime));
+
+            if (record >= inputs.size()
+             || hostTime != inputs[record].HostTime
+             || memcmp(pRecord + sizeof(hostTime), inputs[record].Bytes, header.ReportSize) != 0
+             || (i == 0 && hostTime != index.FirstTime)
+             || (i == count - 1 && hostTime != index.LastTime))
+            { mismatch++; }
+        }
+
+        chunks++;
+        offset += (count == header.ChunkSize) ? full : size_t(count) * header.RecordStride + sizeof(PadCaptureIndex);
+    }
+
+    return mismatch + uint32_t(inputs.size() - std::min<size_t>(record, inputs.size()));
+}
+
+//-----------------------------------------------------------------------------
+//      偽パッドへ1ms間隔で連番のレポートを送信します.
+//-----------------------------------------------------------------------------
+void WriteNumberedReports(int writer, uint32_t count)
+{
+    auto next = std::chrono::steady_clock::now();
+    for(auto frame=0u; frame<count; ++frame)
+    {
+        uint8_t bytes[64] = {};
+        bytes[0] = 0x01;
+        bytes[1] = uint8_t(frame);
+        bytes[2] = uint8_t(frame >> 8);
+        bytes[7] = uint8_t(frame << 2);
+        bytes[35] = 0x80;
+        bytes[39] = 0x80;
+        auto ret = write(writer, bytes, sizeof(bytes));
+        (void)ret;
+
+        if (frame % kReportsPerFrame == kReportsPerFrame - 1)
+        {
+            next += std::chrono::milliseconds(kReportsPerFrame);
+            std::this_thread::sleep_until(next);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      240Hzのゲームループを模擬して count 個のレポートを受信します.
+//-----------------------------------------------------------------------------
+void ReceiveReports(PadHandle* pHandle, uint32_t count, std::vector<PadRawInput>& received)
+{
+    received.clear();
+    received.reserve(count);
+
+    PadRawInput inputs[64];
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while(received.size() < count && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(4167));
+        auto result = PadReadBatch(pHandle, inputs, 64);
+        received.insert(received.end(), inputs, inputs + result);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      キャプチャの有無による入力遅延と書き込み回数を比較します.
+//-----------------------------------------------------------------------------
+void BenchCapture()
+{
+    printf("---- Capture (%u reports, 1 ms/report, 240 Hz consumer) ----\n", kCaptureReports);
+    printf("%-12s %10s %12s %12s %12s\n",
+        "mode", "reports", "extra writes", "latency p50", "latency p99");
+
+    for(auto mode=0; mode<2; ++mode)
+    {
+        FakePad pad;
+        if (!OpenFakePad("libds4_bench_capture", pad))
+        {
+            ReportFailure("failed to open fake pad.");
+            return;
+        }
+
+        PadRawInput discard[8];
+        while(PadReadBatch(pad.pHandle, discard, 8) > 0)
+        { /* DO_NOTHING */ }
+
+        PadEnableReaderThread(pad.pHandle, true);
+        if (mode == 1 && !PadStartCapture(pad.pHandle, kCapturePath))
+        {
+            ReportFailure("failed to start capture.");
+            CloseFakePad(pad);
+            return;
+        }
+
+        auto syscalls = GetWriteSyscalls();
+
+        std::vector<PadRawInput> received;
+        auto writer = std::thread([&]() { WriteNumberedReports(pad.Writer, kCaptureReports); });
+        ReceiveReports(pad.pHandle, kCaptureReports, received);
+        writer.join();
+
+        // FIFOへの送信分を除いた書き込み回数(記録の終了時の書き込みは含まない).
+        auto writes = uint32_t(GetWriteSyscalls() - syscalls - kCaptureReports);
+
+        PadInputStats stats = {};
+        PadGetInputStats(pad.pHandle, stats);
+
+        if (mode == 1)
+        {
+            PadStopCapture(pad.pHandle);
+            unlink(kCapturePath);
+        }
+
+        printf("%-12s %10u %12u %12llu %12llu\n",
+            (mode == 0) ? "off" : "on",
+            uint32_t(received.size()), writes,
+            (unsigned long long)GetPercentile(stats.Latency, 50.0),
+            (unsigned long long)GetPercentile(stats.Latency, 99.0));
+
+        CloseFakePad(pad);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      検証用にビット単位でCRC32を計算します.
+//-----------------------------------------------------------------------------
+uint32_t ReferenceCrc32(uint8_t seed, const uint8_t* pBytes, size_t size)
+{
+    uint32_t crc = 0xffffffffu;
+    for(size_t i=0; i<=size; ++i)
+    {
+        crc ^= (i == 0) ? seed : pBytes[i - 1];
+        for(auto j=0; j<8; ++j)
+        { crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1u))); }
+    }
+    return ~crc;
+}
+
+//-----------------------------------------------------------------------------
+//      接続タイプに応じた入力レポートを生成し, サイズを返却します.
+//-----------------------------------------------------------------------------
+uint32_t MakeInputReport(uint32_t type, uint8_t (&bytes)[78])
+{
+    memset(bytes, 0, sizeof(bytes));
+    if ((type & kPadConnectionMask) != PAD_CONNECTION_BT)
+    {
+        bytes[0] = 0x01;
+        return 64;
+    }
+
+    // Bluetoothは末尾にCRC32(シード 0xA1)が付く.
+    bytes[0] = (type & PAD_CONNECTION_DUAL_SENSE) ? 0x31 : 0x11;
+    auto crc = ReferenceCrc32(0xa1, bytes, 74);
+    memcpy(&bytes[74], &crc, sizeof(crc));
+    return 78;
+}
+
+//-----------------------------------------------------------------------------
+//      USB と Bluetooth(CRC32検証あり)の読み取り時間を比較します.
+//-----------------------------------------------------------------------------
+void BenchBluetoothRead()
+{
+    printf("---- USB vs Bluetooth input (%u reports) ----\n", kCrcReportCount);
+    printf("%-24s %12s %12s\n", "mode", "reports", "ns/report");
+
+    static const char* kNames[] = {
+        "USB 0x01 (64 bytes)",
+        "BT 0x11 (78 bytes+CRC)",
+        "BT 0x31 (78 bytes+CRC)",
+    };
+    static const uint32_t kTypes[] = {
+        PAD_CONNECTION_USB,
+        PAD_CONNECTION_BT,
+        PAD_CONNECTION_BT | PAD_CONNECTION_DUAL_SENSE,
+    };
+
+    for(auto mode=0; mode<3; ++mode)
+    {
+        FakePad pad;
+        auto type = kTypes[mode];
+        if (!OpenFakePad("libds4_bench_bt", pad, type))
+        {
+            ReportFailure("failed to open fake pad.");
+            return;
+        }
+
+        uint8_t bytes[78];
+        auto size = MakeInputReport(type, bytes);
+
+        PadRawInput inputs[64];
+        PadState    state;
+        uint64_t    received = 0;
+        uint64_t    elapsed  = 0;
+
+        for(auto sent=0u; sent<kCrcReportCount; sent+=kReportsPerFrame)
+        {
+            for(auto i=0u; i<kReportsPerFrame; ++i)
+            {
+                auto ret = write(pad.Writer, bytes, size);
+                (void)ret;
+            }
+
+            auto begin = std::chrono::steady_clock::now();
+            auto count = PadReadBatch(pad.pHandle, inputs, 64);
+            for(auto i=0u; i<count; ++i)
+            { PadMap(&inputs[i], state); }
+            auto end = std::chrono::steady_clock::now();
+
+            received += count;
+            elapsed  += std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+        }
+
+        printf("%-24s %12llu %12.1f\n",
+            kNames[mode],
+            (unsigned long long)received,
+            (received > 0) ? double(elapsed) / received : 0.0);
+
+        CloseFakePad(pad);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      偽のsysfsツリーにhidrawデバイスを追加します.
+//-----------------------------------------------------------------------------
+void AddFakeNode(uint32_t index, const char* hidId, bool pad)
+{
+    auto name = "hidraw" + std::to_string(index);
+    auto node = std::string(kFakeRoot) + "/dev/" + name;
+    auto dir  = std::string(kFakeRoot) + "/sys/class/hidraw/" + name;
+
+    if (pad)
+    { mkfifo(node.c_str(), 0600); }
+    else
+    { close(open(node.c_str(), O_CREAT | O_WRONLY, 0600)); }
+
+    mkdir(dir.c_str(), 0700);
+    mkdir((dir + "/device").c_str(), 0700);
+
+    auto file = fopen((dir + "/device/uevent").c_str(), "w");
+    if (file != nullptr)
+    {
+        fprintf(file, "DRIVER=hid-generic\nHID_ID=%s\nHID_NAME=fake\n", hidId);
+        fclose(file);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      偽のsysfsツリーを削除します.
+//-----------------------------------------------------------------------------
+void RemoveFakeTree()
+{
+    auto command = std::string("rm -rf ") + kFakeRoot;
+    auto ret = system(command.c_str());
+    (void)ret;
+}
+
+//-----------------------------------------------------------------------------
+//      最初のパッドを開くまでの時間を計測します.
+//-----------------------------------------------------------------------------
+void BenchStartup()
+{
+    printf("---- Time to first pad (%u decoy HID nodes) ----\n", kDecoyCount);
+    printf("%-24s %12s %12s %12s\n", "mode", "found", "open/op", "us/op");
+
+    RemoveFakeTree();
+    auto root = std::string(kFakeRoot);
+    mkdir(root.c_str(), 0700);
+    mkdir((root + "/dev").c_str(), 0700);
+    mkdir((root + "/sys").c_str(), 0700);
+    mkdir((root + "/sys/class").c_str(), 0700);
+    mkdir((root + "/sys/class/hidraw").c_str(), 0700);
+
+    // パッドは最後に列挙される.
+    for(auto i=0u; i<kDecoyCount; ++i)
+    { AddFakeNode(i, "0003:0000046D:0000C52B", false); }
+    AddFakeNode(kDecoyCount, "0003:0000054C:000005C4", true);
+
+    static const char* kNames[] = {
+        "open every node",
+        "sysfs VID/PID filter",
+    };
+
+    FakeTransportScope transport;
+    for(auto mode=0; mode<2; ++mode)
+    {
+        // sysfsが存在しない場合は全てのノードを開いて判定する.
+        // FIFOはHIDIOCGRAWINFOに応答しないため, この場合パッドは見つからない.
+        auto sysfs = root + ((mode == 0) ? "/none" : "/sys");
+        PadSetDeviceRoot((root + "/dev").c_str(), sysfs.c_str());
+
+        uint32_t found   = 0;
+        uint64_t elapsed = 0;
+        g_OpenCount = 0;
+
+        for(auto i=0u; i<kStartupCount; ++i)
+        {
+            PadHandle* pHandle = nullptr;
+
+            auto begin = std::chrono::steady_clock::now();
+            auto ret   = PadOpen(&pHandle);
+            auto end   = std::chrono::steady_clock::now();
+            elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+            if (ret)
+            {
+                found++;
+                PadClose(pHandle);
+            }
+        }
+
+        printf("%-24s %12u %12.1f %12.2f\n",
+            kNames[mode],
+            found,
+            double(g_OpenCount.load()) / kStartupCount,
+            double(elapsed) / kStartupCount / 1000.0);
+    }
+
+    PadSetDeviceRoot(nullptr, nullptr);
+    RemoveFakeTree();
+}
+
+//-----------------------------------------------------------------------------
+//      同期書き込みと非同期書き込みの設定関数の所要時間を比較します.
+//-----------------------------------------------------------------------------
+void BenchAsyncOutput()
+{
+    printf("---- Sync vs async output (%u us/write, %u frames) ----\n", kSlowWriteCost, kOutputFrameCount);
+    printf("%-24s %12s %12s %12s %12s %12s\n", "mode", "writes", "coalesced", "set us/frame", "avg lat us", "max lat us");
+
+    static const char* kNames[] = {
+        "sync",
+        "async",
+    };
+
+    FakeTransportScope transport;
+    for(auto mode=0; mode<2; ++mode)
+    {
+        FakePad pad;
+        if (!OpenFakePad("libds4_bench_write", pad))
+        {
+            ReportFailure("failed to open fake pad.");
+            return;
+        }
+
+        if (mode == 1)
+        { PadEnableAsyncOutput(pad.pHandle, true); }
+
+        g_SlowWrite = true;
+
+        uint64_t elapsed = 0;
+        for(auto frame=0u; frame<kOutputFrameCount; ++frame)
+        {
+            // 毎フレーム振動とライトバーカラーを変更する.
+            PadVibrationParam vibration = { uint8_t(frame), uint8_t(frame) };
+            PadColor          color     = { uint8_t(frame), 0, uint8_t(255 - frame) };
+
+            auto begin = std::chrono::steady_clock::now();
+            PadSetVibration(pad.pHandle, vibration);
+            PadSetLightBarColor(pad.pHandle, color);
+            auto end = std::chrono::steady_clock::now();
+            elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        // 書き込みスレッドの送信完了を待つ.
+        PadEnableAsyncOutput(pad.pHandle, false);
+        PadFlushOutput(pad.pHandle);
+        g_SlowWrite = false;
+
+        PadIoStats stats = {};
+        PadGetIoStats(pad.pHandle, stats);
+        printf("%-24s %12llu %12llu %12.1f %12.1f %12llu\n",
+            kNames[mode],
+            (unsigned long long)stats.WriteCalls,
+            (unsigned long long)stats.Coalesced,
+            double(elapsed) / kOutputFrameCount / 1000.0,
+            (stats.WriteCalls > 0) ? double(stats.WriteLatencySum) / stats.WriteCalls : 0.0,
+            (unsigned long long)stats.WriteLatencyMax);
+
+        CloseFakePad(pad);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      出力レポートの生成と送信(メモリへの書き込み)の所要時間を計測します.
+//-----------------------------------------------------------------------------
+void BenchHotOutput()
+{
+    PrintHotHeader("Hot path: output report builders (in-memory transport)");
+
+    FakeTransportScope transport;
+    for(auto& target : kHotTargets)
+    {
+        FakePad pad;
+        if (!OpenFakePad("libds4_bench_hot", pad, target.Type) || pad.pDevice == nullptr)
+        {
+            ReportFailure("failed to open fake pad.");
+            CloseFakePad(pad);
+            return;
+        }
+
+        // 毎回送信されるようにレート制限を外す.
+        PadSetOutputRate(pad.pHandle, 0);
+
+        MemoryTransport memory;
+        pad.pDevice->pMemory = &memory;
+
+        auto name = std::string("PadSetVibration/") + target.Name;
+        RunHotCase(name.c_str(), kHotOutputCount, [&]()
+        {
+            for(auto i=0u; i<kHotOutputCount; ++i)
+            {
+                PadVibrationParam vibration = { uint8_t(i), uint8_t(~i) };
+                PadSetVibration(pad.pHandle, vibration);
+            }
+            return TakeMemoryWrites(memory);
+        });
+
+        name = std::string("PadSetLightBarColor/") + target.Name;
+        RunHotCase(name.c_str(), kHotOutputCount, [&]()
+        {
+            for(auto i=0u; i<kHotOutputCount; ++i)
+            {
+                PadColor color = { uint8_t(i), uint8_t(i >> 8), uint8_t(~i) };
+                PadSetLightBarColor(pad.pHandle, color);
+            }
+            return TakeMemoryWrites(memory);
+        });
+
+        CloseFakePad(pad);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      メモリ上の転送路から読み取ってマッピングするまでの所要時間を計測します.
+//-----------------------------------------------------------------------------
+void BenchHotRead()
+{
+    PrintHotHeader("Hot path: read -> map (in-memory transport)");
+
+    std::vector<PadRawInput> inputs(kHotReadPool);
+    std::vector<uint8_t>     bytes;
+
+    FakeTransportScope transport;
+    for(auto& target : kHotTargets)
+    {
+        FakePad pad;
+        if (!OpenFakePad("libds4_bench_hot", pad, target.Type) || pad.pDevice == nullptr)
+        {
+            ReportFailure("failed to open fake pad.");
+            CloseFakePad(pad);
+            return;
+        }
+
+        // Bluetoothのレポートは検証を通るようにCRC32を付加する.
+        auto bluetooth = (target.Type & 0x0f) == PAD_CONNECTION_BT;
+        auto size      = bluetooth ? 78u : 64u;
+        MakeHotInputs(inputs.data(), kHotReadPool, target.Type);
+        bytes.resize(size_t(size) * kHotReadPool);
+        for(auto i=0u; i<kHotReadPool; ++i)
+        {
+            auto pBytes = &bytes[size_t(i) * size];
+            memcpy(pBytes, inputs[i].Bytes, size);
+            if (bluetooth)
+            {
+                auto crc = ReferenceCrc32(0xa1, pBytes, 74);
+                memcpy(&pBytes[74], &crc, sizeof(crc));
+            }
+        }
+
+        MemoryTransport memory;
+        memory.pBytes = bytes.data();
+        memory.Size   = size;
+        memory.Count  = kHotReadPool;
+        pad.pDevice->pMemory = &memory;
+
+        // 1フレーム分のレポートをまとめて読み取る.
+        auto name = std::string("PadReadBatch+PadMap/") + target.Name;
+        RunHotCase(name.c_str(), kHotReadFrames, [&]()
+        {
+            PadRawInput results[64];
+            PadState    state;
+            uint64_t    reports = 0;
+            uint32_t    sink    = 0;
+            for(auto frame=0u; frame<kHotReadFrames; ++frame)
+            {
+                SetMemoryPending(memory, kReportsPerFrame);
+                auto count = PadReadBatch(pad.pHandle, results, 64);
+                for(auto i=0u; i<count; ++i)
+                {
+                    PadMap(&results[i], state);
+                    sink += state.Buttons;
+                }
+                reports += count;
+            }
+            g_Sink = sink;
+            return reports;
+        });
+
+        // 1レポートずつ読み取る.
+        name = std::string("PadGetState/") + target.Name;
+        RunHotCase(name.c_str(), kHotReadFrames, [&]()
+        {
+            PadState state;
+            uint64_t reports = 0;
+            uint32_t sink    = 0;
+            for(auto frame=0u; frame<kHotReadFrames; ++frame)
+            {
+                SetMemoryPending(memory, 1);
+                if (PadGetState(pad.pHandle, state))
+                {
+                    sink += state.Buttons;
+                    reports++;
+                }
+            }
+            g_Sink = sink;
+            return reports;
+        });
+
+        CloseFakePad(pad);
+    }
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Tests
+///////////////////////////////////////////////////////////////////////////////
+
+//-----------------------------------------------------------------------------
+//      接続タイプごとにビューとデコーダーが同じレポートを受け付けるか確認します.
+//-----------------------------------------------------------------------------
+void TestReportView()
+{
+    printf("---- Test: report view and decoders ----\n");
+    auto failures = g_Failures;
+
+    struct Case
+    {
+        uint32_t    Type;
+        uint8_t     ReportId;
+    };
+
+    static const Case kSupported[] = {
+        { PAD_CONNECTION_USB,                                   0x01 },
+        { PAD_CONNECTION_BT,                                    0x11 },
+        { PAD_CONNECTION_WIRELESS,                              0x01 },
+        { PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE,       0x01 },
+        { PAD_CONNECTION_BT  | PAD_CONNECTION_DUAL_SENSE,       0x31 },
+    };
+
+    PadRawInput inputs[64];
+    for(auto& item : kSupported)
+    {
+        MakeRandomInputs(inputs, 64, item.Type);
+
+        auto mismatch = 0u;
+        for(auto& input : inputs)
+        {
+            input.Bytes[0] = item.ReportId;
+            if (!IsViewEqualToMap(input))
+            { mismatch++; }
+        }
+        Expect(PadIsSupportedType(item.Type), "connection type is supported");
+        Expect(mismatch == 0, "PadReportView matches PadMap");
+    }
+
+    // DualSense のワイヤレスアダプタなど, 存在しない組み合わせはどちらも受け付けない.
+    static const uint32_t kUnsupported[] = {
+        PAD_CONNECTION_NONE,
+        PAD_CONNECTION_DUAL_SENSE,
+        PAD_CONNECTION_WIRELESS | PAD_CONNECTION_DUAL_SENSE,
+        4,
+        kPadConnectionMask,
+    };
+
+    for(auto type : kUnsupported)
+    {
+        MakeRandomInputs(inputs, 1, type);
+
+        PadState state;
+        Expect(!PadIsSupportedType(type), "connection type is not supported");
+        Expect(!PadReportView(inputs[0]).IsValid(), "PadReportView rejects the type");
+        Expect(!PadMap(&inputs[0], state), "PadMap rejects the type");
+    }
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      PadMapBatch() が全ての命令セットで PadMap() と同じ値を返すか確認します.
+//-----------------------------------------------------------------------------
+void TestMapBatch()
+{
+    printf("---- Test: PadMapBatch ----\n");
+    auto failures = g_Failures;
+
+    // SIMD命令で処理しきれない端数が残る数にする.
+    static const uint32_t kCount = 1031;
+
+    std::vector<PadRawInput> inputs(kCount);
+    StateArrays              arrays;
+
+    const auto supported = PadGetSimdLevel();
+    for(auto type : kBatchTypes)
+    {
+        MakeBatchInputs(inputs.data(), kCount, type);
+        for(auto level=0; level<=int(supported); ++level)
+        {
+            PadSetSimdLevel(PAD_SIMD_LEVEL(level));
+
+            auto stream = arrays.Bind(kCount);
+            auto mapped = PadMapBatch(inputs.data(), kCount, stream);
+
+            auto valid = 0u;
+            for(auto i=0u; i<kCount; ++i)
+            { valid += stream.Valid[i]; }
+
+            Expect(mapped == valid, "PadMapBatch returns the number of mapped reports");
+            Expect(CountBatchMismatch(inputs.data(), kCount, stream) == 0, "PadMapBatch is bit-exact with PadMap");
+        }
+    }
+    PadSetSimdLevel(supported);
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      PadDiff() が手書きの比較と同じ結果になるか確認します.
+//-----------------------------------------------------------------------------
+void TestDiff()
+{
+    printf("---- Test: PadDiff ----\n");
+    auto failures = g_Failures;
+
+    static const uint32_t kTypes[] = {
+        PAD_CONNECTION_USB,
+        PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE,
+    };
+
+    std::vector<PadRawInput> inputs(kDiffReportCount);
+    for(auto type : kTypes)
+    {
+        for(auto scenario=0; scenario<3; ++scenario)
+        {
+            MakeDiffInputs(inputs.data(), kDiffReportCount, type, scenario);
+            Expect(CountDiffMismatch(inputs.data(), kDiffReportCount) == 0, "PadDiff matches the field comparison");
+        }
+    }
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      整形テーブルによるスティック整形が浮動小数演算と一致するか確認します.
+//-----------------------------------------------------------------------------
+void TestStickShaping()
+{
+    printf("---- Test: stick shaping ----\n");
+    auto failures = g_Failures;
+
+    PadStickTable* pTable = nullptr;
+    if (!PadStickTableOpen(kStickProfile, &pTable))
+    {
+        ReportFailure("failed to open stick table.");
+        return;
+    }
+
+    std::vector<uint8_t> sticksX(kStickSampleCount);
+    std::vector<uint8_t> sticksY(kStickSampleCount);
+    std::vector<int16_t> resultX(kStickSampleCount);
+    std::vector<int16_t> resultY(kStickSampleCount);
+    MakeStickSamples(sticksX.data(), sticksY.data(), kStickSampleCount);
+
+    for(auto i=0u; i<kStickSampleCount; ++i)
+    {
+        PadStickVector value;
+        PadShapeStick(pTable, PadAnalogStick{ sticksX[i], sticksY[i] }, value);
+        resultX[i] = value.X;
+        resultY[i] = value.Y;
+    }
+    Expect(CountStickMismatch(sticksX.data(), sticksY.data(), resultX.data(), resultY.data(), kStickSampleCount) == 0,
+        "PadShapeStick matches the float reference");
+
+    // 端数を含む数で, 全ての命令セットを確認する.
+    const auto count     = kStickSampleCount - 5;
+    const auto supported = PadGetSimdLevel();
+    for(auto level=0; level<=int(supported); ++level)
+    {
+        PadSetSimdLevel(PAD_SIMD_LEVEL(level));
+
+        std::fill(resultX.begin(), resultX.end(), int16_t(0x3333));
+        std::fill(resultY.begin(), resultY.end(), int16_t(0x3333));
+        PadShapeSticks(pTable, sticksX.data(), sticksY.data(), count, resultX.data(), resultY.data());
+        Expect(CountStickMismatch(sticksX.data(), sticksY.data(), resultX.data(), resultY.data(), count) == 0,
+            "PadShapeSticks matches the float reference");
+        Expect(resultX[count] == 0x3333 && resultY[count] == 0x3333, "PadShapeSticks writes only count samples");
+    }
+    PadSetSimdLevel(supported);
+
+    PadStickTableClose(pTable);
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      記録したタッチ操作から期待するジェスチャーが認識されるか確認します.
+//-----------------------------------------------------------------------------
+void TestGesture()
+{
+    printf("---- Test: touchpad gesture ----\n");
+    auto failures = g_Failures;
+
+    for(auto model=0; model<2; ++model)
+    {
+        GestureScript script;
+        MakeGestureScript(script, model == 1);
+
+        GestureResult result;
+        RecognizeGestures(script, result);
+
+        // ピンチは距離200から600(3倍), スクロールは300, スワイプは2000/秒.
+        Expect(result.Recognized == "T1 T2 S P S", "recognized gestures");
+        Expect(std::abs(result.PinchScale - 3.0f) < 0.1f, "pinch scale");
+        Expect(std::abs(result.ScrollDelta - 300.0f) < 10.0f, "scroll delta");
+        Expect(std::abs(result.SwipeSpeed - 2000.0f) < 100.0f, "swipe velocity");
+    }
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      キャプチャファイルが記録どおりに再生されるか確認します.
+//-----------------------------------------------------------------------------
+void TestReplay()
+{
+    printf("---- Test: capture replay ----\n");
+    auto failures = g_Failures;
+
+    std::vector<PadRawInput> inputs(kReplayReports);
+    MakeReplayInputs(inputs);
+
+    uint32_t received;
+    double   seconds;
+    if (!WriteCaptureFile(kReplayPath, inputs.data(), kReplayReports, PAD_CONNECTION_USB, false))
+    {
+        ReportFailure("failed to write capture file.");
+        return;
+    }
+    Expect(ReplayCapture(inputs.data(), kReplayReports, 0.0f, received, seconds) == 0, "replay as fast as possible");
+
+    // 索引の無い最後のチャンク.
+    if (!WriteCaptureFile(kReplayPath, inputs.data(), kReplayReports, PAD_CONNECTION_USB, true))
+    {
+        ReportFailure("failed to write capture file.");
+        return;
+    }
+    Expect(ReplayCapture(inputs.data(), kReplayReports, 0.0f, received, seconds) == 0, "replay of a truncated last chunk");
+
+    // 4倍速でも記録の時刻より早く再生しないこと.
+    static const float kSpeed = 4.0f;
+    if (!WriteCaptureFile(kReplayPath, inputs.data(), kReplayPaced, PAD_CONNECTION_USB, false))
+    {
+        ReportFailure("failed to write capture file.");
+        return;
+    }
+    Expect(ReplayCapture(inputs.data(), kReplayPaced, kSpeed, received, seconds) == 0, "paced replay");
+    Expect(seconds >= (kReplayPaced - 1) * 1e-3 / kSpeed * 0.95, "paced replay follows the recorded time");
+
+    remove(kReplayPath);
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      差分符号化したデータが元のレポートに戻るか確認します.
+//-----------------------------------------------------------------------------
+void TestDeltaCodec()
+{
+    printf("---- Test: delta codec ----\n");
+    auto failures = g_Failures;
+
+    // キーフレーム間隔の倍数でない数にする.
+    static const uint32_t kCount = 5000;
+
+    std::vector<PadRawInput> inputs(kCount);
+    std::vector<uint8_t>     encoded(size_t(kCount) * kPadDeltaMaxRecordSize);
+    std::vector<size_t>      keyframes;
+
+    for(auto data=0; data<2; ++data)
+    {
+        MakeDeltaInputs(inputs, data);
+        auto size = EncodeDelta(inputs, kDeltaKeyframe, encoded, keyframes);
+        Expect(CountDeltaMismatch(inputs, encoded, size, keyframes, kDeltaKeyframe) == 0, "delta codec round trip");
+    }
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+#if !defined(_WIN32)
+//-----------------------------------------------------------------------------
+//      読み取り時間をミリ秒単位で計測します.
+//-----------------------------------------------------------------------------
+bool TimedRead(PadHandle* pHandle, PadRawInput& input, double& milliseconds)
+{
+    auto begin = std::chrono::steady_clock::now();
+    auto ret   = PadRead(pHandle, input);
+    auto end   = std::chrono::steady_clock::now();
+    milliseconds = std::chrono::duration<double, std::milli>(end - begin).count();
+    return ret;
+}
+
+//-----------------------------------------------------------------------------
+//      番号付きのUSBレポートを書き込みます.
+//-----------------------------------------------------------------------------
+bool WriteNumberedReport(int fd, uint8_t number)
+{
+    uint8_t bytes[64] = {};
+    bytes[0] = 0x01;
+    bytes[1] = number;
+    bytes[7] = uint8_t(number << 2);
+    return write(fd, bytes, sizeof(bytes)) == ssize_t(sizeof(bytes));
+}
+
+//-----------------------------------------------------------------------------
+//      空のノード, 溜まったレポートの読み取りを確認します.
+//-----------------------------------------------------------------------------
+void CheckBufferedReads(PadHandle* pHandle, int writer)
+{
+    PadRawInput input;
+    double      milliseconds;
+
+    // 空のノードではタイムアウト0なら待機せずに戻る.
+    PadSetReadTimeout(pHandle, 0);
+    Expect(!TimedRead(pHandle, input, milliseconds), "PadRead returns false on an empty node");
+    Expect(milliseconds < 20.0, "PadRead with timeout 0 returns immediately");
+
+    // タイムアウトを指定した場合はその時間だけ待機する.
+    PadSetReadTimeout(pHandle, 50);
+    Expect(!TimedRead(pHandle, input, milliseconds), "PadRead times out on an empty node");
+    Expect(milliseconds >= 40.0, "PadRead waits for the timeout");
+    PadSetReadTimeout(pHandle, 0);
+
+    // 溜まっているレポートは書き込んだ順に読み取れる.
+    for(auto i=0u; i<3; ++i)
+    { Expect(WriteNumberedReport(writer, uint8_t(10 + i)), "write a report to the node"); }
+
+    for(auto i=0u; i<3; ++i)
+    {
+        input = {};
+        Expect(PadRead(pHandle, input) && input.Bytes[1] == 10 + i, "PadRead returns buffered reports in order");
+    }
+    Expect(!PadRead(pHandle, input), "PadRead returns false once the node is drained");
+    Expect(PadIsConnected(pHandle), "pad stays connected while the node is empty");
+}
+
+//-----------------------------------------------------------------------------
+//      ソケットを偽パッドのデバイスとして開きます.
+//-----------------------------------------------------------------------------
+void* SocketOpen(void* pContext, const char*)
+{
+    // ソケットの所有権はデバイスに移る.
+    auto pSocket = static_cast<int*>(pContext);
+    if (*pSocket < 0)
+    { return nullptr; }
+
+    auto pDevice = new FakeDevice();
+    pDevice->Fd  = *pSocket;
+    *pSocket     = -1;
+    return pDevice;
+}
+
+//-----------------------------------------------------------------------------
+//      hidrawの代わりにFIFOとソケットペアで読み取りを確認します.
+//-----------------------------------------------------------------------------
+void TestRead()
+{
+    printf("---- Test: non-blocking reads (FIFO, socketpair) ----\n");
+    auto failures = g_Failures;
+
+    // FIFOはOSのデバイスとして開く.
+    {
+        FakePad pad;
+        if (OpenFakePad("libds4_test_fifo", pad))
+        { CheckBufferedReads(pad.pHandle, pad.Writer); }
+        else
+        { ReportFailure("failed to open fake pad."); }
+        CloseFakePad(pad);
+    }
+
+    // ソケットペアはレポート単位で読み取れ, 相手側を閉じると読み取りが0を返す.
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sockets) != 0)
+    {
+        ReportFailure("failed to create socketpair.");
+        return;
+    }
+
+    auto transport = kFakeTransport;
+    transport.pContext = &sockets[0];
+    transport.Open     = SocketOpen;
+    PadSetTransport(&transport);
+
+    PadHandle* pHandle = nullptr;
+    if (PadOpen("socketpair", PAD_CONNECTION_USB, &pHandle))
+    {
+        CheckBufferedReads(pHandle, sockets[1]);
+
+        // 切断されたら読み取りに失敗し, 未接続になる.
+        WriteNumberedReport(sockets[1], 20);
+        close(sockets[1]);
+        sockets[1] = -1;
+
+        PadRawInput input;
+        Expect(PadRead(pHandle, input) && input.Bytes[1] == 20, "PadRead returns the report sent before EOF");
+        Expect(!PadRead(pHandle, input), "PadRead returns false at EOF");
+        Expect(!PadIsConnected(pHandle), "EOF marks the pad as disconnected");
+        PadClose(pHandle);
+    }
+    else
+    {
+        ReportFailure("failed to open socketpair.");
+    }
+    PadSetTransport(nullptr);
+
+    for(auto fd : sockets)
+    {
+        if (fd >= 0)
+        { close(fd); }
+    }
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      疑似端末をhidrawの代わりとして開きます.
+//-----------------------------------------------------------------------------
+bool OpenPtyPad(int& master, PadHandle*& pHandle)
+{
+    // マスター側を閉じると, スレーブ側はhidrawの抜去と同じくEPOLLHUPとEOFになる.
+    master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0)
+    { return false; }
+
+    if (grantpt(master) != 0 || unlockpt(master) != 0)
+    { return false; }
+
+    // レポートがそのまま届くように行単位の処理とエコーを無効にする.
+    auto path  = std::string(ptsname(master));
+    auto slave = open(path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (slave < 0)
+    { return false; }
+
+    termios attr;
+    auto ret = (tcgetattr(slave, &attr) == 0);
+    if (ret)
+    {
+        cfmakeraw(&attr);
+        ret = (tcsetattr(slave, TCSANOW, &attr) == 0);
+    }
+    close(slave);
+
+    return ret && PadOpen(path.c_str(), PAD_CONNECTION_USB, &pHandle);
+}
+
+//-----------------------------------------------------------------------------
+//      スロットの最新データが指定した番号になるまで待機します.
+//-----------------------------------------------------------------------------
+bool WaitLatest(PadManager* pManager, uint32_t slot, uint8_t number)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while(std::chrono::steady_clock::now() < deadline)
+    {
+        PadRawInput input;
+        if (PadManagerGetRawInput(pManager, slot, input) && input.Bytes[1] == number)
+        { return true; }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+//      パッドマネージャーのスロットごとの受信と切断を確認します.
+//-----------------------------------------------------------------------------
+void TestManager()
+{
+    static const uint32_t kPadCount       = 4;
+    static const uint32_t kSeqlockReports = 20000;
+
+    printf("---- Test: PadManager (%u FIFO pads + 1 pty) ----\n", kPadCount);
+    auto failures = g_Failures;
+
+    // 実機を列挙しないように存在しないディレクトリを探索させる.
+    auto none = std::string(kFakeRoot) + "/none";
+    PadSetDeviceRoot(none.c_str(), none.c_str());
+
+    PadManager* pManager = nullptr;
+    if (!PadManagerOpen(&pManager))
+    {
+        PadSetDeviceRoot(nullptr, nullptr);
+        ReportFailure("failed to open pad manager.");
+        return;
+    }
+    Expect(PadManagerGetCount(pManager) == 0, "no pads are enumerated from an empty tree");
+
+    FakePad pads[kPadCount];
+    for(auto i=0u; i<kPadCount; ++i)
+    {
+        auto name = "libds4_test_manager" + std::to_string(i);
+        if (!OpenFakePad(name.c_str(), pads[i]))
+        {
+            ReportFailure("failed to open fake pad.");
+            continue;
+        }
+
+        // ハンドルの所有権はマネージャーに移る.
+        Expect(PadManagerAdd(pManager, pads[i].pHandle) == int32_t(i), "PadManagerAdd assigns slots in order");
+        pads[i].pHandle = nullptr;
+    }
+    Expect(PadManagerGetCount(pManager) == kPadCount, "PadManagerGetCount counts added pads");
+
+    // 受信前は取得に失敗し, 範囲外のスロットは常に失敗する.
+    PadRawInput input;
+    PadState    state;
+    for(auto i=0u; i<kPadCount; ++i)
+    {
+        Expect(!PadManagerGetRawInput(pManager, i, input), "slot has no input before the first report");
+        Expect(PadManagerIsConnected(pManager, i), "added slot is connected");
+    }
+    Expect(!PadManagerGetRawInput(pManager, kPadCount, input), "out of range slot has no input");
+    Expect(PadManagerGetHandle(pManager, kPadCount) == nullptr, "out of range slot has no handle");
+    Expect(!PadManagerIsConnected(pManager, kPadCount), "out of range slot is not connected");
+
+    // 各スロットには自分のパッドの最新のレポートだけが届く.
+    for(auto i=0u; i<kPadCount; ++i)
+    {
+        for(auto j=0u; j<3; ++j)
+        { WriteNumberedReport(pads[i].Writer, uint8_t(i * 16 + j)); }
+    }
+    for(auto i=0u; i<kPadCount; ++i)
+    {
+        Expect(WaitLatest(pManager, i, uint8_t(i * 16 + 2)), "slot returns the latest report of its own pad");
+        Expect(PadManagerGetState(pManager, i, state), "PadManagerGetState maps the latest report");
+    }
+
+    // 書き込み中のスロットから読み取っても, 別々のレポートが混ざらないこと.
+    if (pads[0].Writer >= 0)
+    {
+        auto writeReport = [&](uint32_t n)
+        {
+            uint8_t bytes[64];
+            bytes[0] = 0x01;
+            for(auto i=1u; i<64; ++i)
+            { bytes[i] = uint8_t(n + i); }
+
+            auto ret = write(pads[0].Writer, bytes, sizeof(bytes));
+            (void)ret;
+        };
+
+        // 検証前に同じ形式のレポートに置き換えておく.
+        writeReport(0);
+        Expect(WaitLatest(pManager, 0, 1), "slot receives the first streamed report");
+
+        std::atomic<bool> done(false);
+        auto writer = std::thread([&]()
+        {
+            for(auto n=1u; n<kSeqlockReports; ++n)
+            { writeReport(n); }
+            done = true;
+        });
+
+        // 最後のレポートの Bytes[1] は kSeqlockReports の下位8bitになる.
+        auto last     = uint8_t(kSeqlockReports);
+        auto torn     = 0u;
+        auto reads    = 0u;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while(std::chrono::steady_clock::now() < deadline)
+        {
+            if (!PadManagerGetRawInput(pManager, 0, input))
+            { continue; }
+
+            reads++;
+            for(auto i=2u; i<64; ++i)
+            {
+                if (input.Bytes[i] != uint8_t(input.Bytes[1] + i - 1))
+                {
+                    torn++;
+                    break;
+                }
+            }
+
+            if (done && input.Bytes[1] == last)
+            { break; }
+        }
+        writer.join();
+
+        Expect(reads > kSeqlockReports / 100, "seqlock reads while the I/O thread writes");
+        Expect(torn == 0, "seqlock never returns a torn report");
+        Expect(WaitLatest(pManager, 0, last), "slot ends with the last streamed report");
+    }
+
+    // 抜去されたパッドのスロットだけが切断済みになる.
+    // 疑似端末が制御端末になった場合でもマスター側を閉じたときの SIGHUP で終了しないようにする.
+    auto previous = signal(SIGHUP, SIG_IGN);
+    auto master   = -1;
+    PadHandle* pHandle = nullptr;
+    if (OpenPtyPad(master, pHandle))
+    {
+        auto slot = PadManagerAdd(pManager, pHandle);
+        Expect(slot == int32_t(kPadCount), "pty pad is added to the next slot");
+
+        WriteNumberedReport(master, 0x55);
+        Expect(WaitLatest(pManager, uint32_t(slot), 0x55), "pty slot receives reports");
+
+        close(master);
+        master = -1;
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while(PadManagerIsConnected(pManager, uint32_t(slot)) && std::chrono::steady_clock::now() < deadline)
+        { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+
+        Expect(!PadManagerIsConnected(pManager, uint32_t(slot)), "hangup marks the slot as disconnected");
+        Expect(!PadIsConnected(PadManagerGetHandle(pManager, uint32_t(slot))), "hangup marks the handle as disconnected");
+        Expect(PadManagerGetRawInput(pManager, uint32_t(slot), input) && input.Bytes[1] == 0x55, "disconnected slot keeps its last report");
+
+        for(auto i=0u; i<kPadCount; ++i)
+        { Expect(PadManagerIsConnected(pManager, i), "other slots stay connected"); }
+
+        // 他のスロットは切断後も受信を続ける.
+        WriteNumberedReport(pads[1].Writer, 0x66);
+        Expect(WaitLatest(pManager, 1, 0x66), "other slots keep receiving after a hangup");
+    }
+    else
+    {
+        ReportFailure("failed to open pty pad.");
+        if (master >= 0)
+        { close(master); }
+    }
+
+    PadManagerClose(pManager);
+    signal(SIGHUP, previous);
+    PadSetDeviceRoot(nullptr, nullptr);
+
+    for(auto& pad : pads)
+    { CloseFakePad(pad); }
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// HotplugLog structure
+///////////////////////////////////////////////////////////////////////////////
+struct HotplugLog
+{
+    std::vector<PAD_DEVICE_EVENT>   Events;
+    std::vector<PadDeviceInfo>      Infos;
+};
+
+//-----------------------------------------------------------------------------
+//      接続・切断イベントを記録します.
+//-----------------------------------------------------------------------------
+void RecordHotplug(void* pUser, PAD_DEVICE_EVENT event, const PadDeviceInfo& info)
+{
+    auto pLog = static_cast<HotplugLog*>(pUser);
+    pLog->Events.push_back(event);
+    pLog->Infos .push_back(info);
+}
+
+//-----------------------------------------------------------------------------
+//      カーネル形式の uevent メッセージを生成します.
+//-----------------------------------------------------------------------------
+std::string MakeKernelUevent(const char* action, const char* name, const char* subsystem = "hidraw")
+{
+    // "add@/devices/..." の後ろにNUL区切りのプロパティが並ぶ.
+    auto devPath = std::string("/devices/virtual/hidraw/") + name;
+    const std::string fields[] = {
+        std::string(action) + "@" + devPath,
+        std::string("ACTION=") + action,
+        "DEVPATH=" + devPath,
+        std::string("SUBSYSTEM=") + subsystem,
+        std::string("DEVNAME=") + name,
+        "SEQNUM=1",
+    };
+
+    std::string result;
+    for(auto& field : fields)
+    {
+        result += field;
+        result.push_back('\0');
+    }
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      udev形式(libudevのヘッダ付き)の uevent メッセージを生成します.
+//-----------------------------------------------------------------------------
+std::string MakeUdevUevent(const char* action, const char* name, const char* hidId)
+{
+    std::string properties;
+    const std::string fields[] = {
+        std::string("ACTION=") + action,
+        std::string("DEVPATH=/devices/virtual/hidraw/") + name,
+        "SUBSYSTEM=hidraw",
+        std::string("DEVNAME=/dev/") + name,
+        std::string("HID_ID=") + hidId,
+    };
+    for(auto& field : fields)
+    {
+        properties += field;
+        properties.push_back('\0');
+    }
+
+    // "libudev\0", マジック, ヘッダサイズ, プロパティの位置とサイズ, フィルタ用のハッシュ.
+    uint32_t header[10] = {};
+    memcpy(header, "libudev", 8);
+    header[2] = htonl(0xfeedcafe);
+    header[3] = sizeof(header);
+    header[4] = sizeof(header);
+    header[5] = uint32_t(properties.size());
+
+    return std::string(reinterpret_cast<const char*>(header), sizeof(header)) + properties;
+}
+
+//-----------------------------------------------------------------------------
+//      NULを含む文字列リテラルから uevent メッセージを生成します.
+//-----------------------------------------------------------------------------
+template<size_t N>
+std::string MakeRawUevent(const char (&text)[N])
+{ return std::string(text, N - 1); }
+
+//-----------------------------------------------------------------------------
+//      uevent メッセージを注入します.
+//-----------------------------------------------------------------------------
+bool Inject(PadHotplug* pHotplug, const std::string& message)
+{ return PadHotplugInject(pHotplug, message.data(), uint32_t(message.size())); }
+
+//-----------------------------------------------------------------------------
+//      偽のsysfsツリーに注入した uevent で接続・切断を確認します.
+//-----------------------------------------------------------------------------
+void TestHotplug()
+{
+    printf("---- Test: hotplug uevent injection ----\n");
+    auto failures = g_Failures;
+
+    RemoveFakeTree();
+    auto root = std::string(kFakeRoot);
+    mkdir(root.c_str(), 0700);
+    mkdir((root + "/dev").c_str(), 0700);
+    mkdir((root + "/sys").c_str(), 0700);
+    mkdir((root + "/sys/class").c_str(), 0700);
+    mkdir((root + "/sys/class/hidraw").c_str(), 0700);
+    PadSetDeviceRoot((root + "/dev").c_str(), (root + "/sys").c_str());
+
+    // 開始時はパッドとパッド以外のデバイスが1つずつ接続されている.
+    AddFakeNode(0, "0003:0000054C:000005C4", true);
+    AddFakeNode(1, "0003:0000046D:0000C52B", false);
+
+    HotplugLog  log;
+    PadHotplug* pHotplug = nullptr;
+    if (!PadHotplugOpen(RecordHotplug, &log, &pHotplug))
+    {
+        PadSetDeviceRoot(nullptr, nullptr);
+        RemoveFakeTree();
+        ReportFailure("failed to open hotplug monitor.");
+        return;
+    }
+
+    auto path0 = root + "/dev/hidraw0";
+    auto path2 = root + "/dev/hidraw2";
+
+    // 接続済みのパッドは初回の更新で通知される.
+    Expect(PadHotplugUpdate(pHotplug) == 1, "initial update reports the connected pad");
+    Expect(log.Events.size() == 1 && log.Events[0] == PAD_DEVICE_ADDED && log.Infos[0].Path == path0
+        && log.Infos[0].Type == PAD_CONNECTION_USB, "initial pad is reported as added");
+    Expect(PadHotplugUpdate(pHotplug) == 0, "update without uevents reports nothing");
+
+    // カーネル形式 : HID_ID を含まないのでsysfsから判定する.
+    AddFakeNode(2, "0003:0000054C:00000CE6", true);
+    Expect(Inject(pHotplug, MakeKernelUevent("add", "hidraw2")), "kernel add uevent is accepted");
+    Expect(!Inject(pHotplug, MakeKernelUevent("add", "hidraw2")), "duplicate add is ignored");
+    Expect(!Inject(pHotplug, MakeKernelUevent("add", "hidraw1")), "add of a non-pad device is ignored");
+    Expect(!Inject(pHotplug, MakeKernelUevent("add", "hidraw9")), "add without sysfs entry is ignored");
+    Expect(!Inject(pHotplug, MakeKernelUevent("add", "event3", "input")), "add of another subsystem is ignored");
+
+    // udev形式 : HID_ID から判定するのでsysfsは不要.
+    Expect(Inject(pHotplug, MakeUdevUevent("add", "hidraw3", "0005:0000054C:000009CC")), "udev add uevent is accepted");
+    Expect(!Inject(pHotplug, MakeUdevUevent("add", "hidraw3", "0005:0000054C:000009CC")), "duplicate udev add is ignored");
+
+    log = HotplugLog();
+    Expect(PadHotplugUpdate(pHotplug) == 2, "update reports each accepted add once");
+    Expect(log.Events.size() == 2
+        && log.Events[0] == PAD_DEVICE_ADDED && log.Infos[0].Path == path2
+        && log.Infos[0].Type == (PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE)
+        && log.Events[1] == PAD_DEVICE_ADDED && log.Infos[1].Path == std::string("/dev/hidraw3")
+        && log.Infos[1].Type == PAD_CONNECTION_BT, "added pads are reported in order with their type");
+
+    // 不正なメッセージは受け付けない.
+    auto udev = MakeUdevUevent("add", "hidraw4", "0003:0000054C:000005C4");
+    auto badOffset = udev;
+    badOffset[16] = char(0xff);
+    auto badLength = udev;
+    badLength[20] = char(0xff);
+    const std::string malformed[] = {
+        std::string(),
+        std::string("add@/devices/virtual/hidraw/hidraw4"),                     // NUL終端が無い.
+        MakeRawUevent("ACTION=add\0SUBSYSTEM=hidraw\0DEVNAME=hidraw4\0"),        // ヘッダが無い.
+        MakeRawUevent("add@\0SUBSYSTEM=hidraw\0DEVNAME=hidraw4\0"),              // ACTIONが無い.
+        MakeRawUevent("add@\0ACTION=add\0SUBSYSTEM=hidraw\0"),                   // DEVNAMEが無い.
+        udev.substr(0, 20),                                                     // 短いudevヘッダ.
+        udev.substr(0, 40),                                                     // プロパティが無い.
+        badOffset,
+        badLength,
+    };
+    for(auto& message : malformed)
+    { Expect(!Inject(pHotplug, message), "malformed uevent is rejected"); }
+
+    auto valid = MakeKernelUevent("add", "hidraw2");
+    Expect(!PadHotplugInject(pHotplug, nullptr, 16), "null uevent is rejected");
+    Expect(!PadHotplugInject(nullptr, valid.data(), uint32_t(valid.size())), "null monitor is rejected");
+
+    log = HotplugLog();
+    Expect(PadHotplugUpdate(pHotplug) == 0 && log.Events.empty(), "rejected uevents report nothing");
+
+    PadDeviceInfo infos[4] = {};
+    Expect(PadHotplugGetDevices(pHotplug, nullptr, 0) == 3, "device list holds three pads");
+    Expect(PadHotplugGetDevices(pHotplug, infos, 4) == 3
+        && infos[0].Path == path0 && infos[1].Path == path2 && infos[2].Path == std::string("/dev/hidraw3"),
+        "device list is ordered by arrival");
+
+    // 切断はデバイスリストに無いパスを無視する.
+    Expect(Inject(pHotplug, MakeKernelUevent("remove", "hidraw0")), "kernel remove uevent is accepted");
+    Expect(!Inject(pHotplug, MakeKernelUevent("remove", "hidraw0")), "duplicate remove is ignored");
+    Expect(!Inject(pHotplug, MakeKernelUevent("remove", "hidraw1")), "remove of an unknown device is ignored");
+    Expect(Inject(pHotplug, MakeUdevUevent("remove", "hidraw3", "0005:0000054C:000009CC")), "udev remove uevent is accepted");
+
+    log = HotplugLog();
+    Expect(PadHotplugUpdate(pHotplug) == 2, "update reports each accepted remove once");
+    Expect(log.Events.size() == 2
+        && log.Events[0] == PAD_DEVICE_REMOVED && log.Infos[0].Path == path0
+        && log.Events[1] == PAD_DEVICE_REMOVED && log.Infos[1].Path == std::string("/dev/hidraw3"),
+        "removed pads are reported with their last info");
+
+    Expect(PadHotplugGetDevices(pHotplug, infos, 4) == 1 && infos[0].Path == path2, "device list keeps the remaining pad");
+
+    PadHotplugClose(pHotplug);
+    PadSetDeviceRoot(nullptr, nullptr);
+    RemoveFakeTree();
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      ハンドルを指定しない関数群が共有ハンドルを使い回し, 切断時に1度だけ再接続するか確認します.
+//-----------------------------------------------------------------------------
+void TestCachedPad()
+{
+    printf("---- Test: cached pad (handle-less functions) ----\n");
+    auto failures = g_Failures;
+
+    RemoveFakeTree();
+    auto root = std::string(kFakeRoot);
+    mkdir(root.c_str(), 0700);
+    mkdir((root + "/dev").c_str(), 0700);
+    mkdir((root + "/sys").c_str(), 0700);
+    mkdir((root + "/sys/class").c_str(), 0700);
+    mkdir((root + "/sys/class/hidraw").c_str(), 0700);
+    PadSetDeviceRoot((root + "/dev").c_str(), (root + "/sys").c_str());
+    AddFakeNode(0, "0003:0000054C:000005C4", true);
+
+    // 開いた偽パッドは全てメモリの転送路で読み書きする.
+    uint8_t bytes[78];
+    auto size = MakeInputReport(PAD_CONNECTION_USB, bytes);
+    bytes[1] = 0x40;
+
+    MemoryTransport memory;
+    memory.pBytes = bytes;
+    memory.Size   = size;
+    memory.Count  = 1;
+
+    FakeTransportScope transport;
+    g_FakeMemory = &memory;
+    g_OpenCount  = 0;
+
+    PadRawInput raw = {};
+    SetMemoryPending(memory, 4);
+    Expect(PadGetRawInput(raw) && raw.Bytes[0] == 0x01 && raw.Bytes[1] == 0x40, "PadGetRawInput reads from the cached pad");
+    Expect(g_OpenCount == 1, "first call opens the pad");
+
+    PadState state;
+    SetMemoryPending(memory, 1);
+    Expect(PadGetState(state), "PadGetState maps the latest report");
+
+    PadVibrationParam vibration = { 0x80, 0x20 };
+    Expect(PadSetVibration(vibration) && memory.Output[4] == 0x80 && memory.Output[5] == 0x20, "PadSetVibration writes the motors");
+
+    PadColor color = { 0x12, 0x34, 0x56 };
+    Expect(PadSetLightBarColor(color) && memory.Output[6] == 0x12 && memory.Output[7] == 0x34 && memory.Output[8] == 0x56,
+        "PadSetLightBarColor writes the color");
+    Expect(g_OpenCount == 1, "handle is reused across calls");
+
+    // 共有ハンドルを開いている間は入出力も探索先も差し替えられない.
+    Expect(!PadSetTransport(nullptr), "transport swap is rejected while a pad is open");
+    Expect(!PadSetDeviceRoot(nullptr, nullptr), "device root change is rejected while a pad is open");
+
+    // 読み取り, 書き込みのどちらで切断を検出しても再接続して成功する.
+    auto hangUp = []()
+    {
+        if (auto pDevice = g_LastDevice.load())
+        { pDevice->HangUp = true; }
+    };
+
+    hangUp();
+    SetMemoryPending(memory, 1);
+    Expect(PadGetRawInput(raw), "read retries after a disconnect");
+    Expect(g_OpenCount == 2, "read disconnect reopens the pad once");
+
+    hangUp();
+    color = { 0x65, 0x43, 0x21 };
+    Expect(PadSetLightBarColor(color) && memory.Output[6] == 0x65, "write retries after a disconnect");
+    Expect(g_OpenCount == 3, "write disconnect reopens the pad once");
+
+    // 再接続後も失敗する場合は再試行を繰り返さずに失敗を返す.
+    g_FakeHangUp = true;
+    Expect(!PadGetRawInput(raw), "second failure is reported");
+    Expect(g_OpenCount == 4, "only one reopen per call");
+    g_FakeHangUp = false;
+
+    // 切断済みなので共有ハンドルは閉じられている.
+    g_FakeMemory = nullptr;
+    SetMemoryPending(memory, 0);
+    PadSetDeviceRoot(nullptr, nullptr);
+    RemoveFakeTree();
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      複数パッドからのイベントが欠落せず, パッドごとの順序を保って届くか確認します.
+//-----------------------------------------------------------------------------
+void TestEventQueue()
+{
+    printf("---- Test: event queue (1 to %u producers) ----\n", kEventPadCount);
+    auto failures = g_Failures;
+
+    // 7レポート/msで200ms分.
+    static const uint32_t kReports = 1400;
+
+    for(auto padCount=1u; padCount<=kEventPadCount; padCount*=2)
+    {
+        EventQueueResult result;
+        if (!RunEventQueue(padCount, kReports, result))
+        { return; }
+
+        Expect(result.Opened == padCount, "all fake pads opened");
+        Expect(result.Received == result.Expected, "all events received");
+        Expect(result.OrderErrors == 0, "events keep per-pad order");
+        Expect(result.Dropped == 0, "no events dropped");
+    }
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      時計の進んだデバイスの入力時刻と, 時計の進みの差を推定できるか確認します.
+//-----------------------------------------------------------------------------
+void TestTimeline()
+{
+    printf("---- Test: capture time estimation (%.0f ppm drift) ----\n", kClockDrift * 1e6);
+    auto failures = g_Failures;
+
+    static const uint32_t kTypes[] = {
+        PAD_CONNECTION_USB,
+        PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE,
+    };
+
+    for(auto type : kTypes)
+    {
+        TimelineResult result;
+        if (!RunTimeline(type, result))
+        { return; }
+
+        printf("  avg err %.1f us, max err %.1f us, drift %.1f ppm\n", result.AvgError[1], result.MaxError[1], result.Drift);
+        Expect(result.Reports == kClockFrameCount * kReportsPerFrame, "all reports received");
+        Expect(result.DeviceErrors == 0, "device time extended across wrap-around and pause");
+        Expect(result.AvgError[1] < 300.0, "average capture time error");
+        Expect(result.MaxError[1] < 2000.0, "maximum capture time error");
+        Expect(std::abs(result.Drift - kClockDrift * 1e6) < 20.0, "clock drift estimate");
+    }
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      フレームカウンターの欠番と周回から欠落数を正しく数えるか確認します.
+//-----------------------------------------------------------------------------
+void TestInputStats()
+{
+    printf("---- Test: input stats (lost reports) ----\n");
+    auto failures = g_Failures;
+
+    static const uint32_t kTypes[] = {
+        PAD_CONNECTION_USB,
+        PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE,
+    };
+
+    for(auto type : kTypes)
+    {
+        PadInputStats stats = {};
+        uint32_t expected;
+        double   snapshotNs;
+
+        // 単発, 連続, フレームカウンターの周期以上の欠落.
+        if (!RunInputStats(type, kStatsReportCount, IsStatsSkipFrame, stats, expected, snapshotNs))
+        { return; }
+        Expect(stats.Reports == kStatsReportCount - expected, "all sent reports counted");
+        Expect(stats.Lost == expected && stats.Repeated == 0, "lost reports counted");
+
+        // 周回をまたぐ欠落(DualShock4 は 0x3f -> 0x00, DualSense は 0xff -> 0x00).
+        //  62~65 : 0x3d の次が 0x02, 127 : 0x3e の次が 0x00, 192 : 0x3f の次が 0x01.
+        //  255~257 : DualSense の 0xfe の次が 0x02.
+        auto wrap = [](uint32_t frame)
+        {
+            return (frame >= 62 && frame < 66)
+                || (frame == 127)
+                || (frame == 192)
+                || (frame >= 255 && frame < 258);
+        };
+        if (!RunInputStats(type, 700, wrap, stats, expected, snapshotNs))
+        { return; }
+        Expect(stats.Reports == 700 - expected, "all sent reports counted (wrap-around)");
+        Expect(stats.Lost == expected && stats.Repeated == 0, "lost reports counted across wrap-around");
+    }
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      接続タイプごとの補正データの並びを読み取り, 正しく補正できるか確認します.
+//-----------------------------------------------------------------------------
+void TestCalibration()
+{
+    printf("---- Test: IMU calibration ----\n");
+    auto failures = g_Failures;
+
+    // DualShock4 のBluetooth接続とワイヤレスアダプタは正方向と負方向の並びが異なる.
+    static const uint32_t kTypes[] = {
+        PAD_CONNECTION_USB,
+        PAD_CONNECTION_BT,
+        PAD_CONNECTION_WIRELESS,
+        PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE,
+        PAD_CONNECTION_BT  | PAD_CONNECTION_DUAL_SENSE,
+    };
+
+    std::vector<PadState> states(kCalibSampleCount);
+    MakeImuStates(states.data(), kCalibSampleCount);
+
+    FakeTransportScope transport;
+    g_FakeFeature = true;
+    for(auto type : kTypes)
+    {
+        PadCalibration calibration;
+        bool calibrated = false;
+        if (!GetFakeCalibration(type, calibration, calibrated))
+        {
+            ReportFailure("failed to open fake pad.");
+            continue;
+        }
+
+        // 入力は最大で約2000deg/s, 4Gなので, 誤差は float の丸め誤差程度になる.
+        double gyroError;
+        double accelError;
+        GetCalibrationError(calibration, states.data(), kCalibSampleCount, gyroError, accelError);
+        Expect(calibrated, "calibration data read from the pad");
+        Expect(gyroError  < 0.01,   "gyro calibration error below 10 mdeg/s");
+        Expect(accelError < 0.0001, "accel calibration error below 0.1 mG");
+    }
+    g_FakeFeature = false;
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      推定した姿勢の誤差と, 一括姿勢推定のSIMD実装がスカラー実装と一致するか確認します.
+//-----------------------------------------------------------------------------
+void TestFusion()
+{
+    printf("---- Test: orientation fusion (up to 150 deg/s) ----\n");
+    auto failures = g_Failures;
+
+    FusionRecording recording;
+    if (!RecordFusion(recording))
+    { return; }
+
+    // 1000Hzで推定した場合の誤差は 0.12 度程度(最大 0.22 度程度).
+    double avg;
+    double max;
+    GetFusionError(recording.Truth, recording.Fused, 1, avg, max);
+    printf("  PadEnableFusion (1000 Hz) : avg %.3f deg, max %.3f deg\n", avg, max);
+    Expect(avg < 0.25 && max < 0.5, "receive thread fusion error");
+
+    std::vector<PadQuaternion> fused;
+    FuseRecording(recording.Motions, 1, fused);
+    GetFusionError(recording.Truth, fused, 1, avg, max);
+    printf("  PadFuseBatch (1000 Hz)    : avg %.3f deg, max %.3f deg\n", avg, max);
+    Expect(avg < 0.25 && max < 0.5, "batch fusion error");
+
+    // フレームごとの値だけでは誤差が大きくなる(参考値).
+    FuseRecording(recording.Motions, kReportsPerFrame, fused);
+    GetFusionError(recording.Truth, fused, kReportsPerFrame, avg, max);
+    printf("  per frame (144 Hz)        : avg %.3f deg, max %.3f deg\n", avg, max);
+
+    std::vector<PadMotion>      motions;
+    std::vector<float>          deltas;
+    std::vector<PadQuaternion>  results[2];
+    MakeFusionStreams(recording.Motions, motions, deltas);
+
+    const auto simd = PadGetSimdLevel();
+    for(auto mode=0; mode<2; ++mode)
+    {
+        PadSetSimdLevel((mode == 0) ? PAD_SIMD_NONE : simd);
+        results[mode].assign(motions.size(), PadQuaternion());
+        FuseStreams(motions, deltas, results[mode]);
+    }
+    PadSetSimdLevel(simd);
+
+    auto diff = 0.0;
+    for(auto i=0u; i<motions.size(); ++i)
+    {
+        auto& a = results[0][i];
+        auto& b = results[1][i];
+        diff = std::max(diff, double(std::abs(a.W - b.W) + std::abs(a.X - b.X) + std::abs(a.Y - b.Y) + std::abs(a.Z - b.Z)));
+    }
+    Expect(diff < 1e-5, "PadFuseBatch SIMD matches scalar");
+
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      受信したレポートがキャプチャファイルにそのまま記録されるか確認します.
+//-----------------------------------------------------------------------------
+void TestCapture()
+{
+    printf("---- Test: capture ----\n");
+    auto failures = g_Failures;
+
+    FakePad pad;
+    if (!OpenFakePad("libds4_test_capture", pad))
+    {
+        ReportFailure("failed to open fake pad.");
+        return;
+    }
+
+    PadEnableReaderThread(pad.pHandle, true);
+    if (!PadStartCapture(pad.pHandle, kCapturePath))
+    {
+        ReportFailure("failed to start capture.");
+        CloseFakePad(pad);
+        return;
+    }
+
+    std::vector<PadRawInput> received;
+    auto writer = std::thread([&]() { WriteNumberedReports(pad.Writer, kCaptureReports); });
+    ReceiveReports(pad.pHandle, kCaptureReports, received);
+    writer.join();
+    PadStopCapture(pad.pHandle);
+
+    PadCaptureStats capture = {};
+    PadGetCaptureStats(pad.pHandle, capture);
+
+    auto chunks = 0u;
+    Expect(received.size() == kCaptureReports, "all captured reports received");
+    Expect(VerifyCapture(kCapturePath, received, PAD_CONNECTION_USB, chunks) == 0, "capture file matches the received reports");
+    Expect(capture.Records == received.size() && capture.Dropped == 0, "capture stats count every record");
+    Expect(capture.Chunks == chunks, "capture stats count every chunk");
+
+    unlink(kCapturePath);
+    CloseFakePad(pad);
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+
+//-----------------------------------------------------------------------------
+//      Bluetooth の入力レポートが CRC32 を検証して受信されるか確認します.
+//-----------------------------------------------------------------------------
+void TestBluetoothRead()
+{
+    printf("---- Test: Bluetooth input ----\n");
+    auto failures = g_Failures;
+
+    static const uint32_t kTypes[] = {
+        PAD_CONNECTION_USB,
+        PAD_CONNECTION_BT,
+        PAD_CONNECTION_BT | PAD_CONNECTION_DUAL_SENSE,
+    };
+    for(auto type : kTypes)
+    {
+        FakePad pad;
+        if (!OpenFakePad("libds4_test_bt", pad, type))
+        {
+            ReportFailure("failed to open fake pad.");
+            return;
+        }
+
+        uint8_t bytes[78];
+        auto size = MakeInputReport(type, bytes);
+
+        // Bluetooth はCRC32を壊したレポートを1つ混ぜ, 破棄されることを確認する.
+        auto bluetooth = (type & PAD_CONNECTION_BT) != 0;
+        uint8_t corrupted[78];
+        memcpy(corrupted, bytes, sizeof(bytes));
+        corrupted[10] ^= 0xff;
+
+        auto written = 0u;
+        for(auto i=0u; i<kReportsPerFrame; ++i)
+        {
+            if (bluetooth && i == kReportsPerFrame / 2)
+            {
+                auto ret = write(pad.Writer, corrupted, size);
+                (void)ret;
+            }
+
+            if (write(pad.Writer, bytes, size) == ssize_t(size))
+            { written++; }
+        }
+
+        PadRawInput inputs[64];
+        auto received = PadReadBatch(pad.pHandle, inputs, 64);
+
+        PadIoStats stats = {};
+        PadGetIoStats(pad.pHandle, stats);
+        Expect(received == written, "all valid reports received");
+        Expect(stats.CrcErrors == (bluetooth ? 1u : 0u), "corrupted report counted as CRC error");
+        Expect(received == 0 || inputs[0].Bytes[0] == bytes[0], "report id preserved");
+
+        CloseFakePad(pad);
+    }
+
+    // DualShock4 の Bluetooth 出力レポート(ライトバー R=0x12 G=0x34 B=0x56).
+    // 末尾のCRC32はライブラリとは独立に zlib.crc32(b"\xa2" + report[:74]) で求めた値.
+    static const uint8_t kExpectedOutput[78] = {
+        0x11, 0xc0, 0x00, 0xf2, 0x00, 0x00, 0x00, 0x00, 0x12, 0x34, 0x56, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x26, 0x20, 0xab, 0x93,
+    };
+
+    FakeTransportScope transport;
+    FakePad pad;
+    if (!OpenFakePad("libds4_test_bt", pad, PAD_CONNECTION_BT) || pad.pDevice == nullptr)
+    {
+        ReportFailure("failed to open fake pad.");
+        CloseFakePad(pad);
+        return;
+    }
+
+    MemoryTransport memory;
+    pad.pDevice->pMemory = &memory;
+    PadSetOutputRate(pad.pHandle, 0);
+
+    PadColor color = { 0x12, 0x34, 0x56 };
+    PadSetLightBarColor(pad.pHandle, color);
+    Expect(memory.OutputSize == sizeof(kExpectedOutput), "output report size");
+    Expect(memcmp(memory.Output, kExpectedOutput, sizeof(kExpectedOutput)) == 0, "output report matches known bytes");
+
+    CloseFakePad(pad);
+    printf("%s\n", (g_Failures == failures) ? "ok" : "FAILED");
+}
+#endif
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+//      operator new を差し替えてメモリ確保回数を数えます.
+//-----------------------------------------------------------------------------
+void* operator new(size_t size)
+{
+    g_AllocCount.fetch_add(1, std::memory_order_relaxed);
+    auto ptr = malloc((size > 0) ? size : 1);
+    if (ptr == nullptr)
+    { throw std::bad_alloc(); }
+    return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    g_AllocCount.fetch_add(1, std::memory_order_relaxed);
+    return malloc((size > 0) ? size : 1);
+}
+
+void* operator new[](size_t size)
+{ return operator new(size); }
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{ return operator new(size, tag); }
+
+// インライン展開後に operator new と free() の組み合わせとして誤検出されるため警告を抑制する.
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 11)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* ptr) noexcept
+{ free(ptr); }
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 11)
+#pragma GCC diagnostic pop
+#endif
+
+void operator delete(void* ptr, size_t) noexcept
+{ operator delete(ptr); }
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{ operator delete(ptr); }
+
+void operator delete[](void* ptr) noexcept
+{ operator delete(ptr); }
+
+void operator delete[](void* ptr, size_t) noexcept
+{ operator delete(ptr); }
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{ operator delete(ptr); }
+
+
+//-----------------------------------------------------------------------------
+//      メインエントリーポイントです.
+//-----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    auto        hotOnly  = false;
+    auto        testOnly = false;
+    const char* jsonPath = nullptr;
+    for(auto i=1; i<argc; ++i)
+    {
+        if (strcmp(argv[i], "--hot") == 0)
+        { hotOnly = true; }
+        else if (strcmp(argv[i], "--test") == 0)
+        { testOnly = true; }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        { jsonPath = argv[++i]; }
+        else
+        {
+            printf("usage : %s [--hot | --test] [--json <path>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (!hotOnly)
+    {
+        TestReportView();
+        TestMapBatch();
+        TestDiff();
+        TestStickShaping();
+        TestGesture();
+        TestReplay();
+        TestDeltaCodec();
+    #if !defined(_WIN32)
+        TestRead();
+        TestManager();
+        TestHotplug();
+        TestCachedPad();
+        TestEventQueue();
+        TestTimeline();
+        TestInputStats();
+        TestCalibration();
+        TestFusion();
+        TestCapture();
+        TestBluetoothRead();
+    #endif
+    }
+
+    if (!hotOnly && !testOnly)
+    {
+        BenchReportView();
+        BenchMapBatch();
+        BenchDiff();
+        BenchStickShaping();
+        BenchGesture();
+        BenchReplay();
+        BenchDeltaCodec();
+
+    #if defined(_WIN32)
+        printf("I/O benchmarks require Linux.\n");
+    #else
+        BenchReadBatch();
+        BenchStartup();
+        BenchAsyncOutput();
+        BenchBluetoothRead();
+        BenchEventQueue();
+        BenchTimeline();
+        BenchInputStats();
+        BenchCalibration();
+        BenchFusion();
+        BenchCapture();
+    #endif
+    }
+
+    if (!testOnly)
+    {
+        BenchHotMap();
+    #if !defined(_WIN32)
+        BenchHotOutput();
+        BenchHotRead();
+    #endif
+    }
+
+    if (jsonPath != nullptr && !WriteHotJson(jsonPath))
+    {
+        printf("failed to write %s.\n", jsonPath);
+        return 1;
+    }
+
+    if (g_Failures > 0)
+    {
+        printf("%u check(s) failed.\n", g_Failures);
+        return 1;
+    }
+
+    return 0;
+}
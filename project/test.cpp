@@ -61,35 +61,35 @@ int main(int argc, char** argv)
                 break;
 
             case PAD_BUTTON_DPAD_NORTHWEST:
-                printf_s("\n");
+                printf_s("↑←\n");
                 break;
 
             case PAD_BUTTON_DPAD_WEST:
-                printf_s("\n");
+                printf_s("←\n");
                 break;
 
             case PAD_BUTTON_DPAD_SOUTHWEST:
-                printf_s("\n");
+                printf_s("↓←\n");
                 break;
 
             case PAD_BUTTON_DPAD_SOUTH:
-                printf_s("\n");
+                printf_s("↓\n");
                 break;
 
             case PAD_BUTTON_DPAD_SOUTHEAST:
-                printf_s("\n");
+                printf_s("↓→\n");
                 break;
 
             case PAD_BUTTON_DPAD_EAST:
-                printf_s("\n");
+                printf_s("→\n");
                 break;
 
             case PAD_BUTTON_DPAD_NORTHEAST:
-                printf_s("\n");
+                printf_s("↑→\n");
                 break;
 
             case PAD_BUTTON_DPAD_NORTH:
-                printf_s("\n");
+                printf_s("↑\n");
                 break;
             }
 
@@ -106,16 +106,16 @@ int main(int argc, char** argv)
             { printf_s("L1 button\n"); }
 
             if (state.Buttons & PAD_BUTTON_TRIANGLE)
-            { printf_s(" button\n"); }
+            { printf_s("△ button\n"); }
 
             if (state.Buttons & PAD_BUTTON_CIRCLE)
-            { printf_s("Z button\n"); }
+            { printf_s("〇 button\n"); }
 
             if (state.Buttons & PAD_BUTTON_CROSS)
-            { printf_s("~ button\n"); }
+            { printf_s("× button\n"); }
 
             if (state.Buttons & PAD_BUTTON_SQUARE)
-            { printf_s(" button\n"); }
+            { printf_s("□ button\n"); }
 
             if (state.SpecialButtons & PAD_SPECIAL_BUTTON_TPAD)
             { printf_s("TPad button\n"); }
@@ -201,7 +201,7 @@ int main(int argc, char** argv)
             }
         #endif
 
-            // EscŏI.
+            // Escで終了.
             if (GetAsyncKeyState(VK_ESCAPE) & VK_ESCAPE)
             { break; }
         }
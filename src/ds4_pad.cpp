@@ -8,16 +8,59 @@
 // Includes
 //-----------------------------------------------------------------------------
 #include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 #include <string>
 #include <array>
 #include <vector>
 #include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
 #include <ds4_pad.h>
+#include "ds4_pad_test.h"
+
+#if defined(_WIN32)
 #include <Windows.h>
 #include <hidsdi.h>
 #include <SetupAPI.h>
 #include <Bthsdpdef.h>
 #include <BluetoothAPIs.h>
+#include <cfgmgr32.h>
+#else
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <linux/input.h>
+#include <linux/hidraw.h>
+#include <linux/netlink.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PAD_SIMD_X86    1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#define PAD_TARGET(isa)
+#else
+#include <immintrin.h>
+#define PAD_TARGET(isa) __attribute__((target(isa)))
+#endif
+#else
+#define PAD_SIMD_X86    0
+#endif
 
 
 namespace {
@@ -41,836 +84,7114 @@ static const int   IOCTL_BTH_DISCONNECT_DEVICE = 0x41000c;
 static const float kAccelResPerG    = 8192.0f;
 static const float kGyroResInDegSec = 16.0f;
 
+// Native Handle.
+#if defined(_WIN32)
+using NativeHandle = HANDLE;
+using DevicePath   = std::wstring;
+static const NativeHandle kInvalidHandle = nullptr;
+#else
+using NativeHandle = int;
+using DevicePath   = std::string;
+static const NativeHandle kInvalidHandle = -1;
 
-} // namespace
+// hidrawデバイスの格納ディレクトリ.
+static const char kHidRawDir[] = "/dev";
+
+// sysfsのマウント先.
+static const char kSysfsDir[] = "/sys";
+
+// udevのnetlinkマルチキャストグループ.
+static const uint32_t kUdevMonitorGroup = 2;
+
+// udevのnetlinkメッセージのヘッダサイズ.
+static const size_t kUdevHeaderSize = 40;
+
+// HIDのバス番号.
+static const uint32_t kBusUsb       = 0x03;
+static const uint32_t kBusBluetooth = 0x05;
+#endif
+
+// USB接続時の入力レポートサイズ.
+static const uint32_t kUsbInputReportSize = 64;
+
+// キャッシュラインサイズ.
+static const size_t kCacheLineSize = 64;
+
+// 読み取りスレッド用リングバッファの要素数(1000Hzで約0.5秒分).
+static const uint32_t kInputRingSize = 512;
+
+// 1回の読み取りでまとめて取り出すレポートの最大数.
+static const uint32_t kReadBatchSize = 32;
+
+// マネージャーのスレッド起床用イベントを示す番号.
+static const uint32_t kWakeIndex = ~0u;
+
+// 1レポートから生成される入力イベントの最大数(ボタン20 + トリガー2 + タッチ4).
+static const uint32_t kMaxReportEvents = 32;
+
+// 入力イベントキューの最大要素数.
+static const uint32_t kMaxEventQueueSize = 1u << 24;
+
+// 傾きの推定で受信遅延が最小のレポートを1つ選ぶ区間の長さ(デバイス時刻, マイクロ秒).
+static const uint64_t kClockBlock = 100000;
+
+// 傾きの推定に使用する直近の区間数(指数移動平均の時定数, 約4秒).
+static const uint32_t kClockWindow = 40;
+
+// 傾きの推定を開始するまでの区間数.
+static const uint32_t kClockWarmup = 8;
+
+// デバイスとホストの時計の進み方の差の上限(1000ppm).
+static const double kClockMaxDrift = 1e-3;
+
+// 推定より遅れて届いたレポートに追従する割合.
+static const double kClockCreep = 1.0 / 1024.0;
 
 
 ///////////////////////////////////////////////////////////////////////////////
-// PadHandle structure
+// SpscRing class
 ///////////////////////////////////////////////////////////////////////////////
-struct PadHandle
+//! @brief  単一プロデューサー/単一コンシューマー用のロックフリーリングバッファです.
+//!
+//! @note   プロデューサー側とコンシューマー側のインデックスはキャッシュライン単位で
+//!         分離しているため, 互いの更新で偽共有が発生しません.
+template<typename T, uint32_t N>
+class SpscRing
 {
-    HANDLE          Handle;
-    std::wstring    DevicePath;
-    uint32_t        Size;
-    uint32_t        Type;
-    std::string     MacAddress;
+    static_assert((N & (N - 1)) == 0, "N must be power of 2.");
+
+public:
+    SpscRing()
+    : m_Head        (0)
+    , m_CachedTail  (0)
+    , m_Tail        (0)
+    , m_CachedHead  (0)
+    { /* DO_NOTHING */ }
+
+    //-------------------------------------------------------------------------
+    //! @brief      要素を追加します(プロデューサー側).
+    //!
+    //! @retval true    追加に成功.
+    //! @retval false   バッファが満杯.
+    //-------------------------------------------------------------------------
+    bool Push(const T& value)
+    {
+        auto head = m_Head.load(std::memory_order_relaxed);
+        if (head - m_CachedTail == N)
+        {
+            m_CachedTail = m_Tail.load(std::memory_order_acquire);
+            if (head - m_CachedTail == N)
+            { return false; }
+        }
+
+        m_Items[head & (N - 1)] = value;
+        m_Head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    //-------------------------------------------------------------------------
+    //! @brief      要素を取り出します(コンシューマー側).
+    //!
+    //! @retval true    取り出しに成功.
+    //! @retval false   バッファが空.
+    //-------------------------------------------------------------------------
+    bool Pop(T& value)
+    {
+        auto tail = m_Tail.load(std::memory_order_relaxed);
+        if (tail == m_CachedHead)
+        {
+            m_CachedHead = m_Head.load(std::memory_order_acquire);
+            if (tail == m_CachedHead)
+            { return false; }
+        }
+
+        value = m_Items[tail & (N - 1)];
+        m_Tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    // プロデューサー側.
+    std::atomic<uint32_t>   m_Head;
+    uint32_t                m_CachedTail;
+    uint8_t                 m_Padding0[kCacheLineSize - sizeof(std::atomic<uint32_t>) - sizeof(uint32_t)];
+
+    // コンシューマー側.
+    std::atomic<uint32_t>   m_Tail;
+    uint32_t                m_CachedHead;
+    uint8_t                 m_Padding1[kCacheLineSize - sizeof(std::atomic<uint32_t>) - sizeof(uint32_t)];
+
+    T                       m_Items[N];
+};
+
+using InputRing = SpscRing<PadRawInput, kInputRingSize>;
+
+// 出力レポートの変更フラグ.
+static const uint32_t kOutputVibration  = 0x01;
+static const uint32_t kOutputLightBar   = 0x02;
+static const uint32_t kOutputFlash      = 0x04;
+static const uint32_t kOutputTriggerL   = 0x08;
+static const uint32_t kOutputTriggerR   = 0x10;
+static const uint32_t kOutputAll        = 0x1f;
+
+// 出力レポートサイズ.
+static const uint32_t kDualShock4OutputSize = 32;
+static const uint32_t kDualSenseOutputSize  = 48;
+static const uint32_t kBluetoothReportSize  = 78;
+static const uint32_t kMaxOutputReportSize     = 547;  // DualShock4 Bluetooth のHIDディスクリプタ上の最大サイズ.
+
+// Bluetooth レポートのCRC32の位置とシード(HIDPヘッダ).
+static const uint32_t kBluetoothCrcOffset   = kBluetoothReportSize - 4;
+static const uint8_t  kCrcSeedInput         = 0xa1;
+static const uint8_t  kCrcSeedOutput        = 0xa2;
+
+// Bluetooth 入力レポートID.
+static const uint8_t  kDualShock4InputBT    = 0x11;
+static const uint8_t  kDualSenseInputBT     = 0x31;
+
+// Bluetooth 接続時, 読み取ると全データ入りのレポートに切り替わるフィーチャーレポート.
+static const uint8_t  kFeatureCalibrationBT = 0x05;
+
+// DualShock4 のUSB接続時にIMUの補正データが格納されているフィーチャーレポート(DualSense は 0x05).
+static const uint8_t  kFeatureCalibrationUSB = 0x02;
+
+// IMUの補正データとして使用するフィーチャーレポートの先頭サイズ(レポートID + 16bit x 17).
+static const uint32_t kCalibrationSize      = 35;
+
+// 補正係数の倍率の1.0に相当する値(16bit固定小数).
+static const int32_t  kCalibrationOne       = 1 << 16;
+
+// 姿勢推定の既定のゲイン(Madgwickフィルタのβ, rad/s).
+static const float    kFusionDefaultGain    = 0.1f;
+
+// 姿勢推定で1レポートあたりに積分する時間の上限(秒). 欠落した区間は角速度が変化しているため長く積分しない.
+static const float    kFusionMaxDelta       = 0.02f;
+
+// 度からラジアンへの変換係数.
+static const float    kDegToRad             = 3.14159265358979f / 180.0f;
+
+// スティックの整形テーブルの1軸あたりの要素数(中心からの距離 0.5 - 127.5).
+static const uint32_t kStickTableSize       = 128;
+
+// スティックの中心と整形後の最大値.
+static const double   kStickCenter          = 127.5;
+static const double   kStickOutputMax       = 32767.0;
+static const uint64_t kGestureVelocityTime  = 16000;    // タッチの速度を求める間隔(マイクロ秒).
+static const uint32_t kCaptureBufferCount   = 4;        // キャプチャのチャンクバッファ数(書き込み中を含む).
+static const uint32_t kDeltaReadMargin      = 8;        // 差分の復号でレコードの末尾を超えて読み取る最大バイト数.
+static const int32_t  kTransportPollTime    = 10;       // 差し替えた入出力の読み取りスレッドが停止要求を確認する間隔(ミリ秒).
+
+///////////////////////////////////////////////////////////////////////////////
+// Crc32Table structure
+///////////////////////////////////////////////////////////////////////////////
+struct Crc32Table
+{
+    uint32_t    Values[8][256];
 };
 
 //-----------------------------------------------------------------------------
-//      }`oCgɕϊ܂.
+//      スライス8方式のCRC32テーブルを生成します.
 //-----------------------------------------------------------------------------
-std::string ToStringA( const std::wstring& value )
+constexpr Crc32Table MakeCrc32Table()
 {
-    auto length = WideCharToMultiByte(CP_ACP, 0, value.c_str(), int(value.size() + 1), nullptr, 0, nullptr, nullptr); 
-    auto buffer = new char[length];
- 
-    WideCharToMultiByte(CP_ACP, 0, value.c_str(), int(value.size() + 1), buffer, length, nullptr, nullptr);
+    Crc32Table table = {};
+    for(uint32_t i=0; i<256; ++i)
+    {
+        auto crc = i;
+        for(auto j=0; j<8; ++j)
+        { crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1u))); }
+        table.Values[0][i] = crc;
+    }
 
-    std::string result(buffer);
-    delete[] buffer;
+    for(uint32_t i=0; i<256; ++i)
+    {
+        for(auto k=1; k<8; ++k)
+        {
+            auto prev = table.Values[k - 1][i];
+            table.Values[k][i] = (prev >> 8) ^ table.Values[0][prev & 0xff];
+        }
+    }
 
-    return result;
+    return table;
 }
 
+static constexpr Crc32Table kCrc32Table = MakeCrc32Table();
+
+// 入力レポートのレイアウト(PadReportLayout)はヘッダで定義し, PadReportView と共有する.
+static_assert(PadGetReportLayout(PAD_CONNECTION_BT).ReportId == kDualShock4InputBT, "Report ID mismatch.");
+static_assert(PadGetReportLayout(PAD_CONNECTION_BT | PAD_CONNECTION_DUAL_SENSE).ReportId == kDualSenseInputBT, "Report ID mismatch.");
+
+///////////////////////////////////////////////////////////////////////////////
+// ClockLayout structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  センサータイムスタンプとフレームカウンターの位置(入力データの開始位置から)と単位です.
+//!
+//! @note   1カウントは TickNum / TickDen マイクロ秒です.
+//!         フレームカウンターは Counter バイト目を CounterShift ビット右シフトした値です.
+struct ClockLayout
+{
+    uint8_t     Offset;
+    uint8_t     Size;
+    uint8_t     TickNum;
+    uint8_t     TickDen;
+    uint8_t     Counter;
+    uint8_t     CounterShift;
+};
+
+// Dual Shock4 : 16bit, 16/3マイクロ秒単位(約350ミリ秒で一周). フレームカウンターは6bit.
+static constexpr ClockLayout kDualShock4Clock = { 10, 2, 16, 3, 7, 2 };
+
+// Dual Sense : 32bit, 1/3マイクロ秒単位. PadState::TimeStamp とは別のフィールド. フレームカウンターは8bit.
+static constexpr ClockLayout kDualSenseClock  = { 28, 4, 1, 3, 7, 0 };
+
 //-----------------------------------------------------------------------------
-//      w蕶ŕ𕪊܂.
+//      接続タイプに対応するタイムスタンプの配置を取得します.
 //-----------------------------------------------------------------------------
-std::vector<std::string> Split(const std::string& input, char delimiter)
-{
-    std::istringstream stream(input);
+constexpr ClockLayout GetClockLayout(uint32_t type)
+{ return (type & PAD_CONNECTION_DUAL_SENSE) ? kDualSenseClock : kDualShock4Clock; }
 
-    std::string field;
-    std::vector<std::string> result;
-    while (std::getline(stream, field, delimiter))
-    { result.push_back(field); }
-    return result;
+//-----------------------------------------------------------------------------
+//      リトルエンディアンの16bit値を読み取ります.
+//-----------------------------------------------------------------------------
+inline uint16_t ReadU16(const uint8_t* pBytes)
+{ return uint16_t(pBytes[0] | (pBytes[1] << 8)); }
+
+//-----------------------------------------------------------------------------
+//      タッチデータ(4バイト)をマッピングします.
+//-----------------------------------------------------------------------------
+inline void MapTouch(const uint8_t* input, PadTouch& touch)
+{
+    touch.Id = (input[0] & 0x7f);
+    touch.X  = static_cast<uint16_t>((uint16_t(input[2] & 0xf) << 8) | input[1]);
+    touch.Y  = static_cast<uint16_t>((uint16_t(input[3] << 4)) | ((input[2] & 0xf0) >> 4));
 }
 
 //-----------------------------------------------------------------------------
-//      u܂.
+//      接続タイプごとに特殊化したマッピング処理です.
 //-----------------------------------------------------------------------------
-std::string Replace
-(
-    const std::string&  input,
-    std::string         pattern,
-    std::string         replace
-)
+template<uint32_t Type>
+bool MapReport(const PadRawInput* pRawData, PadState& state)
 {
-    std::string result = input;
-    auto pos = result.find( pattern );
+    constexpr PadReportLayout layout = PadGetReportLayout(Type);
 
-    while( pos != std::string::npos )
-    {
-        result.replace( pos, pattern.length(), replace );
-        pos = result.find( pattern, pos + replace.length() );
-    }
+    if (layout.ReportId != 0 && pRawData->Bytes[0] != layout.ReportId)
+    { return false; }
 
-    return result;
+    const uint8_t* input = &pRawData->Bytes[layout.Base];
+
+    state.Type              = PAD_CONNECTION_TYPE(Type & kPadConnectionMask);
+    state.StickL.X          = input[layout.StickL + 0];
+    state.StickL.Y          = input[layout.StickL + 1];
+    state.StickR.X          = input[layout.StickR + 0];
+    state.StickR.Y          = input[layout.StickR + 1];
+    state.AnalogButtons.L2  = input[layout.L2];
+    state.AnalogButtons.R2  = input[layout.R2];
+    state.Buttons           = ReadU16(&input[layout.Buttons]);
+    state.SpecialButtons    = input[layout.Special] & layout.SpecialMask;
+    state.TimeStamp         = ReadU16(&input[layout.TimeStamp]);
+
+    if (layout.Battery != 0)
+    { state.BatteryLevel = input[layout.Battery]; }
+
+    state.Gyro.X  = int16_t(ReadU16(&input[layout.Gyro  + 0]));
+    state.Gyro.Y  = int16_t(ReadU16(&input[layout.Gyro  + 2]));
+    state.Gyro.Z  = int16_t(ReadU16(&input[layout.Gyro  + 4]));
+
+    state.Accel.X = int16_t(ReadU16(&input[layout.Accel + 0]));
+    state.Accel.Y = int16_t(ReadU16(&input[layout.Accel + 2]));
+    state.Accel.Z = int16_t(ReadU16(&input[layout.Accel + 4]));
+
+    const auto touch0 = &input[layout.Touch + 0];
+    const auto touch1 = &input[layout.Touch + 4];
+    if (layout.TouchCount != 0)
+    { state.TouchData.Count = input[layout.TouchCount]; }
+    else
+    { state.TouchData.Count = uint8_t(((touch0[0] & 0x80) == 0) + ((touch1[0] & 0x80) == 0)); }
+
+    MapTouch(touch0, state.TouchData.Touch[0]);
+    MapTouch(touch1, state.TouchData.Touch[1]);
+
+    state.Orientation = pRawData->Orientation;
+
+    return true;
 }
 
 //-----------------------------------------------------------------------------
-//      MACAhX擾܂.
+//      接続タイプが不明なレポートのマッピング処理です.
 //-----------------------------------------------------------------------------
-std::string GetMacAddress(const std::wstring& value)
+inline bool MapReportNone(const PadRawInput*, PadState& state)
 {
-    auto temp = ToStringA(value);
-    auto idx = temp.find("{");
-    if (idx == std::string::npos)
-    { return ""; }
+    memset(&state, 0, sizeof(state));
+    return false;
+}
 
-    temp = temp.substr(idx - 15, 14);
-    auto lst = Split(temp, '&');
-    if (lst.size() != 3)
-    { return ""; }
+// マッピング処理.
+typedef bool (*ReportDecoder)(const PadRawInput* pRawData, PadState& state);
 
-    lst[2] = Replace(lst[2], "0", "");
-    if (lst[2] == "")
-    { lst[2] = "0"; }
-    return lst[0] + lst[1] + lst[2];
+// [DualSenseかどうか][接続タイプ].
+static const ReportDecoder kReportDecoders[2][4] = {
+    {
+        MapReportNone,
+        MapReport<PAD_CONNECTION_USB>,
+        MapReport<PAD_CONNECTION_BT>,
+        MapReport<PAD_CONNECTION_WIRELESS>,
+    },
+    {
+        MapReportNone,
+        MapReport<PAD_CONNECTION_USB      | PAD_CONNECTION_DUAL_SENSE>,
+        MapReport<PAD_CONNECTION_BT       | PAD_CONNECTION_DUAL_SENSE>,
+        MapReportNone,  // DualSense にワイヤレスアダプタは存在しない.
+    },
+};
+
+//-----------------------------------------------------------------------------
+//      接続タイプに対応するマッピング処理を取得します.
+//-----------------------------------------------------------------------------
+inline ReportDecoder GetReportDecoder(uint32_t type)
+{
+    if (!PadIsSupportedType(type))
+    { return MapReportNone; }
+
+    return kReportDecoders[!!(type & PAD_CONNECTION_DUAL_SENSE) ? 1 : 0][type & kPadConnectionMask];
 }
 
+// DPadの値(0~8)から方向ビット(↑→↓←)への変換表.
+static const uint8_t kDpadBits[16] = {
+    0x1, 0x3, 0x2, 0x6, 0x4, 0xc, 0x8, 0x9,
+    0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+};
 
 //-----------------------------------------------------------------------------
-//      pbhڑ܂.
+//      マッピングできるレポートかどうか.
 //-----------------------------------------------------------------------------
-bool PadOpen(PadHandle& result)
+bool IsMappable(const PadRawInput* pRawData)
 {
-    GUID guid;
-    HidD_GetHidGuid(&guid);
-
-    auto info = SetupDiGetClassDevs(&guid, NULL, NULL, DIGCF_PRESENT | DIGCF_INTERFACEDEVICE);
-    if (info == nullptr)
+    if (!PadIsSupportedType(pRawData->Type))
     { return false; }
 
-    SP_DEVICE_INTERFACE_DATA devInfoData;
-    devInfoData.cbSize = sizeof(devInfoData);
+    const auto reportId = PadGetReportLayout(pRawData->Type).ReportId;
+    return reportId == 0 || pRawData->Bytes[0] == reportId;
+}
 
-    ULONG length    = 0;
-    ULONG required  = 0;
-    auto  index     = 0u;
-    auto  deviceDetected = false;
+//-----------------------------------------------------------------------------
+//      ボタンと特殊ボタンを PAD_EDGE_BUTTON のビットにまとめます.
+//-----------------------------------------------------------------------------
+uint32_t GetButtonMask(const uint8_t* input, const PadReportLayout& layout)
+{
+    const auto buttons = ReadU16(&input[layout.Buttons]);
+    const auto special = uint32_t(input[layout.Special] & layout.SpecialMask);
+    return (buttons & 0xfff0u) | kDpadBits[buttons & 0xf] | (special << 16);
+}
 
-    uint32_t        type = 0;
-    DWORD           size = 0;
-    HANDLE          handle = nullptr;
-    std::wstring    devicePath;
-    std::string     macAddress;
+} // namespace
 
-    // 170(CUH_ZCT1x), 182(CUH_ZCT2x), 180(CFI_ZCT1J).
-    std::array<uint8_t, 184> buf;
 
-    for(; deviceDetected == false; index++)
-    {
-        auto ret = SetupDiEnumDeviceInterfaces(info, 0, &guid, index, &devInfoData);
-        if (ret == FALSE)
-        {
-            SetupDiDestroyDeviceInfoList(info);
-            return false;
-        }
+///////////////////////////////////////////////////////////////////////////////
+// DeviceTimeline structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  センサータイムスタンプの周回を補正し, ホスト時刻との対応を推定します.
+//!
+//! @note   時計の進み方の比は一定区間ごとに受信遅延が最小のレポートを選び, それらから
+//!         指数移動平均による最小二乗法で求めます. オフセットは受信遅延が最小となる
+//!         レポート(推定直線の下側の包絡線)で求めます.
+//!         ホスト時刻は AnchorHost からの相対値で保持します.
+struct DeviceTimeline
+{
+    bool        Valid       = false;    //!< 1度でもタイムスタンプを受信したかどうか.
+    uint32_t    LastCount   = 0;        //!< 前回のカウント値.
+    uint64_t    LastHost    = 0;        //!< 前回の受信時刻.
+    uint64_t    Ticks       = 0;        //!< 接続時からの累積カウント.
+    uint64_t    DeviceTime  = 0;        //!< 前回のデバイス時刻(マイクロ秒).
+    uint64_t    AnchorHost  = 0;        //!< 最初の受信時刻.
+    uint64_t    Samples     = 0;        //!< 推定に使用したレポート数.
+    uint64_t    BlockStart  = 0;        //!< 現在の区間の開始時刻(デバイス時刻).
+    double      BlockDevice = 0.0;      //!< 現在の区間で受信遅延が最小のレポートのデバイス時刻.
+    double      BlockHost   = 0.0;      //!< 現在の区間で受信遅延が最小のレポートの受信時刻.
+    uint64_t    Blocks      = 0;        //!< 傾きの推定に使用した区間数.
+    double      MeanDevice  = 0.0;      //!< デバイス時刻の平均.
+    double      MeanHost    = 0.0;      //!< 受信時刻の平均.
+    double      VarDevice   = 0.0;      //!< デバイス時刻の分散.
+    double      CovDevHost  = 0.0;      //!< デバイス時刻と受信時刻の共分散.
+    double      Rate        = 1.0;      //!< デバイス時刻1マイクロ秒あたりのホスト時刻の進み.
+    double      EstDevice   = 0.0;      //!< 推定直線上の点(デバイス時刻).
+    double      EstHost     = 0.0;      //!< 推定直線上の点(ホスト時刻).
+};
 
-        // TCY擾.
-        SetupDiGetDeviceInterfaceDetail(info, &devInfoData, NULL, 0, &length, NULL);
+///////////////////////////////////////////////////////////////////////////////
+// FrameCounter structure
+///////////////////////////////////////////////////////////////////////////////
+struct FrameCounter
+{
+    bool        Valid       = false;    //!< 1度でもフレームカウンターを受信したかどうか.
+    uint32_t    Last        = 0;        //!< 前回のフレームカウンター.
+    uint64_t    DeviceTime  = 0;        //!< 前回のデバイス時刻(マイクロ秒).
+    double      Interval    = 0.0;      //!< レポート間隔の平均(デバイス時刻, マイクロ秒).
+};
 
-        // TCYҒlȏȂ珈Ȃ.
-        if (buf.size() < length)
-        { continue; }
+///////////////////////////////////////////////////////////////////////////////
+// FusionState structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  受信スレッドで行う姿勢推定の状態です.
+//!
+//! @note   姿勢は重力方向をZ軸とする内部座標系(X = 右, Y = 奥, Z = 上)で保持します.
+struct FusionState
+{
+    bool        Valid       = false;                //!< 姿勢を初期化済みかどうか.
+    uint64_t    DeviceTime  = 0;                    //!< 前回のデバイス時刻(マイクロ秒).
+    float       Q[4]        = { 1.0f, 0.0f, 0.0f, 0.0f };   //!< 姿勢(W, X, Y, Z).
+};
 
-        auto detailData = reinterpret_cast<PSP_DEVICE_INTERFACE_DETAIL_DATA>(buf.data());
-        detailData->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
+///////////////////////////////////////////////////////////////////////////////
+// Histogram structure
+///////////////////////////////////////////////////////////////////////////////
+struct Histogram
+{
+    std::atomic<uint64_t>   Count   { 0 };
+    std::atomic<uint64_t>   Sum     { 0 };
+    std::atomic<uint64_t>   Max     { 0 };
+    std::atomic<uint64_t>   Buckets[kPadHistogramBuckets] = {};
+};
 
-        ret = SetupDiGetDeviceInterfaceDetail(info, &devInfoData, detailData, length, &required, NULL);
-        if (ret == FALSE)
-        {
-            auto errcode = GetLastError();
-            SetupDiDestroyDeviceInfoList(info);
-            return false;
-        }
+///////////////////////////////////////////////////////////////////////////////
+// PadOutput structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadOutput
+{
+    PadVibrationParam   Vibration   = {};       //!< バイブレーション.
+    PadColor            LightBar    = {};       //!< ライトバーカラー.
+    PadFlashParam       Flash       = {};       //!< ライトバーの点滅.
+    PadTriggerEffect    Trigger[2]  = {};       //!< アダプティブトリガー.
+    uint32_t            Dirty       = 0;        //!< 未送信の変更フラグ.
+    uint8_t             Sequence    = 0;        //!< DualSense Bluetooth 出力レポートのシーケンス番号.
+    std::chrono::steady_clock::duration     Interval {};    //!< 最小送信間隔.
+    std::chrono::steady_clock::time_point   LastFlush {};   //!< 最後に送信した時刻.
+    std::chrono::steady_clock::time_point   DirtySince {};  //!< 未送信の変更が最初に発生した時刻.
+
+    std::mutex              Lock;                   //!< 設定関数と書き込みスレッドの排他制御.
+    std::condition_variable Signal;                 //!< 書き込みスレッドへの送信要求.
+    std::thread             Writer;                 //!< 書き込みスレッド.
+    bool                    Requested   = false;    //!< 送信要求があるかどうか.
+    bool                    WriterStop  = false;    //!< 書き込みスレッドの停止要求.
+};
 
-        handle = CreateFile(
-            detailData->DevicePath,
-            FILE_GENERIC_READ | FILE_GENERIC_WRITE,
-            FILE_SHARE_READ   | FILE_SHARE_WRITE,
-            (LPSECURITY_ATTRIBUTES)NULL,
-            OPEN_EXISTING,
-            0,
-            NULL);
 
-        if (handle == nullptr)
-        {
-            continue;
-        }
+///////////////////////////////////////////////////////////////////////////////
+// CaptureCounters structure
+///////////////////////////////////////////////////////////////////////////////
+struct CaptureCounters
+{
+    std::atomic<uint64_t>   Records     { 0 };  //!< ファイルに書き込んだレコード数.
+    std::atomic<uint64_t>   Dropped     { 0 };  //!< 書き込みが追いつかず破棄したレコード数.
+    std::atomic<uint64_t>   Chunks      { 0 };  //!< ファイルに書き込んだチャンク数.
+    std::atomic<uint64_t>   WriteCalls  { 0 };  //!< ファイルへの書き込み回数.
+    std::atomic<uint64_t>   WriteErrors { 0 };  //!< ファイルへの書き込みに失敗した回数.
+};
 
-        HIDD_ATTRIBUTES attributes = {};
-        ret = HidD_GetAttributes(handle, &attributes);
-        if (ret == FALSE)
-        {
-            CloseHandle(handle);
-            handle = nullptr;
+///////////////////////////////////////////////////////////////////////////////
+// CaptureChunk structure
+///////////////////////////////////////////////////////////////////////////////
+struct CaptureChunk
+{
+    uint8_t*    pBytes  = nullptr;  //!< 索引まで書き込み済みのチャンク.
+    uint32_t    Count   = 0;        //!< レコード数.
+};
 
-            continue;
-        }
+///////////////////////////////////////////////////////////////////////////////
+// CaptureWriter structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  キャプチャファイルの書き込み状態です.
+//!
+//! @note   受信スレッドは pActive のチャンクにレコードを追記し, 満杯になったら Pending に渡します.
+//!         書き込みスレッドは Pending のチャンクをファイルに書き込み, Free に戻します.
+struct CaptureWriter
+{
+    FILE*                       pFile        = nullptr;     //!< 記録先のファイル.
+    uint32_t                    ReportSize   = 0;           //!< レコード内のレポートのサイズ.
+    uint32_t                    RecordStride = 0;           //!< レコードのサイズ.
+    uint32_t                    ChunkBytes   = 0;           //!< 索引を含むチャンクの最大サイズ.
+    std::unique_ptr<uint8_t[]>  Memory;                     //!< チャンクバッファ(kCaptureBufferCount 個).
+    CaptureCounters*            pCounters    = nullptr;     //!< 統計の格納先.
+
+    uint8_t*                    pActive      = nullptr;     //!< 追記中のチャンク(PadHandle::CaptureLock で保護).
+    uint32_t                    Count        = 0;           //!< 追記中のチャンクのレコード数(PadHandle::CaptureLock で保護).
+    uint64_t                    NextRecord   = 0;           //!< 追記中のチャンク先頭のレコードの通し番号(PadHandle::CaptureLock で保護).
+
+    std::mutex                  Lock;                       //!< Pending, Free, WriterStop の排他制御.
+    std::condition_variable     Signal;                     //!< 書き込みスレッドへの通知.
+    std::thread                 Writer;                     //!< 書き込みスレッド.
+    std::vector<CaptureChunk>   Pending;                    //!< 書き込み待ちのチャンク.
+    std::vector<uint8_t*>       Free;                       //!< 空きチャンク.
+    bool                        WriterStop   = false;       //!< 書き込みスレッドの停止要求.
+};
 
-        if (attributes.VendorID != kSonyCorp)
-        {
-            CloseHandle(handle);
-            handle = nullptr;
+///////////////////////////////////////////////////////////////////////////////
+// ReplaySource structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  キャプチャファイルを再生する入力元です.
+//!
+//! @note   ファイル全体をメモリマップし, チャンクの索引をたどってレコードを順に返します.
+struct ReplaySource
+{
+#if defined(_WIN32)
+    HANDLE              File        = INVALID_HANDLE_VALUE;     //!< ファイルハンドル.
+    HANDLE              Mapping     = nullptr;                  //!< ファイルマッピングオブジェクト.
+#endif
+    const uint8_t*      pBytes      = nullptr;  //!< マップしたファイルの先頭.
+    size_t              Size        = 0;        //!< ファイルサイズ.
+    PadCaptureHeader    Header      = {};       //!< ファイルのヘッダ.
+    size_t              Offset      = 0;        //!< 次のレコードの位置.
+    uint32_t            Remain      = 0;        //!< 現在のチャンクの残りレコード数.
+    bool                Indexed     = false;    //!< 現在のチャンクの末尾に索引があるかどうか.
+    double              Speed       = 1.0;      //!< 再生速度(0の場合は待たない).
+    uint64_t            FirstTime   = 0;        //!< 最初のレコードの受信時刻.
+    uint64_t            StartTime   = 0;        //!< 再生を開始したホスト時刻(0の場合は未開始).
+};
 
-            continue;
-        }
+///////////////////////////////////////////////////////////////////////////////
+// CalibrationBlob structure
+///////////////////////////////////////////////////////////////////////////////
+struct CalibrationBlob
+{
+    std::string     MacAddress;                         //!< デバイスのMACアドレス.
+    uint32_t        Type    = PAD_CONNECTION_NONE;      //!< 読み取った時の接続タイプ(接続方式で並びが異なる).
+    uint8_t         Bytes[kCalibrationSize] = {};       //!< フィーチャーレポート.
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadHandle structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadHandle
+{
+    NativeHandle    Handle      = kInvalidHandle;
+#if defined(_WIN32)
+    std::wstring    DevicePath;
+    OVERLAPPED      ReadOverlapped  = {};   //!< 読み取り用オーバーラップ構造体.
+    OVERLAPPED      WriteOverlapped = {};   //!< 書き込み用オーバーラップ構造体.
+    std::vector<uint8_t> ReadBuffer;        //!< まとめ読み用バッファ.
+    uint32_t        OutputSize  = 0;        //!< 出力レポートサイズ.
+    uint32_t        FeatureSize = 0;        //!< フィーチャーレポートサイズ.
+#else
+    int             Epoll       = -1;       //!< 読み取り待ち用のepollインスタンス.
+    std::string     DevicePath;
+#endif
+    uint32_t        Size        = 0;
+    uint32_t        Type        = PAD_CONNECTION_NONE;
+    ReportDecoder   Decoder     = MapReportNone;    //!< 接続タイプに対応するマッピング処理(接続時に決定).
+    PadRawInput     Previous    = {};       //!< PadGetStateChanges() で前回読み取ったデータ.
+    std::string     MacAddress;
+    int32_t         Timeout     = -1;       //!< 読み取りタイムアウト(ミリ秒, 負値で無制限).
+    PadOutput       Output;                 //!< 出力レポートの状態.
+    std::atomic<bool> Connected { true };   //!< 接続中かどうか(読み書きでデバイスエラーを検出した場合にfalse).
+
+    std::atomic<uint64_t>       ReadCalls   { 0 };      //!< 読み取りシステムコール回数.
+    std::atomic<uint64_t>       WaitCalls   { 0 };      //!< 待機システムコール回数.
+    std::atomic<uint64_t>       Reports     { 0 };      //!< 受信したレポート数.
+    std::atomic<uint64_t>       CrcErrors   { 0 };      //!< CRC32が一致せず破棄したレポート数.
+    std::atomic<uint64_t>       WriteCalls  { 0 };      //!< 書き込みシステムコール回数.
+    std::atomic<uint64_t>       WriteErrors { 0 };      //!< 書き込みに失敗した回数.
+    std::atomic<uint64_t>       Coalesced   { 0 };      //!< 未送信のレポートにまとめた変更の数.
+    std::atomic<uint64_t>       LatencySum  { 0 };      //!< 書き込み完了までの時間の合計(マイクロ秒).
+    std::atomic<uint64_t>       LatencyMax  { 0 };      //!< 書き込み完了までの時間の最大値(マイクロ秒).
+
+    std::unique_ptr<InputRing>  Ring;                   //!< 読み取りスレッドからの受信データ.
+    std::thread                 Reader;                 //!< 読み取りスレッド.
+    std::atomic<bool>           ReaderStop  { false };  //!< 読み取りスレッドの停止要求.
+    std::atomic<uint32_t>       Overflow    { 0 };      //!< リングバッファ溢れで破棄したレポート数.
+
+    FrameCounter                Counter;                //!< 欠落検出用のフレームカウンター(受信スレッドのみ参照).
+    uint64_t                    LastReceive = 0;        //!< 前回の受信時刻(受信スレッドのみ参照).
+    std::atomic<uint64_t>       Counted     { 0 };      //!< フレームカウンターを確認したレポート数.
+    std::atomic<uint64_t>       Lost        { 0 };      //!< フレームカウンターの欠番から検出した未受信のレポート数.
+    std::atomic<uint64_t>       Repeated    { 0 };      //!< フレームカウンターが進まなかったレポート数.
+    Histogram                   Interval;               //!< 受信間隔.
+    Histogram                   Latency;                //!< 受信から取り出しまでの時間.
+
+    PadCalibration              Calibration = {};       //!< IMUの補正係数.
+    bool                        Calibrated  = false;    //!< デバイスから補正データを取得できたかどうか.
+
+    std::atomic<bool>           FusionEnabled { false };                //!< 姿勢推定を行うかどうか.
+    std::atomic<bool>           FusionReset   { false };                //!< 姿勢の初期化要求.
+    std::atomic<float>          FusionGain    { kFusionDefaultGain };   //!< 姿勢推定のゲイン.
+    FusionState                 Fusion;                                 //!< 姿勢推定の状態(受信スレッドのみ参照).
+
+    std::atomic<PadEventQueue*> EventQueue  { nullptr };    //!< 入力イベントの追加先.
+    std::atomic<uint32_t>       EventSource { 0 };          //!< 入力イベントの識別子.
+    PadEventQueue*              EventTarget = nullptr;      //!< EventPrevious を記録したキュー(受信スレッドのみ参照).
+    bool                        EventPrimed = false;        //!< EventPrevious が有効かどうか(受信スレッドのみ参照).
+    PadRawInput                 EventPrevious = {};         //!< 入力イベント生成用の前回の受信データ(受信スレッドのみ参照).
+
+    DeviceTimeline              Timeline;                   //!< デバイス時刻の拡張と時刻推定(受信スレッドのみ参照).
+    std::atomic<uint32_t>       ClockSequence { 0 };        //!< Clock のシーケンスロック(奇数の場合は書き込み中, 0の場合は未受信).
+    PadClockEstimate            Clock       = {};           //!< 公開用の時刻推定値.
+
+    std::mutex                      CaptureLock;                //!< Capture の排他制御(受信スレッドと記録の開始・終了).
+    std::atomic<bool>               Capturing   { false };      //!< 記録中かどうか.
+    std::unique_ptr<CaptureWriter>  Capture;                    //!< 記録先.
+    CaptureCounters                 CaptureStats;               //!< 記録の統計.
+
+    std::unique_ptr<ReplaySource>   Replay;                     //!< キャプチャファイルの再生元(デバイスの代わり).
+    PadTransport                    Transport   = {};           //!< 差し替えた入出力(Device が有効な場合のみ使用).
+    void*                           Device      = nullptr;      //!< Transport で開いたデバイス.
+#if defined(_WIN32)
+    HANDLE                      ReaderEvent = nullptr;  //!< 読み取りスレッド停止通知用のイベント.
+#else
+    int                         ReaderEvent = -1;       //!< 読み取りスレッド停止通知用のeventfd.
+#endif
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadSlot structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadSlot
+{
+    PadHandle*              pHandle     = nullptr;
+    std::atomic<uint32_t>   Sequence    { 0 };      //!< シーケンスロック(奇数の場合は書き込み中, 0の場合は未受信).
+    std::atomic<bool>       Connected   { false };  //!< 接続中かどうか.
+    PadRawInput             Latest      = {};       //!< 最新の受信データ.
+    uint8_t                 Padding[kCacheLineSize];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadManager structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadManager
+{
+    PadSlot                 Slots[kPadMaxManagedCount];
+    std::atomic<uint32_t>   Count       { 0 };      //!< 使用中のスロット数.
+    std::mutex              Lock;                   //!< スロット追加の排他制御.
+    std::thread             Thread;                 //!< 入出力スレッド.
+    std::atomic<bool>       Stop        { false };  //!< 入出力スレッドの停止要求.
+#if defined(_WIN32)
+    HANDLE                  WakeEvent   = nullptr;  //!< 入出力スレッド起床用イベント.
+#else
+    int                     Epoll       = -1;       //!< 全パッドを監視するepollインスタンス.
+    int                     WakeEvent   = -1;       //!< 入出力スレッド起床用のeventfd.
+#endif
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadEventCell structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadEventCell
+{
+    std::atomic<uint32_t>   Sequence;   //!< 書き込み可能な位置, または書き込み済みの位置 + 1.
+    PadEvent                Event;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadEventQueue structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  複数プロデューサー/単一コンシューマー用の有界ロックフリーキューです.
+//!
+//! @note   プロデューサーは1レポート分のイベントを1回のCASでまとめて確保し,
+//!         セルごとのシーケンス番号で書き込み完了をコンシューマーに通知します.
+struct PadEventQueue
+{
+    std::atomic<uint32_t>   Head        { 0 };      //!< 次に確保する位置(プロデューサー間で共有).
+    uint8_t                 Padding0[kCacheLineSize - sizeof(std::atomic<uint32_t>)];
+    uint32_t                Tail        = 0;        //!< 次に取り出す位置(コンシューマーのみ).
+    uint8_t                 Padding1[kCacheLineSize - sizeof(uint32_t)];
+    std::atomic<uint64_t>   Dropped     { 0 };      //!< 満杯のため破棄したイベント数.
+    uint32_t                Mask        = 0;        //!< 要素数 - 1.
+    std::unique_ptr<PadEventCell[]> Cells;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadStickTable structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  スティックの整形結果のテーブルです.
+//!
+//! @note   整形は上下左右で対称なので, 中心からの距離ごとの出力の大きさを1象限分のみ保持し,
+//!         符号は入力から決めます.
+struct PadStickTable
+{
+    PadStickProfile     Profile;                                        //!< 整形方法.
+    uint32_t            Entries[kStickTableSize * kStickTableSize];     //!< [Yの距離][Xの距離] の出力(下位16bitがX, 上位16bitがY).
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadDeviceEvent structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadDeviceEvent
+{
+    PAD_DEVICE_EVENT        Event;
+    PadDeviceInfo           Info;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// PadHotplug structure
+///////////////////////////////////////////////////////////////////////////////
+struct PadHotplug
+{
+    PadHotplugCallback          Callback    = nullptr;
+    void*                       pUser       = nullptr;
+    std::mutex                  Lock;                   //!< デバイスリストと未通知イベントの排他制御.
+    std::vector<PadDeviceInfo>  Devices;                //!< 接続中のデバイスリスト.
+    std::vector<PadDeviceEvent> Pending;                //!< 未通知のイベント.
+    std::vector<PadDeviceEvent> Dispatch;               //!< 通知処理用の作業領域.
+#if defined(_WIN32)
+    HCMNOTIFICATION             Notify      = nullptr;  //!< デバイス通知ハンドル.
+#else
+    int                         Socket      = -1;       //!< udev監視用のnetlinkソケット.
+#endif
+};
+
+//-----------------------------------------------------------------------------
+//      接続タイプを判定します.
+//-----------------------------------------------------------------------------
+uint32_t GetConnectionType(uint16_t vendorId, uint16_t productId, bool bluetooth)
+{
+    if (vendorId != kSonyCorp)
+    { return PAD_CONNECTION_NONE; }
+
+    if (productId == kDualShockWirelessAdaptor)
+    { return PAD_CONNECTION_WIRELESS; }
+
+    uint32_t connection = (bluetooth) ? PAD_CONNECTION_BT : PAD_CONNECTION_USB;
+
+    if (productId == kDualShock4_CUH_ZCT1x || productId == kDualShock4_CUH_ZCT2x)
+    { return connection; }
+
+    if (productId == kDualSense_CFI_ZCT1J)
+    { return connection | PAD_CONNECTION_DUAL_SENSE; }
+
+    return PAD_CONNECTION_NONE;
+}
+
+//-----------------------------------------------------------------------------
+//      Bluetooth 接続かどうかチェックします.
+//-----------------------------------------------------------------------------
+bool IsBluetooth(uint32_t type)
+{
+    // PAD_CONNECTION_WIRELESS もBluetoothのビットを含むため一致で判定する.
+    return (type & kPadConnectionMask) == PAD_CONNECTION_BT;
+}
+
+//-----------------------------------------------------------------------------
+//      CRC32を計算します.
+//-----------------------------------------------------------------------------
+uint32_t Crc32(uint32_t crc, const uint8_t* pBytes, size_t size)
+{
+    auto& table = kCrc32Table.Values;
+
+    // 8バイトずつ処理する(リトルエンディアン前提).
+    while(size >= 8)
+    {
+        uint32_t lo;
+        uint32_t hi;
+        memcpy(&lo, pBytes + 0, sizeof(lo));
+        memcpy(&hi, pBytes + 4, sizeof(hi));
+        lo ^= crc;
+
+        crc = table[7][ lo        & 0xff] ^ table[6][(lo >>  8) & 0xff]
+            ^ table[5][(lo >> 16) & 0xff] ^ table[4][ lo >> 24        ]
+            ^ table[3][ hi        & 0xff] ^ table[2][(hi >>  8) & 0xff]
+            ^ table[1][(hi >> 16) & 0xff] ^ table[0][ hi >> 24        ];
+
+        pBytes += 8;
+        size   -= 8;
+    }
+
+    while(size > 0)
+    {
+        crc = (crc >> 8) ^ table[0][(crc ^ *pBytes) & 0xff];
+        pBytes++;
+        size--;
+    }
+
+    return crc;
+}
+
+//-----------------------------------------------------------------------------
+//      Bluetooth レポートのCRC32を計算します.
+//-----------------------------------------------------------------------------
+uint32_t BluetoothCrc32(uint8_t seed, const uint8_t* pBytes)
+{
+    auto crc = Crc32(0xffffffffu, &seed, 1);
+    return ~Crc32(crc, pBytes, kBluetoothCrcOffset);
+}
+
+//-----------------------------------------------------------------------------
+//      Bluetooth 入力レポートを検証します.
+//-----------------------------------------------------------------------------
+bool ValidateReport(uint32_t type, const uint8_t* pBytes, size_t size)
+{
+    if (!IsBluetooth(type))
+    { return true; }
+
+    // 全データ入りのレポートのみCRC32が付加されている.
+    if (pBytes[0] != kDualShock4InputBT && pBytes[0] != kDualSenseInputBT)
+    { return true; }
+
+    if (size < kBluetoothReportSize)
+    { return false; }
+
+    uint32_t expected = uint32_t(pBytes[kBluetoothCrcOffset + 0])
+                      | uint32_t(pBytes[kBluetoothCrcOffset + 1]) << 8
+                      | uint32_t(pBytes[kBluetoothCrcOffset + 2]) << 16
+                      | uint32_t(pBytes[kBluetoothCrcOffset + 3]) << 24;
+
+    return BluetoothCrc32(kCrcSeedInput, pBytes) == expected;
+}
+
+//-----------------------------------------------------------------------------
+//      Bluetooth 出力レポートにCRC32を付加します.
+//-----------------------------------------------------------------------------
+void AppendCrc32(uint8_t* pBytes)
+{
+    auto crc = BluetoothCrc32(kCrcSeedOutput, pBytes);
+    pBytes[kBluetoothCrcOffset + 0] = uint8_t(crc);
+    pBytes[kBluetoothCrcOffset + 1] = uint8_t(crc >> 8);
+    pBytes[kBluetoothCrcOffset + 2] = uint8_t(crc >> 16);
+    pBytes[kBluetoothCrcOffset + 3] = uint8_t(crc >> 24);
+}
+
+//-----------------------------------------------------------------------------
+// Global Variables.
+//-----------------------------------------------------------------------------
+static std::mutex                   g_CalibrationLock;  // 補正データキャッシュの排他制御.
+static std::vector<CalibrationBlob> g_CalibrationCache; // デバイスごとの補正データ.
+
+//-----------------------------------------------------------------------------
+//      既定のIMU補正係数(オフセット無し, 等倍)を設定します.
+//-----------------------------------------------------------------------------
+void SetDefaultCalibration(PadCalibration& result)
+{
+    for(auto i=0; i<3; ++i)
+    {
+        result.GyroBias  [i] = 0;
+        result.GyroScale [i] = kCalibrationOne;
+        result.AccelBias [i] = 0;
+        result.AccelScale[i] = kCalibrationOne;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      補正係数の倍率を16bit固定小数で求めます.
+//-----------------------------------------------------------------------------
+bool GetCalibrationScale(int64_t numer, int64_t denom, int32_t& result)
+{
+    if (numer <= 0 || denom <= 0)
+    { return false; }
+
+    // 公称値から大きく外れる場合は補正データが壊れているとみなす.
+    auto scale = (numer * kCalibrationOne + denom / 2) / denom;
+    if (scale < kCalibrationOne / 2 || scale > kCalibrationOne * 2)
+    { return false; }
+
+    result = int32_t(scale);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      IMUの補正データから補正係数を求めます.
+//-----------------------------------------------------------------------------
+bool ParseCalibration(uint32_t type, const uint8_t* pBytes, PadCalibration& result)
+{
+    auto read = [pBytes](uint32_t offset) { return int32_t(int16_t(ReadU16(pBytes + offset))); };
+
+    SetDefaultCalibration(result);
+
+    // DualShock4 のBluetooth接続時とワイヤレスアダプタ経由の場合のみ, 正方向と負方向の並びが異なる.
+    // PAD_CONNECTION_WIRELESS はBluetoothのビットを含むので, ビットの有無で判定する.
+    uint32_t plusOffset [3] = {  7, 11, 15 };
+    uint32_t minusOffset[3] = {  9, 13, 17 };
+    if ((type & PAD_CONNECTION_BT) != 0 && (type & PAD_CONNECTION_DUAL_SENSE) == 0)
+    {
+        plusOffset [0] =  7; plusOffset [1] =  9; plusOffset [2] = 11;
+        minusOffset[0] = 13; minusOffset[1] = 15; minusOffset[2] = 17;
+    }
+
+    auto valid   = true;
+    auto speed2x = int64_t(read(19)) + read(21);
+    for(auto i=0; i<3; ++i)
+    {
+        // オフセットはファームウェアで補正済みのため, 範囲の算出にのみ使用する.
+        auto bias  = read(1 + i * 2);
+        auto range = std::abs(read(plusOffset[i]) - bias) + std::abs(read(minusOffset[i]) - bias);
+        valid &= GetCalibrationScale(speed2x * int64_t(kGyroResInDegSec), range, result.GyroScale[i]);
+    }
+
+    for(auto i=0; i<3; ++i)
+    {
+        auto plus  = read(23 + i * 4);
+        auto minus = read(25 + i * 4);
+        auto range = plus - minus;
+        if (GetCalibrationScale(2 * int64_t(kAccelResPerG), range, result.AccelScale[i]))
+        { result.AccelBias[i] = plus - range / 2; }
+        else
+        { valid = false; }
+    }
+
+    return valid;
+}
+
+//-----------------------------------------------------------------------------
+//      キャッシュから補正データを検索します.
+//-----------------------------------------------------------------------------
+bool FindCalibration(const std::string& macAddress, CalibrationBlob& result)
+{
+    if (macAddress.empty())
+    { return false; }
+
+    std::lock_guard<std::mutex> locker(g_CalibrationLock);
+    for(auto& itr : g_CalibrationCache)
+    {
+        if (itr.MacAddress == macAddress)
+        {
+            result = itr;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+//      補正データをキャッシュに格納します.
+//-----------------------------------------------------------------------------
+void StoreCalibration(const CalibrationBlob& value)
+{
+    if (value.MacAddress.empty())
+    { return; }
+
+    std::lock_guard<std::mutex> locker(g_CalibrationLock);
+    for(auto& itr : g_CalibrationCache)
+    {
+        if (itr.MacAddress == value.MacAddress)
+        {
+            itr = value;
+            return;
+        }
+    }
+
+    g_CalibrationCache.push_back(value);
+}
+
+//-----------------------------------------------------------------------------
+//      IMUの補正係数を求めます(補正データは read(id, pBytes) で読み取ります).
+//-----------------------------------------------------------------------------
+template<typename Reader>
+bool LoadCalibration(const std::string& macAddress, uint32_t type, Reader read, PadCalibration& result)
+{
+    CalibrationBlob blob;
+
+    // Bluetooth 接続時は全データ入りのレポートに切り替えるため, キャッシュがあっても読み取る.
+    auto found = !IsBluetooth(type) && FindCalibration(macAddress, blob);
+    if (!found)
+    {
+        auto id = (IsBluetooth(type) || (type & PAD_CONNECTION_DUAL_SENSE) != 0)
+            ? kFeatureCalibrationBT
+            : kFeatureCalibrationUSB;
+
+        blob.MacAddress = macAddress;
+        blob.Type       = type;
+        blob.Bytes[0]   = id;
+        found = read(id, blob.Bytes) && blob.Bytes[0] == id;
+        if (found)
+        { StoreCalibration(blob); }
+    }
+
+    if (!found)
+    {
+        SetDefaultCalibration(result);
+        return false;
+    }
+
+    return ParseCalibration(blob.Type, blob.Bytes, result);
+}
+
+//-----------------------------------------------------------------------------
+//      角速度と加速度に補正係数を適用します.
+//-----------------------------------------------------------------------------
+void CalibrateMotion
+(
+    const PadCalibration&       calibration,
+    const PadAngularVelocity&   gyro,
+    const PadAccelaration&      accel,
+    PadMotion&                  result
+)
+{
+    // 固定小数の倍率と分解能の逆数をまとめて掛け, 除算を使わずに物理単位にする.
+    const float kGyroFactor  = 1.0f / (kGyroResInDegSec * float(kCalibrationOne));
+    const float kAccelFactor = 1.0f / (kAccelResPerG    * float(kCalibrationOne));
+
+    auto& c = calibration;
+    result.GyroX  = float(int64_t(gyro.X  - c.GyroBias [0]) * c.GyroScale [0]) * kGyroFactor;
+    result.GyroY  = float(int64_t(gyro.Y  - c.GyroBias [1]) * c.GyroScale [1]) * kGyroFactor;
+    result.GyroZ  = float(int64_t(gyro.Z  - c.GyroBias [2]) * c.GyroScale [2]) * kGyroFactor;
+    result.AccelX = float(int64_t(accel.X - c.AccelBias[0]) * c.AccelScale[0]) * kAccelFactor;
+    result.AccelY = float(int64_t(accel.Y - c.AccelBias[1]) * c.AccelScale[1]) * kAccelFactor;
+    result.AccelZ = float(int64_t(accel.Z - c.AccelBias[2]) * c.AccelScale[2]) * kAccelFactor;
+}
+
+//-----------------------------------------------------------------------------
+//      1 / sqrt(x) を求めます(0以下の場合は0).
+//-----------------------------------------------------------------------------
+inline float InvSqrt(float x)
+{ return (x > 0.0f) ? 1.0f / std::sqrt(x) : 0.0f; }
+
+//-----------------------------------------------------------------------------
+//      x が正の場合は value を, そうでない場合は0を返却します.
+//-----------------------------------------------------------------------------
+inline float IfPositive(float x, float value)
+{ return (x > 0.0f) ? value : 0.0f; }
+
+//-----------------------------------------------------------------------------
+//      Madgwickフィルタで姿勢 q を1ステップ更新します.
+//-----------------------------------------------------------------------------
+//      V は float または複数の記録を並べたSIMD型です.
+//      q, g(rad/s), a は内部座標系(X = 右, Y = 奥, Z = 上)の値です.
+template<typename V>
+inline void FuseStep(V* q, const V* g, const V* a, V beta, V dt)
+{
+    const V half (0.5f);
+    const V two  (2.0f);
+    const V four (4.0f);
+    const V eight(8.0f);
+
+    auto q0 = q[0];
+    auto q1 = q[1];
+    auto q2 = q[2];
+    auto q3 = q[3];
+
+    // 角速度による姿勢の変化率.
+    auto dq0 = (q1 * g[0] + q2 * g[1] + q3 * g[2]) * V(-0.5f);
+    auto dq1 = (q0 * g[0] + q2 * g[2] - q3 * g[1]) * half;
+    auto dq2 = (q0 * g[1] - q1 * g[2] + q3 * g[0]) * half;
+    auto dq3 = (q0 * g[2] + q1 * g[1] - q2 * g[0]) * half;
+
+    // 姿勢から求めた重力方向と加速度の差を小さくする勾配.
+    auto an = a[0] * a[0] + a[1] * a[1] + a[2] * a[2];
+    auto ar = InvSqrt(an);
+    auto ax = a[0] * ar;
+    auto ay = a[1] * ar;
+    auto az = a[2] * ar;
+
+    auto q0q0 = q0 * q0;
+    auto q1q1 = q1 * q1;
+    auto q2q2 = q2 * q2;
+    auto q3q3 = q3 * q3;
+
+    auto s0 = four * q0 * q2q2 + two * q2 * ax + four * q0 * q1q1 - two * q1 * ay;
+    auto s1 = four * q1 * q3q3 - two * q3 * ax + four * q0q0 * q1 - two * q0 * ay - four * q1
+            + eight * q1 * q1q1 + eight * q1 * q2q2 + four * q1 * az;
+    auto s2 = four * q0q0 * q2 + two * q0 * ax + four * q2 * q3q3 - two * q3 * ay - four * q2
+            + eight * q2 * q1q1 + eight * q2 * q2q2 + four * q2 * az;
+    auto s3 = four * q1q1 * q3 - two * q1 * ax + four * q2q2 * q3 - two * q2 * ay;
+
+    // 加速度が0の場合(自由落下など)は補正しない.
+    auto k = IfPositive(an, beta * InvSqrt(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3));
+
+    q0 = q0 + (dq0 - k * s0) * dt;
+    q1 = q1 + (dq1 - k * s1) * dt;
+    q2 = q2 + (dq2 - k * s2) * dt;
+    q3 = q3 + (dq3 - k * s3) * dt;
+
+    auto qr = InvSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+    q[0] = q0 * qr;
+    q[1] = q1 * qr;
+    q[2] = q2 * qr;
+    q[3] = q3 * qr;
+}
+
+//-----------------------------------------------------------------------------
+//      加速度から初期姿勢(鉛直軸周りの回転無し)を求めます.
+//-----------------------------------------------------------------------------
+void InitFusion(const float* a, float* q)
+{
+    auto roll  = std::atan2(a[1], a[2]) * 0.5f;
+    auto pitch = std::atan2(-a[0], std::sqrt(a[1] * a[1] + a[2] * a[2])) * 0.5f;
+
+    auto cr = std::cos(roll);
+    auto sr = std::sin(roll);
+    auto cp = std::cos(pitch);
+    auto sp = std::sin(pitch);
+
+    q[0] =  cr * cp;
+    q[1] =  sr * cp;
+    q[2] =  cr * sp;
+    q[3] = -sr * sp;
+}
+
+//-----------------------------------------------------------------------------
+//      角速度と加速度を内部座標系に変換します.
+//-----------------------------------------------------------------------------
+inline void ToFusionFrame(const PadMotion& motion, float* g, float* a)
+{
+    g[0] =  motion.GyroX * kDegToRad;
+    g[1] = -motion.GyroZ * kDegToRad;
+    g[2] =  motion.GyroY * kDegToRad;
+    a[0] =  motion.AccelX;
+    a[1] = -motion.AccelZ;
+    a[2] =  motion.AccelY;
+}
+
+//-----------------------------------------------------------------------------
+//      姿勢を内部座標系に変換します.
+//-----------------------------------------------------------------------------
+inline void ToFusionFrame(const PadQuaternion& value, float* q)
+{
+    q[0] =  value.W;
+    q[1] =  value.X;
+    q[2] = -value.Z;
+    q[3] =  value.Y;
+}
+
+//-----------------------------------------------------------------------------
+//      内部座標系の姿勢をパッドの座標系に変換します.
+//-----------------------------------------------------------------------------
+inline PadQuaternion FromFusionFrame(const float* q)
+{ return PadQuaternion{ q[0], q[1], q[3], -q[2] }; }
+
+//-----------------------------------------------------------------------------
+//      ホストの現在時刻をマイクロ秒単位で取得します.
+//-----------------------------------------------------------------------------
+uint64_t GetHostTime()
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+//-----------------------------------------------------------------------------
+//      入力イベントキューにまとめて追加します.
+//-----------------------------------------------------------------------------
+bool PushEvents(PadEventQueue* pQueue, const PadEvent* pEvents, uint32_t count)
+{
+    if (count == 0)
+    { return true; }
+
+    if (count > pQueue->Mask + 1)
+    {
+        pQueue->Dropped.fetch_add(count, std::memory_order_relaxed);
+        return false;
+    }
+
+    auto head = pQueue->Head.load(std::memory_order_relaxed);
+    for(;;)
+    {
+        // コンシューマーは順番に取り出すため, 末尾のセルが空いていれば間のセルも空いている.
+        auto last = head + count - 1;
+        auto sequence = pQueue->Cells[last & pQueue->Mask].Sequence.load(std::memory_order_acquire);
+        auto diff = int32_t(sequence - last);
+        if (diff == 0)
+        {
+            if (pQueue->Head.compare_exchange_weak(head, head + count, std::memory_order_relaxed))
+            { break; }
+        }
+        else if (diff < 0)
+        {
+            pQueue->Dropped.fetch_add(count, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            head = pQueue->Head.load(std::memory_order_relaxed);
+        }
+    }
+
+    for(auto i=0u; i<count; ++i)
+    {
+        auto& cell = pQueue->Cells[(head + i) & pQueue->Mask];
+        cell.Event = pEvents[i];
+        cell.Sequence.store(head + i + 1, std::memory_order_release);
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      前回の受信データとの差分から入力イベントを生成します.
+//-----------------------------------------------------------------------------
+uint32_t MakeEvents(const PadRawInput* pPrevious, const PadRawInput& current, uint32_t source, PadEvent* pEvents)
+{
+    const auto layout   = PadGetReportLayout(current.Type);
+    const auto curr     = &current.Bytes[layout.Base];
+    const auto prev     = (pPrevious != nullptr) ? &pPrevious->Bytes[layout.Base] : nullptr;
+    const auto time     = ReadU16(&curr[layout.TimeStamp]);
+
+    auto count = 0u;
+    auto emit = [&](PAD_EVENT_TYPE type) -> PadEvent&
+    {
+        auto& event = pEvents[count++];
+        event.HostTime      = current.HostTime;
+        event.CaptureTime   = current.CaptureTime;
+        event.Source        = source;
+        event.Button        = 0;
+        event.DeviceTime    = time;
+        event.Type          = uint8_t(type);
+        event.Index         = 0;
+        event.X             = 0;
+        event.Y             = 0;
+        return event;
+    };
+
+    // ボタン(前回が無い場合は全て離されていたとみなす).
+    const auto buttons = GetButtonMask(curr, layout);
+    const auto changed = buttons ^ ((prev != nullptr) ? GetButtonMask(prev, layout) : 0u);
+    for(auto bits = changed; bits != 0; bits &= bits - 1)
+    {
+        const auto button = bits & (~bits + 1);
+        emit((buttons & button) ? PAD_EVENT_BUTTON_DOWN : PAD_EVENT_BUTTON_UP).Button = button;
+    }
+
+    // トリガー.
+    const uint8_t triggers[2] = { layout.L2, layout.R2 };
+    for(auto i=0u; i<2; ++i)
+    {
+        const auto value = curr[triggers[i]];
+        if (value == ((prev != nullptr) ? prev[triggers[i]] : 0))
+        { continue; }
+
+        auto& event = emit(PAD_EVENT_TRIGGER);
+        event.Index = uint8_t(i);
+        event.X     = value;
+    }
+
+    // タッチ(最上位ビットが0の場合に接触中).
+    for(auto i=0u; i<kPadMaxTouchCount; ++i)
+    {
+        const auto offset = layout.Touch + i * 4;
+        const auto currDown = (curr[offset] & 0x80) == 0;
+        const auto prevDown = (prev != nullptr) && (prev[offset] & 0x80) == 0;
+        const auto sameId   = prevDown && currDown && (prev[offset] == curr[offset]);
+
+        PadTouch touch;
+        if (prevDown && !sameId)
+        {
+            MapTouch(&prev[offset], touch);
+            auto& event = emit(PAD_EVENT_TOUCH_UP);
+            event.Index = uint8_t(i);
+            event.X     = touch.X;
+            event.Y     = touch.Y;
+        }
+
+        if (currDown && (!sameId || memcmp(&prev[offset + 1], &curr[offset + 1], 3) != 0))
+        {
+            MapTouch(&curr[offset], touch);
+            auto& event = emit(sameId ? PAD_EVENT_TOUCH_MOVE : PAD_EVENT_TOUCH_DOWN);
+            event.Index = uint8_t(i);
+            event.X     = touch.X;
+            event.Y     = touch.Y;
+        }
+    }
+
+    return count;
+}
+
+//-----------------------------------------------------------------------------
+//      センサータイムスタンプを64bitに拡張し, 入力時刻を推定します.
+//-----------------------------------------------------------------------------
+void UpdateTimeline(PadHandle* pHandle, PadRawInput& input)
+{
+    auto& timeline = pHandle->Timeline;
+
+    // タイムスタンプを含まないレポートは受信時刻を入力時刻とみなす.
+    if (!IsMappable(&input))
+    {
+        input.DeviceTime  = timeline.DeviceTime;
+        input.CaptureTime = input.HostTime;
+        return;
+    }
+
+    const auto clock  = GetClockLayout(input.Type);
+    const auto pBytes = &input.Bytes[PadGetReportLayout(input.Type).Base + clock.Offset];
+    const auto period = uint64_t(1) << (clock.Size * 8);
+
+    auto count = uint32_t(ReadU16(pBytes));
+    if (clock.Size == 4)
+    { count |= uint32_t(ReadU16(pBytes + 2)) << 16; }
+
+    const auto first = !timeline.Valid;
+    if (first)
+    {
+        timeline.Valid      = true;
+        timeline.AnchorHost = input.HostTime;
+    }
+    else
+    {
+        auto delta = (uint64_t(count) - timeline.LastCount) & (period - 1);
+
+        // 受信間隔が半周期を超えた場合は, 受信時刻の差から周回数を補う.
+        auto elapsed = (input.HostTime - timeline.LastHost) * clock.TickDen / clock.TickNum;
+        if (elapsed > delta + period / 2)
+        { delta += (elapsed - delta + period / 2) / period * period; }
+
+        timeline.Ticks += delta;
+    }
+
+    timeline.LastCount  = count;
+    timeline.LastHost   = input.HostTime;
+    timeline.DeviceTime = timeline.Ticks * clock.TickNum / clock.TickDen;
+    timeline.Samples++;
+
+    const auto device = double(timeline.DeviceTime);
+    const auto host   = double(input.HostTime - timeline.AnchorHost);
+
+    // 時計の進み方の比を求める.
+    // 受信遅延の揺らぎは正の側にだけ大きく出るので, 全てのレポートで回帰すると傾きが偏る.
+    // 区間ごとに受信遅延が最小(ホスト時刻 - デバイス時刻が最小)のレポートだけを使う.
+    if (first)
+    {
+        timeline.BlockStart  = timeline.DeviceTime;
+        timeline.BlockDevice = device;
+        timeline.BlockHost   = host;
+    }
+    else if (timeline.DeviceTime - timeline.BlockStart >= kClockBlock)
+    {
+        timeline.Blocks++;
+
+        const auto alpha = 1.0 / double(std::min<uint64_t>(timeline.Blocks, kClockWindow));
+        const auto dd    = timeline.BlockDevice - timeline.MeanDevice;
+        const auto dh    = timeline.BlockHost   - timeline.MeanHost;
+        timeline.MeanDevice += alpha * dd;
+        timeline.MeanHost   += alpha * dh;
+        timeline.VarDevice   = (1.0 - alpha) * (timeline.VarDevice  + alpha * dd * dd);
+        timeline.CovDevHost  = (1.0 - alpha) * (timeline.CovDevHost + alpha * dd * dh);
+        if (timeline.Blocks >= kClockWarmup && timeline.VarDevice > 0.0)
+        {
+            timeline.Rate = std::min(std::max(timeline.CovDevHost / timeline.VarDevice,
+                1.0 - kClockMaxDrift), 1.0 + kClockMaxDrift);
+        }
+
+        timeline.BlockStart  = timeline.DeviceTime;
+        timeline.BlockDevice = device;
+        timeline.BlockHost   = host;
+    }
+    else if (host - device < timeline.BlockHost - timeline.BlockDevice)
+    {
+        timeline.BlockDevice = device;
+        timeline.BlockHost   = host;
+    }
+
+    // 受信遅延は常に正なので, 推定より早く届いた場合は即座に合わせ, 遅く届いた場合はゆっくり追従する.
+    auto estimate = host;
+    if (!first)
+    {
+        estimate = timeline.EstHost + timeline.Rate * (device - timeline.EstDevice);
+        auto residual = host - estimate;
+        estimate += (residual < 0.0) ? residual : residual * kClockCreep;
+    }
+    timeline.EstDevice = device;
+    timeline.EstHost   = estimate;
+
+    input.DeviceTime  = timeline.DeviceTime;
+    input.CaptureTime = uint64_t(int64_t(timeline.AnchorHost) + std::llround(estimate));
+
+    // 公開用の推定値を更新する.
+    auto sequence = pHandle->ClockSequence.load(std::memory_order_relaxed);
+    pHandle->ClockSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    pHandle->Clock.DeviceTime = input.DeviceTime;
+    pHandle->Clock.HostTime   = input.CaptureTime;
+    pHandle->Clock.Rate       = timeline.Rate;
+    pHandle->Clock.Samples    = timeline.Samples;
+
+    pHandle->ClockSequence.store(sequence + 2, std::memory_order_release);
+}
+
+//-----------------------------------------------------------------------------
+//      ヒストグラムに記録します.
+//-----------------------------------------------------------------------------
+void RecordHistogram(Histogram& histogram, uint64_t value)
+{
+    auto bucket = 0u;
+    for(auto bits = value; bits != 0 && bucket < kPadHistogramBuckets - 1; bits >>= 1)
+    { bucket++; }
+
+    histogram.Count.fetch_add(1, std::memory_order_relaxed);
+    histogram.Sum  .fetch_add(value, std::memory_order_relaxed);
+    histogram.Buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    auto peak = histogram.Max.load(std::memory_order_relaxed);
+    while(value > peak && !histogram.Max.compare_exchange_weak(peak, value, std::memory_order_relaxed))
+    { /* DO_NOTHING */ }
+}
+
+//-----------------------------------------------------------------------------
+//      ヒストグラムを読み取ります.
+//-----------------------------------------------------------------------------
+void LoadHistogram(const Histogram& histogram, PadHistogram& result)
+{
+    result.Count = histogram.Count.load(std::memory_order_relaxed);
+    result.Sum   = histogram.Sum  .load(std::memory_order_relaxed);
+    result.Max   = histogram.Max  .load(std::memory_order_relaxed);
+    for(auto i=0u; i<kPadHistogramBuckets; ++i)
+    { result.Buckets[i] = histogram.Buckets[i].load(std::memory_order_relaxed); }
+}
+
+//-----------------------------------------------------------------------------
+//      取り出したレポートの受信からの経過時間を記録します.
+//-----------------------------------------------------------------------------
+void RecordLatency(PadHandle* pHandle, const PadRawInput* pInputs, uint32_t count)
+{
+    if (count == 0)
+    { return; }
+
+    auto now = GetHostTime();
+    for(auto i=0u; i<count; ++i)
+    { RecordHistogram(pHandle->Latency, (now > pInputs[i].HostTime) ? now - pInputs[i].HostTime : 0); }
+}
+
+//-----------------------------------------------------------------------------
+//      フレームカウンターの欠番から未受信のレポートを検出します.
+//-----------------------------------------------------------------------------
+void CheckFrameCounter(PadHandle* pHandle, const PadRawInput& input)
+{
+    if (!IsMappable(&input))
+    { return; }
+
+    const auto clock  = GetClockLayout(input.Type);
+    const auto period = 256u >> clock.CounterShift;
+    const auto value  = uint32_t(input.Bytes[PadGetReportLayout(input.Type).Base + clock.Counter] >> clock.CounterShift);
+
+    auto& counter = pHandle->Counter;
+    if (counter.Valid)
+    {
+        const auto elapsed = input.DeviceTime - counter.DeviceTime;
+        auto steps = uint64_t((value - counter.Last) & (period - 1));
+
+        // 1周期以上欠落した場合は, デバイス時刻の差から周回数を補う.
+        if (counter.Interval > 0.0)
+        {
+            const auto estimate = double(elapsed) / counter.Interval;
+            if (estimate > double(steps + period / 2))
+            { steps += uint64_t(estimate - double(steps) + double(period / 2)) / period * period; }
+        }
+
+        if (steps == 0)
+        { pHandle->Repeated.fetch_add(1, std::memory_order_relaxed); }
+        else if (steps > 1)
+        { pHandle->Lost.fetch_add(steps - 1, std::memory_order_relaxed); }
+        else if (elapsed > 0)
+        {
+            // 欠落が無い場合のみレポート間隔を更新する.
+            counter.Interval = (counter.Interval > 0.0)
+                ? counter.Interval + (double(elapsed) - counter.Interval) / 16.0
+                : double(elapsed);
+        }
+    }
+
+    counter.Valid       = true;
+    counter.Last        = value;
+    counter.DeviceTime  = input.DeviceTime;
+    pHandle->Counted.fetch_add(1, std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+//      受信したレポートで姿勢を更新します.
+//-----------------------------------------------------------------------------
+void UpdateFusion(PadHandle* pHandle, PadRawInput& input)
+{
+    auto& fusion = pHandle->Fusion;
+    if (pHandle->FusionReset.exchange(false, std::memory_order_acquire))
+    { fusion.Valid = false; }
+
+    // 角速度を含まないレポートは前回の姿勢を引き継ぐ.
+    if (!IsMappable(&input))
+    {
+        input.Orientation = FromFusionFrame(fusion.Q);
+        return;
+    }
+
+    const auto& layout = PadGetReportLayout(input.Type);
+    const auto  bytes  = &input.Bytes[layout.Base];
+
+    PadAngularVelocity gyro;
+    gyro.X = int16_t(ReadU16(&bytes[layout.Gyro + 0]));
+    gyro.Y = int16_t(ReadU16(&bytes[layout.Gyro + 2]));
+    gyro.Z = int16_t(ReadU16(&bytes[layout.Gyro + 4]));
+
+    PadAccelaration accel;
+    accel.X = int16_t(ReadU16(&bytes[layout.Accel + 0]));
+    accel.Y = int16_t(ReadU16(&bytes[layout.Accel + 2]));
+    accel.Z = int16_t(ReadU16(&bytes[layout.Accel + 4]));
+
+    PadMotion motion;
+    CalibrateMotion(pHandle->Calibration, gyro, accel, motion);
+
+    float g[3];
+    float a[3];
+    ToFusionFrame(motion, g, a);
+
+    if (!fusion.Valid)
+    {
+        InitFusion(a, fusion.Q);
+        fusion.Valid = true;
+    }
+    else
+    {
+        // 経過時間はデバイス時刻から求める(受信間隔の揺らぎを含まない).
+        auto delta = int64_t(input.DeviceTime - fusion.DeviceTime);
+        if (delta > 0)
+        {
+            auto dt   = std::min(float(delta) * 1e-6f, kFusionMaxDelta);
+            auto gain = pHandle->FusionGain.load(std::memory_order_relaxed);
+            FuseStep(fusion.Q, g, a, gain, dt);
+        }
+    }
+
+    fusion.DeviceTime = input.DeviceTime;
+    input.Orientation = FromFusionFrame(fusion.Q);
+}
+
+//-----------------------------------------------------------------------------
+//      追記中のチャンクの末尾に索引を書き込み, 索引を含むサイズを返却します.
+//-----------------------------------------------------------------------------
+size_t CloseCaptureChunk(CaptureWriter& writer)
+{
+    const auto pLast = writer.pActive + size_t(writer.Count - 1) * writer.RecordStride;
+
+    PadCaptureIndex index = {};
+    index.Magic       = kPadCaptureIndexMagic;
+    index.Count       = writer.Count;
+    index.FirstRecord = writer.NextRecord;
+    memcpy(&index.FirstTime, writer.pActive, sizeof(uint64_t));
+    memcpy(&index.LastTime,  pLast,          sizeof(uint64_t));
+
+    auto size = size_t(writer.Count) * writer.RecordStride;
+    memcpy(writer.pActive + size, &index, sizeof(index));
+    writer.NextRecord += writer.Count;
+    return size + sizeof(index);
+}
+
+//-----------------------------------------------------------------------------
+//      受信したレポートをキャプチャのチャンクに追記します.
+//-----------------------------------------------------------------------------
+void AppendCapture(PadHandle* pHandle, const PadRawInput& input)
+{
+    std::lock_guard<std::mutex> locker(pHandle->CaptureLock);
+
+    auto pWriter = pHandle->Capture.get();
+    if (pWriter == nullptr)
+    { return; }
+
+    auto& writer  = *pWriter;
+    auto  pRecord = writer.pActive + size_t(writer.Count) * writer.RecordStride;
+    memcpy(pRecord, &input.HostTime, sizeof(uint64_t));
+    memcpy(pRecord + sizeof(uint64_t), input.Bytes, writer.ReportSize);
+
+    if (++writer.Count < kPadCaptureChunkSize)
+    { return; }
+
+    // チャンクが満杯になったら書き込みスレッドに渡す.
+    CloseCaptureChunk(writer);
+
+    std::lock_guard<std::mutex> chunkLocker(writer.Lock);
+    if (writer.Free.empty())
+    {
+        // 書き込みが追いつかない場合は, 受信を止めないようにチャンクを捨てる.
+        writer.pCounters->Dropped += writer.Count;
+    }
+    else
+    {
+        writer.Pending.push_back(CaptureChunk{ writer.pActive, writer.Count });
+        writer.pActive = writer.Free.back();
+        writer.Free.pop_back();
+        writer.Signal.notify_one();
+    }
+    writer.Count = 0;
+}
+
+//-----------------------------------------------------------------------------
+//      受信したレポートに受信時刻と姿勢を設定し, 入力イベントを生成します.
+//-----------------------------------------------------------------------------
+void OnReceive(PadHandle* pHandle, PadRawInput& input, uint64_t hostTime)
+{
+    input.Type     = pHandle->Type;
+    input.HostTime = hostTime;
+
+    if (pHandle->Capturing.load(std::memory_order_relaxed))
+    { AppendCapture(pHandle, input); }
+
+    UpdateTimeline(pHandle, input);
+    CheckFrameCounter(pHandle, input);
+
+    if (pHandle->FusionEnabled.load(std::memory_order_relaxed))
+    { UpdateFusion(pHandle, input); }
+    else
+    { input.Orientation = PadQuaternion{ 1.0f, 0.0f, 0.0f, 0.0f }; }
+
+    if (pHandle->LastReceive != 0)
+    { RecordHistogram(pHandle->Interval, hostTime - pHandle->LastReceive); }
+    pHandle->LastReceive = hostTime;
+
+    // 接続先が変わった場合は前回の受信データを破棄する.
+    auto pQueue = pHandle->EventQueue.load(std::memory_order_acquire);
+    if (pQueue != pHandle->EventTarget)
+    {
+        pHandle->EventTarget = pQueue;
+        pHandle->EventPrimed = false;
+    }
+
+    if (pQueue == nullptr || !IsMappable(&input))
+    { return; }
+
+    PadEvent events[kMaxReportEvents];
+    auto source = pHandle->EventSource.load(std::memory_order_relaxed);
+    auto count  = MakeEvents(pHandle->EventPrimed ? &pHandle->EventPrevious : nullptr, input, source, events);
+    PushEvents(pQueue, events, count);
+
+    pHandle->EventPrevious = input;
+    pHandle->EventPrimed   = true;
+}
+
+//-----------------------------------------------------------------------------
+//      デバイス情報にパスを設定します.
+//-----------------------------------------------------------------------------
+void SetDevicePath(PadDeviceInfo& info, const std::string& path)
+{
+    auto size = std::min<size_t>(path.size(), kPadMaxDevicePath - 1);
+    memcpy(info.Path, path.data(), size);
+    info.Path[size] = '\0';
+}
+
+#if defined(_WIN32)
+//-----------------------------------------------------------------------------
+//      マルチバイト文字列に変換します.
+//-----------------------------------------------------------------------------
+std::string ToStringA( const std::wstring& value )
+{
+    auto length = WideCharToMultiByte(CP_ACP, 0, value.c_str(), int(value.size() + 1), nullptr, 0, nullptr, nullptr);
+    auto buffer = new char[length];
+
+    WideCharToMultiByte(CP_ACP, 0, value.c_str(), int(value.size() + 1), buffer, length, nullptr, nullptr);
+
+    std::string result(buffer);
+    delete[] buffer;
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      ワイド文字列に変換します.
+//-----------------------------------------------------------------------------
+std::wstring ToStringW( const std::string& value )
+{
+    auto length = MultiByteToWideChar(CP_ACP, 0, value.c_str(), int(value.size() + 1), nullptr, 0);
+    auto buffer = new wchar_t[length];
+
+    MultiByteToWideChar(CP_ACP, 0, value.c_str(), int(value.size() + 1), buffer, length);
+
+    std::wstring result(buffer);
+    delete[] buffer;
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      指定文字で文字列を分割します.
+//-----------------------------------------------------------------------------
+std::vector<std::string> Split(const std::string& input, char delimiter)
+{
+    std::istringstream stream(input);
+
+    std::string field;
+    std::vector<std::string> result;
+    while (std::getline(stream, field, delimiter))
+    { result.push_back(field); }
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      文字列を置換します.
+//-----------------------------------------------------------------------------
+std::string Replace
+(
+    const std::string&  input,
+    std::string         pattern,
+    std::string         replace
+)
+{
+    std::string result = input;
+    auto pos = result.find( pattern );
+
+    while( pos != std::string::npos )
+    {
+        result.replace( pos, pattern.length(), replace );
+        pos = result.find( pattern, pos + replace.length() );
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      MACアドレスを取得します.
+//-----------------------------------------------------------------------------
+std::string GetMacAddress(const std::wstring& value)
+{
+    auto temp = ToStringA(value);
+    auto idx = temp.find("{");
+    if (idx == std::string::npos)
+    { return ""; }
+
+    temp = temp.substr(idx - 15, 14);
+    auto lst = Split(temp, '&');
+    if (lst.size() != 3)
+    { return ""; }
+
+    lst[2] = Replace(lst[2], "0", "");
+    if (lst[2] == "")
+    { lst[2] = "0"; }
+    return lst[0] + lst[1] + lst[2];
+}
+
+//-----------------------------------------------------------------------------
+//      デバイスパスを指定してパッドを接続します.
+//-----------------------------------------------------------------------------
+bool OpenDevice(const std::wstring& devicePath, uint32_t type, PadHandle& result)
+{
+    auto handle = CreateFile(
+        devicePath.c_str(),
+        FILE_GENERIC_READ | FILE_GENERIC_WRITE,
+        FILE_SHARE_READ   | FILE_SHARE_WRITE,
+        (LPSECURITY_ATTRIBUTES)NULL,
+        OPEN_EXISTING,
+        FILE_FLAG_OVERLAPPED,
+        NULL);
+
+    if (handle == nullptr || handle == INVALID_HANDLE_VALUE)
+    { return false; }
+
+    PHIDP_PREPARSED_DATA preparsedData;
+    if (HidD_GetPreparsedData(handle, &preparsedData) == FALSE)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+
+    HIDP_CAPS capabilities;
+    HidP_GetCaps(preparsedData, &capabilities);
+    HidD_FreePreparsedData(preparsedData);
+
+    if (type == PAD_CONNECTION_NONE)
+    {
+        HIDD_ATTRIBUTES attributes = {};
+        if (HidD_GetAttributes(handle, &attributes) == FALSE)
+        {
+            CloseHandle(handle);
+            return false;
+        }
+
+        auto bluetooth = (capabilities.InputReportByteLength != kUsbInputReportSize);
+        type = GetConnectionType(attributes.VendorID, attributes.ProductID, bluetooth);
+        if (type == PAD_CONNECTION_NONE)
+        {
+            CloseHandle(handle);
+            return false;
+        }
+    }
+
+    std::string macAddress;
+    if (type == PAD_CONNECTION_USB)
+    {
+        char buf[16];
+        buf[0] = 18;
+        if (HidD_GetFeature(handle, buf, 16) == TRUE)
+        { macAddress = buf; }
+        else
+        { macAddress = GetMacAddress(devicePath); }
+    }
+    else if (IsBluetooth(type))
+    {
+        // Bluetooth 接続時はシリアル番号がMACアドレス.
+        wchar_t serial[32] = {};
+        if (HidD_GetSerialNumberString(handle, serial, sizeof(serial)) == TRUE)
+        { macAddress = ToStringA(serial); }
+        else
+        { macAddress = GetMacAddress(devicePath); }
+
+    }
+    else
+    {
+        // デバイス名からMACアドレスを取得.
+        macAddress = GetMacAddress(devicePath);
+    }
+
+    // IMUの補正データ(Bluetooth 接続時は読み取ると全データ入りのレポートに切り替わる).
+    auto readFeature = [&](uint8_t id, uint8_t* pBytes)
+    {
+        std::vector<uint8_t> feature(std::max<size_t>(capabilities.FeatureReportByteLength, kCalibrationSize));
+        feature[0] = id;
+        if (HidD_GetFeature(handle, feature.data(), ULONG(feature.size())) == FALSE)
+        { return false; }
+
+        memcpy(pBytes, feature.data(), kCalibrationSize);
+        return true;
+    };
+    PadCalibration calibration;
+    auto calibrated = LoadCalibration(macAddress, type, readFeature, calibration);
+
+    // フレーム間でレポートを取りこぼさないようにドライバ側のバッファを拡張.
+    HidD_SetNumInputBuffers(handle, 128);
+
+    auto readEvent  = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    auto writeEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    if (readEvent == nullptr || writeEvent == nullptr)
+    {
+        if (readEvent != nullptr)
+        { CloseHandle(readEvent); }
+        if (writeEvent != nullptr)
+        { CloseHandle(writeEvent); }
+
+        CloseHandle(handle);
+        return false;
+    }
+
+    // ハンドル生成.
+    result.Handle       = handle;
+    result.DevicePath   = devicePath;
+    result.Size         = capabilities.InputReportByteLength;
+    result.OutputSize   = capabilities.OutputReportByteLength;
+    result.FeatureSize  = capabilities.FeatureReportByteLength;
+    result.Type         = type;
+    result.Decoder      = GetReportDecoder(type);
+    result.MacAddress   = macAddress;
+    result.Calibration  = calibration;
+    result.Calibrated   = calibrated;
+
+    result.ReadOverlapped.hEvent  = readEvent;
+    result.WriteOverlapped.hEvent = writeEvent;
+    result.ReadBuffer.resize(size_t(result.Size) * kReadBatchSize);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      HIDデバイスのパスを列挙します.
+//-----------------------------------------------------------------------------
+std::vector<DevicePath> EnumerateDevicePaths()
+{
+    std::vector<DevicePath> result;
+
+    GUID guid;
+    HidD_GetHidGuid(&guid);
+
+    auto info = SetupDiGetClassDevs(&guid, NULL, NULL, DIGCF_PRESENT | DIGCF_INTERFACEDEVICE);
+    if (info == nullptr)
+    { return result; }
+
+    SP_DEVICE_INTERFACE_DATA devInfoData;
+    devInfoData.cbSize = sizeof(devInfoData);
+
+    ULONG length    = 0;
+    ULONG required  = 0;
+    auto  index     = 0u;
+
+    // 170(CUH_ZCT1x), 182(CUH_ZCT2x), 180(CFI_ZCT1J).
+    std::array<uint8_t, 184> buf;
+
+    for(;; index++)
+    {
+        auto ret = SetupDiEnumDeviceInterfaces(info, 0, &guid, index, &devInfoData);
+        if (ret == FALSE)
+        { break; }
+
+        // サイズ取得.
+        SetupDiGetDeviceInterfaceDetail(info, &devInfoData, NULL, 0, &length, NULL);
+
+        // サイズが期待値以上なら処理しない.
+        if (buf.size() < length)
+        { continue; }
+
+        auto detailData = reinterpret_cast<PSP_DEVICE_INTERFACE_DETAIL_DATA>(buf.data());
+        detailData->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
+
+        ret = SetupDiGetDeviceInterfaceDetail(info, &devInfoData, detailData, length, &required, NULL);
+        if (ret == FALSE)
+        { break; }
+
+        result.push_back(detailData->DevicePath);
+    }
+
+    SetupDiDestroyDeviceInfoList(info);
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      文字列中の16進数を読み取ります.
+//-----------------------------------------------------------------------------
+bool ParseHex(const std::string& value, const char* key, uint32_t digits, uint32_t& result)
+{
+    auto pos = value.find(key);
+    if (pos == std::string::npos)
+    { return false; }
+
+    pos += strlen(key);
+    if (pos + digits > value.size())
+    { return false; }
+
+    result = uint32_t(strtoul(value.substr(pos, digits).c_str(), nullptr, 16));
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      デバイスを開かずにデバイスパスからデバイス情報を取得します.
+//-----------------------------------------------------------------------------
+bool QueryDeviceInfo(const std::wstring& devicePath, PadDeviceInfo& result)
+{
+    // 通知とSetupAPIで大文字小文字が異なることがあるため小文字に揃える.
+    auto path = ToStringA(devicePath);
+    std::transform(path.begin(), path.end(), path.begin(), [](char c) { return char(tolower(c)); });
+
+    // USB は "vid_054c&pid_05c4", Bluetooth は "vid&0002054c_pid&05c4" の形式.
+    uint32_t vendorId  = 0;
+    uint32_t productId = 0;
+    if (!ParseHex(path, "vid_", 4, vendorId) && !ParseHex(path, "vid&", 8, vendorId))
+    { return false; }
+    if (!ParseHex(path, "pid_", 4, productId) && !ParseHex(path, "pid&", 4, productId))
+    { return false; }
+
+    // HID over Bluetooth のサービスクラスGUID.
+    auto bluetooth = path.find("00001124-0000-1000-8000-00805f9b34fb") != std::string::npos;
+
+    SetDevicePath(result, path);
+    result.VendorId  = uint16_t(vendorId & 0xffff);
+    result.ProductId = uint16_t(productId);
+    result.Type      = GetConnectionType(result.VendorId, result.ProductId, bluetooth);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      Bluetooth 接続を切断します.
+//-----------------------------------------------------------------------------
+void DisconnectBluetooth(const PadHandle& padHandle)
+{
+    // MACアドレスをBluetoothアドレスに変換.
+    auto text = Replace(padHandle.MacAddress, ":", "");
+    if (text.size() != 12)
+    { return; }
+
+    BTH_ADDR address = strtoull(text.c_str(), nullptr, 16);
+
+    BLUETOOTH_FIND_RADIO_PARAMS params = {};
+    params.dwSize = sizeof(params);
+
+    HANDLE radio = nullptr;
+    auto search = BluetoothFindFirstRadio(&params, &radio);
+    if (search == nullptr)
+    { return; }
+
+    // 接続しているラジオが見つかるまで試す.
+    BOOL ret = FALSE;
+    while(!ret && radio != nullptr)
+    {
+        DWORD length = 0;
+        ret = DeviceIoControl(radio, IOCTL_BTH_DISCONNECT_DEVICE, &address, sizeof(address), nullptr, 0, &length, nullptr);
+        CloseHandle(radio);
+
+        if (!ret)
+        {
+            if (!BluetoothFindNextRadio(search, &radio))
+            { radio = nullptr; }
+        }
+    }
+
+    BluetoothFindRadioClose(search);
+}
+
+//-----------------------------------------------------------------------------
+//      デバイスを閉じます.
+//-----------------------------------------------------------------------------
+void CloseDevice(PadHandle& padHandle)
+{
+    CloseHandle(padHandle.Handle);
+    padHandle.Handle = kInvalidHandle;
+
+    CloseHandle(padHandle.ReadOverlapped.hEvent);
+    CloseHandle(padHandle.WriteOverlapped.hEvent);
+    padHandle.ReadOverlapped.hEvent  = nullptr;
+    padHandle.WriteOverlapped.hEvent = nullptr;
+}
+
+//-----------------------------------------------------------------------------
+//      エラーコードから切断を検出します.
+//-----------------------------------------------------------------------------
+void CheckConnection(PadHandle* pHandle, DWORD error)
+{
+    switch(error)
+    {
+    case ERROR_SUCCESS:
+    case ERROR_IO_PENDING:
+    case ERROR_IO_INCOMPLETE:
+    case ERROR_OPERATION_ABORTED:
+    case WAIT_TIMEOUT:
+        return;
+    }
+
+    pHandle->Connected.store(false, std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+//      非同期読み取りを開始します.
+//-----------------------------------------------------------------------------
+bool BeginRead(PadHandle* pHandle, uint32_t count)
+{
+    auto& ov = pHandle->ReadOverlapped;
+    ov.Internal     = 0;
+    ov.InternalHigh = 0;
+    ov.Offset       = 0;
+    ov.OffsetHigh   = 0;
+
+    // HIDクラスドライバはバッファに収まる分だけ溜まっているレポートを一度に返す.
+    count = std::min(count, kReadBatchSize);
+
+    pHandle->ReadCalls.fetch_add(1, std::memory_order_relaxed);
+    if (ReadFile(pHandle->Handle, pHandle->ReadBuffer.data(), pHandle->Size * count, nullptr, &ov) == FALSE)
+    {
+        auto error = GetLastError();
+        CheckConnection(pHandle, error);
+        return (error == ERROR_IO_PENDING);
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      完了した非同期読み取りの結果を取り出します.
+//-----------------------------------------------------------------------------
+uint32_t EndRead(PadHandle* pHandle, PadRawInput* pResults, DWORD readSize)
+{
+    auto size     = pHandle->Size;
+    auto count    = uint32_t(readSize / size);
+    auto copySize = std::min<size_t>(size, sizeof(pResults[0].Bytes));
+    auto hostTime = GetHostTime();
+    auto result   = 0u;
+    for(auto i=0u; i<count; ++i)
+    {
+        auto pBytes = pHandle->ReadBuffer.data() + size_t(i) * size;
+        if (!ValidateReport(pHandle->Type, pBytes, copySize))
+        {
+            pHandle->CrcErrors.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        memcpy(pResults[result].Bytes, pBytes, copySize);
+        OnReceive(pHandle, pResults[result], hostTime);
+        result++;
+    }
+
+    pHandle->Reports.fetch_add(result, std::memory_order_relaxed);
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      1回のReadFile()で取り出せるだけ入力レポートを読み取ります.
+//-----------------------------------------------------------------------------
+uint32_t ReadChunk(PadHandle* pHandle, PadRawInput* pResults, uint32_t count, int32_t timeout)
+{
+    if (pHandle->Size == 0 || count == 0)
+    { return 0; }
+
+    if (!BeginRead(pHandle, count))
+    { return 0; }
+
+    auto& ov = pHandle->ReadOverlapped;
+
+    DWORD readSize = 0;
+    if (!HasOverlappedIoCompleted(&ov))
+    { pHandle->WaitCalls.fetch_add(1, std::memory_order_relaxed); }
+
+    auto wait = (timeout < 0) ? INFINITE : DWORD(timeout);
+    if (GetOverlappedResultEx(pHandle->Handle, &ov, &readSize, wait, FALSE) == FALSE)
+    {
+        // タイムアウトした場合は読み取りを取り消す.
+        // 取り消しと完了が競合した場合は読み取れたデータを返す.
+        // 待機は上で数えているので, 取り消しの完了待ちは数えない.
+        CancelIoEx(pHandle->Handle, &ov);
+        if (GetOverlappedResult(pHandle->Handle, &ov, &readSize, TRUE) == FALSE)
+        {
+            CheckConnection(pHandle, GetLastError());
+            return 0;
+        }
+    }
+
+    return EndRead(pHandle, pResults, readSize);
+}
+
+//-----------------------------------------------------------------------------
+//      入力レポートをまとめて読み取ります.
+//-----------------------------------------------------------------------------
+uint32_t ReadReports(PadHandle* pHandle, PadRawInput* pResults, uint32_t count, int32_t timeout)
+{
+    auto result = 0u;
+    while(result < count)
+    {
+        // 最初の1回のみタイムアウトまで待機し, 以降は溜まっている分だけ取り出す.
+        auto request = std::min(count - result, kReadBatchSize);
+        auto ret = ReadChunk(pHandle, pResults + result, request, (result == 0) ? timeout : 0);
+        result += ret;
+
+        // バッファが埋まらなかった場合は全て取り出し済み.
+        if (ret < request)
+        { break; }
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      出力レポートを書き込みます.
+//-----------------------------------------------------------------------------
+bool WriteReport(PadHandle* pHandle, const uint8_t* pBytes, uint32_t size)
+{
+    // WriteFile() には出力レポートサイズ分のバッファを渡す必要がある.
+    uint8_t padded[kMaxOutputReportSize] = {};
+    if (size < pHandle->OutputSize && pHandle->OutputSize <= sizeof(padded))
+    {
+        memcpy(padded, pBytes, size);
+        pBytes = padded;
+        size   = pHandle->OutputSize;
+    }
+
+    auto& ov = pHandle->WriteOverlapped;
+    ov.Internal     = 0;
+    ov.InternalHigh = 0;
+    ov.Offset       = 0;
+    ov.OffsetHigh   = 0;
+
+    DWORD writeSize = 0;
+    if (WriteFile(pHandle->Handle, pBytes, size, nullptr, &ov) == FALSE)
+    {
+        auto error = GetLastError();
+        if (error != ERROR_IO_PENDING)
+        {
+            CheckConnection(pHandle, error);
+            return false;
+        }
+    }
+
+    if (GetOverlappedResult(pHandle->Handle, &ov, &writeSize, TRUE) == FALSE)
+    {
+        CheckConnection(pHandle, GetLastError());
+        return false;
+    }
+
+    return (writeSize == size);
+}
+
+//-----------------------------------------------------------------------------
+//      読み取りスレッドの処理です.
+//-----------------------------------------------------------------------------
+void ReaderThread(PadHandle* pHandle)
+{
+    PadRawInput inputs[kReadBatchSize];
+
+    auto&  ov        = pHandle->ReadOverlapped;
+    HANDLE events[2] = { ov.hEvent, pHandle->ReaderEvent };
+
+    while(!pHandle->ReaderStop.load(std::memory_order_acquire))
+    {
+        if (!BeginRead(pHandle, kReadBatchSize))
+        {
+            if (!pHandle->Connected.load(std::memory_order_relaxed))
+            { break; }
+
+            continue;
+        }
+
+        // 停止イベントも同時に待つため, 読み取り開始前に停止要求された場合も取りこぼさない.
+        DWORD readSize = 0;
+        if (!HasOverlappedIoCompleted(&ov))
+        { pHandle->WaitCalls.fetch_add(1, std::memory_order_relaxed); }
+
+        if (WaitForMultipleObjects(2, events, FALSE, INFINITE) != WAIT_OBJECT_0)
+        {
+            CancelIoEx(pHandle->Handle, &ov);
+            GetOverlappedResult(pHandle->Handle, &ov, &readSize, TRUE);
+            break;
+        }
+
+        if (GetOverlappedResult(pHandle->Handle, &ov, &readSize, FALSE) == FALSE)
+        {
+            CheckConnection(pHandle, GetLastError());
+            if (!pHandle->Connected.load(std::memory_order_relaxed))
+            { break; }
+
+            continue;
+        }
+
+        // CRC32の不一致で全て破棄した場合は0件になる.
+        auto count = EndRead(pHandle, inputs, readSize);
+        for(auto i=0u; i<count; ++i)
+        {
+            if (!pHandle->Ring->Push(inputs[i]))
+            { pHandle->Overflow.fetch_add(1, std::memory_order_relaxed); }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      読み取りスレッドを開始します.
+//-----------------------------------------------------------------------------
+bool StartReader(PadHandle* pHandle)
+{
+    auto event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    if (event == nullptr)
+    { return false; }
+
+    pHandle->ReaderEvent = event;
+    pHandle->Reader = std::thread(ReaderThread, pHandle);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      読み取りスレッドを停止します.
+//-----------------------------------------------------------------------------
+void StopReader(PadHandle* pHandle)
+{
+    pHandle->ReaderStop.store(true, std::memory_order_release);
+    SetEvent(pHandle->ReaderEvent);
+
+    pHandle->Reader.join();
+
+    CloseHandle(pHandle->ReaderEvent);
+    pHandle->ReaderEvent = nullptr;
+}
+
+#else
+//-----------------------------------------------------------------------------
+// Global Variables.
+//-----------------------------------------------------------------------------
+static std::mutex  g_DeviceRootLock;            // 探索先ディレクトリの排他制御.
+static std::string g_HidRawDir = kHidRawDir;    // hidrawデバイスの格納ディレクトリ.
+static std::string g_SysfsDir  = kSysfsDir;     // sysfsのマウント先.
+
+//-----------------------------------------------------------------------------
+//      hidrawデバイスの格納ディレクトリを取得します.
+//-----------------------------------------------------------------------------
+std::string GetHidRawDir()
+{
+    std::lock_guard<std::mutex> locker(g_DeviceRootLock);
+    return g_HidRawDir;
+}
+
+//-----------------------------------------------------------------------------
+//      sysfsのマウント先を取得します.
+//-----------------------------------------------------------------------------
+std::string GetSysfsDir()
+{
+    std::lock_guard<std::mutex> locker(g_DeviceRootLock);
+    return g_SysfsDir;
+}
+
+//-----------------------------------------------------------------------------
+//      MACアドレスを取得します.
+//-----------------------------------------------------------------------------
+std::string GetMacAddress(int fd, uint32_t type)
+{
+    char text[32] = {};
+
+    // DualShock4 (USB) はフィーチャーレポート 0x12 にMACアドレスが格納されている.
+    if (type == PAD_CONNECTION_USB)
+    {
+        uint8_t buf[16] = {};
+        buf[0] = 0x12;
+        if (ioctl(fd, HIDIOCGFEATURE(sizeof(buf)), buf) >= 7)
+        {
+            snprintf(text, sizeof(text), "%02x%02x%02x%02x%02x%02x",
+                buf[6], buf[5], buf[4], buf[3], buf[2], buf[1]);
+            return text;
+        }
+    }
+
+#if defined(HIDIOCGRAWUNIQ)
+    if (ioctl(fd, HIDIOCGRAWUNIQ(sizeof(text) - 1), text) > 0)
+    {
+        // "xx:xx:xx:xx:xx:xx" 形式から区切り文字を取り除く.
+        std::string result;
+        for(auto c = text; *c != '\0'; ++c)
+        {
+            if (*c != ':')
+            { result.push_back(*c); }
+        }
+        return result;
+    }
+#endif
+
+    return "";
+}
+
+//-----------------------------------------------------------------------------
+//      デバイスパスを指定してパッドを接続します.
+//-----------------------------------------------------------------------------
+bool OpenDevice(const std::string& devicePath, uint32_t type, PadHandle& result)
+{
+    auto fd = open(devicePath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    { return false; }
+
+    if (type == PAD_CONNECTION_NONE)
+    {
+        hidraw_devinfo info = {};
+        if (ioctl(fd, HIDIOCGRAWINFO, &info) < 0)
+        {
+            close(fd);
+            return false;
+        }
+
+        auto bluetooth = (info.bustype == BUS_BLUETOOTH);
+        type = GetConnectionType(uint16_t(info.vendor), uint16_t(info.product), bluetooth);
+        if (type == PAD_CONNECTION_NONE)
+        {
+            close(fd);
+            return false;
+        }
+    }
+
+    auto epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll < 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    epoll_event ev = {};
+    ev.events  = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        close(epoll);
+        close(fd);
+        return false;
+    }
+
+    auto macAddress = GetMacAddress(fd, type);
+
+    // IMUの補正データ(Bluetooth 接続時は読み取ると全データ入りのレポートに切り替わる).
+    auto readFeature = [fd](uint8_t id, uint8_t* pBytes)
+    {
+        uint8_t feature[64] = {};
+        feature[0] = id;
+        if (ioctl(fd, HIDIOCGFEATURE(sizeof(feature)), feature) < int(kCalibrationSize))
+        { return false; }
+
+        memcpy(pBytes, feature, kCalibrationSize);
+        return true;
+    };
+    PadCalibration calibration;
+    auto calibrated = LoadCalibration(macAddress, type, readFeature, calibration);
+
+    // ハンドル生成.
+    result.Handle       = fd;
+    result.Epoll        = epoll;
+    result.DevicePath   = devicePath;
+    result.Size         = IsBluetooth(type) ? kBluetoothReportSize : kUsbInputReportSize;
+    result.Type         = type;
+    result.Decoder      = GetReportDecoder(type);
+    result.MacAddress   = macAddress;
+    result.Calibration  = calibration;
+    result.Calibrated   = calibrated;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      HIDデバイスのパスを列挙します.
+//-----------------------------------------------------------------------------
+std::vector<DevicePath> EnumerateDevicePaths()
+{
+    std::vector<DevicePath> result;
+
+    auto root = GetHidRawDir();
+    auto dir  = opendir(root.c_str());
+    if (dir == nullptr)
+    { return result; }
+
+    // hidraw番号順に列挙する.
+    std::vector<int> indices;
+    while(auto entry = readdir(dir))
+    {
+        int index = 0;
+        if (sscanf(entry->d_name, "hidraw%d", &index) == 1)
+        { indices.push_back(index); }
+    }
+    closedir(dir);
+
+    std::sort(indices.begin(), indices.end());
+
+    for(auto index : indices)
+    { result.push_back(root + "/hidraw" + std::to_string(index)); }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      HID_ID からデバイス情報を設定します.
+//-----------------------------------------------------------------------------
+bool ParseHidId(const char* value, PadDeviceInfo& result)
+{
+    // "0003:0000054C:000005C4" の形式.
+    unsigned int bus       = 0;
+    unsigned int vendorId  = 0;
+    unsigned int productId = 0;
+    if (sscanf(value, "%x:%x:%x", &bus, &vendorId, &productId) != 3)
+    { return false; }
+
+    result.VendorId  = uint16_t(vendorId);
+    result.ProductId = uint16_t(productId);
+    result.Type      = GetConnectionType(result.VendorId, result.ProductId, bus == kBusBluetooth);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      デバイスを開かずにsysfsからデバイス情報を取得します.
+//-----------------------------------------------------------------------------
+bool QueryDeviceInfo(const std::string& devicePath, PadDeviceInfo& result)
+{
+    auto name = devicePath.substr(devicePath.rfind('/') + 1);
+    auto path = GetSysfsDir() + "/class/hidraw/" + name + "/device/uevent";
+
+    auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    { return false; }
+
+    char buf[512];
+    auto size = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+
+    if (size <= 0)
+    { return false; }
+    buf[size] = '\0';
+
+    // "HID_ID=0003:0000054C:000005C4" の行を探す.
+    auto pos = strstr(buf, "HID_ID=");
+    if (pos == nullptr || !ParseHidId(pos + 7, result))
+    { return false; }
+
+    SetDevicePath(result, devicePath);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      Bluetooth 接続を切断します.
+//-----------------------------------------------------------------------------
+void DisconnectBluetooth(const PadHandle& padHandle)
+{
+    // hidrawからは切断できない. 切断はBlueZに任せる.
+    (void)padHandle;
+}
+
+//-----------------------------------------------------------------------------
+//      デバイスを閉じます.
+//-----------------------------------------------------------------------------
+void CloseDevice(PadHandle& padHandle)
+{
+    if (padHandle.Epoll >= 0)
+    {
+        close(padHandle.Epoll);
+        padHandle.Epoll = -1;
+    }
+
+    close(padHandle.Handle);
+    padHandle.Handle = kInvalidHandle;
+}
+
+//-----------------------------------------------------------------------------
+//      エラーコードから切断を検出します.
+//-----------------------------------------------------------------------------
+void CheckConnection(PadHandle* pHandle, int error)
+{
+    if (error == EAGAIN || error == EINTR)
+    { return; }
+
+    pHandle->Connected.store(false, std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+//      入力レポートをまとめて読み取ります.
+//-----------------------------------------------------------------------------
+uint32_t ReadReports(PadHandle* pHandle, PadRawInput* pResults, uint32_t count, int32_t timeout)
+{
+    auto result = 0u;
+    auto waited = false;
+
+    // hidrawは1回のread()で1レポートしか返さないため, EAGAINになるまで読み続ける.
+    // データが1件も無い場合のみepollで待機する.
+    while(result < count)
+    {
+        pHandle->ReadCalls.fetch_add(1, std::memory_order_relaxed);
+        auto ret = read(pHandle->Handle, pResults[result].Bytes, pHandle->Size);
+        if (ret > 0)
+        {
+            if (!ValidateReport(pHandle->Type, pResults[result].Bytes, size_t(ret)))
+            {
+                pHandle->CrcErrors.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            OnReceive(pHandle, pResults[result], GetHostTime());
+            result++;
+            continue;
+        }
+
+        if (ret < 0 && errno == EINTR)
+        { continue; }
+
+        if (ret == 0 || errno != EAGAIN)
+        {
+            // 切断された.
+            CheckConnection(pHandle, (ret == 0) ? ENODEV : errno);
+            break;
+        }
+
+        if (result > 0 || waited || timeout == 0)
+        { break; }
+
+        pHandle->WaitCalls.fetch_add(1, std::memory_order_relaxed);
+        epoll_event ev;
+        auto ready = epoll_wait(pHandle->Epoll, &ev, 1, timeout);
+        if (ready < 0 && errno == EINTR)
+        { continue; }
+
+        if (ready <= 0)
+        { break; }
+
+        waited = true;
+    }
+
+    pHandle->Reports.fetch_add(result, std::memory_order_relaxed);
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      出力レポートを書き込みます.
+//-----------------------------------------------------------------------------
+bool WriteReport(PadHandle* pHandle, const uint8_t* pBytes, uint32_t size)
+{
+    ssize_t ret;
+    do
+    {
+        ret = write(pHandle->Handle, pBytes, size);
+    }
+    while (ret < 0 && errno == EINTR);
+
+    if (ret < 0)
+    { CheckConnection(pHandle, errno); }
+
+    return (ret == ssize_t(size));
+}
+
+//-----------------------------------------------------------------------------
+//      読み取りスレッドの処理です.
+//-----------------------------------------------------------------------------
+void ReaderThread(PadHandle* pHandle)
+{
+    PadRawInput input = {};
+    input.Type = pHandle->Type;
+
+    for(;;)
+    {
+        epoll_event events[2];
+        pHandle->WaitCalls.fetch_add(1, std::memory_order_relaxed);
+        auto count = epoll_wait(pHandle->Epoll, events, 2, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+
+            return;
+        }
+
+        if (pHandle->ReaderStop.load(std::memory_order_acquire))
+        { return; }
+
+        // 溜まっているレポートを全て取り出す.
+        for(;;)
+        {
+            pHandle->ReadCalls.fetch_add(1, std::memory_order_relaxed);
+            auto ret = read(pHandle->Handle, input.Bytes, pHandle->Size);
+            if (ret > 0)
+            {
+                if (!ValidateReport(pHandle->Type, input.Bytes, size_t(ret)))
+                {
+                    pHandle->CrcErrors.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+
+                pHandle->Reports.fetch_add(1, std::memory_order_relaxed);
+                OnReceive(pHandle, input, GetHostTime());
+                if (!pHandle->Ring->Push(input))
+                { pHandle->Overflow.fetch_add(1, std::memory_order_relaxed); }
+                continue;
+            }
+
+            if (ret < 0 && errno == EINTR)
+            { continue; }
+
+            if (ret < 0 && errno == EAGAIN)
+            { break; }
+
+            // 切断された.
+            CheckConnection(pHandle, (ret == 0) ? ENODEV : errno);
+            return;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      読み取りスレッドを開始します.
+//-----------------------------------------------------------------------------
+bool StartReader(PadHandle* pHandle)
+{
+    auto event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (event < 0)
+    { return false; }
+
+    epoll_event ev = {};
+    ev.events  = EPOLLIN;
+    ev.data.fd = event;
+    if (epoll_ctl(pHandle->Epoll, EPOLL_CTL_ADD, event, &ev) < 0)
+    {
+        close(event);
+        return false;
+    }
+
+    pHandle->ReaderEvent = event;
+    pHandle->Reader = std::thread(ReaderThread, pHandle);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      読み取りスレッドを停止します.
+//-----------------------------------------------------------------------------
+void StopReader(PadHandle* pHandle)
+{
+    pHandle->ReaderStop.store(true, std::memory_order_release);
+
+    uint64_t value = 1;
+    auto ret = write(pHandle->ReaderEvent, &value, sizeof(value));
+    (void)ret;
+
+    pHandle->Reader.join();
+
+    epoll_ctl(pHandle->Epoll, EPOLL_CTL_DEL, pHandle->ReaderEvent, nullptr);
+    close(pHandle->ReaderEvent);
+    pHandle->ReaderEvent = -1;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Global Variables.
+//-----------------------------------------------------------------------------
+static std::mutex   g_TransportLock;    // 入出力の差し替えの排他制御.
+static PadTransport g_Transport = {};   // 差し替えた入出力(Open が nullptr の場合はOSのデバイス).
+static uint32_t     g_OpenDevices = 0;  // 開いている(開こうとしている)デバイス数.
+
+//-----------------------------------------------------------------------------
+//      デバイスを開いているかどうか.
+//-----------------------------------------------------------------------------
+inline bool IsOpen(const PadHandle* pHandle)
+{ return pHandle->Handle != kInvalidHandle || pHandle->Device != nullptr; }
+
+//-----------------------------------------------------------------------------
+//      差し替えた入出力でデバイスを開きます.
+//-----------------------------------------------------------------------------
+bool OpenTransport(const PadTransport& transport, const DevicePath& devicePath, uint32_t type, PadHandle& result)
+{
+#if defined(_WIN32)
+    const auto path = ToStringA(devicePath);
+#else
+    const auto& path = devicePath;
+#endif
+
+    auto pDevice = transport.Open(transport.pContext, path.c_str());
+    if (pDevice == nullptr)
+    { return false; }
+
+    // OSのデバイスと同じく開いてから判定するが, 接続タイプを問い合わせる手段が無い.
+    if (type == PAD_CONNECTION_NONE)
+    {
+        transport.Close(transport.pContext, pDevice);
+        return false;
+    }
+
+    auto getFeature = [&](uint8_t* pBytes, uint32_t size)
+    { return transport.GetFeature(transport.pContext, pDevice, pBytes, size); };
+
+    // MACアドレスはフィーチャーレポート 0x12 から取得する.
+    std::string macAddress;
+    {
+        uint8_t buf[16] = {};
+        buf[0] = 0x12;
+        if (getFeature(buf, sizeof(buf)) >= 7)
+        {
+            char text[16];
+            snprintf(text, sizeof(text), "%02x%02x%02x%02x%02x%02x",
+                buf[6], buf[5], buf[4], buf[3], buf[2], buf[1]);
+            macAddress = text;
+        }
+    }
+
+    auto readFeature = [&](uint8_t id, uint8_t* pBytes)
+    {
+        uint8_t feature[64] = {};
+        feature[0] = id;
+        if (getFeature(feature, sizeof(feature)) < int32_t(kCalibrationSize))
+        { return false; }
+
+        memcpy(pBytes, feature, kCalibrationSize);
+        return true;
+    };
+    PadCalibration calibration;
+    auto calibrated = LoadCalibration(macAddress, type, readFeature, calibration);
+
+    result.Transport    = transport;
+    result.Device       = pDevice;
+    result.DevicePath   = devicePath;
+    result.Size         = IsBluetooth(type) ? kBluetoothReportSize : kUsbInputReportSize;
+    result.Type         = type;
+    result.Decoder      = GetReportDecoder(type);
+    result.MacAddress   = macAddress;
+    result.Calibration  = calibration;
+    result.Calibrated   = calibrated;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      差し替えた入出力から入力レポートをまとめて読み取ります.
+//-----------------------------------------------------------------------------
+uint32_t ReadTransport(PadHandle* pHandle, PadRawInput* pResults, uint32_t count, int32_t timeout)
+{
+    const auto& transport = pHandle->Transport;
+    auto result = 0u;
+
+    // 最初の1件のみタイムアウトまで待機し, 以降は溜まっている分だけ取り出す.
+    while(result < count)
+    {
+        pHandle->ReadCalls.fetch_add(1, std::memory_order_relaxed);
+        auto ret = transport.Read(transport.pContext, pHandle->Device,
+            pResults[result].Bytes, pHandle->Size, (result == 0) ? timeout : 0);
+        if (ret < 0)
+        {
+            // 切断された.
+            pHandle->Connected.store(false, std::memory_order_relaxed);
+            break;
+        }
+
+        if (ret == 0)
+        { break; }
+
+        if (!ValidateReport(pHandle->Type, pResults[result].Bytes, size_t(ret)))
+        {
+            pHandle->CrcErrors.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        OnReceive(pHandle, pResults[result], GetHostTime());
+        result++;
+    }
+
+    pHandle->Reports.fetch_add(result, std::memory_order_relaxed);
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      差し替えた入出力の読み取りスレッドの処理です.
+//-----------------------------------------------------------------------------
+void TransportReaderThread(PadHandle* pHandle)
+{
+    PadRawInput inputs[kReadBatchSize];
+
+    while(!pHandle->ReaderStop.load(std::memory_order_acquire))
+    {
+        // 停止要求を確認できるよう, 一定時間ごとに待機を打ち切る.
+        auto count = ReadTransport(pHandle, inputs, kReadBatchSize, kTransportPollTime);
+        for(auto i=0u; i<count; ++i)
+        {
+            if (!pHandle->Ring->Push(inputs[i]))
+            { pHandle->Overflow.fetch_add(1, std::memory_order_relaxed); }
+        }
+
+        if (!pHandle->Connected.load(std::memory_order_relaxed))
+        { break; }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      デバイスを開きます.
+//-----------------------------------------------------------------------------
+bool OpenPadDevice(const DevicePath& devicePath, uint32_t type, PadHandle& result)
+{
+    // 開いている間に入出力が差し替えられないよう, 開く前に数えておく.
+    PadTransport transport;
+    {
+        std::lock_guard<std::mutex> locker(g_TransportLock);
+        transport = g_Transport;
+        g_OpenDevices++;
+    }
+
+    auto ret = (transport.Open != nullptr)
+        ? OpenTransport(transport, devicePath, type, result)
+        : OpenDevice(devicePath, type, result);
+
+    if (!ret)
+    {
+        std::lock_guard<std::mutex> locker(g_TransportLock);
+        g_OpenDevices--;
+    }
+
+    return ret;
+}
+
+//-----------------------------------------------------------------------------
+//      デバイスを閉じます.
+//-----------------------------------------------------------------------------
+void ClosePadDevice(PadHandle& padHandle)
+{
+    if (padHandle.Device != nullptr)
+    {
+        padHandle.Transport.Close(padHandle.Transport.pContext, padHandle.Device);
+        padHandle.Device = nullptr;
+    }
+    else
+    {
+        CloseDevice(padHandle);
+
+        if (IsBluetooth(padHandle.Type))
+        { DisconnectBluetooth(padHandle); }
+    }
+
+    std::lock_guard<std::mutex> locker(g_TransportLock);
+    g_OpenDevices--;
+}
+
+//-----------------------------------------------------------------------------
+//      入力レポートをまとめて読み取ります.
+//-----------------------------------------------------------------------------
+uint32_t ReadPadReports(PadHandle* pHandle, PadRawInput* pResults, uint32_t count, int32_t timeout)
+{
+    if (pHandle->Device != nullptr)
+    { return ReadTransport(pHandle, pResults, count, timeout); }
+
+    return ReadReports(pHandle, pResults, count, timeout);
+}
+
+//-----------------------------------------------------------------------------
+//      出力レポートを書き込みます.
+//-----------------------------------------------------------------------------
+bool WritePadReport(PadHandle* pHandle, const uint8_t* pBytes, uint32_t size)
+{
+    if (pHandle->Device != nullptr)
+    {
+        const auto& transport = pHandle->Transport;
+        auto ret = transport.Write(transport.pContext, pHandle->Device, pBytes, size);
+        if (ret < 0)
+        {
+            // 切断された.
+            pHandle->Connected.store(false, std::memory_order_relaxed);
+        }
+
+        return ret == int32_t(size);
+    }
+
+    return WriteReport(pHandle, pBytes, size);
+}
+
+//-----------------------------------------------------------------------------
+//      読み取りスレッドを開始します.
+//-----------------------------------------------------------------------------
+bool StartPadReader(PadHandle* pHandle)
+{
+    if (pHandle->Device != nullptr)
+    {
+        pHandle->Reader = std::thread(TransportReaderThread, pHandle);
+        return true;
+    }
+
+    return StartReader(pHandle);
+}
+
+//-----------------------------------------------------------------------------
+//      読み取りスレッドを停止します.
+//-----------------------------------------------------------------------------
+void StopPadReader(PadHandle* pHandle)
+{
+    if (pHandle->Device != nullptr)
+    {
+        pHandle->ReaderStop.store(true, std::memory_order_release);
+        pHandle->Reader.join();
+        return;
+    }
+
+    StopReader(pHandle);
+}
+
+//-----------------------------------------------------------------------------
+//      キャプチャファイルをメモリマップします.
+//-----------------------------------------------------------------------------
+bool MapReplayFile(const char* path, ReplaySource& replay)
+{
+#if defined(_WIN32)
+    replay.File = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (replay.File == INVALID_HANDLE_VALUE)
+    { return false; }
+
+    LARGE_INTEGER size = {};
+    if (GetFileSizeEx(replay.File, &size) == FALSE || size.QuadPart == 0)
+    { return false; }
+
+    replay.Mapping = CreateFileMappingA(replay.File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (replay.Mapping == nullptr)
+    { return false; }
+
+    replay.pBytes = static_cast<const uint8_t*>(MapViewOfFile(replay.Mapping, FILE_MAP_READ, 0, 0, 0));
+    if (replay.pBytes == nullptr)
+    { return false; }
+
+    replay.Size = size_t(size.QuadPart);
+#else
+    auto fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    { return false; }
+
+    // マップ後はファイル記述子を保持する必要が無い.
+    struct stat info = {};
+    auto ret = (fstat(fd, &info) == 0 && info.st_size > 0);
+    void* pMapped = MAP_FAILED;
+    if (ret)
+    { pMapped = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0); }
+    close(fd);
+
+    if (pMapped == MAP_FAILED)
+    { return false; }
+
+    madvise(pMapped, size_t(info.st_size), MADV_SEQUENTIAL);
+    replay.pBytes = static_cast<const uint8_t*>(pMapped);
+    replay.Size   = size_t(info.st_size);
+#endif
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      キャプチャファイルのメモリマップを解除します.
+//-----------------------------------------------------------------------------
+void UnmapReplayFile(ReplaySource& replay)
+{
+#if defined(_WIN32)
+    if (replay.pBytes != nullptr)
+    { UnmapViewOfFile(replay.pBytes); }
+
+    if (replay.Mapping != nullptr)
+    { CloseHandle(replay.Mapping); }
+
+    if (replay.File != INVALID_HANDLE_VALUE)
+    { CloseHandle(replay.File); }
+
+    replay.Mapping = nullptr;
+    replay.File    = INVALID_HANDLE_VALUE;
+#else
+    if (replay.pBytes != nullptr)
+    { munmap(const_cast<uint8_t*>(replay.pBytes), replay.Size); }
+#endif
+    replay.pBytes = nullptr;
+    replay.Size   = 0;
+}
+
+//-----------------------------------------------------------------------------
+//      次のチャンクのレコード数を求めます.
+//-----------------------------------------------------------------------------
+void BeginReplayChunk(ReplaySource& replay)
+{
+    const auto& header = replay.Header;
+    const auto  rest   = replay.Size - replay.Offset;
+    const auto  full   = size_t(header.RecordStride) * header.ChunkSize + sizeof(PadCaptureIndex);
+
+    replay.Remain  = 0;
+    replay.Indexed = false;
+
+    // 最後以外のチャンクは全て満杯.
+    if (rest >= full)
+    {
+        replay.Remain  = header.ChunkSize;
+        replay.Indexed = true;
+        return;
+    }
+
+    // 最後のチャンクは索引のレコード数を使う.
+    if (rest >= sizeof(PadCaptureIndex))
+    {
+        PadCaptureIndex index;
+        memcpy(&index, replay.pBytes + replay.Size - sizeof(index), sizeof(index));
+        if (index.Magic == kPadCaptureIndexMagic && size_t(index.Count) * header.RecordStride + sizeof(index) == rest)
+        {
+            replay.Remain  = index.Count;
+            replay.Indexed = true;
+            return;
+        }
+    }
+
+    // 索引が無い場合(記録中の異常終了など)は, 残りのサイズから求める.
+    replay.Remain = uint32_t(rest / header.RecordStride);
+}
+
+//-----------------------------------------------------------------------------
+//      次のレコードを取得します. 最後まで再生した場合はnullptrを返却します.
+//-----------------------------------------------------------------------------
+const uint8_t* PeekReplayRecord(ReplaySource& replay)
+{
+    if (replay.Remain == 0)
+    {
+        if (replay.Indexed)
+        { replay.Offset += sizeof(PadCaptureIndex); }
+
+        BeginReplayChunk(replay);
+        if (replay.Remain == 0)
+        { return nullptr; }
+    }
+
+    return replay.pBytes + replay.Offset;
+}
+
+//-----------------------------------------------------------------------------
+//      キャプチャファイルから入力レポートをまとめて読み取ります.
+//-----------------------------------------------------------------------------
+uint32_t ReadReplay(PadHandle* pHandle, PadRawInput* pResults, uint32_t count, int32_t timeout)
+{
+    auto& replay = *pHandle->Replay;
+    auto  result = 0u;
+
+    while(result < count)
+    {
+        auto pRecord = PeekReplayRecord(replay);
+        if (pRecord == nullptr)
+        {
+            // 最後まで再生したら切断されたものとする.
+            pHandle->Connected.store(false, std::memory_order_relaxed);
+            break;
+        }
+
+        uint64_t recordTime;
+        memcpy(&recordTime, pRecord, sizeof(recordTime));
+        if (replay.StartTime == 0)
+        {
+            replay.StartTime = GetHostTime();
+            replay.FirstTime = recordTime;
+        }
+
+        auto elapsed = (recordTime > replay.FirstTime) ? recordTime - replay.FirstTime : 0;
+
+        // 記録時の受信間隔を再生速度で縮めた時刻まで待つ.
+        if (replay.Speed > 0.0)
+        {
+            auto due = replay.StartTime + uint64_t(double(elapsed) / replay.Speed);
+            auto now = GetHostTime();
+            if (now < due)
+            {
+                // ReadReports() と同じく, 取り出し済みのレポートがあれば待たずに返す.
+                if (result > 0 || timeout == 0)
+                { break; }
+
+                pHandle->WaitCalls.fetch_add(1, std::memory_order_relaxed);
+                if (timeout > 0 && due - now > uint64_t(timeout) * 1000)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
+                    break;
+                }
+
+                std::this_thread::sleep_for(std::chrono::microseconds(due - now));
+            }
+        }
+
+        auto& input = pResults[result++];
+        memcpy(input.Bytes, pRecord + sizeof(uint64_t), replay.Header.ReportSize);
+        replay.Offset += replay.Header.RecordStride;
+        replay.Remain--;
+
+        OnReceive(pHandle, input, replay.StartTime + elapsed);
+    }
+
+    pHandle->Reports.fetch_add(result, std::memory_order_relaxed);
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      DualShock4の出力レポートを生成します.
+//-----------------------------------------------------------------------------
+uint32_t BuildOutputDualShock4(PadHandle* pHandle, uint8_t* bytes)
+{
+    auto& output = pHandle->Output;
+
+    // 0x01 : rumble, 0x02 : lightbar, 0x04 : flash. 変更された項目のみ有効にする.
+    auto flags = uint8_t(0xf0 | (output.Dirty & (kOutputVibration | kOutputLightBar | kOutputFlash)));
+
+    // Bluetooth はHIDP制御とオーディオ制御の分だけオフセットがずれる.
+    auto offset = 0u;
+    auto bluetooth = IsBluetooth(pHandle->Type);
+    if (bluetooth)
+    {
+        bytes[0] = 0x11;
+        bytes[1] = 0xc0;    // HID (0x80) | CRC32 (0x40).
+        offset   = 2;
+    }
+    else
+    {
+        bytes[0] = 0x05;
+    }
+
+    bytes[offset + 1]  = flags;
+    bytes[offset + 4]  = output.Vibration.LargeMotor;
+    bytes[offset + 5]  = output.Vibration.SmallMotor;
+    bytes[offset + 6]  = output.LightBar.R;
+    bytes[offset + 7]  = output.LightBar.G;
+    bytes[offset + 8]  = output.LightBar.B;
+    bytes[offset + 9]  = output.Flash.OnTime;
+    bytes[offset + 10] = output.Flash.OffTime;
+
+    if (bluetooth)
+    {
+        AppendCrc32(bytes);
+        return kBluetoothReportSize;
+    }
+
+    return kDualShock4OutputSize;
+}
+
+//-----------------------------------------------------------------------------
+//      DualSenseの出力レポートを生成します.
+//-----------------------------------------------------------------------------
+uint32_t BuildOutputDualSense(PadHandle* pHandle, uint8_t* bytes)
+{
+    auto& output = pHandle->Output;
+
+    // 制御フラグ0 : 0x01 | 0x02 振動, 0x04 R2エフェクト, 0x08 L2エフェクト.
+    uint8_t flags0 = 0;
+    if (!!(output.Dirty & kOutputVibration))
+    { flags0 |= 0x01 | 0x02; }
+    if (!!(output.Dirty & kOutputTriggerR))
+    { flags0 |= 0x04; }
+    if (!!(output.Dirty & kOutputTriggerL))
+    { flags0 |= 0x08; }
+
+    // 制御フラグ1 : 0x04 ライトバー.
+    uint8_t flags1 = 0;
+    if (!!(output.Dirty & kOutputLightBar))
+    { flags1 |= 0x04; }
+
+    // Bluetooth はシーケンス番号とタグの分だけオフセットがずれる.
+    auto offset = 0u;
+    auto bluetooth = IsBluetooth(pHandle->Type);
+    if (bluetooth)
+    {
+        bytes[0] = 0x31;
+        bytes[1] = uint8_t(output.Sequence << 4);
+        bytes[2] = 0x10;    // tag.
+        offset   = 2;
+
+        output.Sequence = (output.Sequence + 1) & 0xf;
+    }
+    else
+    {
+        bytes[0] = 0x2;
+    }
+
+    bytes[offset + 1] = flags0;
+    bytes[offset + 2] = flags1;
+    bytes[offset + 3] = output.Vibration.LargeMotor;
+    bytes[offset + 4] = output.Vibration.SmallMotor;
+    bytes[offset + 9] = 0x0; // mic
+
+    auto& right = output.Trigger[PAD_TRIGGER_RIGHT];
+    bytes[offset + 11] = right.Mode;
+    memcpy(&bytes[offset + 12], right.Params, sizeof(right.Params));
+
+    auto& left = output.Trigger[PAD_TRIGGER_LEFT];
+    bytes[offset + 22] = left.Mode;
+    memcpy(&bytes[offset + 23], left.Params, sizeof(left.Params));
+
+    bytes[offset + 45] = output.LightBar.R;
+    bytes[offset + 46] = output.LightBar.G;
+    bytes[offset + 47] = output.LightBar.B;
+
+    if (bluetooth)
+    {
+        AppendCrc32(bytes);
+        return kBluetoothReportSize;
+    }
+
+    return kDualSenseOutputSize;
+}
+
+//-----------------------------------------------------------------------------
+//      出力レポートを書き込み, 完了までの時間を記録します.
+//-----------------------------------------------------------------------------
+bool WriteOutput(PadHandle* pHandle, const uint8_t* pBytes, uint32_t size, std::chrono::steady_clock::time_point since)
+{
+    pHandle->WriteCalls.fetch_add(1, std::memory_order_relaxed);
+    if (!WritePadReport(pHandle, pBytes, size))
+    {
+        pHandle->WriteErrors.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    auto latency = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - since).count());
+
+    pHandle->LatencySum.fetch_add(latency, std::memory_order_relaxed);
+
+    // 最大値の更新は書き込みスレッドか呼び出し元の一方からしか行われない.
+    if (latency > pHandle->LatencyMax.load(std::memory_order_relaxed))
+    { pHandle->LatencyMax.store(latency, std::memory_order_relaxed); }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      出力レポートを生成し, 変更フラグをクリアします.
+//-----------------------------------------------------------------------------
+uint32_t TakeOutput(PadHandle* pHandle, uint8_t* bytes)
+{
+    auto size = (!!(pHandle->Type & PAD_CONNECTION_DUAL_SENSE))
+        ? BuildOutputDualSense(pHandle, bytes)
+        : BuildOutputDualShock4(pHandle, bytes);
+
+    pHandle->Output.Dirty = 0;
+    return size;
+}
+
+//-----------------------------------------------------------------------------
+//      未送信の出力設定を送信します.
+//-----------------------------------------------------------------------------
+bool FlushOutput(PadHandle* pHandle, bool force)
+{
+    auto& output = pHandle->Output;
+    std::lock_guard<std::mutex> locker(output.Lock);
+
+    if (output.Dirty == 0)
+    { return true; }
+
+    // 書き込みスレッドに任せる.
+    if (output.Writer.joinable())
+    {
+        output.Requested = true;
+        output.Signal.notify_one();
+        return true;
+    }
+
+    // 最大送信レートを超える場合は次回にまとめる.
+    auto now = std::chrono::steady_clock::now();
+    if (!force && now - output.LastFlush < output.Interval)
+    { return true; }
+
+    auto dirty = output.Dirty;
+
+    uint8_t bytes[kBluetoothReportSize] = {};
+    auto size = TakeOutput(pHandle, bytes);
+    if (size == 0 || !WriteOutput(pHandle, bytes, size, output.DirtySince))
+    {
+        output.Dirty = dirty;
+        return false;
+    }
+
+    output.LastFlush = now;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      書き込みスレッドの処理です.
+//-----------------------------------------------------------------------------
+void WriterThread(PadHandle* pHandle)
+{
+    auto& output = pHandle->Output;
+    std::unique_lock<std::mutex> locker(output.Lock);
+
+    for(;;)
+    {
+        output.Signal.wait(locker, [&]() { return output.WriterStop || (output.Requested && output.Dirty != 0); });
+        if (output.WriterStop)
+        { break; }
+
+        // 最大送信レートを超える場合は待つ. 待機中の変更は同じレポートにまとめられる.
+        auto due = output.LastFlush + output.Interval;
+        if (output.Signal.wait_until(locker, due, [&]() { return output.WriterStop; }))
+        { break; }
+
+        output.Requested = false;
+
+        auto dirty = output.Dirty;
+        auto since = output.DirtySince;
+
+        uint8_t bytes[kBluetoothReportSize] = {};
+        auto size = TakeOutput(pHandle, bytes);
+        if (size == 0)
+        { continue; }
+
+        // 書き込み中も設定関数がブロックしないようにロックを外す.
+        locker.unlock();
+        auto ret = WriteOutput(pHandle, bytes, size, since);
+        locker.lock();
+
+        output.LastFlush = std::chrono::steady_clock::now();
+
+        // 失敗した項目は次の送信要求で再送する.
+        if (!ret && pHandle->Connected.load(std::memory_order_relaxed))
+        {
+            if (output.Dirty == 0)
+            { output.DirtySince = since; }
+            output.Dirty |= dirty;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      書き込みスレッドを停止します.
+//-----------------------------------------------------------------------------
+void StopWriter(PadHandle* pHandle)
+{
+    auto& output = pHandle->Output;
+    {
+        std::lock_guard<std::mutex> locker(output.Lock);
+        output.WriterStop = true;
+    }
+    output.Signal.notify_one();
+    output.Writer.join();
+}
+
+//-----------------------------------------------------------------------------
+//      出力設定を更新します.
+//-----------------------------------------------------------------------------
+template<typename T>
+bool UpdateOutput(PadHandle* pHandle, T& current, const T& value, uint32_t flag)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    if (!IsOpen(pHandle))
+    { return false; }
+
+    {
+        std::lock_guard<std::mutex> locker(pHandle->Output.Lock);
+
+        // 値が変化していなければ送信しない.
+        if (memcmp(&current, &value, sizeof(T)) != 0)
+        {
+            auto& output = pHandle->Output;
+            if (output.Dirty == 0)
+            { output.DirtySince = std::chrono::steady_clock::now(); }
+            else
+            { pHandle->Coalesced.fetch_add(1, std::memory_order_relaxed); }
+
+            current = value;
+            output.Dirty |= flag;
+        }
+    }
+
+    return FlushOutput(pHandle, false);
+}
+
+//-----------------------------------------------------------------------------
+//      出力設定を初期状態に戻します.
+//-----------------------------------------------------------------------------
+void ResetOutput(PadHandle* pHandle)
+{
+    if (pHandle->Output.Writer.joinable())
+    { StopWriter(pHandle); }
+
+    {
+        auto& output = pHandle->Output;
+        std::lock_guard<std::mutex> locker(output.Lock);
+        output.Vibration  = {};
+        output.LightBar   = {};
+        output.Flash      = {};
+        output.Trigger[PAD_TRIGGER_LEFT]  = {};
+        output.Trigger[PAD_TRIGGER_RIGHT] = {};
+        output.Dirty      = kOutputAll;
+        output.DirtySince = std::chrono::steady_clock::now();
+    }
+
+    FlushOutput(pHandle, true);
+}
+
+//-----------------------------------------------------------------------------
+//      パッドの候補となるデバイスのみを開きます.
+//-----------------------------------------------------------------------------
+bool OpenCandidate(const DevicePath& devicePath, PadHandle& result)
+{
+    // メタデータが取得できない場合は, 開いてから判定する.
+    PadDeviceInfo info = {};
+    if (!QueryDeviceInfo(devicePath, info))
+    { return OpenPadDevice(devicePath, PAD_CONNECTION_NONE, result); }
+
+    // パッド以外のデバイスは開かない.
+    if (info.Type == PAD_CONNECTION_NONE)
+    { return false; }
+
+    return OpenPadDevice(devicePath, info.Type, result);
+}
+
+//-----------------------------------------------------------------------------
+//      最初に見つかったパッドを接続します.
+//-----------------------------------------------------------------------------
+bool OpenDevice(PadHandle& result)
+{
+    for(auto& devicePath : EnumerateDevicePaths())
+    {
+        if (OpenCandidate(devicePath, result))
+        { return true; }
+    }
+
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+//      パッドを接続します.
+//-----------------------------------------------------------------------------
+bool PadOpen(PadHandle& result)
+{ return OpenDevice(result); }
+
+//-----------------------------------------------------------------------------
+//      パッドを接続します.
+//-----------------------------------------------------------------------------
+bool PadOpen(PadHandle** ppHandle)
+{
+    if (ppHandle == nullptr)
+    { return false; }
+
+    auto padHandle = new(std::nothrow) PadHandle();
+    if (padHandle == nullptr)
+    { return false; }
+
+    if (!PadOpen(*padHandle))
+    {
+        delete padHandle;
+        padHandle = nullptr;
+    }
+
+    *ppHandle = padHandle;
+
+    return (padHandle != nullptr);
+}
+
+//-----------------------------------------------------------------------------
+//      デバイスパスを指定してパッドを接続します.
+//-----------------------------------------------------------------------------
+bool PadOpen(const char* devicePath, uint32_t type, PadHandle** ppHandle)
+{
+    if (devicePath == nullptr || ppHandle == nullptr)
+    { return false; }
+
+    auto padHandle = new(std::nothrow) PadHandle();
+    if (padHandle == nullptr)
+    { return false; }
+
+#if defined(_WIN32)
+    auto ret = OpenPadDevice(ToStringW(devicePath), type, *padHandle);
+#else
+    auto ret = OpenPadDevice(devicePath, type, *padHandle);
+#endif
+    if (!ret)
+    {
+        delete padHandle;
+        padHandle = nullptr;
+    }
+
+    *ppHandle = padHandle;
+
+    return ret;
+}
+
+//-----------------------------------------------------------------------------
+//      キャプチャファイルを再生するパッドハンドルを開きます.
+//-----------------------------------------------------------------------------
+bool PadOpenReplay(const char* path, float speed, PadHandle** ppHandle)
+{
+    if (path == nullptr || ppHandle == nullptr || !(speed >= 0.0f))
+    { return false; }
+
+    std::unique_ptr<ReplaySource> pReplay(new(std::nothrow) ReplaySource());
+    if (!pReplay)
+    { return false; }
+
+    auto& replay = *pReplay;
+    auto& header = replay.Header;
+    auto  ret    = MapReplayFile(path, replay) && replay.Size >= sizeof(header);
+    if (ret)
+    {
+        memcpy(&header, replay.pBytes, sizeof(header));
+        ret = header.Magic        == kPadCaptureMagic
+           && header.Version      == kPadCaptureVersion
+           && header.HeaderSize   >= sizeof(header)
+           && header.HeaderSize   <= replay.Size
+           && header.ReportSize   <= kPadMaxReportSize
+           && header.RecordStride >= sizeof(uint64_t) + header.ReportSize
+           && header.ChunkSize    > 0;
+    }
+
+    auto padHandle = ret ? new(std::nothrow) PadHandle() : nullptr;
+    if (padHandle == nullptr)
+    {
+        UnmapReplayFile(replay);
+        return false;
+    }
+
+    replay.Offset = header.HeaderSize;
+    replay.Speed  = speed;
+
+    padHandle->Type         = header.Type;
+    padHandle->Size         = header.ReportSize;
+    padHandle->Decoder      = GetReportDecoder(header.Type);
+    padHandle->MacAddress   = std::string(header.MacAddress, strnlen(header.MacAddress, sizeof(header.MacAddress)));
+    padHandle->Calibration  = header.Calibration;
+    padHandle->Calibrated   = (header.Calibrated != 0);
+    padHandle->Replay       = std::move(pReplay);
+
+    *ppHandle = padHandle;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      パッドを切断します.
+//-----------------------------------------------------------------------------
+bool PadClose(PadHandle& padHandle)
+{
+    if (padHandle.Reader.joinable())
+    {
+        StopPadReader(&padHandle);
+        padHandle.Ring.reset();
+    }
+
+    PadStopCapture(&padHandle);
+
+    if (padHandle.Replay)
+    {
+        UnmapReplayFile(*padHandle.Replay);
+        padHandle.Replay.reset();
+    }
+
+    if (IsOpen(&padHandle))
+    {
+        ResetOutput(&padHandle);
+        ClosePadDevice(padHandle);
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      パッドを切断します.
+//-----------------------------------------------------------------------------
+bool PadClose(PadHandle*& pHandle)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    if (PadClose(*pHandle))
+    {
+        // ハンドル破棄.
+        delete pHandle;
+        pHandle = nullptr;
+
+        return true;
+    }
+
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+//      読み取りタイムアウトを設定します.
+//-----------------------------------------------------------------------------
+bool PadSetReadTimeout(PadHandle* pHandle, int32_t milliseconds)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    pHandle->Timeout = (milliseconds < 0) ? -1 : milliseconds;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      読み取りスレッドの有効/無効を切り替えます.
+//-----------------------------------------------------------------------------
+bool PadEnableReaderThread(PadHandle* pHandle, bool enable)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    if (!IsOpen(pHandle))
+    { return false; }
+
+    if (enable == pHandle->Reader.joinable())
+    { return true; }
+
+    if (!enable)
+    {
+        StopPadReader(pHandle);
+        pHandle->Ring.reset();
+        return true;
+    }
+
+    pHandle->Ring.reset(new(std::nothrow) InputRing());
+    if (!pHandle->Ring)
+    { return false; }
+
+    pHandle->ReaderStop.store(false, std::memory_order_relaxed);
+    if (!StartPadReader(pHandle))
+    {
+        pHandle->Ring.reset();
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      パッド生データを読み取ります.
+//-----------------------------------------------------------------------------
+bool PadRead(PadHandle* pHandle, PadRawInput& result)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    if (!IsOpen(pHandle) && !pHandle->Replay)
+    { return false; }
+
+    // 読み取りスレッド有効時はリングバッファから取り出すのみ.
+    auto ret = (pHandle->Replay) ? ReadReplay(pHandle, &result, 1, pHandle->Timeout) == 1
+             : (pHandle->Ring)   ? pHandle->Ring->Pop(result)
+             : ReadPadReports(pHandle, &result, 1, pHandle->Timeout) == 1;
+
+    if (ret)
+    { RecordLatency(pHandle, &result, 1); }
+
+    return ret;
+}
+
+//-----------------------------------------------------------------------------
+//      溜まっているパッド生データをまとめて読み取ります.
+//-----------------------------------------------------------------------------
+uint32_t PadReadBatch(PadHandle* pHandle, PadRawInput* pResults, uint32_t count)
+{
+    if (pHandle == nullptr || pResults == nullptr)
+    { return 0; }
+
+    if (!IsOpen(pHandle) && !pHandle->Replay)
+    { return 0; }
+
+    // 読み取りスレッド有効時はリングバッファから取り出すのみ.
+    auto result = 0u;
+    if (pHandle->Replay)
+    {
+        result = ReadReplay(pHandle, pResults, count, pHandle->Timeout);
+    }
+    else if (pHandle->Ring)
+    {
+        while(result < count && pHandle->Ring->Pop(pResults[result]))
+        { result++; }
+    }
+    else
+    {
+        result = ReadPadReports(pHandle, pResults, count, pHandle->Timeout);
+    }
+
+    RecordLatency(pHandle, pResults, result);
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      入力の欠落と遅延の統計を取得します.
+//-----------------------------------------------------------------------------
+bool PadGetInputStats(PadHandle* pHandle, PadInputStats& stats)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    stats.Reports   = pHandle->Counted  .load(std::memory_order_relaxed);
+    stats.Lost      = pHandle->Lost     .load(std::memory_order_relaxed);
+    stats.Repeated  = pHandle->Repeated .load(std::memory_order_relaxed);
+    stats.Overflow  = pHandle->Overflow .load(std::memory_order_relaxed);
+    LoadHistogram(pHandle->Interval, stats.Interval);
+    LoadHistogram(pHandle->Latency,  stats.Latency);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      デバイス時刻からホスト時刻への変換パラメータを取得します.
+//-----------------------------------------------------------------------------
+bool PadGetClockEstimate(PadHandle* pHandle, PadClockEstimate& result)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    for(;;)
+    {
+        auto begin = pHandle->ClockSequence.load(std::memory_order_acquire);
+        if (begin == 0)
+        { return false; }
+
+        if (begin & 0x1)
+        { continue; }
+
+        result = pHandle->Clock;
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (pHandle->ClockSequence.load(std::memory_order_relaxed) == begin)
+        { return true; }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      デバイス時刻をホスト時刻に変換します.
+//-----------------------------------------------------------------------------
+uint64_t PadConvertDeviceTime(const PadClockEstimate& clock, uint64_t deviceTime)
+{
+    auto delta = double(int64_t(deviceTime - clock.DeviceTime)) * clock.Rate;
+    return uint64_t(int64_t(clock.HostTime) + std::llround(delta));
+}
+
+//-----------------------------------------------------------------------------
+//      IMUの補正係数を取得します.
+//-----------------------------------------------------------------------------
+bool PadGetCalibration(PadHandle* pHandle, PadCalibration& result)
+{
+    if (pHandle == nullptr)
+    {
+        SetDefaultCalibration(result);
+        return false;
+    }
+
+    result = pHandle->Calibration;
+    return pHandle->Calibrated;
+}
+
+//-----------------------------------------------------------------------------
+//      角速度と加速度を補正し, 物理単位に変換します.
+//-----------------------------------------------------------------------------
+bool PadCalibrate(const PadCalibration& calibration, const PadState& state, PadMotion& result)
+{
+    if (state.Type == PAD_CONNECTION_NONE)
+    { return false; }
+
+    CalibrateMotion(calibration, state.Gyro, state.Accel, result);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      姿勢推定の有効/無効を切り替えます.
+//-----------------------------------------------------------------------------
+bool PadEnableFusion(PadHandle* pHandle, bool enable)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    // 受信スレッドが次のレポートで初期姿勢を求め直す.
+    if (enable)
+    { pHandle->FusionReset.store(true, std::memory_order_release); }
+
+    pHandle->FusionEnabled.store(enable, std::memory_order_release);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      姿勢推定のゲインを設定します.
+//-----------------------------------------------------------------------------
+bool PadSetFusionGain(PadHandle* pHandle, float gain)
+{
+    if (pHandle == nullptr || !(gain >= 0.0f))
+    { return false; }
+
+    pHandle->FusionGain.store(gain, std::memory_order_relaxed);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      パッドが接続中かどうかチェックします.
+//-----------------------------------------------------------------------------
+bool PadIsConnected(PadHandle* pHandle)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    if (!IsOpen(pHandle) && !pHandle->Replay)
+    { return false; }
+
+    return pHandle->Connected.load(std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+//      入出力統計を取得します.
+//-----------------------------------------------------------------------------
+bool PadGetIoStats(PadHandle* pHandle, PadIoStats& stats)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    stats.ReadCalls = pHandle->ReadCalls.load(std::memory_order_relaxed);
+    stats.WaitCalls = pHandle->WaitCalls.load(std::memory_order_relaxed);
+    stats.Reports   = pHandle->Reports  .load(std::memory_order_relaxed);
+    stats.CrcErrors = pHandle->CrcErrors.load(std::memory_order_relaxed);
+
+    stats.WriteCalls        = pHandle->WriteCalls   .load(std::memory_order_relaxed);
+    stats.WriteErrors       = pHandle->WriteErrors  .load(std::memory_order_relaxed);
+    stats.Coalesced         = pHandle->Coalesced    .load(std::memory_order_relaxed);
+    stats.WriteLatencySum   = pHandle->LatencySum   .load(std::memory_order_relaxed);
+    stats.WriteLatencyMax   = pHandle->LatencyMax   .load(std::memory_order_relaxed);
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+//      パッドデータを扱いやすい形にマッピングします.
+//-----------------------------------------------------------------------------
+bool PadMap(const PadRawInput* pRawData, PadState& state)
+{
+    if (pRawData == nullptr)
+    { return false; }
+
+    return GetReportDecoder(pRawData->Type)(pRawData, state);
+}
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+// BatchLayout structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  PadMapBatch() が入力レポートからフィールドを集める方法です.
+//!
+//! @note   PadReportLayout から MakeBatchLayout() で生成します.
+//!         16bitのフィールドは [ボタン, タイムスタンプ, 角速度XYZ, 加速度XYZ],
+//!         8bitのフィールドは [スティック4つ, L2, R2, 特殊ボタン, バッテリー/タッチ数, タッチ2つ分の4バイト] の順に並べます.
+struct BatchLayout
+{
+    uint8_t     MotionOffset;           //!< 角速度の位置(2回目の読み込み位置).
+    uint8_t     TouchOffset;            //!< 1つ目のタッチの位置(3回目の読み込み位置).
+    uint8_t     SpecialMask;            //!< 特殊ボタンの有効ビット.
+    bool        HasTouchCount;          //!< 8bitフィールドの7番目がタッチ数ならtrue, バッテリーならfalse.
+    int8_t      WordShuffle[2][16];     //!< 16bitフィールドを集めるシャッフル(1回目, 2回目の読み込み).
+    int8_t      ByteShuffle[2][16];     //!< 8bitフィールドを集めるシャッフル(1回目, 3回目の読み込み).
+};
+
+//-----------------------------------------------------------------------------
+//      レポートのレイアウトからフィールドを集めるシャッフルを生成します.
+//-----------------------------------------------------------------------------
+constexpr BatchLayout MakeBatchLayout(const PadReportLayout& layout)
+{
+    // シャッフルの値は各読み込み位置(1回目は1バイト目)からの相対位置. -1は0で埋める.
+    BatchLayout result = {};
+    result.MotionOffset  = layout.Gyro;
+    result.TouchOffset   = layout.Touch;
+    result.SpecialMask   = layout.SpecialMask;
+    result.HasTouchCount = (layout.TouchCount != 0);
+
+    for(auto i=0; i<16; ++i)
+    {
+        result.WordShuffle[0][i] = -1;
+        result.WordShuffle[1][i] = -1;
+        result.ByteShuffle[0][i] = -1;
+        result.ByteShuffle[1][i] = -1;
+    }
+
+    // 16bit : ボタン, タイムスタンプは1回目, 角速度と加速度は2回目の読み込みから.
+    result.WordShuffle[0][0] = int8_t(layout.Buttons   - 1);
+    result.WordShuffle[0][1] = int8_t(layout.Buttons);
+    result.WordShuffle[0][2] = int8_t(layout.TimeStamp - 1);
+    result.WordShuffle[0][3] = int8_t(layout.TimeStamp);
+    for(auto i=0; i<12; ++i)
+    { result.WordShuffle[1][4 + i] = int8_t(i); }
+
+    // 8bit : タッチ以外は1回目, タッチとタッチ数は3回目の読み込みから.
+    result.ByteShuffle[0][0] = int8_t(layout.StickL - 1);
+    result.ByteShuffle[0][1] = int8_t(layout.StickL);
+    result.ByteShuffle[0][2] = int8_t(layout.StickR - 1);
+    result.ByteShuffle[0][3] = int8_t(layout.StickR);
+    result.ByteShuffle[0][4] = int8_t(layout.L2      - 1);
+    result.ByteShuffle[0][5] = int8_t(layout.R2      - 1);
+    result.ByteShuffle[0][6] = int8_t(layout.Special - 1);
+    if (layout.Battery != 0)
+    { result.ByteShuffle[0][7] = int8_t(layout.Battery - 1); }
+    else
+    { result.ByteShuffle[1][7] = int8_t(layout.TouchCount - layout.Touch); }
+    for(auto i=0; i<8; ++i)
+    { result.ByteShuffle[1][8 + i] = int8_t(i); }
+
+    return result;
+}
+
+static_assert(kPadDualShock4Layout.Accel == kPadDualShock4Layout.Gyro + 6, "Accel must follow Gyro.");
+static_assert(kPadDualSenseLayout .Accel == kPadDualSenseLayout .Gyro + 6, "Accel must follow Gyro.");
+static_assert(kPadDualShock4Layout.Battery != 0 && kPadDualShock4Layout.TouchCount == 0, "Invalid batch layout.");
+static_assert(kPadDualSenseLayout .Battery == 0 && kPadDualSenseLayout .TouchCount != 0, "Invalid batch layout.");
+
+static constexpr BatchLayout kBatchDualShock4 = MakeBatchLayout(kPadDualShock4Layout);
+static constexpr BatchLayout kBatchDualSense  = MakeBatchLayout(kPadDualSenseLayout);
+
+static const uint32_t kBatchWidth = 16;     // SIMD命令で一度に処理するレポート数.
+
+std::atomic<int> g_SimdLevel(-1);
+
+//-----------------------------------------------------------------------------
+//      マッピング結果を出力先の配列に書き込みます.
+//-----------------------------------------------------------------------------
+void StoreState(const PadStateStream& stream, uint32_t index, const PadState& state, bool valid)
+{
+    if (stream.Valid          != nullptr) { stream.Valid[index]          = valid ? 1 : 0; }
+    if (stream.StickLX        != nullptr) { stream.StickLX[index]        = state.StickL.X; }
+    if (stream.StickLY        != nullptr) { stream.StickLY[index]        = state.StickL.Y; }
+    if (stream.StickRX        != nullptr) { stream.StickRX[index]        = state.StickR.X; }
+    if (stream.StickRY        != nullptr) { stream.StickRY[index]        = state.StickR.Y; }
+    if (stream.L2             != nullptr) { stream.L2[index]             = state.AnalogButtons.L2; }
+    if (stream.R2             != nullptr) { stream.R2[index]             = state.AnalogButtons.R2; }
+    if (stream.Buttons        != nullptr) { stream.Buttons[index]        = state.Buttons; }
+    if (stream.SpecialButtons != nullptr) { stream.SpecialButtons[index] = state.SpecialButtons; }
+    if (stream.TimeStamp      != nullptr) { stream.TimeStamp[index]      = state.TimeStamp; }
+    if (stream.BatteryLevel   != nullptr) { stream.BatteryLevel[index]   = state.BatteryLevel; }
+    if (stream.GyroX          != nullptr) { stream.GyroX[index]          = state.Gyro.X; }
+    if (stream.GyroY          != nullptr) { stream.GyroY[index]          = state.Gyro.Y; }
+    if (stream.GyroZ          != nullptr) { stream.GyroZ[index]          = state.Gyro.Z; }
+    if (stream.AccelX         != nullptr) { stream.AccelX[index]         = state.Accel.X; }
+    if (stream.AccelY         != nullptr) { stream.AccelY[index]         = state.Accel.Y; }
+    if (stream.AccelZ         != nullptr) { stream.AccelZ[index]         = state.Accel.Z; }
+    if (stream.TouchCount     != nullptr) { stream.TouchCount[index]     = state.TouchData.Count; }
+
+    for(auto i=0; i<kPadMaxTouchCount; ++i)
+    {
+        if (stream.TouchId[i] != nullptr) { stream.TouchId[i][index] = state.TouchData.Touch[i].Id; }
+        if (stream.TouchX[i]  != nullptr) { stream.TouchX[i][index]  = state.TouchData.Touch[i].X; }
+        if (stream.TouchY[i]  != nullptr) { stream.TouchY[i][index]  = state.TouchData.Touch[i].Y; }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      PadMap() を使って1レポートずつマッピングします.
+//-----------------------------------------------------------------------------
+uint32_t MapBatchScalar(const PadRawInput* pRawData, uint32_t begin, uint32_t end, const PadStateStream& stream)
+{
+    auto result = 0u;
+    for(auto i=begin; i<end; ++i)
+    {
+        // PadMap() が書き込まないフィールドと失敗したレポートは0とする.
+        PadState state = {};
+        auto valid = PadMap(&pRawData[i], state);
+        if (!valid)
+        { memset(&state, 0, sizeof(state)); }
+
+        StoreState(stream, i, state, valid);
+        result += valid ? 1 : 0;
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      CPUが対応する命令セットを調べます.
+//-----------------------------------------------------------------------------
+PAD_SIMD_LEVEL DetectSimdLevel()
+{
+#if PAD_SIMD_X86
+#if defined(_MSC_VER)
+    int info[4] = {};
+    __cpuid(info, 0);
+    const auto maxId = info[0];
+    if (maxId < 1)
+    { return PAD_SIMD_NONE; }
+
+    __cpuid(info, 1);
+    const auto sse41   = (info[2] & (1 << 19)) != 0;
+    const auto osxsave = (info[2] & (1 << 27)) != 0;
+    const auto avx     = (info[2] & (1 << 28)) != 0;
+    if (!sse41)
+    { return PAD_SIMD_NONE; }
+
+    // OSがYMMレジスタを保存しない場合はAVX2を使わない.
+    if (maxId < 7 || !osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+    { return PAD_SIMD_SSE41; }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) ? PAD_SIMD_AVX2 : PAD_SIMD_SSE41;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    { return PAD_SIMD_AVX2; }
+
+    if (__builtin_cpu_supports("sse4.1"))
+    { return PAD_SIMD_SSE41; }
+#endif
+#endif
+    return PAD_SIMD_NONE;
+}
+
+//-----------------------------------------------------------------------------
+//      CPUが対応する最上位の命令セットを取得します.
+//-----------------------------------------------------------------------------
+PAD_SIMD_LEVEL GetSupportedSimdLevel()
+{
+    static const PAD_SIMD_LEVEL level = DetectSimdLevel();
+    return level;
+}
+
+#if PAD_SIMD_X86
+
+//-----------------------------------------------------------------------------
+//      16個のレポートの接続タイプが揃っているか判定し, 入力データの開始位置を返却します.
+//-----------------------------------------------------------------------------
+int GetBatchOffset(const PadRawInput* pRawData)
+{
+    const auto mask = kPadConnectionMask | PAD_CONNECTION_DUAL_SENSE;
+    const auto type = pRawData[0].Type & mask;
+    for(auto i=1u; i<kBatchWidth; ++i)
+    {
+        if ((pRawData[i].Type & mask) != type)
+        { return -1; }
+    }
+
+    if (!PadIsSupportedType(type))
+    { return -1; }
+
+    return PadGetReportLayout(type).Base;
+}
+
+//-----------------------------------------------------------------------------
+//      Bluetoothの簡易レポートを PadMap() の結果で上書きし, その数を返却します.
+//-----------------------------------------------------------------------------
+uint32_t FixupShortReports(const PadRawInput* pRawData, uint32_t begin, const PadStateStream& stream)
+{
+    const auto reportId = PadGetReportLayout(pRawData[begin].Type).ReportId;
+    if (reportId == 0)
+    { return 0; }
+
+    auto result = 0u;
+    for(auto i=begin; i<begin + kBatchWidth; ++i)
+    {
+        if (pRawData[i].Bytes[0] != reportId)
+        {
+            MapBatchScalar(pRawData, i, i + 1, stream);
+            result++;
+        }
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      タッチパッドのデータを出力するかどうか.
+//-----------------------------------------------------------------------------
+bool IsTouchRequested(const PadStateStream& stream)
+{
+    if (stream.TouchCount != nullptr)
+    { return true; }
+
+    for(auto i=0; i<kPadMaxTouchCount; ++i)
+    {
+        if (stream.TouchId[i] != nullptr || stream.TouchX[i] != nullptr || stream.TouchY[i] != nullptr)
+        { return true; }
+    }
+
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+//      行iと行i+4の16bit要素を交互に並べます(8行).
+//-----------------------------------------------------------------------------
+PAD_TARGET("sse4.1")
+inline void InterleaveWords(__m128i* d, const __m128i* s)
+{
+    d[0] = _mm_unpacklo_epi16(s[0], s[4]);  d[1] = _mm_unpackhi_epi16(s[0], s[4]);
+    d[2] = _mm_unpacklo_epi16(s[1], s[5]);  d[3] = _mm_unpackhi_epi16(s[1], s[5]);
+    d[4] = _mm_unpacklo_epi16(s[2], s[6]);  d[5] = _mm_unpackhi_epi16(s[2], s[6]);
+    d[6] = _mm_unpacklo_epi16(s[3], s[7]);  d[7] = _mm_unpackhi_epi16(s[3], s[7]);
+}
+
+//-----------------------------------------------------------------------------
+//      行iと行i+8の8bit要素を交互に並べます(16行).
+//-----------------------------------------------------------------------------
+PAD_TARGET("sse4.1")
+inline void InterleaveBytes(__m128i* d, const __m128i* s)
+{
+    d[ 0] = _mm_unpacklo_epi8(s[0], s[ 8]);  d[ 1] = _mm_unpackhi_epi8(s[0], s[ 8]);
+    d[ 2] = _mm_unpacklo_epi8(s[1], s[ 9]);  d[ 3] = _mm_unpackhi_epi8(s[1], s[ 9]);
+    d[ 4] = _mm_unpacklo_epi8(s[2], s[10]);  d[ 5] = _mm_unpackhi_epi8(s[2], s[10]);
+    d[ 6] = _mm_unpacklo_epi8(s[3], s[11]);  d[ 7] = _mm_unpackhi_epi8(s[3], s[11]);
+    d[ 8] = _mm_unpacklo_epi8(s[4], s[12]);  d[ 9] = _mm_unpackhi_epi8(s[4], s[12]);
+    d[10] = _mm_unpacklo_epi8(s[5], s[13]);  d[11] = _mm_unpackhi_epi8(s[5], s[13]);
+    d[12] = _mm_unpacklo_epi8(s[6], s[14]);  d[13] = _mm_unpackhi_epi8(s[6], s[14]);
+    d[14] = _mm_unpacklo_epi8(s[7], s[15]);  d[15] = _mm_unpackhi_epi8(s[7], s[15]);
+}
+
+//-----------------------------------------------------------------------------
+//      8x8ワードの行列を転置します.
+//-----------------------------------------------------------------------------
+PAD_TARGET("sse4.1")
+inline void Transpose8x8(const __m128i* m, __m128i* result)
+{
+    // 行iと行i+4を交互に並べる操作を3回繰り返すと転置になる.
+    __m128i t0[8];
+    __m128i t1[8];
+    InterleaveWords(t0, m);
+    InterleaveWords(t1, t0);
+    InterleaveWords(result, t1);
+}
+
+//-----------------------------------------------------------------------------
+//      16x16バイトの行列を転置します.
+//-----------------------------------------------------------------------------
+PAD_TARGET("sse4.1")
+inline void Transpose16x16(const __m128i* m, __m128i* result)
+{
+    // 行iと行i+8を交互に並べる操作を4回繰り返すと転置になる.
+    __m128i t0[16];
+    __m128i t1[16];
+    InterleaveBytes(t0, m);
+    InterleaveBytes(t1, t0);
+    InterleaveBytes(t0, t1);
+    InterleaveBytes(result, t0);
+}
+
+//-----------------------------------------------------------------------------
+//      8bitの値を16個書き込みます.
+//-----------------------------------------------------------------------------
+PAD_TARGET("sse4.1")
+inline void Store8(uint8_t* pDst, uint32_t index, __m128i value)
+{
+    if (pDst != nullptr)
+    { _mm_storeu_si128(reinterpret_cast<__m128i*>(pDst + index), value); }
+}
+
+//-----------------------------------------------------------------------------
+//      16bitの値を8個ずつ2回書き込みます.
+//-----------------------------------------------------------------------------
+PAD_TARGET("sse4.1")
+inline void Store16(void* pDst, uint32_t index, __m128i lo, __m128i hi)
+{
+    if (pDst == nullptr)
+    { return; }
+
+    auto pValues = reinterpret_cast<__m128i*>(static_cast<uint16_t*>(pDst) + index);
+    _mm_storeu_si128(pValues + 0, lo);
+    _mm_storeu_si128(pValues + 1, hi);
+}
+
+//-----------------------------------------------------------------------------
+//      8bitフィールドを書き込みます.
+//-----------------------------------------------------------------------------
+PAD_TARGET("sse4.1")
+inline void StoreByteFields
+(
+    const __m128i*          field,
+    bool                    touch,
+    const BatchLayout&      layout,
+    const PadStateStream&   stream,
+    uint32_t                index
+)
+{
+    // field[i] には16個のレポートの i 番目の8bitフィールドが並んでいる.
+    const auto zero = _mm_setzero_si128();
+
+    Store8(stream.Valid,          index, _mm_set1_epi8(1));
+    Store8(stream.StickLX,        index, field[0]);
+    Store8(stream.StickLY,        index, field[1]);
+    Store8(stream.StickRX,        index, field[2]);
+    Store8(stream.StickRY,        index, field[3]);
+    Store8(stream.L2,             index, field[4]);
+    Store8(stream.R2,             index, field[5]);
+    Store8(stream.SpecialButtons, index, _mm_and_si128(field[6], _mm_set1_epi8(char(layout.SpecialMask))));
+    Store8(stream.BatteryLevel,   index, layout.HasTouchCount ? zero : field[7]);
+
+    if (!touch)
+    { return; }
+
+    if (stream.TouchCount != nullptr)
+    {
+        auto count = field[7];
+        if (!layout.HasTouchCount)
+        {
+            // 識別番号の最上位ビットが0ならタッチしている.
+            const auto one = _mm_set1_epi8(1);
+            auto released0 = _mm_and_si128(_mm_srli_epi16(field[8],  7), one);
+            auto released1 = _mm_and_si128(_mm_srli_epi16(field[12], 7), one);
+            count = _mm_sub_epi8(_mm_set1_epi8(2), _mm_add_epi8(released0, released1));
+        }
+        Store8(stream.TouchCount, index, count);
+    }
+
+    const auto lowNibble = _mm_set1_epi8(0x0f);
+    const auto idMask    = _mm_set1_epi8(0x7f);
+
+    for(auto i=0; i<kPadMaxTouchCount; ++i)
+    {
+        const auto pTouch = &field[8 + i * 4];
+        Store8(stream.TouchId[i], index, _mm_and_si128(pTouch[0], idMask));
+
+        // X = ((b2 & 0xf) << 8) | b1.
+        auto high = _mm_and_si128(pTouch[2], lowNibble);
+        Store16(stream.TouchX[i], index,
+            _mm_unpacklo_epi8(pTouch[1], high),
+            _mm_unpackhi_epi8(pTouch[1], high));
+
+        // Y = (b3 << 4) | (b2 >> 4).
+        if (stream.TouchY[i] != nullptr)
+        {
+            auto h0 = _mm_cvtepu8_epi16(pTouch[3]);
+            auto h1 = _mm_cvtepu8_epi16(_mm_srli_si128(pTouch[3], 8));
+            auto l0 = _mm_cvtepu8_epi16(pTouch[2]);
+            auto l1 = _mm_cvtepu8_epi16(_mm_srli_si128(pTouch[2], 8));
+            Store16(stream.TouchY[i], index,
+                _mm_or_si128(_mm_slli_epi16(h0, 4), _mm_srli_epi16(l0, 4)),
+                _mm_or_si128(_mm_slli_epi16(h1, 4), _mm_srli_epi16(l1, 4)));
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      16個のレポートをSSE4.1でマッピングします.
+//-----------------------------------------------------------------------------
+PAD_TARGET("sse4.1")
+void MapBlockSse41
+(
+    const PadRawInput*      pRawData,
+    uint32_t                offset,
+    bool                    touch,
+    const BatchLayout&      layout,
+    const PadStateStream&   stream,
+    uint32_t                index
+)
+{
+    const auto w0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.WordShuffle[0]));
+    const auto w1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.WordShuffle[1]));
+    const auto b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.ByteShuffle[0]));
+    const auto b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.ByteShuffle[1]));
+
+    // 各レポートから必要なバイトだけを集める.
+    __m128i words[kBatchWidth];
+    __m128i bytes[kBatchWidth];
+    for(auto i=0u; i<kBatchWidth; ++i)
+    {
+        auto pInput = &pRawData[i].Bytes[offset];
+        auto head   = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pInput + 1));
+        auto motion = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pInput + layout.MotionOffset));
+        words[i] = _mm_or_si128(_mm_shuffle_epi8(head, w0), _mm_shuffle_epi8(motion, w1));
+        bytes[i] = _mm_shuffle_epi8(head, b0);
+
+        if (touch)
+        {
+            auto tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pInput + layout.TouchOffset));
+            bytes[i] = _mm_or_si128(bytes[i], _mm_shuffle_epi8(tail, b1));
+        }
+    }
+
+    __m128i lo[8];
+    __m128i hi[8];
+    __m128i fields[16];
+    Transpose8x8(&words[0], lo);
+    Transpose8x8(&words[8], hi);
+    Transpose16x16(bytes, fields);
+
+    Store16(stream.Buttons,   index, lo[0], hi[0]);
+    Store16(stream.TimeStamp, index, lo[1], hi[1]);
+    Store16(stream.GyroX,     index, lo[2], hi[2]);
+    Store16(stream.GyroY,     index, lo[3], hi[3]);
+    Store16(stream.GyroZ,     index, lo[4], hi[4]);
+    Store16(stream.AccelX,    index, lo[5], hi[5]);
+    Store16(stream.AccelY,    index, lo[6], hi[6]);
+    Store16(stream.AccelZ,    index, lo[7], hi[7]);
+
+    StoreByteFields(fields, touch, layout, stream, index);
+}
+
+//-----------------------------------------------------------------------------
+//      128bitレーンごとに行iと行i+4の16bit要素を交互に並べます(8行).
+//-----------------------------------------------------------------------------
+PAD_TARGET("avx2")
+inline void InterleaveWords(__m256i* d, const __m256i* s)
+{
+    d[0] = _mm256_unpacklo_epi16(s[0], s[4]);  d[1] = _mm256_unpackhi_epi16(s[0], s[4]);
+    d[2] = _mm256_unpacklo_epi16(s[1], s[5]);  d[3] = _mm256_unpackhi_epi16(s[1], s[5]);
+    d[4] = _mm256_unpacklo_epi16(s[2], s[6]);  d[5] = _mm256_unpackhi_epi16(s[2], s[6]);
+    d[6] = _mm256_unpacklo_epi16(s[3], s[7]);  d[7] = _mm256_unpackhi_epi16(s[3], s[7]);
+}
+
+//-----------------------------------------------------------------------------
+//      128bitレーンごとに行iと行i+4の8bit要素を交互に並べます(8行).
+//-----------------------------------------------------------------------------
+PAD_TARGET("avx2")
+inline void InterleaveBytes(__m256i* d, const __m256i* s)
+{
+    d[0] = _mm256_unpacklo_epi8(s[0], s[4]);  d[1] = _mm256_unpackhi_epi8(s[0], s[4]);
+    d[2] = _mm256_unpacklo_epi8(s[1], s[5]);  d[3] = _mm256_unpackhi_epi8(s[1], s[5]);
+    d[4] = _mm256_unpacklo_epi8(s[2], s[6]);  d[5] = _mm256_unpackhi_epi8(s[2], s[6]);
+    d[6] = _mm256_unpacklo_epi8(s[3], s[7]);  d[7] = _mm256_unpackhi_epi8(s[3], s[7]);
+}
+
+//-----------------------------------------------------------------------------
+//      16bitの値を16個書き込みます.
+//-----------------------------------------------------------------------------
+PAD_TARGET("avx2")
+inline void Store16x16(void* pDst, uint32_t index, __m256i value)
+{
+    if (pDst != nullptr)
+    { _mm256_storeu_si256(reinterpret_cast<__m256i*>(static_cast<uint16_t*>(pDst) + index), value); }
+}
+
+//-----------------------------------------------------------------------------
+//      2つの16バイトを下位レーンと上位レーンに読み込みます.
+//-----------------------------------------------------------------------------
+PAD_TARGET("avx2")
+inline __m256i Load2x128(const uint8_t* pLo, const uint8_t* pHi)
+{
+    auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pLo));
+    auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pHi));
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+}
+
+//-----------------------------------------------------------------------------
+//      16個のレポートをAVX2でマッピングします.
+//-----------------------------------------------------------------------------
+PAD_TARGET("avx2")
+void MapBlockAvx2
+(
+    const PadRawInput*      pRawData,
+    uint32_t                offset,
+    bool                    touch,
+    const BatchLayout&      layout,
+    const PadStateStream&   stream,
+    uint32_t                index
+)
+{
+    const auto w0 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.WordShuffle[0])));
+    const auto w1 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.WordShuffle[1])));
+    const auto b0 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.ByteShuffle[0])));
+    const auto b1 = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(layout.ByteShuffle[1])));
+
+    // レポートiを下位レーン, レポートi+8を上位レーンに集める.
+    __m256i words[8];
+    __m256i bytes[8];
+    for(auto i=0u; i<8; ++i)
+    {
+        auto pLo = &pRawData[i + 0].Bytes[offset];
+        auto pHi = &pRawData[i + 8].Bytes[offset];
+        auto head   = Load2x128(pLo + 1, pHi + 1);
+        auto motion = Load2x128(pLo + layout.MotionOffset, pHi + layout.MotionOffset);
+        words[i] = _mm256_or_si256(_mm256_shuffle_epi8(head, w0), _mm256_shuffle_epi8(motion, w1));
+        bytes[i] = _mm256_shuffle_epi8(head, b0);
+
+        if (touch)
+        {
+            auto tail = Load2x128(pLo + layout.TouchOffset, pHi + layout.TouchOffset);
+            bytes[i] = _mm256_or_si256(bytes[i], _mm256_shuffle_epi8(tail, b1));
+        }
+    }
+
+    // 16bitフィールドはレーンごとの8x8転置で16個ずつ並ぶ.
+    // 8bitフィールドは8x16転置で各レーンに2フィールド分が並ぶ.
+    __m256i t0[8];
+    __m256i t1[8];
+    InterleaveWords(t0, words);
+    InterleaveWords(t1, t0);
+    InterleaveWords(words, t1);
+
+    InterleaveBytes(t0, bytes);
+    InterleaveBytes(t1, t0);
+    InterleaveBytes(bytes, t1);
+
+    Store16x16(stream.Buttons,   index, words[0]);
+    Store16x16(stream.TimeStamp, index, words[1]);
+    Store16x16(stream.GyroX,     index, words[2]);
+    Store16x16(stream.GyroY,     index, words[3]);
+    Store16x16(stream.GyroZ,     index, words[4]);
+    Store16x16(stream.AccelX,    index, words[5]);
+    Store16x16(stream.AccelY,    index, words[6]);
+    Store16x16(stream.AccelZ,    index, words[7]);
+
+    // bytes[i] = [フィールド2i(0~7), フィールド2i+1(0~7) | フィールド2i(8~15), フィールド2i+1(8~15)].
+    __m128i fields[16];
+    for(auto i=0; i<8; ++i)
+    {
+        auto sorted = _mm256_permute4x64_epi64(bytes[i], _MM_SHUFFLE(3, 1, 2, 0));
+        fields[i * 2 + 0] = _mm256_castsi256_si128(sorted);
+        fields[i * 2 + 1] = _mm256_extracti128_si256(sorted, 1);
+    }
+
+    // SSE命令の関数を呼ぶ前に上位レーンをクリアして切り替えのペナルティを避ける.
+    _mm256_zeroupper();
+    StoreByteFields(fields, touch, layout, stream, index);
+}
+
+#endif//PAD_SIMD_X86
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+//      複数のパッドデータをフィールドごとの配列にまとめてマッピングします.
+//-----------------------------------------------------------------------------
+uint32_t PadMapBatch(const PadRawInput* pRawData, uint32_t count, const PadStateStream& stream)
+{
+    if (pRawData == nullptr)
+    { return 0; }
+
+    auto result = 0u;
+    auto i      = 0u;
+
+#if PAD_SIMD_X86
+    const auto level = PadGetSimdLevel();
+    if (level != PAD_SIMD_NONE)
+    {
+        const auto touch = IsTouchRequested(stream);
+        for(; i + kBatchWidth <= count; i += kBatchWidth)
+        {
+            // 接続タイプが混在する区間は1つずつ処理する.
+            const auto offset = GetBatchOffset(&pRawData[i]);
+            if (offset < 0)
+            {
+                result += MapBatchScalar(pRawData, i, i + kBatchWidth, stream);
+                continue;
+            }
+
+            const auto& layout = !!(pRawData[i].Type & PAD_CONNECTION_DUAL_SENSE)
+                ? kBatchDualSense
+                : kBatchDualShock4;
+
+            if (level == PAD_SIMD_AVX2)
+            { MapBlockAvx2(&pRawData[i], uint32_t(offset), touch, layout, stream, i); }
+            else
+            { MapBlockSse41(&pRawData[i], uint32_t(offset), touch, layout, stream, i); }
+
+            // 簡易レポートの位置はSIMD命令で無意味な値を書き込んでいるので修正する.
+            result += kBatchWidth - FixupShortReports(pRawData, i, stream);
+        }
+    }
+#endif
+
+    result += MapBatchScalar(pRawData, i, count, stream);
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      PadMapBatch() が使用する命令セットを取得します.
+//-----------------------------------------------------------------------------
+PAD_SIMD_LEVEL PadGetSimdLevel()
+{
+    auto level = g_SimdLevel.load(std::memory_order_relaxed);
+    if (level < 0)
+    { return GetSupportedSimdLevel(); }
+
+    return PAD_SIMD_LEVEL(level);
+}
+
+//-----------------------------------------------------------------------------
+//      PadMapBatch() が使用する命令セットを設定します.
+//-----------------------------------------------------------------------------
+bool PadSetSimdLevel(PAD_SIMD_LEVEL level)
+{
+    if (level < PAD_SIMD_NONE || level > GetSupportedSimdLevel())
+    { return false; }
+
+    g_SimdLevel.store(level, std::memory_order_relaxed);
+    return true;
+}
+
+namespace {
+
+//-----------------------------------------------------------------------------
+//      記録のサンプル数を取得します(入力が無い場合は0).
+//-----------------------------------------------------------------------------
+uint32_t GetStreamCount(const PadMotionStream& stream)
+{
+    if (stream.pMotions == nullptr || stream.pDeltaTimes == nullptr)
+    { return 0; }
+
+    return stream.Count;
+}
+
+//-----------------------------------------------------------------------------
+//      記録の初期姿勢を求め, 最初に処理するサンプル番号を返却します.
+//-----------------------------------------------------------------------------
+uint32_t BeginStream(PadMotionStream& stream, float* q)
+{
+    const auto& o = stream.Orientation;
+    if (o.W != 0.0f || o.X != 0.0f || o.Y != 0.0f || o.Z != 0.0f)
+    {
+        ToFusionFrame(o, q);
+        return 0;
+    }
+
+    q[0] = 1.0f;
+    q[1] = q[2] = q[3] = 0.0f;
+    if (GetStreamCount(stream) == 0)
+    { return 0; }
+
+    // 初期姿勢が無い場合は最初のサンプルの加速度から求める.
+    float g[3];
+    float a[3];
+    ToFusionFrame(stream.pMotions[0], g, a);
+    InitFusion(a, q);
+
+    if (stream.pOrientations != nullptr)
+    { stream.pOrientations[0] = FromFusionFrame(q); }
+
+    return 1;
+}
+
+//-----------------------------------------------------------------------------
+//      記録の残りのサンプルを1つずつ処理します.
+//-----------------------------------------------------------------------------
+void FuseStreamScalar(float gain, PadMotionStream& stream, uint32_t begin, float* q)
+{
+    const auto count = GetStreamCount(stream);
+    for(auto i=begin; i<count; ++i)
+    {
+        float g[3];
+        float a[3];
+        ToFusionFrame(stream.pMotions[i], g, a);
+        FuseStep(q, g, a, gain, stream.pDeltaTimes[i]);
+
+        if (stream.pOrientations != nullptr)
+        { stream.pOrientations[i] = FromFusionFrame(q); }
+    }
+
+    stream.Orientation = FromFusionFrame(q);
+}
+
+#if PAD_SIMD_X86
+
+static const uint32_t kFusionWidth = 4;     // SIMD命令で並列に処理する記録の数.
+
+///////////////////////////////////////////////////////////////////////////////
+// Float4 structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  FuseStep() を4つの記録で並列に実行するための型です.
+struct Float4
+{
+    __m128  V;
+
+    Float4() = default;
+    PAD_TARGET("sse2") Float4(__m128 value) : V(value) {}
+    PAD_TARGET("sse2") explicit Float4(float value) : V(_mm_set1_ps(value)) {}
+};
+
+PAD_TARGET("sse2") inline Float4 operator + (Float4 a, Float4 b) { return _mm_add_ps(a.V, b.V); }
+PAD_TARGET("sse2") inline Float4 operator - (Float4 a, Float4 b) { return _mm_sub_ps(a.V, b.V); }
+PAD_TARGET("sse2") inline Float4 operator * (Float4 a, Float4 b) { return _mm_mul_ps(a.V, b.V); }
+
+//-----------------------------------------------------------------------------
+//      1 / sqrt(x) を求めます(0以下の要素は0).
+//-----------------------------------------------------------------------------
+PAD_TARGET("sse2")
+inline Float4 InvSqrt(Float4 x)
+{
+    auto mask = _mm_cmpgt_ps(x.V, _mm_setzero_ps());
+    return _mm_and_ps(mask, _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(x.V)));
+}
+
+//-----------------------------------------------------------------------------
+//      x が正の要素は value を, そうでない要素は0を返却します.
+//-----------------------------------------------------------------------------
+PAD_TARGET("sse2")
+inline Float4 IfPositive(Float4 x, Float4 value)
+{ return _mm_and_ps(_mm_cmpgt_ps(x.V, _mm_setzero_ps()), value.V); }
+
+//-----------------------------------------------------------------------------
+//      4つの記録を並列に処理し, 処理したサンプル数を返却します.
+//-----------------------------------------------------------------------------
+PAD_TARGET("sse2")
+uint32_t FuseGroupSse(float gain, PadMotionStream* pStreams)
+{
+    float    q    [kFusionWidth][4];
+    uint32_t begin[kFusionWidth];
+    uint32_t count = ~0u;
+    auto     store = false;
+    for(auto lane=0u; lane<kFusionWidth; ++lane)
+    {
+        begin[lane] = BeginStream(pStreams[lane], q[lane]);
+        count = std::min(count, GetStreamCount(pStreams[lane]) - begin[lane]);
+        store |= (pStreams[lane].pOrientations != nullptr);
+    }
+
+    // 記録ごとの姿勢を成分ごとのレジスタに並べ替える.
+    Float4 vq[4];
+    for(auto i=0; i<4; ++i)
+    { vq[i] = _mm_setr_ps(q[0][i], q[1][i], q[2][i], q[3][i]); }
+
+    const Float4 beta(gain);
+    for(auto k=0u; k<count; ++k)
+    {
+        float g [kFusionWidth][3];
+        float a [kFusionWidth][3];
+        float dt[kFusionWidth];
+        for(auto lane=0u; lane<kFusionWidth; ++lane)
+        {
+            auto& stream = pStreams[lane];
+            ToFusionFrame(stream.pMotions[begin[lane] + k], g[lane], a[lane]);
+            dt[lane] = stream.pDeltaTimes[begin[lane] + k];
+        }
+
+        Float4 vg[3];
+        Float4 va[3];
+        for(auto i=0; i<3; ++i)
+        {
+            vg[i] = _mm_setr_ps(g[0][i], g[1][i], g[2][i], g[3][i]);
+            va[i] = _mm_setr_ps(a[0][i], a[1][i], a[2][i], a[3][i]);
+        }
+
+        FuseStep(vq, vg, va, beta, Float4(_mm_loadu_ps(dt)));
+
+        if (store)
+        {
+            _MM_TRANSPOSE4_PS(vq[0].V, vq[1].V, vq[2].V, vq[3].V);
+            for(auto lane=0u; lane<kFusionWidth; ++lane)
+            {
+                auto& stream = pStreams[lane];
+                _mm_storeu_ps(q[lane], vq[lane].V);
+                if (stream.pOrientations != nullptr)
+                { stream.pOrientations[begin[lane] + k] = FromFusionFrame(q[lane]); }
+            }
+            _MM_TRANSPOSE4_PS(vq[0].V, vq[1].V, vq[2].V, vq[3].V);
+        }
+    }
+
+    // 記録ごとの残りのサンプルは1つずつ処理する.
+    _MM_TRANSPOSE4_PS(vq[0].V, vq[1].V, vq[2].V, vq[3].V);
+    auto result = 0u;
+    for(auto lane=0u; lane<kFusionWidth; ++lane)
+    {
+        _mm_storeu_ps(q[lane], vq[lane].V);
+        FuseStreamScalar(gain, pStreams[lane], begin[lane] + count, q[lane]);
+        result += GetStreamCount(pStreams[lane]);
+    }
+
+    return result;
+}
+
+#endif//PAD_SIMD_X86
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+//      記録した角速度と加速度から姿勢をまとめて推定します.
+//-----------------------------------------------------------------------------
+uint32_t PadFuseBatch(float gain, PadMotionStream* pStreams, uint32_t count)
+{
+    if (pStreams == nullptr)
+    { return 0; }
+
+    auto result = 0u;
+    auto i      = 0u;
+
+#if PAD_SIMD_X86
+    if (PadGetSimdLevel() != PAD_SIMD_NONE)
+    {
+        for(; i + kFusionWidth <= count; i += kFusionWidth)
+        { result += FuseGroupSse(gain, &pStreams[i]); }
+    }
+#endif
+
+    for(; i<count; ++i)
+    {
+        float q[4];
+        auto begin = BeginStream(pStreams[i], q);
+        FuseStreamScalar(gain, pStreams[i], begin, q);
+        result += GetStreamCount(pStreams[i]);
+    }
+
+    return result;
+}
+
+namespace {
+
+// 変化を調べるバイト数(入力データの開始位置から).
+static const uint32_t kDiffSize = 64;
+
+///////////////////////////////////////////////////////////////////////////////
+// DiffLayout structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  フィールドごとの比較対象のバイトです(ビットiが入力データのiバイト目).
+//!
+//! @note   ボタンと特殊ボタンは有効なビットだけを比較するため含みません.
+struct DiffLayout
+{
+    uint64_t    StickL;
+    uint64_t    StickR;
+    uint64_t    AnalogButtons;
+    uint64_t    TimeStamp;
+    uint64_t    Battery;
+    uint64_t    Gyro;
+    uint64_t    Accel;
+    uint64_t    Touch;
+};
+
+//-----------------------------------------------------------------------------
+//      offsetバイト目からcountバイト分のビットを立てます.
+//-----------------------------------------------------------------------------
+constexpr uint64_t ByteRange(uint32_t offset, uint32_t count)
+{ return ((uint64_t(1) << count) - 1) << offset; }
+
+//-----------------------------------------------------------------------------
+//      レポートのレイアウトから比較対象のバイトを求めます.
+//-----------------------------------------------------------------------------
+constexpr DiffLayout MakeDiffLayout(const PadReportLayout& layout)
+{
+    DiffLayout result = {};
+    result.StickL        = ByteRange(layout.StickL, 2);
+    result.StickR        = ByteRange(layout.StickR, 2);
+    result.AnalogButtons = ByteRange(layout.L2, 1) | ByteRange(layout.R2, 1);
+    result.TimeStamp     = ByteRange(layout.TimeStamp, 2);
+    result.Battery       = (layout.Battery != 0) ? ByteRange(layout.Battery, 1) : 0;
+    result.Gyro          = ByteRange(layout.Gyro,  6);
+    result.Accel         = ByteRange(layout.Accel, 6);
+    result.Touch         = ByteRange(layout.Touch, 8)
+                         | ((layout.TouchCount != 0) ? ByteRange(layout.TouchCount, 1) : 0);
+    return result;
+}
+
+static constexpr DiffLayout kDiffDualShock4 = MakeDiffLayout(kPadDualShock4Layout);
+static constexpr DiffLayout kDiffDualSense  = MakeDiffLayout(kPadDualSenseLayout);
+
+//-----------------------------------------------------------------------------
+//      64バイトを比較し, 値が異なるバイトのビットを立てて返却します.
+//-----------------------------------------------------------------------------
+#if PAD_SIMD_X86
+PAD_TARGET("sse2")
+uint64_t DiffBytes(const uint8_t* pPrevious, const uint8_t* pCurrent)
+{
+    const auto zero = _mm_setzero_si128();
+    const auto x0 = _mm_xor_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPrevious +  0)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCurrent  +  0)));
+    const auto x1 = _mm_xor_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPrevious + 16)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCurrent  + 16)));
+    const auto x2 = _mm_xor_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPrevious + 32)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCurrent  + 32)));
+    const auto x3 = _mm_xor_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPrevious + 48)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCurrent  + 48)));
+
+    // 変化が無いレポートはここで除外する.
+    const auto any = _mm_or_si128(_mm_or_si128(x0, x1), _mm_or_si128(x2, x3));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) == 0xffff)
+    { return 0; }
+
+    const auto m0 = uint64_t(~_mm_movemask_epi8(_mm_cmpeq_epi8(x0, zero)) & 0xffff);
+    const auto m1 = uint64_t(~_mm_movemask_epi8(_mm_cmpeq_epi8(x1, zero)) & 0xffff);
+    const auto m2 = uint64_t(~_mm_movemask_epi8(_mm_cmpeq_epi8(x2, zero)) & 0xffff);
+    const auto m3 = uint64_t(~_mm_movemask_epi8(_mm_cmpeq_epi8(x3, zero)) & 0xffff);
+    return m0 | (m1 << 16) | (m2 << 32) | (m3 << 48);
+}
+#else
+uint64_t DiffBytes(const uint8_t* pPrevious, const uint8_t* pCurrent)
+{
+    if (memcmp(pPrevious, pCurrent, kDiffSize) == 0)
+    { return 0; }
+
+    uint64_t result = 0;
+    for(auto i=0u; i<kDiffSize; ++i)
+    {
+        if (pPrevious[i] != pCurrent[i])
+        { result |= uint64_t(1) << i; }
+    }
+
+    return result;
+}
+#endif
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+//      2つのパッド生データを比較し, 変化したフィールドとボタンを求めます.
+//-----------------------------------------------------------------------------
+bool PadDiff(const PadRawInput* pPrevious, const PadRawInput* pCurrent, PadChanges& changes)
+{
+    if (pCurrent == nullptr || !IsMappable(pCurrent))
+    { return false; }
+
+    const auto layout  = PadGetReportLayout(pCurrent->Type);
+    const auto current = &pCurrent->Bytes[layout.Base];
+
+    changes.Buttons = GetButtonMask(current, layout);
+
+    // 比較できない場合は全て変化したとみなす.
+    if (pPrevious == nullptr || pPrevious->Type != pCurrent->Type || !IsMappable(pPrevious))
+    {
+        changes.Fields   = PAD_FIELD_ALL;
+        changes.Pressed  = changes.Buttons;
+        changes.Released = 0;
+        return true;
+    }
+
+    const auto previous = &pPrevious->Bytes[layout.Base];
+    const auto diff     = DiffBytes(previous, current);
+    if (diff == 0)
+    {
+        changes.Fields   = 0;
+        changes.Pressed  = 0;
+        changes.Released = 0;
+        return true;
+    }
+
+    const auto buttons = GetButtonMask(previous, layout);
+    changes.Pressed  = changes.Buttons & ~buttons;
+    changes.Released = buttons & ~changes.Buttons;
+
+    const auto& masks = !!(pCurrent->Type & PAD_CONNECTION_DUAL_SENSE) ? kDiffDualSense : kDiffDualShock4;
+    const auto  edges = changes.Pressed | changes.Released;
+
+    uint32_t fields = 0;
+    if (diff & masks.StickL)        { fields |= PAD_FIELD_STICK_L; }
+    if (diff & masks.StickR)        { fields |= PAD_FIELD_STICK_R; }
+    if (diff & masks.AnalogButtons) { fields |= PAD_FIELD_ANALOG_BUTTONS; }
+    if (edges & 0xffff)             { fields |= PAD_FIELD_BUTTONS; }
+    if (edges >> 16)                { fields |= PAD_FIELD_SPECIAL_BUTTONS; }
+    if (diff & masks.TimeStamp)     { fields |= PAD_FIELD_TIMESTAMP; }
+    if (diff & masks.Battery)       { fields |= PAD_FIELD_BATTERY; }
+    if (diff & masks.Gyro)          { fields |= PAD_FIELD_GYRO; }
+    if (diff & masks.Accel)         { fields |= PAD_FIELD_ACCEL; }
+    if (diff & masks.Touch)         { fields |= PAD_FIELD_TOUCH; }
+
+    changes.Fields = fields;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      パッドデータを読み取ります.
+//-----------------------------------------------------------------------------
+bool PadGetState(PadHandle* pHandle, PadState& state)
+{
+    PadRawInput pResult;
+    if (!PadRead(pHandle, pResult))
+    { return false; }
+
+    if (!pHandle->Decoder(&pResult, state))
+    { return false; }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      パッドデータを読み取り, 前回読み取ったデータからの変化を求めます.
+//-----------------------------------------------------------------------------
+bool PadGetStateChanges(PadHandle* pHandle, PadState& state, PadChanges& changes)
+{
+    PadRawInput input;
+    if (!PadRead(pHandle, input))
+    { return false; }
+
+    if (!pHandle->Decoder(&input, state))
+    { return false; }
+
+    PadDiff(&pHandle->Previous, &input, changes);
+    pHandle->Previous = input;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      バイブレーションを設定します.
+//-----------------------------------------------------------------------------
+bool PadSetVibration(PadHandle* pHandle, const PadVibrationParam& param)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    return UpdateOutput(pHandle, pHandle->Output.Vibration, param, kOutputVibration);
+}
+
+//-----------------------------------------------------------------------------
+//      ライトバーカラーを設定します.
+//-----------------------------------------------------------------------------
+bool PadSetLightBarColor(PadHandle* pHandle, const PadColor& param)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    return UpdateOutput(pHandle, pHandle->Output.LightBar, param, kOutputLightBar);
+}
+
+//-----------------------------------------------------------------------------
+//      ライトバーの点滅を設定します.
+//-----------------------------------------------------------------------------
+bool PadSetLightBarFlash(PadHandle* pHandle, const PadFlashParam& param)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    // DualSense のライトバーは点滅しない.
+    if (!!(pHandle->Type & PAD_CONNECTION_DUAL_SENSE))
+    { return false; }
+
+    return UpdateOutput(pHandle, pHandle->Output.Flash, param, kOutputFlash);
+}
+
+//-----------------------------------------------------------------------------
+//      アダプティブトリガーのエフェクトを設定します.
+//-----------------------------------------------------------------------------
+bool PadSetTriggerEffect(PadHandle* pHandle, PAD_TRIGGER trigger, const PadTriggerEffect& param)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    // アダプティブトリガーは DualSense のみ.
+    if (!(pHandle->Type & PAD_CONNECTION_DUAL_SENSE))
+    { return false; }
+
+    if (trigger != PAD_TRIGGER_LEFT && trigger != PAD_TRIGGER_RIGHT)
+    { return false; }
+
+    auto flag = (trigger == PAD_TRIGGER_LEFT) ? kOutputTriggerL : kOutputTriggerR;
+    return UpdateOutput(pHandle, pHandle->Output.Trigger[trigger], param, flag);
+}
+
+//-----------------------------------------------------------------------------
+//      出力レポートの最大送信レートを設定します.
+//-----------------------------------------------------------------------------
+bool PadSetOutputRate(PadHandle* pHandle, uint32_t maxRate)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    auto& output = pHandle->Output;
+    {
+        std::lock_guard<std::mutex> locker(output.Lock);
+        output.Interval = (maxRate == 0)
+            ? std::chrono::steady_clock::duration::zero()
+            : std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / maxRate;
+    }
+    output.Signal.notify_one();
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      未送信の出力設定を1つのレポートにまとめて送信します.
+//-----------------------------------------------------------------------------
+bool PadFlushOutput(PadHandle* pHandle)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    if (!IsOpen(pHandle))
+    { return false; }
+
+    return FlushOutput(pHandle, false);
+}
+
+//-----------------------------------------------------------------------------
+//      出力レポートを書き込みスレッドから送信するかどうか設定します.
+//-----------------------------------------------------------------------------
+bool PadEnableAsyncOutput(PadHandle* pHandle, bool enable)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    if (!IsOpen(pHandle))
+    { return false; }
+
+    auto& output = pHandle->Output;
+    if (enable == output.Writer.joinable())
+    { return true; }
+
+    if (!enable)
+    {
+        StopWriter(pHandle);
+        return true;
+    }
+
+    std::lock_guard<std::mutex> locker(output.Lock);
+    output.WriterStop = false;
+    output.Requested  = (output.Dirty != 0);
+    output.Writer     = std::thread(WriterThread, pHandle);
+    return true;
+}
+
+namespace {
+
+///////////////////////////////////////////////////////////////////////////////
+// CachedPad class
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  ハンドルを指定しない関数群が共有するパッドハンドルです.
+//!
+//! @note   初回呼び出し時に接続し, 以降はプロセス終了まで同じハンドルを使い回します.
+//!         切断を検出した場合は次の呼び出しで再接続します.
+class CachedPad
+{
+public:
+    ~CachedPad()
+    {
+        if (m_pHandle != nullptr)
+        { PadClose(m_pHandle); }
+    }
+
+    //-------------------------------------------------------------------------
+    //! @brief      キャッシュしたハンドルで処理を実行します.
+    //-------------------------------------------------------------------------
+    template<typename Func>
+    bool Invoke(Func func)
+    {
+        std::lock_guard<std::mutex> locker(m_Lock);
+
+        for(auto retry=0; retry<2; ++retry)
+        {
+            if (m_pHandle == nullptr)
+            {
+                if (!PadOpen(&m_pHandle))
+                { return false; }
+            }
+
+            if (func(m_pHandle))
+            { return true; }
+
+            if (PadIsConnected(m_pHandle))
+            { return false; }
+
+            // 切断されたため, 再接続して再試行する.
+            PadClose(m_pHandle);
+        }
+
+        return false;
+    }
+
+private:
+    std::mutex  m_Lock;
+    PadHandle*  m_pHandle = nullptr;
+};
+
+CachedPad g_CachedPad;
+
+//-----------------------------------------------------------------------------
+//      溜まっているパッド生データのうち最新のものを読み取ります.
+//-----------------------------------------------------------------------------
+bool ReadLatest(PadHandle* pHandle, PadRawInput& result)
+{
+    PadRawInput inputs[kReadBatchSize];
+    auto count = PadReadBatch(pHandle, inputs, kReadBatchSize);
+    if (count == 0)
+    { return false; }
+
+    result = inputs[count - 1];
+
+    // 呼び出し間隔が空いた場合に古いレポートを返さないよう読み捨てる.
+    // 溜まっている分だけ取り出せば良いので, 次のレポートの到着は待たない.
+    auto timeout = pHandle->Timeout;
+    pHandle->Timeout = 0;
+    while(count == kReadBatchSize)
+    {
+        count = PadReadBatch(pHandle, inputs, kReadBatchSize);
+        if (count > 0)
+        { result = inputs[count - 1]; }
+    }
+    pHandle->Timeout = timeout;
+
+    return true;
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+//      パッドデータを読み取ります.
+//-----------------------------------------------------------------------------
+bool PadGetState(PadState& state)
+{
+    PadRawInput rawData;
+    if (!PadGetRawInput(rawData))
+    { return false; }
+
+    return PadMap(&rawData, state);
+}
+
+//-----------------------------------------------------------------------------
+//      パッド生データを読み取ります.
+//-----------------------------------------------------------------------------
+bool PadGetRawInput(PadRawInput& state)
+{
+    return g_CachedPad.Invoke([&](PadHandle* pHandle)
+    { return ReadLatest(pHandle, state); });
+}
+
+//-----------------------------------------------------------------------------
+//      バイブレーションを設定します.
+//-----------------------------------------------------------------------------
+bool PadSetVibration(const PadVibrationParam& param)
+{
+    return g_CachedPad.Invoke([&](PadHandle* pHandle)
+    { return PadSetVibration(pHandle, param); });
+}
+
+//-----------------------------------------------------------------------------
+//      ライトバーカラーを設定します.
+//-----------------------------------------------------------------------------
+bool PadSetLightBarColor(const PadColor& param)
+{
+    return g_CachedPad.Invoke([&](PadHandle* pHandle)
+    { return PadSetLightBarColor(pHandle, param); });
+}
+
+//-----------------------------------------------------------------------------
+//      最新の受信データを格納します.
+//-----------------------------------------------------------------------------
+void StoreLatest(PadSlot& slot, const PadRawInput& input)
+{
+    auto sequence = slot.Sequence.load(std::memory_order_relaxed);
+    slot.Sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.Latest = input;
+
+    slot.Sequence.store(sequence + 2, std::memory_order_release);
+}
+
+//-----------------------------------------------------------------------------
+//      最新の受信データを取得します.
+//-----------------------------------------------------------------------------
+bool LoadLatest(const PadSlot& slot, PadRawInput& result)
+{
+    for(;;)
+    {
+        auto begin = slot.Sequence.load(std::memory_order_acquire);
+        if (begin == 0)
+        { return false; }
+
+        if (begin & 0x1)
+        { continue; }
+
+        result = slot.Latest;
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (slot.Sequence.load(std::memory_order_relaxed) == begin)
+        { return true; }
+    }
+}
+
+#if defined(_WIN32)
+//-----------------------------------------------------------------------------
+//      マネージャーの入出力スレッドの処理です.
+//-----------------------------------------------------------------------------
+void ManagerThread(PadManager* pManager)
+{
+    PadRawInput inputs[kReadBatchSize];
+    HANDLE      events [kPadMaxManagedCount + 1];
+    uint32_t    indices[kPadMaxManagedCount + 1];
+    uint32_t    started = 0;
+
+    for(;;)
+    {
+        // 新しく追加されたパッドの読み取りを開始.
+        auto count = pManager->Count.load(std::memory_order_acquire);
+        for(; started < count; ++started)
+        {
+            auto& slot = pManager->Slots[started];
+            if (!BeginRead(slot.pHandle, kReadBatchSize))
+            { slot.Connected.store(false, std::memory_order_relaxed); }
+        }
+
+        DWORD waitCount = 0;
+        events [waitCount] = pManager->WakeEvent;
+        indices[waitCount] = kWakeIndex;
+        waitCount++;
+
+        for(auto i=0u; i<count; ++i)
+        {
+            auto& slot = pManager->Slots[i];
+            if (!slot.Connected.load(std::memory_order_relaxed))
+            { continue; }
+
+            events [waitCount] = slot.pHandle->ReadOverlapped.hEvent;
+            indices[waitCount] = i;
+            waitCount++;
+        }
+
+        auto ret = WaitForMultipleObjects(waitCount, events, FALSE, INFINITE);
+        if (ret >= WAIT_OBJECT_0 + waitCount)
+        { break; }
+
+        auto index = indices[ret - WAIT_OBJECT_0];
+        if (index == kWakeIndex)
+        {
+            if (pManager->Stop.load(std::memory_order_acquire))
+            { break; }
+
+            continue;
+        }
+
+        auto& slot = pManager->Slots[index];
+        auto  pHandle = slot.pHandle;
+
+        DWORD readSize = 0;
+        if (GetOverlappedResult(pHandle->Handle, &pHandle->ReadOverlapped, &readSize, FALSE) == FALSE)
+        {
+            // 切断された.
+            CheckConnection(pHandle, GetLastError());
+            slot.Connected.store(false, std::memory_order_relaxed);
+            continue;
+        }
+
+        auto received = EndRead(pHandle, inputs, readSize);
+        if (received > 0)
+        { StoreLatest(slot, inputs[received - 1]); }
+
+        if (!BeginRead(pHandle, kReadBatchSize))
+        { slot.Connected.store(false, std::memory_order_relaxed); }
+    }
+
+    // 発行済みの読み取りを取り消す.
+    for(auto i=0u; i<started; ++i)
+    {
+        auto& slot = pManager->Slots[i];
+        if (!slot.Connected.load(std::memory_order_relaxed))
+        { continue; }
+
+        DWORD readSize = 0;
+        CancelIoEx(slot.pHandle->Handle, &slot.pHandle->ReadOverlapped);
+        GetOverlappedResult(slot.pHandle->Handle, &slot.pHandle->ReadOverlapped, &readSize, TRUE);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      マネージャーの入出力スレッド用リソースを生成します.
+//-----------------------------------------------------------------------------
+bool InitManager(PadManager* pManager)
+{
+    pManager->WakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    return (pManager->WakeEvent != nullptr);
+}
+
+//-----------------------------------------------------------------------------
+//      マネージャーの入出力スレッド用リソースを破棄します.
+//-----------------------------------------------------------------------------
+void TermManager(PadManager* pManager)
+{
+    if (pManager->WakeEvent != nullptr)
+    {
+        CloseHandle(pManager->WakeEvent);
+        pManager->WakeEvent = nullptr;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      マネージャーの入出力スレッドを起床させます.
+//-----------------------------------------------------------------------------
+void WakeManager(PadManager* pManager)
+{ SetEvent(pManager->WakeEvent); }
+
+//-----------------------------------------------------------------------------
+//      マネージャーの監視対象にパッドを登録します.
+//-----------------------------------------------------------------------------
+bool WatchSlot(PadManager* pManager, uint32_t index)
+{
+    // 読み取りの開始は入出力スレッド側で行う.
+    WakeManager(pManager);
+    return true;
+}
+
+#else
+//-----------------------------------------------------------------------------
+//      マネージャーの入出力スレッドの処理です.
+//-----------------------------------------------------------------------------
+void ManagerThread(PadManager* pManager)
+{
+    PadRawInput inputs[kReadBatchSize];
+    epoll_event events[kPadMaxManagedCount + 1];
+
+    for(;;)
+    {
+        auto count = epoll_wait(pManager->Epoll, events, kPadMaxManagedCount + 1, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+
+            return;
+        }
+
+        for(auto i=0; i<count; ++i)
+        {
+            auto index = events[i].data.u32;
+            if (index == kWakeIndex)
+            {
+                if (pManager->Stop.load(std::memory_order_acquire))
+                { return; }
+
+                // 読み取らないと通知が残り続け, epoll_wait() が即座に戻り続ける.
+                uint64_t value;
+                auto ret = read(pManager->WakeEvent, &value, sizeof(value));
+                (void)ret;
+                continue;
+            }
+
+            auto& slot = pManager->Slots[index];
+
+            // 溜まっているレポートを全て取り出し, 最新のものだけを保持する.
+            auto received = ReadReports(slot.pHandle, inputs, kReadBatchSize, 0);
+            if (received > 0)
+            {
+                StoreLatest(slot, inputs[received - 1]);
+                continue;
+            }
+
+            if (!!(events[i].events & (EPOLLHUP | EPOLLERR)) || !slot.pHandle->Connected.load(std::memory_order_relaxed))
+            {
+                // 切断された.
+                slot.pHandle->Connected.store(false, std::memory_order_relaxed);
+                epoll_ctl(pManager->Epoll, EPOLL_CTL_DEL, slot.pHandle->Handle, nullptr);
+                slot.Connected.store(false, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      マネージャーの入出力スレッド用リソースを生成します.
+//-----------------------------------------------------------------------------
+bool InitManager(PadManager* pManager)
+{
+    pManager->Epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (pManager->Epoll < 0)
+    { return false; }
+
+    pManager->WakeEvent = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (pManager->WakeEvent < 0)
+    { return false; }
+
+    epoll_event ev = {};
+    ev.events   = EPOLLIN;
+    ev.data.u32 = kWakeIndex;
+    return epoll_ctl(pManager->Epoll, EPOLL_CTL_ADD, pManager->WakeEvent, &ev) == 0;
+}
+
+//-----------------------------------------------------------------------------
+//      マネージャーの入出力スレッド用リソースを破棄します.
+//-----------------------------------------------------------------------------
+void TermManager(PadManager* pManager)
+{
+    if (pManager->WakeEvent >= 0)
+    {
+        close(pManager->WakeEvent);
+        pManager->WakeEvent = -1;
+    }
+
+    if (pManager->Epoll >= 0)
+    {
+        close(pManager->Epoll);
+        pManager->Epoll = -1;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      マネージャーの入出力スレッドを起床させます.
+//-----------------------------------------------------------------------------
+void WakeManager(PadManager* pManager)
+{
+    uint64_t value = 1;
+    auto ret = write(pManager->WakeEvent, &value, sizeof(value));
+    (void)ret;
+}
+
+//-----------------------------------------------------------------------------
+//      マネージャーの監視対象にパッドを登録します.
+//-----------------------------------------------------------------------------
+bool WatchSlot(PadManager* pManager, uint32_t index)
+{
+    epoll_event ev = {};
+    ev.events   = EPOLLIN;
+    ev.data.u32 = index;
+    return epoll_ctl(pManager->Epoll, EPOLL_CTL_ADD, pManager->Slots[index].pHandle->Handle, &ev) == 0;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+//      マネージャーを破棄します.
+//-----------------------------------------------------------------------------
+void DestroyManager(PadManager* pManager)
+{
+    if (pManager->Thread.joinable())
+    {
+        pManager->Stop.store(true, std::memory_order_release);
+        WakeManager(pManager);
+        pManager->Thread.join();
+    }
+
+    auto count = pManager->Count.load(std::memory_order_acquire);
+    for(auto i=0u; i<count; ++i)
+    { PadClose(pManager->Slots[i].pHandle); }
+
+    TermManager(pManager);
+    delete pManager;
+}
+
+//-----------------------------------------------------------------------------
+//      パッドマネージャーを生成し, 接続されている全てのパッドを開きます.
+//-----------------------------------------------------------------------------
+bool PadManagerOpen(PadManager** ppManager)
+{
+    if (ppManager == nullptr)
+    { return false; }
+
+    auto pManager = new(std::nothrow) PadManager();
+    if (pManager == nullptr)
+    { return false; }
+
+    if (!InitManager(pManager))
+    {
+        DestroyManager(pManager);
+        return false;
+    }
+
+    pManager->Thread = std::thread(ManagerThread, pManager);
+
+    for(auto& devicePath : EnumerateDevicePaths())
+    {
+        if (pManager->Count.load(std::memory_order_relaxed) == kPadMaxManagedCount)
+        { break; }
+
+        auto pHandle = new(std::nothrow) PadHandle();
+        if (pHandle == nullptr)
+        { break; }
+
+        if (!OpenCandidate(devicePath, *pHandle)
+         || PadManagerAdd(pManager, pHandle) < 0)
+        { PadClose(pHandle); }
+    }
+
+    *ppManager = pManager;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      パッドマネージャーを破棄します.
+//-----------------------------------------------------------------------------
+bool PadManagerClose(PadManager*& pManager)
+{
+    if (pManager == nullptr)
+    { return false; }
+
+    DestroyManager(pManager);
+    pManager = nullptr;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      パッドマネージャーにパッドを追加します.
+//-----------------------------------------------------------------------------
+int32_t PadManagerAdd(PadManager* pManager, PadHandle* pHandle)
+{
+    if (pManager == nullptr || pHandle == nullptr)
+    { return -1; }
+
+    // 差し替えた入出力のハンドルは待機に使えるOSのハンドルを持たない.
+    if (pHandle->Handle == kInvalidHandle)
+    { return -1; }
+
+    std::lock_guard<std::mutex> locker(pManager->Lock);
+
+    auto index = pManager->Count.load(std::memory_order_relaxed);
+    if (index == kPadMaxManagedCount)
+    { return -1; }
+
+    // 読み取りはマネージャーの入出力スレッドが一括して行う.
+    PadEnableReaderThread(pHandle, false);
+
+    auto& slot = pManager->Slots[index];
+    slot.pHandle = pHandle;
+    slot.Sequence.store(0, std::memory_order_relaxed);
+    slot.Connected.store(true, std::memory_order_relaxed);
+
+    pManager->Count.store(index + 1, std::memory_order_release);
+
+    if (!WatchSlot(pManager, index))
+    { slot.Connected.store(false, std::memory_order_relaxed); }
+
+    return int32_t(index);
+}
+
+//-----------------------------------------------------------------------------
+//      管理しているパッド数を取得します.
+//-----------------------------------------------------------------------------
+uint32_t PadManagerGetCount(PadManager* pManager)
+{
+    if (pManager == nullptr)
+    { return 0; }
+
+    return pManager->Count.load(std::memory_order_acquire);
+}
+
+//-----------------------------------------------------------------------------
+//      スロット番号に対応するパッドハンドルを取得します.
+//-----------------------------------------------------------------------------
+PadHandle* PadManagerGetHandle(PadManager* pManager, uint32_t slot)
+{
+    if (slot >= PadManagerGetCount(pManager))
+    { return nullptr; }
+
+    return pManager->Slots[slot].pHandle;
+}
+
+//-----------------------------------------------------------------------------
+//      スロット番号に対応するパッドの接続状態を取得します.
+//-----------------------------------------------------------------------------
+bool PadManagerIsConnected(PadManager* pManager, uint32_t slot)
+{
+    if (slot >= PadManagerGetCount(pManager))
+    { return false; }
+
+    return pManager->Slots[slot].Connected.load(std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+//      スロット番号に対応するパッドの最新の生データを取得します.
+//-----------------------------------------------------------------------------
+bool PadManagerGetRawInput(PadManager* pManager, uint32_t slot, PadRawInput& result)
+{
+    if (slot >= PadManagerGetCount(pManager))
+    { return false; }
+
+    if (!LoadLatest(pManager->Slots[slot], result))
+    { return false; }
+
+    RecordLatency(pManager->Slots[slot].pHandle, &result, 1);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      スロット番号に対応するパッドの最新のパッドデータを取得します.
+//-----------------------------------------------------------------------------
+bool PadManagerGetState(PadManager* pManager, uint32_t slot, PadState& state)
+{
+    PadRawInput rawData;
+    if (!PadManagerGetRawInput(pManager, slot, rawData))
+    { return false; }
+
+    return pManager->Slots[slot].pHandle->Decoder(&rawData, state);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Event Queue
+///////////////////////////////////////////////////////////////////////////////
+
+//-----------------------------------------------------------------------------
+//      ホストの現在時刻を取得します.
+//-----------------------------------------------------------------------------
+uint64_t PadGetHostTime()
+{ return GetHostTime(); }
+
+//-----------------------------------------------------------------------------
+//      入力イベントキューを生成します.
+//-----------------------------------------------------------------------------
+bool PadEventQueueOpen(uint32_t capacity, PadEventQueue** ppQueue)
+{
+    if (ppQueue == nullptr || capacity == 0 || capacity > kMaxEventQueueSize)
+    { return false; }
+
+    auto size = 1u;
+    while(size < capacity)
+    { size <<= 1; }
+
+    auto pQueue = new(std::nothrow) PadEventQueue();
+    if (pQueue == nullptr)
+    { return false; }
+
+    pQueue->Cells.reset(new(std::nothrow) PadEventCell[size]);
+    if (!pQueue->Cells)
+    {
+        delete pQueue;
+        return false;
+    }
+
+    for(auto i=0u; i<size; ++i)
+    { pQueue->Cells[i].Sequence.store(i, std::memory_order_relaxed); }
+
+    pQueue->Mask = size - 1;
+    *ppQueue = pQueue;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      入力イベントキューを破棄します.
+//-----------------------------------------------------------------------------
+bool PadEventQueueClose(PadEventQueue*& pQueue)
+{
+    if (pQueue == nullptr)
+    { return false; }
+
+    delete pQueue;
+    pQueue = nullptr;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      パッドハンドルに入力イベントキューを接続します.
+//-----------------------------------------------------------------------------
+bool PadAttachEventQueue(PadHandle* pHandle, PadEventQueue* pQueue, uint32_t source)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    pHandle->EventSource.store(source, std::memory_order_relaxed);
+    pHandle->EventQueue .store(pQueue, std::memory_order_release);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      入力イベントをまとめて取り出します.
+//-----------------------------------------------------------------------------
+uint32_t PadEventQueuePop(PadEventQueue* pQueue, PadEvent* pEvents, uint32_t count)
+{
+    if (pQueue == nullptr || pEvents == nullptr)
+    { return 0; }
+
+    auto tail   = pQueue->Tail;
+    auto result = 0u;
+    while(result < count)
+    {
+        // 確保済みでも書き込みが完了していないセルで止まる.
+        auto& cell = pQueue->Cells[tail & pQueue->Mask];
+        if (cell.Sequence.load(std::memory_order_acquire) != tail + 1)
+        { break; }
+
+        pEvents[result++] = cell.Event;
+        cell.Sequence.store(tail + pQueue->Mask + 1, std::memory_order_release);
+        tail++;
+    }
+
+    pQueue->Tail = tail;
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      キューが満杯のため破棄したイベント数を取得します.
+//-----------------------------------------------------------------------------
+uint64_t PadEventQueueGetDropCount(PadEventQueue* pQueue)
+{
+    if (pQueue == nullptr)
+    { return 0; }
+
+    return pQueue->Dropped.load(std::memory_order_relaxed);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Stick Shaping
+///////////////////////////////////////////////////////////////////////////////
+namespace {
+
+//-----------------------------------------------------------------------------
+//      中心からの距離 (x, y) のスティック入力の整形結果の大きさを求めます.
+//-----------------------------------------------------------------------------
+uint32_t MakeStickEntry(const PadStickProfile& profile, double x, double y)
+{
+    auto r = std::sqrt(x * x + y * y);
+    if (r <= profile.InnerDeadzone)
+    { return 0; }
+
+    auto t = (r - profile.InnerDeadzone) / (profile.OuterDeadzone - profile.InnerDeadzone);
+    t = std::pow(std::min(t, 1.0), double(profile.Exponent));
+
+    auto scale = (profile.AntiDeadzone + (1.0 - profile.AntiDeadzone) * t) * kStickOutputMax / r;
+    auto ox = uint32_t(std::lround(std::min(x * scale, kStickOutputMax)));
+    auto oy = uint32_t(std::lround(std::min(y * scale, kStickOutputMax)));
+    return ox | (oy << 16);
+}
+
+//-----------------------------------------------------------------------------
+//      スティック入力1つ分を整形します.
+//-----------------------------------------------------------------------------
+inline void ShapeStick(const uint32_t* pEntries, uint32_t x, uint32_t y, int16_t& resultX, int16_t& resultY)
+{
+    // 中心より小さい値は全ビットが1, それ以外は0.
+    const auto sx = int32_t(x >> 7) - 1;
+    const auto sy = int32_t(y >> 7) - 1;
+
+    // 中心より小さい値は 127 - x, それ以外は x - 128 が中心からの距離.
+    const auto ix = (x ^ uint32_t(sx)) & 0x7f;
+    const auto iy = (y ^ uint32_t(sy)) & 0x7f;
+
+    const auto entry = pEntries[iy * kStickTableSize + ix];
+    resultX = int16_t((int32_t(entry & 0xffff) ^ sx) - sx);
+    resultY = int16_t((int32_t(entry >> 16)    ^ sy) - sy);
+}
+
+#if PAD_SIMD_X86
+
+//-----------------------------------------------------------------------------
+//      8個のスティック入力をAVX2命令で整形します.
+//-----------------------------------------------------------------------------
+PAD_TARGET("avx2")
+inline void ShapeBlockAvx2(const uint32_t* pEntries, const uint8_t* pX, const uint8_t* pY, int16_t* pResultX, int16_t* pResultY)
+{
+    const auto k80 = _mm256_set1_epi32(0x80);
+    const auto k7f = _mm256_set1_epi32(0x7f);
+
+    const auto x  = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pX)));
+    const auto y  = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pY)));
+    const auto sx = _mm256_cmpgt_epi32(k80, x);
+    const auto sy = _mm256_cmpgt_epi32(k80, y);
+    const auto ix = _mm256_and_si256(_mm256_xor_si256(x, sx), k7f);
+    const auto iy = _mm256_and_si256(_mm256_xor_si256(y, sy), k7f);
+
+    auto index = _mm256_or_si256(_mm256_slli_epi32(iy, 7), ix);
+    auto entry = _mm256_i32gather_epi32(reinterpret_cast<const int*>(pEntries), index, 4);
+
+    // 下位16bitにXの符号, 上位16bitにYの符号を適用する.
+    const auto sign = _mm256_blend_epi16(sx, sy, 0xaa);
+    entry = _mm256_sub_epi16(_mm256_xor_si256(entry, sign), sign);
+
+    // [X0-3, Y0-3 | X4-7, Y4-7] を [X0-7 | Y0-7] に並べ替える.
+    auto xs = _mm256_srai_epi32(_mm256_slli_epi32(entry, 16), 16);
+    auto ys = _mm256_srai_epi32(entry, 16);
+    auto packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(xs, ys), _MM_SHUFFLE(3, 1, 2, 0));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pResultX), _mm256_castsi256_si128(packed));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pResultY), _mm256_extracti128_si256(packed, 1));
+}
+
+//-----------------------------------------------------------------------------
+//      スティック入力を8個ずつAVX2命令で整形し, 処理した数を返却します.
+//-----------------------------------------------------------------------------
+PAD_TARGET("avx2")
+uint32_t ShapeSticksAvx2(const uint32_t* pEntries, const uint8_t* pX, const uint8_t* pY, uint32_t count, int16_t* pResultX, int16_t* pResultY)
+{
+    auto i = 0u;
+    for(; i + 8 <= count; i += 8)
+    { ShapeBlockAvx2(pEntries, &pX[i], &pY[i], &pResultX[i], &pResultY[i]); }
+
+    _mm256_zeroupper();
+    return i;
+}
+
+#endif//PAD_SIMD_X86
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+//      スティックの整形テーブルを生成します.
+//-----------------------------------------------------------------------------
+bool PadStickTableOpen(const PadStickProfile& profile, PadStickTable** ppTable)
+{
+    if (ppTable == nullptr)
+    { return false; }
+
+    // NaNも弾くように否定形で判定する.
+    if (!(profile.InnerDeadzone >= 0.0f)
+     || !(profile.OuterDeadzone >  profile.InnerDeadzone)
+     || !(profile.OuterDeadzone <= 1.5f)
+     || !(profile.AntiDeadzone  >= 0.0f && profile.AntiDeadzone < 1.0f)
+     || !(profile.Exponent      >  0.0f))
+    { return false; }
+
+    auto pTable = new(std::nothrow) PadStickTable();
+    if (pTable == nullptr)
+    { return false; }
+
+    pTable->Profile = profile;
+    for(auto iy=0u; iy<kStickTableSize; ++iy)
+    {
+        for(auto ix=0u; ix<kStickTableSize; ++ix)
+        {
+            // 中心から要素の位置(0.5, 1.5, ... 127.5)までの距離を, 端を1.0として求める.
+            auto x = (ix + 0.5) / kStickCenter;
+            auto y = (iy + 0.5) / kStickCenter;
+            pTable->Entries[iy * kStickTableSize + ix] = MakeStickEntry(profile, x, y);
+        }
+    }
+
+    *ppTable = pTable;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      スティックの整形テーブルを破棄します.
+//-----------------------------------------------------------------------------
+bool PadStickTableClose(PadStickTable*& pTable)
+{
+    if (pTable == nullptr)
+    { return false; }
+
+    delete pTable;
+    pTable = nullptr;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      スティックの入力を整形します.
+//-----------------------------------------------------------------------------
+bool PadShapeStick(const PadStickTable* pTable, const PadAnalogStick& stick, PadStickVector& result)
+{
+    if (pTable == nullptr)
+    { return false; }
+
+    ShapeStick(pTable->Entries, stick.X, stick.Y, result.X, result.Y);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      複数のスティックの入力をまとめて整形します.
+//-----------------------------------------------------------------------------
+uint32_t PadShapeSticks(const PadStickTable* pTable, const uint8_t* pX, const uint8_t* pY, uint32_t count, int16_t* pResultX, int16_t* pResultY)
+{
+    if (pTable == nullptr || pX == nullptr || pY == nullptr || pResultX == nullptr || pResultY == nullptr)
+    { return 0; }
+
+    auto i = 0u;
+
+#if PAD_SIMD_X86
+    if (PadGetSimdLevel() == PAD_SIMD_AVX2)
+    { i = ShapeSticksAvx2(pTable->Entries, pX, pY, count, pResultX, pResultY); }
+#endif
+
+    for(; i<count; ++i)
+    { ShapeStick(pTable->Entries, pX[i], pY[i], pResultX[i], pResultY[i]); }
+
+    return count;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Gesture
+///////////////////////////////////////////////////////////////////////////////
+namespace {
+
+// ジェスチャー認識の既定の閾値.
+static constexpr PadGestureParam kDefaultGestureParam = { 250000, 40.0f, 300.0f, 1500.0f, 80.0f, 60.0f };
+
+// ジェスチャー認識の段階.
+enum GESTURE_PHASE
+{
+    GESTURE_PHASE_IDLE      = 0,    // 触れていない.
+    GESTURE_PHASE_PENDING   = 1,    // 触れた位置から動いていない(タップ候補).
+    GESTURE_PHASE_MOVED     = 2,    // 動いた(スワイプ候補).
+    GESTURE_PHASE_PINCH     = 3,    // ピンチ中.
+    GESTURE_PHASE_SCROLL    = 4,    // スクロール中.
+};
+
+//-----------------------------------------------------------------------------
+//      ジェスチャーを追加します. 格納先が足りない場合は捨てます.
+//-----------------------------------------------------------------------------
+inline void AddGesture
+(
+    const PadGesture&   gesture,
+    PadGesture*         pGestures,
+    uint32_t            count,
+    uint32_t&           index
+)
+{
+    if (index < count)
+    { pGestures[index++] = gesture; }
+}
+
+//-----------------------------------------------------------------------------
+//      ジェスチャーを初期化します.
+//-----------------------------------------------------------------------------
+inline PadGesture MakeGesture(uint64_t time, uint8_t type, uint8_t fingers, float x, float y)
+{
+    PadGesture result = {};
+    result.DeviceTime = time;
+    result.Type       = type;
+    result.Fingers    = fingers;
+    result.X          = x;
+    result.Y          = y;
+    result.Scale      = 1.0f;
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//      全ての指が離れた時にタップかスワイプかを判定します.
+//-----------------------------------------------------------------------------
+bool FinishGesture(const PadGestureState& state, uint64_t time, PadGesture& result)
+{
+    const auto& param = state.Param;
+
+    if (state.Phase == GESTURE_PHASE_PENDING)
+    {
+        if (time - state.StartTime > param.TapTime)
+        { return false; }
+
+        result = MakeGesture(time, PAD_GESTURE_TAP, state.MaxFingers, state.OriginX, state.OriginY);
+        return true;
+    }
+
+    if (state.Phase == GESTURE_PHASE_MOVED && state.MaxFingers == 1)
+    {
+        const auto& finger = state.Fingers[state.LastFinger];
+        auto dx = finger.X - finger.StartX;
+        auto dy = finger.Y - finger.StartY;
+        auto vx = finger.VelocityX;
+        auto vy = finger.VelocityY;
+        if (dx * dx + dy * dy < param.SwipeDistance * param.SwipeDistance
+         || vx * vx + vy * vy < param.SwipeVelocity * param.SwipeVelocity)
+        { return false; }
+
+        result = MakeGesture(time, PAD_GESTURE_SWIPE, 1, finger.X, finger.Y);
+        result.DeltaX    = dx;
+        result.DeltaY    = dy;
+        result.VelocityX = vx;
+        result.VelocityY = vy;
+        return true;
+    }
+
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+//      2本の指によるピンチ・スクロールを判定します.
+//-----------------------------------------------------------------------------
+bool UpdateTwoFingers(PadGestureState& state, uint64_t time, PadGesture& result)
+{
+    const auto& param = state.Param;
+    const auto& f0 = state.Fingers[0];
+    const auto& f1 = state.Fingers[1];
+
+    auto dx = f1.X - f0.X;
+    auto dy = f1.Y - f0.Y;
+    auto distance = std::sqrt(dx * dx + dy * dy);
+    auto cx = (f0.X + f1.X) * 0.5f;
+    auto cy = (f0.Y + f1.Y) * 0.5f;
+
+    // 2本目の指が触れた時点を基準にする.
+    if (!state.TwoFingers)
+    {
+        state.TwoFingers    = 1;
+        state.StartDistance = state.LastDistance = distance;
+        state.StartCenterX  = state.LastCenterX  = cx;
+        state.StartCenterY  = state.LastCenterY  = cy;
+        state.EventTime     = time;
+        return false;
+    }
+
+    if (state.Phase == GESTURE_PHASE_PENDING || state.Phase == GESTURE_PHASE_MOVED)
+    {
+        auto mx = cx - state.StartCenterX;
+        auto my = cy - state.StartCenterY;
+        if (std::abs(distance - state.StartDistance) > param.PinchDistance)
+        { state.Phase = GESTURE_PHASE_PINCH; }
+        else if (mx * mx + my * my > param.ScrollDistance * param.ScrollDistance)
+        { state.Phase = GESTURE_PHASE_SCROLL; }
+        else
+        { return false; }
+    }
+
+    // 前回の通知からの変化量と速度を求める.
+    auto elapsed = float(time - state.EventTime) * 1e-6f;
+    auto invTime = (elapsed > 0.0f) ? 1.0f / elapsed : 0.0f;
+
+    if (state.Phase == GESTURE_PHASE_PINCH)
+    {
+        if (distance == state.LastDistance)
+        { return false; }
+
+        result = MakeGesture(time, PAD_GESTURE_PINCH, 2, cx, cy);
+        result.Scale          = (state.LastDistance > 0.0f) ? distance / state.LastDistance : 1.0f;
+        result.SpreadVelocity = (distance - state.LastDistance) * invTime;
+    }
+    else if (state.Phase == GESTURE_PHASE_SCROLL)
+    {
+        if (cx == state.LastCenterX && cy == state.LastCenterY)
+        { return false; }
+
+        result = MakeGesture(time, PAD_GESTURE_SCROLL, 2, cx, cy);
+        result.DeltaX    = cx - state.LastCenterX;
+        result.DeltaY    = cy - state.LastCenterY;
+        result.VelocityX = result.DeltaX * invTime;
+        result.VelocityY = result.DeltaY * invTime;
+    }
+    else
+    { return false; }
+
+    state.LastDistance = distance;
+    state.LastCenterX  = cx;
+    state.LastCenterY  = cy;
+    state.EventTime    = time;
+    return true;
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+//      ジェスチャー認識の状態を初期化します.
+//-----------------------------------------------------------------------------
+bool PadGestureInit(PadGestureState& state, const PadGestureParam* pParam)
+{
+    const auto& param = (pParam != nullptr) ? *pParam : kDefaultGestureParam;
+    if (!(param.TapSlop        >= 0.0f)
+     || !(param.SwipeDistance  >= 0.0f)
+     || !(param.SwipeVelocity  >= 0.0f)
+     || !(param.PinchDistance  >= 0.0f)
+     || !(param.ScrollDistance >= 0.0f))
+    { return false; }
+
+    state = PadGestureState();
+    state.Param = param;
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      パッド生データのタッチ情報からジェスチャーを認識します.
+//-----------------------------------------------------------------------------
+uint32_t PadGestureUpdate
+(
+    PadGestureState&    state,
+    const PadRawInput*  pRawData,
+    PadGesture*         pGestures,
+    uint32_t            count
+)
+{
+    if (pRawData == nullptr || !IsMappable(pRawData))
+    { return 0; }
+
+    if (pGestures == nullptr)
+    { count = 0; }
+
+    const auto  layout = PadGetReportLayout(pRawData->Type);
+    const auto* input  = &pRawData->Bytes[layout.Base + layout.Touch];
+    const auto  time   = pRawData->DeviceTime;
+    const auto  slop   = state.Param.TapSlop * state.Param.TapSlop;
+
+    uint32_t   result = 0;
+    PadGesture gesture;
+
+    // 離れた指(識別番号が変わった場合は, 離れてから触れたとみなす).
+    bool down[kPadMaxTouchCount];
+    auto active = 0u;
+    for(auto i=0u; i<kPadMaxTouchCount; ++i)
+    {
+        auto& finger = state.Fingers[i];
+        const auto* touch = &input[i * 4];
+
+        down[i] = (touch[0] & 0x80) == 0;
+        if (finger.Active && (!down[i] || finger.Id != (touch[0] & 0x7f)))
+        {
+            finger.Active    = 0;
+            state.LastFinger = uint8_t(i);
+        }
+        active += finger.Active;
+    }
+
+    // 全ての指が離れたらタップ・スワイプを判定する.
+    if (active == 0 && state.Phase != GESTURE_PHASE_IDLE)
+    {
+        if (FinishGesture(state, time, gesture))
+        { AddGesture(gesture, pGestures, count, result); }
+
+        state.Phase      = GESTURE_PHASE_IDLE;
+        state.TwoFingers = 0;
+    }
+
+    // 触れた指と動いた指.
+    active = 0;
+    for(auto i=0u; i<kPadMaxTouchCount; ++i)
+    {
+        if (!down[i])
+        { continue; }
+
+        auto& finger = state.Fingers[i];
+        const auto* touch = &input[i * 4];
+
+        auto x = float((uint32_t(touch[2] & 0xf) << 8) | touch[1]);
+        auto y = float((uint32_t(touch[3]) << 4) | (touch[2] >> 4));
+        active++;
+
+        if (!finger.Active)
+        {
+            if (state.Phase == GESTURE_PHASE_IDLE)
+            {
+                state.Phase      = GESTURE_PHASE_PENDING;
+                state.StartTime  = time;
+                state.OriginX    = x;
+                state.OriginY    = y;
+                state.MaxFingers = 0;
+            }
+
+            finger.Active    = 1;
+            finger.Id        = touch[0] & 0x7f;
+            finger.StartX    = finger.RefX = x;
+            finger.StartY    = finger.RefY = y;
+            finger.VelocityX = 0.0f;
+            finger.VelocityY = 0.0f;
+            finger.RefTime   = time;
+        }
+        else if (time - finger.RefTime >= kGestureVelocityTime)
+        {
+            auto invTime = 1e6f / float(time - finger.RefTime);
+            finger.VelocityX = (x - finger.RefX) * invTime;
+            finger.VelocityY = (y - finger.RefY) * invTime;
+            finger.RefX      = x;
+            finger.RefY      = y;
+            finger.RefTime   = time;
+        }
+
+        finger.X = x;
+        finger.Y = y;
+
+        if (state.Phase == GESTURE_PHASE_PENDING)
+        {
+            auto dx = x - finger.StartX;
+            auto dy = y - finger.StartY;
+            if (dx * dx + dy * dy > slop)
+            { state.Phase = GESTURE_PHASE_MOVED; }
+        }
+    }
+
+    if (active > state.MaxFingers)
+    { state.MaxFingers = uint8_t(active); }
+
+    // 2本の指によるピンチ・スクロール.
+    if (active == 2)
+    {
+        if (UpdateTwoFingers(state, time, gesture))
+        { AddGesture(gesture, pGestures, count, result); }
+    }
+    else
+    { state.TwoFingers = 0; }
+
+    return result;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Capture
+///////////////////////////////////////////////////////////////////////////////
+namespace {
+
+static_assert(sizeof(PadCaptureHeader) % 8 == 0, "PadCaptureHeader must be 8-byte aligned.");
+static_assert(sizeof(PadCaptureIndex)  % 8 == 0, "PadCaptureIndex must be 8-byte aligned.");
+
+//-----------------------------------------------------------------------------
+//      キャプチャファイルを作成します.
+//-----------------------------------------------------------------------------
+FILE* CreateCaptureFile(const char* path)
+{
+    FILE* pFile = nullptr;
+#if defined(_WIN32)
+    if (fopen_s(&pFile, path, "wb") != 0)
+    { return nullptr; }
+#else
+    pFile = fopen(path, "wb");
+    if (pFile == nullptr)
+    { return nullptr; }
+#endif
+
+    // チャンク単位でまとめて書き込むので, 標準ライブラリのバッファは使わない.
+    setvbuf(pFile, nullptr, _IONBF, 0);
+    return pFile;
+}
+
+//-----------------------------------------------------------------------------
+//      チャンクをファイルに書き込みます.
+//-----------------------------------------------------------------------------
+void WriteCaptureChunk(CaptureWriter& writer, const uint8_t* pBytes, uint32_t count)
+{
+    auto  size     = size_t(count) * writer.RecordStride + sizeof(PadCaptureIndex);
+    auto& counters = *writer.pCounters;
+
+    counters.WriteCalls++;
+    if (fwrite(pBytes, 1, size, writer.pFile) == size)
+    {
+        counters.Records += count;
+        counters.Chunks++;
+    }
+    else
+    {
+        counters.WriteErrors++;
+        counters.Dropped += count;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//      キャプチャの書き込みスレッドです.
+//-----------------------------------------------------------------------------
+void CaptureThread(CaptureWriter* pWriter)
+{
+    auto& writer = *pWriter;
+    std::unique_lock<std::mutex> locker(writer.Lock);
+
+    for(;;)
+    {
+        writer.Signal.wait(locker, [&]() { return writer.WriterStop || !writer.Pending.empty(); });
+
+        // 停止要求があっても書き込み待ちのチャンクは全て書き込む.
+        if (writer.Pending.empty())
+        { break; }
+
+        auto chunk = writer.Pending.front();
+        writer.Pending.erase(writer.Pending.begin());
+
+        // 書き込み中も受信スレッドがチャンクを渡せるようにロックを外す.
+        locker.unlock();
+        WriteCaptureChunk(writer, chunk.pBytes, chunk.Count);
+        locker.lock();
+
+        writer.Free.push_back(chunk.pBytes);
+    }
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+//      受信したレポートのファイルへの記録を開始します.
+//-----------------------------------------------------------------------------
+bool PadStartCapture(PadHandle* pHandle, const char* path)
+{
+    if (pHandle == nullptr || path == nullptr || pHandle->Capturing.load(std::memory_order_relaxed))
+    { return false; }
+
+    std::unique_ptr<CaptureWriter> pWriter(new(std::nothrow) CaptureWriter());
+    if (!pWriter)
+    { return false; }
+
+    auto& writer = *pWriter;
+    writer.ReportSize   = IsBluetooth(pHandle->Type) ? kBluetoothReportSize : kUsbInputReportSize;
+    writer.RecordStride = (uint32_t(sizeof(uint64_t)) + writer.ReportSize + 7) & ~7u;
+    writer.ChunkBytes   = writer.RecordStride * kPadCaptureChunkSize + uint32_t(sizeof(PadCaptureIndex));
+    writer.pCounters    = &pHandle->CaptureStats;
+
+    // レコードの詰め物が0のままになるように, ゼロ初期化しておく.
+    writer.Memory.reset(new(std::nothrow) uint8_t[size_t(writer.ChunkBytes) * kCaptureBufferCount]());
+    if (!writer.Memory)
+    { return false; }
+
+    writer.Pending.reserve(kCaptureBufferCount);
+    writer.Free   .reserve(kCaptureBufferCount);
+    for(auto i=1u; i<kCaptureBufferCount; ++i)
+    { writer.Free.push_back(writer.Memory.get() + size_t(writer.ChunkBytes) * i); }
+    writer.pActive = writer.Memory.get();
+
+    PadCaptureHeader header = {};
+    header.Magic        = kPadCaptureMagic;
+    header.Version      = kPadCaptureVersion;
+    header.HeaderSize   = uint16_t(sizeof(header));
+    header.Type         = pHandle->Type;
+    header.ReportSize   = uint16_t(writer.ReportSize);
+    header.RecordStride = uint16_t(writer.RecordStride);
+    header.ChunkSize    = kPadCaptureChunkSize;
+    header.Calibrated   = pHandle->Calibrated ? 1 : 0;
+    header.StartTime    = GetHostTime();
+    header.Calibration  = pHandle->Calibration;
+    memcpy(header.MacAddress, pHandle->MacAddress.c_str(),
+        std::min(pHandle->MacAddress.size(), sizeof(header.MacAddress) - 1));
+
+    writer.pFile = CreateCaptureFile(path);
+    if (writer.pFile == nullptr)
+    { return false; }
+
+    if (fwrite(&header, sizeof(header), 1, writer.pFile) != 1)
+    {
+        fclose(writer.pFile);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> locker(pHandle->CaptureLock);
+    if (pHandle->Capture)
+    {
+        fclose(writer.pFile);
+        return false;
+    }
+
+    auto& counters = pHandle->CaptureStats;
+    counters.Records    .store(0, std::memory_order_relaxed);
+    counters.Dropped    .store(0, std::memory_order_relaxed);
+    counters.Chunks     .store(0, std::memory_order_relaxed);
+    counters.WriteCalls .store(1, std::memory_order_relaxed);   // ヘッダ分.
+    counters.WriteErrors.store(0, std::memory_order_relaxed);
+
+    writer.Writer = std::thread(CaptureThread, pWriter.get());
+    pHandle->Capture = std::move(pWriter);
+    pHandle->Capturing.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//      ファイルへの記録を終了します.
+//-----------------------------------------------------------------------------
+bool PadStopCapture(PadHandle* pHandle)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    // 受信スレッドから切り離す. 以降は追記されない.
+    std::unique_ptr<CaptureWriter> pWriter;
+    {
+        std::lock_guard<std::mutex> locker(pHandle->CaptureLock);
+        pHandle->Capturing.store(false, std::memory_order_relaxed);
+        pWriter = std::move(pHandle->Capture);
+    }
+
+    if (!pWriter)
+    { return false; }
+
+    auto& writer = *pWriter;
+    {
+        std::lock_guard<std::mutex> locker(writer.Lock);
+        writer.WriterStop = true;
+    }
+    writer.Signal.notify_one();
+    writer.Writer.join();
+
+    // 最後のチャンクだけは満杯でなくても書き込む.
+    if (writer.Count > 0)
+    {
+        CloseCaptureChunk(writer);
+        WriteCaptureChunk(writer, writer.pActive, writer.Count);
+    }
+
+    auto ret = (fclose(writer.pFile) == 0);
+    return ret && writer.pCounters->WriteErrors.load(std::memory_order_relaxed) == 0;
+}
+
+//-----------------------------------------------------------------------------
+//      ファイルへの記録の統計を取得します.
+//-----------------------------------------------------------------------------
+bool PadGetCaptureStats(PadHandle* pHandle, PadCaptureStats& stats)
+{
+    if (pHandle == nullptr)
+    { return false; }
+
+    const auto& counters = pHandle->CaptureStats;
+    stats.Records     = counters.Records    .load(std::memory_order_relaxed);
+    stats.Dropped     = counters.Dropped    .load(std::memory_order_relaxed);
+    stats.Chunks      = counters.Chunks     .load(std::memory_order_relaxed);
+    stats.WriteCalls  = counters.WriteCalls .load(std::memory_order_relaxed);
+    stats.WriteErrors = counters.WriteErrors.load(std::memory_order_relaxed);
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Delta Codec
+///////////////////////////////////////////////////////////////////////////////
+namespace {
+
+//-----------------------------------------------------------------------------
+//      符号無し整数を可変長(7bit単位, 最大10バイト)で書き込みます.
+//-----------------------------------------------------------------------------
+inline uint8_t* WriteVarint(uint8_t* p, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        *p++ = uint8_t(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = uint8_t(value);
+    return p;
+}
+
+//-----------------------------------------------------------------------------
+//      可変長の符号無し整数を読み取ります. 10バイトを超える場合はnullptrを返却します.
+//-----------------------------------------------------------------------------
+inline const uint8_t* ReadVarint(const uint8_t* p, uint64_t& value)
+{
+    uint64_t result = 0;
+    for(auto shift=0u; shift<64; shift+=7)
+    {
+        auto byte = *p++;
+        result |= uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            value = result;
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+//-----------------------------------------------------------------------------
+//      0でないバイトのビットマスク(bit i がバイト i)を求めます.
+//-----------------------------------------------------------------------------
+inline uint32_t GetNonZeroBytes(uint64_t value)
+{
+    value |= value >> 4;
+    value |= value >> 2;
+    value |= value >> 1;
+    value &= 0x0101010101010101ull;
+
+    // 各バイトの最下位ビットを最上位バイトに集める.
+    return uint32_t((value * 0x0102040810204080ull) >> 56);
+}
+
+//-----------------------------------------------------------------------------
+//      レポートの8バイト単位のグループを読み取ります(末尾の足りない分は0).
+//-----------------------------------------------------------------------------
+inline uint64_t LoadDeltaGroup(const uint8_t* pBytes, uint32_t group, uint32_t size)
+{
+    uint64_t result = 0;
+    auto offset = group * 8;
+    memcpy(&result, pBytes + offset, std::min(size - offset, 8u));
+    return result;
+}
 
-        if (attributes.ProductID == kDualShockWirelessAdaptor)
-        {
-            deviceDetected = true;
-            type = PAD_CONNECTION_WIRELESS;
+//-----------------------------------------------------------------------------
+//      差分符号化したレポートを1つ復号し, 使用したバイト数を返却します(不正なデータの場合は0).
+//      pInput からは kPadDeltaMaxRecordSize + kDeltaReadMargin バイトまで読み取ります.
+//-----------------------------------------------------------------------------
+size_t DecodeDeltaRecord(PadDeltaDecoder& decoder, const uint8_t* pInput, PadRawInput& result, bool& emitted)
+{
+    auto p = pInput;
 
-            PHIDP_PREPARSED_DATA preparsedData;
-            HidD_GetPreparsedData(handle, &preparsedData);
+    uint64_t header;
+    p = ReadVarint(p, header);
+    if (p == nullptr)
+    { return 0; }
 
-            HIDP_CAPS capabilities;
-            HidP_GetCaps(preparsedData, &capabilities);
+    if (header & 1)
+    {
+        // キーフレーム : 受信時刻, 接続タイプ, サイズ, レポート全体.
+        uint64_t type;
+        p = ReadVarint(p, type);
+        if (p == nullptr || type > UINT32_MAX)
+        { return 0; }
+
+        auto size = uint32_t(*p++);
+        if (size == 0 || size > kPadMaxReportSize)
+        { return 0; }
+
+        memset(decoder.Previous, 0, sizeof(decoder.Previous));
+        memcpy(decoder.Previous, p, size);
+        p += size;
+
+        decoder.PreviousTime = header >> 1;
+        decoder.PreviousType = uint32_t(type);
+        decoder.ReportSize   = size;
+    }
+    else
+    {
+        // 差分 : 受信時刻の差, 変化したグループ, グループごとに変化したバイトのマスクとXOR.
+        uint64_t groups;
+        p = ReadVarint(p, groups);
+        if (p == nullptr || (groups >> kPadDeltaGroupCount) != 0)
+        { return 0; }
 
-            macAddress = GetMacAddress(detailData->DevicePath);
-            size = capabilities.FeatureReportByteLength;
+        if (decoder.ReportSize != 0 && (groups >> ((decoder.ReportSize + 7) / 8)) != 0)
+        { return 0; }
 
-            HidD_FreePreparsedData(preparsedData);
-        }
-        else if (attributes.ProductID == kDualShock4_CUH_ZCT1x)
+        for(auto g=0u; groups != 0; ++g, groups >>= 1)
         {
-            deviceDetected = true;
-
-            PHIDP_PREPARSED_DATA preparsedData;
-            HidD_GetPreparsedData(handle, &preparsedData);
+            if ((groups & 1) == 0)
+            { continue; }
 
-            HIDP_CAPS capabilities;
-            HidP_GetCaps(preparsedData, &capabilities);
+            auto mask = uint32_t(*p++);
+            if (mask == 0)
+            { return 0; }
 
-            if (capabilities.InputReportByteLength == 64)
+            uint64_t value = 0;
+            if (mask == 0xff)
             {
-                type = PAD_CONNECTION_USB;
-
-                char buf[16];
-                buf[0] = 18;
-                if (HidD_GetFeature(handle, buf, 16) == TRUE)
-                { macAddress = buf; }
-                else
-                { macAddress = GetMacAddress(detailData->DevicePath); }
+                memcpy(&value, p, sizeof(value));
+                p += sizeof(value);
             }
             else
             {
-            #if 0
-                //type = PAD_CONNECTION_BT;
-
-                //char buf[126];
-                //if (HidD_GetSerialNumberString(handle, buf, 126) == TRUE)
-                //{ macAddress = buf; }
-            #else
-                // Bluetooth T|[g.
-                HidD_FreePreparsedData(preparsedData);
-
-                CloseHandle(handle);
-                handle = nullptr;
-
-                continue;
-            #endif
+                // マスクは予測できないので分岐せずに展開する(読み過ぎる分は入力の範囲内).
+                for(auto k=0u; k<8; ++k)
+                {
+                    auto bit = (mask >> k) & 1;
+                    value |= (uint64_t(*p) << (k * 8)) & (0 - uint64_t(bit));
+                    p += bit;
+                }
             }
 
-            size = capabilities.FeatureReportByteLength;
-
-            HidD_FreePreparsedData(preparsedData);
+            decoder.Previous[g] ^= value;
         }
-        else if (attributes.ProductID == kDualShock4_CUH_ZCT2x)
-        {
-            deviceDetected = true;
 
-            PHIDP_PREPARSED_DATA preparsedData;
-            HidD_GetPreparsedData(handle, &preparsedData);
-
-            HIDP_CAPS capabilities;
-            HidP_GetCaps(preparsedData, &capabilities);
+        // キーフレームを受け取るまでは読み飛ばすのみ.
+        if (decoder.ReportSize == 0)
+        {
+            emitted = false;
+            return size_t(p - pInput);
+        }
 
-            // Output32
+        decoder.PreviousTime += header >> 1;
+    }
 
-            if (capabilities.InputReportByteLength == 64)
-            {
-                type = PAD_CONNECTION_USB;
-
-                char buf[16];
-                buf[0] = 18;
-                if (HidD_GetFeature(handle, buf, 16) == TRUE)
-                { macAddress = buf; }
-                else
-                { macAddress = GetMacAddress(detailData->DevicePath); }
-            }
-            else
-            {
-            #if 0
-                //type = PAD_CONNECTION_BT;
+    result.Type     = decoder.PreviousType;
+    result.HostTime = decoder.PreviousTime;
+    memcpy(result.Bytes, decoder.Previous, decoder.ReportSize);
+    emitted = true;
+    return size_t(p - pInput);
+}
 
-                //char buf[126];
-                //if (HidD_GetSerialNumberString(handle, buf, 126) == TRUE)
-                //{ macAddress = buf; }
-            #else
-                // Bluetooth T|[g.
-                HidD_FreePreparsedData(preparsedData);
+} // namespace
 
-                CloseHandle(handle);
-                handle = nullptr;
+//-----------------------------------------------------------------------------
+//      差分符号化の状態を初期化します.
+//-----------------------------------------------------------------------------
+bool PadDeltaEncoderInit(PadDeltaEncoder& encoder, uint32_t reportSize, uint32_t keyframeInterval)
+{
+    if (reportSize == 0 || reportSize > kPadMaxReportSize || keyframeInterval == 0)
+    { return false; }
 
-                continue;
-            #endif
-            }
+    encoder = PadDeltaEncoder();
+    encoder.ReportSize       = reportSize;
+    encoder.KeyframeInterval = keyframeInterval;
+    return true;
+}
 
-            size = capabilities.FeatureReportByteLength;
-            HidD_FreePreparsedData(preparsedData);
-        }
-        else if (attributes.ProductID == kDualSense_CFI_ZCT1J)
-        {
-            deviceDetected = true;
+//-----------------------------------------------------------------------------
+//      パッド生データを1つ差分符号化します.
+//-----------------------------------------------------------------------------
+uint32_t PadDeltaEncode(PadDeltaEncoder& encoder, const PadRawInput& input, uint8_t* pOutput, uint32_t capacity)
+{
+    if (pOutput == nullptr || capacity < kPadDeltaMaxRecordSize || encoder.ReportSize == 0)
+    { return 0; }
 
-            PHIDP_PREPARSED_DATA preparsedData;
-            HidD_GetPreparsedData(handle, &preparsedData);
+    const auto size   = encoder.ReportSize;
+    const auto groups = (size + 7) / 8;
+    auto p = pOutput;
 
-            HIDP_CAPS capabilities;
-            HidP_GetCaps(preparsedData, &capabilities);
+    auto key = (encoder.Count == 0)
+            || (encoder.Count >= encoder.KeyframeInterval)
+            || (input.HostTime < encoder.PreviousTime)
+            || (input.Type != encoder.PreviousType);
 
-            // Output48
+    if (key)
+    {
+        p = WriteVarint(p, (input.HostTime << 1) | 1);
+        p = WriteVarint(p, input.Type);
+        *p++ = uint8_t(size);
+        memcpy(p, input.Bytes, size);
+        p += size;
+
+        for(auto g=0u; g<groups; ++g)
+        { encoder.Previous[g] = LoadDeltaGroup(input.Bytes, g, size); }
+        encoder.Count = 1;
+    }
+    else
+    {
+        uint64_t values[kPadDeltaGroupCount];
+        uint32_t changed = 0;
+        for(auto g=0u; g<groups; ++g)
+        {
+            auto current = LoadDeltaGroup(input.Bytes, g, size);
+            values[g] = current ^ encoder.Previous[g];
+            changed  |= uint32_t(values[g] != 0) << g;
+            encoder.Previous[g] = current;
+        }
 
-            if (capabilities.InputReportByteLength == 64)
-            {
-                type = PAD_CONNECTION_USB | PAD_CONNECTION_DUAL_SENSE;
+        p = WriteVarint(p, (input.HostTime - encoder.PreviousTime) << 1);
+        p = WriteVarint(p, changed);
+        for(auto g=0u; g<groups; ++g)
+        {
+            auto value = values[g];
+            if (value == 0)
+            { continue; }
 
-                // foCXMACAhX擾.
-                macAddress = GetMacAddress(detailData->DevicePath);
-            }
-            else
+            auto mask = GetNonZeroBytes(value);
+            *p++ = uint8_t(mask);
+            if (mask == 0xff)
             {
-                // Bluetooth T|[g.
-                HidD_FreePreparsedData(preparsedData);
-
-                CloseHandle(handle);
-                handle = nullptr;
-
+                memcpy(p, &value, sizeof(value));
+                p += sizeof(value);
                 continue;
             }
 
-            size = capabilities.FeatureReportByteLength;
-            HidD_FreePreparsedData(preparsedData);
+            // 0のバイトは書いた後に進めないことで分岐を避ける(出力先は最大サイズ分ある).
+            for(auto k=0u; k<8; ++k)
+            {
+                auto byte = uint8_t(value >> (k * 8));
+                *p = byte;
+                p += (byte != 0);
+            }
         }
-
-        devicePath = detailData->DevicePath;
+        encoder.Count++;
     }
 
-    SetupDiDestroyDeviceInfoList(info);
-
-    // nh.
-    result.Handle       = handle;
-    result.DevicePath   = devicePath;
-    result.Size         = size;
-    result.Type         = type;
-    result.MacAddress   = macAddress;
-
-    return true;
+    encoder.PreviousTime = input.HostTime;
+    encoder.PreviousType = input.Type;
+    return uint32_t(p - pOutput);
 }
 
 //-----------------------------------------------------------------------------
-//      pbhڑ܂.
+//      差分符号化の復号の状態を初期化します.
 //-----------------------------------------------------------------------------
-bool PadOpen(PadHandle** ppHandle)
+bool PadDeltaDecoderInit(PadDeltaDecoder& decoder)
 {
-    auto padHandle = new(std::nothrow) PadHandle();
-    if (padHandle == nullptr)
-    { return false; }
-
-    if (!PadOpen(*padHandle))
-    {
-        delete padHandle;
-        padHandle = nullptr;
-    }
-
-    *ppHandle = padHandle;
-
+    decoder = PadDeltaDecoder();
     return true;
 }
 
 //-----------------------------------------------------------------------------
-//      pbhؒf܂.
+//      差分符号化したレポート列をまとめて復号します.
 //-----------------------------------------------------------------------------
-bool PadClose(PadHandle& padHandle)
+uint32_t PadDeltaDecode
+(
+    PadDeltaDecoder&    decoder,
+    const uint8_t*      pInput,
+    uint32_t            size,
+    uint32_t&           consumed,
+    PadRawInput*        pResults,
+    uint32_t            count
+)
 {
-    if (padHandle.Type == PAD_CONNECTION_BT)
+    consumed = 0;
+    if (pInput == nullptr || pResults == nullptr || decoder.Error != 0)
+    { return 0; }
+
+    auto result = 0u;
+    auto offset = 0u;
+    while(result < count && offset < size)
     {
-        // TODO: Bluetoothؒf.
-    #if 0
-        //BLUETOOTH_FIND_RADIO_PARAMS params;
-        //params.dwSize = sizeof(BLUETOOTH_FIND_RADIO_PARAMS);
+        auto rest    = size - offset;
+        auto emitted = false;
+        size_t used;
+
+        if (rest >= kPadDeltaMaxRecordSize + kDeltaReadMargin)
+        {
+            used = DecodeDeltaRecord(decoder, pInput + offset, pResults[result], emitted);
+            if (used == 0)
+            {
+                decoder.Error = 1;
+                break;
+            }
+        }
+        else
+        {
+            // 末尾は読み過ぎないように0埋めした領域で復号し, 途中までのレポートなら状態を戻して残す.
+            uint8_t tail[kPadDeltaMaxRecordSize + kDeltaReadMargin] = {};
+            memcpy(tail, pInput + offset, rest);
 
-        //HANDLE handleBT = nullptr;
-        //auto handleSearch = BluetoothFindFirstRadio(&params, &handleBT);
+            auto state = decoder;
+            used = DecodeDeltaRecord(state, tail, pResults[result], emitted);
+            if (used == 0 || used > rest)
+            { break; }
 
-        //uint8_t btAddress[8];
-        //DWORD length = 0;
-        //BOOL ret = FALSE;
-        //while(!ret && handleBT != nullptr)
-        //{
-        //    ret = DeviceIoControl(handleBT, IOCTL_BTH_DISCONNECT_DEVICE, btAddress, sizeof(btAddress), NULL, 0, &length, NULL);
-        //    CloseHandle(handleBT);
-        //    if (!ret)
-        //    {
-        //        if (!BluetoothFindNextRadio(handleSearch, &handleBT))
-        //        { handleBT = nullptr; }
-        //    }
-        //}
+            decoder = state;
+        }
 
-        //BluetoothFindRadioClose(handleSearch);
-    #endif
+        offset += uint32_t(used);
+        if (emitted)
+        { result++; }
     }
 
-    if (padHandle.Handle != nullptr)
-    {
-        PadColor color = {};
-        PadVibrationParam vibrate = {};
+    consumed = offset;
+    return result;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Hotplug
+///////////////////////////////////////////////////////////////////////////////
 
-        PadSetLightBarColor(&padHandle, color);
-        PadSetVibration(&padHandle, vibrate);
+//-----------------------------------------------------------------------------
+//      デバイスリストに追加し, 接続イベントを積みます.
+//-----------------------------------------------------------------------------
+bool AddDevice(PadHotplug* pHotplug, const PadDeviceInfo& info)
+{
+    std::lock_guard<std::mutex> locker(pHotplug->Lock);
 
-        CloseHandle(padHandle.Handle);
-        padHandle.Handle = nullptr;
+    for(auto& device : pHotplug->Devices)
+    {
+        if (strcmp(device.Path, info.Path) == 0)
+        { return false; }
     }
 
+    pHotplug->Devices.push_back(info);
+    pHotplug->Pending.push_back({PAD_DEVICE_ADDED, info});
     return true;
 }
 
 //-----------------------------------------------------------------------------
-//      pbhؒf܂.
+//      デバイスリストから削除し, 切断イベントを積みます.
 //-----------------------------------------------------------------------------
-bool PadClose(PadHandle*& pHandle)
+bool RemoveDevice(PadHotplug* pHotplug, const std::string& path)
 {
-    if (pHandle == nullptr)
-    { return false; }
+    std::lock_guard<std::mutex> locker(pHotplug->Lock);
 
-    if (PadClose(*pHandle))
+    for(auto itr = pHotplug->Devices.begin(); itr != pHotplug->Devices.end(); ++itr)
     {
-        // nhj.
-        delete pHandle;
-        pHandle = nullptr;
+        if (path != itr->Path)
+        { continue; }
 
+        pHotplug->Pending.push_back({PAD_DEVICE_REMOVED, *itr});
+        pHotplug->Devices.erase(itr);
         return true;
     }
 
     return false;
 }
 
+#if defined(_WIN32)
 //-----------------------------------------------------------------------------
-//      pbhf[^ǂݎ܂.
+//      デバイス通知のコールバック関数です.
 //-----------------------------------------------------------------------------
-bool PadRead(PadHandle* pHandle, PadRawInput& result)
+DWORD CALLBACK HotplugNotify
+(
+    HCMNOTIFICATION         hNotify,
+    PVOID                   pContext,
+    CM_NOTIFY_ACTION        action,
+    PCM_NOTIFY_EVENT_DATA   pEventData,
+    DWORD                   eventDataSize
+)
 {
-    if (pHandle == nullptr)
-    { return false; }
+    (void)hNotify;
+    (void)eventDataSize;
 
-    if (pHandle->Handle == nullptr)
-    { return false; }
+    auto pHotplug = reinterpret_cast<PadHotplug*>(pContext);
+    PadDeviceInfo info = {};
+    if (!QueryDeviceInfo(pEventData->u.DeviceInterface.SymbolicLink, info))
+    { return ERROR_SUCCESS; }
 
-    if (!!(pHandle->Type & PAD_CONNECTION_BT))
+    if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL)
     {
-        // BluetoothT|[g.
-        return false;
+        if (info.Type != PAD_CONNECTION_NONE)
+        { AddDevice(pHotplug, info); }
+    }
+    else if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEREMOVAL)
+    {
+        RemoveDevice(pHotplug, info.Path);
     }
 
-    auto ret = ReadFile(pHandle->Handle, result.Bytes, pHandle->Size, nullptr, nullptr);
-    result.Type = pHandle->Type;
-
-    return (ret == TRUE);
+    return ERROR_SUCCESS;
 }
 
 //-----------------------------------------------------------------------------
-//      Dual Shock4pbhf[^₷`Ƀ}bsO܂.
+//      デバイス通知を登録します.
 //-----------------------------------------------------------------------------
-bool PadMapDualShock4(const PadRawInput* pRawData, PadState& state)
+bool InitHotplug(PadHotplug* pHotplug)
 {
-    const uint8_t* input = &pRawData->Bytes[0];
+    CM_NOTIFY_FILTER filter = {};
+    filter.cbSize       = sizeof(filter);
+    filter.FilterType   = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+    HidD_GetHidGuid(&filter.u.DeviceInterface.ClassGuid);
 
-    if (!!(pRawData->Type & PAD_CONNECTION_NONE))
-    { 
-        memset(&state, 0, sizeof(state));
-        return false;
-    }
-    else if (!!(pRawData->Type & PAD_CONNECTION_USB))
-    {
-        // 64 bytes.
-        state.Type = PAD_CONNECTION_USB;
-    }
-    else if (!!(pRawData->Type & PAD_CONNECTION_WIRELESS))
-    {
-        // 64 bytes.
-        state.Type = PAD_CONNECTION_WIRELESS;
-    }
-    else if (!!(pRawData->Type & PAD_CONNECTION_BT))
-    {
-        //// 547 bytes.
-        //state.Type = PAD_CONNECTION_BT;
-        //input = &pRawData->Bytes[2];
+    return CM_Register_Notification(&filter, pHotplug, HotplugNotify, &pHotplug->Notify) == CR_SUCCESS;
+}
 
-        // Bluetooth T|[g.
-        return false;
+//-----------------------------------------------------------------------------
+//      デバイス通知を解除します.
+//-----------------------------------------------------------------------------
+void TermHotplug(PadHotplug* pHotplug)
+{
+    // 実行中のコールバック関数の完了を待ってから戻る.
+    if (pHotplug->Notify != nullptr)
+    {
+        CM_Unregister_Notification(pHotplug->Notify);
+        pHotplug->Notify = nullptr;
     }
+}
 
-    state.StickL.X          = input[1];
-    state.StickL.Y          = input[2];
-    state.StickR.X          = input[3];
-    state.StickR.Y          = input[4];
-    state.AnalogButtons.L2  = input[8];
-    state.AnalogButtons.R2  = input[9];
-    state.Buttons           = uint16_t(input[5] | (input[6] << 8));
-    state.SpecialButtons    = input[7] & 0x3;
-    state.TimeStamp         = uint16_t((input[11] << 8) | input[10]);
-    state.BatteryLevel      = input[12];
-
-    state.Gyro.X  = (int16_t)(uint16_t(input[14] << 8) | input[13]);
-    state.Gyro.Y  = (int16_t)(uint16_t(input[16] << 8) | input[15]);
-    state.Gyro.Z  = (int16_t)(uint16_t(input[18] << 8) | input[17]);
-
-    state.Accel.X = (int16_t)(uint16_t(input[20] << 8) | input[19]);
-    state.Accel.Y = (int16_t)(uint16_t(input[22] << 8) | input[21]);
-    state.Accel.Z = (int16_t)(uint16_t(input[24] << 8) | input[23]);
-
-    auto touch_count = 0;
-    if ((input[35] & 0x80) == 0)
-    { touch_count++; }
-
-    if ((input[39] & 0x80) == 0)
-    { touch_count++; }
-
-    state.TouchData.Count = touch_count;
-    state.TouchData.Touch[0].Id = (input[35] & 0x7f);
-    state.TouchData.Touch[0].X = static_cast<uint16_t>((uint16_t(input[37] & 0xf) << 8) | input[36]);
-    state.TouchData.Touch[0].Y = static_cast<uint16_t>((uint16_t(input[38] << 4)) | ((input[37] & 0xf0) >> 4));
-
-    state.TouchData.Touch[1].Id = (input[39] & 0x7f);
-    state.TouchData.Touch[1].X = static_cast<uint16_t>((uint16_t(input[41] & 0xf) << 8) | input[40]);
-    state.TouchData.Touch[1].Y = static_cast<uint16_t>((uint16_t(input[42] << 4)) | ((input[41] & 0xf0) >> 4));
+//-----------------------------------------------------------------------------
+//      到着済みの通知を処理します.
+//-----------------------------------------------------------------------------
+void PollHotplug(PadHotplug* pHotplug)
+{
+    // 通知はシステムのスレッドで直接キューに積まれる.
+    (void)pHotplug;
+}
 
-    return true;
+//-----------------------------------------------------------------------------
+//      uevent メッセージを処理します.
+//-----------------------------------------------------------------------------
+bool HandleUevent(PadHotplug* pHotplug, const char* pMessage, size_t size)
+{
+    (void)pHotplug;
+    (void)pMessage;
+    (void)size;
+    return false;
 }
 
+#else
 //-----------------------------------------------------------------------------
-//      Dual Sensepbhf[^₷`Ƀ}bsO܂.
+//      uevent メッセージを処理します.
 //-----------------------------------------------------------------------------
-bool PadMapDualSense(const PadRawInput* pRawData, PadState& state)
+bool HandleUevent(PadHotplug* pHotplug, const char* pMessage, size_t size)
 {
-    const uint8_t* input = &pRawData->Bytes[0];
+    const char* pProperties = nullptr;
+    size_t      length      = 0;
 
-    if (!!(pRawData->Type & PAD_CONNECTION_NONE))
-    { 
-        memset(&state, 0, sizeof(state));
-        return false;
-    }
-    else if (!!(pRawData->Type & PAD_CONNECTION_USB))
-    {
-        // 64 bytes.
-        state.Type = PAD_CONNECTION_USB;
-    }
-    else if (!!(pRawData->Type == PAD_CONNECTION_WIRELESS))
+    if (size >= kUdevHeaderSize && memcmp(pMessage, "libudev", 8) == 0)
     {
-        // 64 bytes.
-        state.Type = PAD_CONNECTION_WIRELESS;
+        // udev形式 : ヘッダの後ろにプロパティが並ぶ.
+        uint32_t offset = 0;
+        uint32_t bytes  = 0;
+        memcpy(&offset, pMessage + 16, sizeof(offset));
+        memcpy(&bytes,  pMessage + 20, sizeof(bytes));
+        if (offset > size || bytes > size - offset)
+        { return false; }
+
+        pProperties = pMessage + offset;
+        length      = bytes;
     }
-    else if (pRawData->Type == PAD_CONNECTION_BT)
+    else
     {
-        //state.Type = PAD_CONNECTION_BT;
-        //input = &pRawData->Bytes[2];
+        // カーネル形式 : "add@/devices/..." の後ろにプロパティが並ぶ.
+        auto header = strnlen(pMessage, size);
+        if (header == size || memchr(pMessage, '@', header) == nullptr)
+        { return false; }
 
-        // Bluetooth T|[g.
-        return false;
+        pProperties = pMessage + header + 1;
+        length      = size - header - 1;
     }
 
-    /* Memo :
-    * input[7] @^C}[JE^[ۂ.
-    * input[11] @Ƀ[.
-    * input[12]~[15]@@^CX^vۂ.
-    * input[16]~@@WCx.
-    * input[30]~[32]@ ^CX^vۂ.
-    */
+    std::string action;
+    std::string subsystem;
+    std::string devName;
+    std::string hidId;
+
+    auto end = pProperties + length;
+    for(auto itr = pProperties; itr < end; )
+    {
+        auto count = strnlen(itr, size_t(end - itr));
+        std::string pair(itr, count);
+        itr += count + 1;
 
-    state.StickL.X          = input[1];
-    state.StickL.Y          = input[2];
-    state.StickR.X          = input[3];
-    state.StickR.Y          = input[4];
-    state.AnalogButtons.L2  = input[5];
-    state.AnalogButtons.R2  = input[6];
-    state.Buttons           = uint16_t(input[8] | (input[9] << 8));
-    state.SpecialButtons    = input[10] & 0xf;
-    state.TimeStamp         = uint16_t((input[13] << 8) | input[12]);
+        auto pos = pair.find('=');
+        if (pos == std::string::npos)
+        { continue; }
 
-    // WC, x͎bΉ.
-    // TODO : Gyro, Accelaration Implementation.
-    state.Gyro.X  = (int16_t)(uint16_t(input[17] << 8) | input[16]);
-    state.Gyro.Y  = (int16_t)(uint16_t(input[19] << 8) | input[18]);
-    state.Gyro.Z  = (int16_t)(uint16_t(input[21] << 8) | input[20]);
+        auto key   = pair.substr(0, pos);
+        auto value = pair.substr(pos + 1);
+        if (key == "ACTION")
+        { action = value; }
+        else if (key == "SUBSYSTEM")
+        { subsystem = value; }
+        else if (key == "DEVNAME")
+        { devName = value; }
+        else if (key == "HID_ID")
+        { hidId = value; }
+    }
 
-    state.Accel.X = (int16_t)(uint16_t(input[23] << 8) | input[22]);
-    state.Accel.Y = (int16_t)(uint16_t(input[25] << 8) | input[24]);
-    state.Accel.Z = (int16_t)(uint16_t(input[27] << 8) | input[26]);
+    if (subsystem != "hidraw" || devName.empty())
+    { return false; }
 
-    state.TouchData.Count       = input[41];
-    state.TouchData.Touch[0].Id = (input[33] & 0x7f);
-    state.TouchData.Touch[0].X  = static_cast<uint16_t>((uint16_t(input[35] & 0xf) << 8) | input[34]);
-    state.TouchData.Touch[0].Y  = static_cast<uint16_t>((uint16_t(input[36] << 4)) | ((input[35] & 0xf0) >> 4));
+    auto devicePath = (devName[0] == '/') ? devName : GetHidRawDir() + "/" + devName;
 
-    state.TouchData.Touch[1].Id = (input[37] & 0x7f);
-    state.TouchData.Touch[1].X  = static_cast<uint16_t>((uint16_t(input[39] & 0xf) << 8) | input[38]);
-    state.TouchData.Touch[1].Y  = static_cast<uint16_t>((uint16_t(input[40] << 4)) | ((input[39] & 0xf0) >> 4));
+    if (action == "add")
+    {
+        PadDeviceInfo info = {};
+        auto ret = hidId.empty()
+            ? QueryDeviceInfo(devicePath, info)
+            : ParseHidId(hidId.c_str(), info);
+        if (!ret || info.Type == PAD_CONNECTION_NONE)
+        { return false; }
+
+        SetDevicePath(info, devicePath);
+        return AddDevice(pHotplug, info);
+    }
+    else if (action == "remove")
+    {
+        return RemoveDevice(pHotplug, devicePath);
+    }
 
-    return true;
+    return false;
 }
 
 //-----------------------------------------------------------------------------
-//      pbhf[^₷`Ƀ}bsO܂.
+//      udev監視用のnetlinkソケットを開きます.
 //-----------------------------------------------------------------------------
-bool PadMap(const PadRawInput* pRawData, PadState& state)
+bool InitHotplug(PadHotplug* pHotplug)
 {
-    if (pRawData == nullptr)
+    auto fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0)
     { return false; }
 
-    if (!!(pRawData->Type & PAD_CONNECTION_DUAL_SENSE))
-    { return PadMapDualSense(pRawData, state); }
+    // udevがルール適用後に再送するイベントを受け取る.
+    sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = kUdevMonitorGroup;
+
+    int enable = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &enable, sizeof(enable)) != 0
+     || bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+    {
+        close(fd);
+        return false;
+    }
 
-    return PadMapDualShock4(pRawData, state);
+    pHotplug->Socket = fd;
+    return true;
 }
 
 //-----------------------------------------------------------------------------
-//      pbhf[^ǂݎ܂.
+//      netlinkソケットを閉じます.
 //-----------------------------------------------------------------------------
-bool PadGetState(PadHandle* pHandle, PadState& state)
+void TermHotplug(PadHotplug* pHotplug)
 {
-    PadRawInput pResult;
-    if (!PadRead(pHandle, pResult))
-    { return false; }
-
-    if (!PadMap(&pResult, state))
-    { return false; }
-
-    return true;
+    if (pHotplug->Socket >= 0)
+    {
+        close(pHotplug->Socket);
+        pHotplug->Socket = -1;
+    }
 }
 
 //-----------------------------------------------------------------------------
-//      DualShock4ɃoCu[Vf[^ݒ肵܂.
+//      到着済みの uevent を処理します.
 //-----------------------------------------------------------------------------
-bool PadSetVibrationDualShock4(PadHandle* pHandle, const PadVibrationParam& param)
+void PollHotplug(PadHotplug* pHotplug)
 {
-    uint8_t bytes[32] = {};
-    if (!!(pHandle->Type & PAD_CONNECTION_BT))
-    {
-        bytes[0] = 0x11;
-        bytes[1] = 0xb0;
-        bytes[3] = 0xf1;    // enable rumble (0x01), lightbar (0x02), flash (0x04)
-        bytes[6] = param.LargeMotor;
-        bytes[7] = param.SmallMotor;
-    }
-    else
+    char buffer[8192];
+    char control[CMSG_SPACE(sizeof(ucred))];
+
+    for(;;)
     {
-        bytes[0] = 0x05;
-        bytes[1] = 0xf1;    // enable rumble (0x01), lightbar (0x02), flash (0x04)
-        bytes[4] = param.LargeMotor;
-        bytes[5] = param.SmallMotor;
-    }
+        iovec iov = {};
+        iov.iov_base = buffer;
+        iov.iov_len  = sizeof(buffer);
+
+        sockaddr_nl addr = {};
+        msghdr msg = {};
+        msg.msg_name        = &addr;
+        msg.msg_namelen     = sizeof(addr);
+        msg.msg_iov         = &iov;
+        msg.msg_iovlen      = 1;
+        msg.msg_control     = control;
+        msg.msg_controllen  = sizeof(control);
+
+        auto size = recvmsg(pHotplug->Socket, &msg, 0);
+        if (size < 0)
+        {
+            if (errno == EINTR)
+            { continue; }
+            break;
+        }
 
-    auto size = WriteFile(pHandle->Handle, bytes, 32, nullptr, nullptr);
-    if (size != 32)
-    { return false; }
+        // root以外から送られたメッセージは信用しない.
+        auto cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg == nullptr || cmsg->cmsg_type != SCM_CREDENTIALS)
+        { continue; }
 
-    return true;
+        ucred cred;
+        memcpy(&cred, CMSG_DATA(cmsg), sizeof(cred));
+        if (cred.uid != 0)
+        { continue; }
+
+        HandleUevent(pHotplug, buffer, size_t(size));
+    }
 }
+#endif
 
 //-----------------------------------------------------------------------------
-//      DualSenseɃoCu[Vf[^ݒ肵܂.
+//      監視ハンドルを破棄します.
 //-----------------------------------------------------------------------------
-bool PadSetVibrationDualSense(PadHandle* pHandle, const PadVibrationParam& param)
+void DestroyHotplug(PadHotplug* pHotplug)
 {
-    uint8_t bytes[48] = {};
-    if (!!(pHandle->Type & PAD_CONNECTION_BT))
-    {
-        return false;
-    }
-    else
-    {
-        // tO = 0x01 | 0x04 | 0x08 | 0x10 | 0x20 | 0x80
-        bytes[0] = 0x2;
-        bytes[1] = 0xff;
-        bytes[2] = 0x1; // control flags.
-        bytes[3] = param.LargeMotor;
-        bytes[4] = param.SmallMotor;
-        bytes[9] = 0x0; // mic
-    }
-
-    auto size = WriteFile(pHandle->Handle, bytes, 48, nullptr, nullptr);
-    if (size != 48)
-    { return false; }
-
-    return true;
+    TermHotplug(pHotplug);
+    delete pHotplug;
 }
 
 //-----------------------------------------------------------------------------
-//      oCu[Vݒ肵܂.
+//      デバイスの接続・切断の監視を開始します.
 //-----------------------------------------------------------------------------
-bool PadSetVibration(PadHandle* pHandle, const PadVibrationParam& param)
+bool PadHotplugOpen(PadHotplugCallback callback, void* pUser, PadHotplug** ppHotplug)
 {
-    if (pHandle == nullptr)
+    if (callback == nullptr || ppHotplug == nullptr)
     { return false; }
 
-    if (pHandle->Handle == nullptr)
+    auto pHotplug = new(std::nothrow) PadHotplug();
+    if (pHotplug == nullptr)
     { return false; }
 
-    if (!!(pHandle->Type & PAD_CONNECTION_DUAL_SENSE))
-    { return PadSetVibrationDualSense(pHandle, param); }
-
-    return PadSetVibrationDualShock4(pHandle, param); 
-}
+    pHotplug->Callback = callback;
+    pHotplug->pUser    = pUser;
 
-//-----------------------------------------------------------------------------
-//      DualShock4ɃCgo[J[ݒ肵܂.
-//-----------------------------------------------------------------------------
-bool PadSetLightBarColorDualShock4(PadHandle* pHandle, const PadColor& param)
-{
-    uint8_t bytes[32] = {};
-    if (!!(pHandle->Type & PAD_CONNECTION_BT))
+    // 列挙前に監視を開始して, 列挙中の接続を取りこぼさないようにする.
+    if (!InitHotplug(pHotplug))
     {
-        bytes[0]  = 0x11;
-        bytes[1]  = 0xb0;
-        bytes[3]  = 0xf6;    // enable rumble (0x01), lightbar (0x02), flash (0x04)
-        bytes[8]  = param.R;
-        bytes[9]  = param.G;
-        bytes[10] = param.B;
+        DestroyHotplug(pHotplug);
+        return false;
     }
-    else
+
+    for(auto& devicePath : EnumerateDevicePaths())
     {
-        bytes[0] = 0x05;
-        bytes[1] = 0xf6;    // enable rumble (0x01), lightbar (0x02), flash (0x04)
-        bytes[6] = param.R;
-        bytes[7] = param.G;
-        bytes[8] = param.B;
+        PadDeviceInfo info = {};
+        if (QueryDeviceInfo(devicePath, info) && info.Type != PAD_CONNECTION_NONE)
+        { AddDevice(pHotplug, info); }
     }
 
-    auto size = WriteFile(pHandle->Handle, bytes, 32, nullptr, nullptr);
-    if (size != 32)
-    { return false; }
-
+    *ppHotplug = pHotplug;
     return true;
 }
 
 //-----------------------------------------------------------------------------
-//      DualSenseɃCgo[J[ݒ肵܂.
+//      デバイスの接続・切断の監視を終了します.
 //-----------------------------------------------------------------------------
-bool PadSetLightBarColorDualSense(PadHandle* pHandle, const PadColor& param)
+bool PadHotplugClose(PadHotplug*& pHotplug)
 {
-    uint8_t bytes[48] = {};
-    if (!!(pHandle->Type & PAD_CONNECTION_BT))
-    {
-        return false;
-    }
-    else
-    {
-        // tO = 0x01 | 0x04 | 0x08 | 0x10 | 0x20 | 0x80
-        bytes[0] = 0x2;
-        bytes[1] = 0xff;
-        bytes[2] = 0x2 | 0x4; // control flags.
-        bytes[3] = 0;
-        bytes[4] = 0;
-        bytes[9] = 0x0; // mic
-        bytes[45] = param.R;
-        bytes[46] = param.G;
-        bytes[47] = param.B;
-    }
-
-    auto size = WriteFile(pHandle->Handle, bytes, 48, nullptr, nullptr);
-    if (size != 48)
+    if (pHotplug == nullptr)
     { return false; }
 
+    DestroyHotplug(pHotplug);
+    pHotplug = nullptr;
     return true;
 }
 
 //-----------------------------------------------------------------------------
-//      Cgo[J[ݒ肵܂.
+//      溜まっている接続・切断イベントをコールバック関数に通知します.
 //-----------------------------------------------------------------------------
-bool PadSetLightBarColor(PadHandle* pHandle, const PadColor& param)
+uint32_t PadHotplugUpdate(PadHotplug* pHotplug)
 {
-    if (pHandle == nullptr)
-    { return false; }
+    if (pHotplug == nullptr)
+    { return 0; }
 
-    if (pHandle->Handle == nullptr)
-    { return false; }
+    PollHotplug(pHotplug);
 
-    if (!!(pHandle->Type & PAD_CONNECTION_DUAL_SENSE))
-    { return PadSetLightBarColorDualSense(pHandle, param); }
+    // コールバック関数内から他のAPIを呼べるようにロック外で通知する.
+    pHotplug->Dispatch.clear();
+    {
+        std::lock_guard<std::mutex> locker(pHotplug->Lock);
+        pHotplug->Dispatch.swap(pHotplug->Pending);
+    }
 
-    return PadSetLightBarColorDualShock4(pHandle, param);
+    for(auto& item : pHotplug->Dispatch)
+    { pHotplug->Callback(pHotplug->pUser, item.Event, item.Info); }
+
+    return uint32_t(pHotplug->Dispatch.size());
 }
 
 //-----------------------------------------------------------------------------
-//      pbhf[^ǂݎ܂.
+//      接続中のパッドのデバイス情報を取得します.
 //-----------------------------------------------------------------------------
-bool PadGetState(PadState& state)
+uint32_t PadHotplugGetDevices(PadHotplug* pHotplug, PadDeviceInfo* pInfos, uint32_t count)
 {
-    PadHandle handle;
-    if (!PadOpen(handle))
-    { return false; }
+    if (pHotplug == nullptr)
+    { return 0; }
 
-    PadRawInput rawData;
-    if (!PadRead(&handle, rawData))
+    std::lock_guard<std::mutex> locker(pHotplug->Lock);
+
+    auto size = uint32_t(pHotplug->Devices.size());
+    if (pInfos != nullptr)
     {
-        PadClose(handle);
-        return false;
+        for(auto i=0u; i<size && i<count; ++i)
+        { pInfos[i] = pHotplug->Devices[i]; }
     }
 
-    auto ret = PadMap(&rawData, state);
-    PadClose(handle);
-
-    return ret;
+    return size;
 }
 
 //-----------------------------------------------------------------------------
-//      pbhf[^ǂݎ܂.
+//      uevent メッセージを注入します.
 //-----------------------------------------------------------------------------
-bool PadGetRawInput(PadRawInput& state)
+bool PadHotplugInject(PadHotplug* pHotplug, const char* pMessage, uint32_t size)
 {
-    PadHandle handle;
-    if (!PadOpen(handle))
+    if (pHotplug == nullptr || pMessage == nullptr)
     { return false; }
 
-    PadRawInput rawData;
-    auto ret = PadRead(&handle, rawData);
-
-    PadClose(handle);
-    return ret;
+    return HandleUevent(pHotplug, pMessage, size);
 }
 
 //-----------------------------------------------------------------------------
-//      oCu[Vݒ肵܂.
+//      以降に開くパッドの入出力を差し替えます.
 //-----------------------------------------------------------------------------
-bool PadSetVibration(const PadVibrationParam& param)
+bool PadSetTransport(const PadTransport* pTransport)
 {
-    PadHandle handle;
-    if (!PadOpen(handle))
-    { return false; }
+    PadTransport transport = {};
+    if (pTransport != nullptr)
+    {
+        transport = *pTransport;
+        if (transport.Open  == nullptr || transport.Close == nullptr || transport.Read == nullptr
+         || transport.Write == nullptr || transport.GetFeature == nullptr)
+        { return false; }
+    }
 
-    auto ret = PadSetVibration(&handle, param);
-    PadClose(handle);
+    // 開いているハンドルと以降に開くハンドルで入出力が混ざらないようにする.
+    std::lock_guard<std::mutex> locker(g_TransportLock);
+    if (g_OpenDevices != 0)
+    { return false; }
 
-    return ret;
+    g_Transport = transport;
+    return true;
 }
 
 //-----------------------------------------------------------------------------
-//      Cgo[J[ݒ肵܂.
+//      デバイスの探索先ディレクトリを変更します.
 //-----------------------------------------------------------------------------
-bool PadSetLightBarColor(const PadColor& param)
+bool PadSetDeviceRoot(const char* devDir, const char* sysfsDir)
 {
-    PadHandle handle;
-    if (!PadOpen(handle))
+#if defined(_WIN32)
+    (void)devDir;
+    (void)sysfsDir;
+    return false;
+#else
+    std::lock_guard<std::mutex> locker(g_TransportLock);
+    if (g_OpenDevices != 0)
     { return false; }
 
-    auto ret = PadSetLightBarColor(&handle, param);
-    PadClose(handle);
-
-    return ret;
+    std::lock_guard<std::mutex> rootLocker(g_DeviceRootLock);
+    g_HidRawDir = (devDir   != nullptr) ? devDir   : kHidRawDir;
+    g_SysfsDir  = (sysfsDir != nullptr) ? sysfsDir : kSysfsDir;
+    return true;
+#endif
 }
@@ -0,0 +1,84 @@
+//-----------------------------------------------------------------------------
+// File : ds4_pad_test.h
+// Desc : Dual Shock4 Game Pad Library Test Hooks.
+// Copyright(c) Project Asura. All right reserved.
+//-----------------------------------------------------------------------------
+#pragma once
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <ds4_pad.h>
+
+
+//-----------------------------------------------------------------------------
+// Test Hooks.
+//-----------------------------------------------------------------------------
+// テストやベンチマークでハードウェア無しにライブラリを動かすための内部APIです.
+// 公開ヘッダには含めないので, アプリケーションからは使用しないでください.
+
+//-----------------------------------------------------------------------------
+//! @brief      uevent メッセージを注入します.
+//!
+//! @param[in]      pHotplug    監視ハンドル.
+//! @param[in]      pMessage    uevent メッセージ. カーネル形式とudev形式のどちらも受け付けます.
+//! @param[in]      size        メッセージのサイズ.
+//! @retval true    パッドのイベントとして処理された.
+//! @retval false   パッド以外のイベント, または不正なメッセージ.
+//! @note   テスト用です. Linux以外では常にfalseを返却します.
+//-----------------------------------------------------------------------------
+bool PadHotplugInject(PadHotplug* pHotplug, const char* pMessage, uint32_t size);
+
+//-----------------------------------------------------------------------------
+//! @brief      デバイスの探索先ディレクトリを変更します.
+//!
+//! @param[in]      devDir      hidrawデバイスの格納ディレクトリ. nullptrの場合は"/dev".
+//! @param[in]      sysfsDir    sysfsのマウント先. nullptrの場合は"/sys".
+//! @retval true    変更に成功.
+//! @retval false   変更に失敗(パッドを開いている).
+//! @note   テストやベンチマークで偽のsysfsツリーを使うためのものです.
+//!         パッドを開いている間は変更できません. Linux以外では常にfalseを返却します.
+//-----------------------------------------------------------------------------
+bool PadSetDeviceRoot(const char* devDir, const char* sysfsDir);
+
+///////////////////////////////////////////////////////////////////////////////
+// PadTransport structure
+///////////////////////////////////////////////////////////////////////////////
+//! @brief  デバイスとの入出力を差し替えるための関数テーブルです.
+//!
+//! @note   各関数の第1引数には pContext が, 第2引数には Open() の戻り値が渡されます.
+//!         Read() は読み取りスレッドから, Write() は書き込みスレッドから並行して呼び出される場合があります.
+struct PadTransport
+{
+    void*   pContext;   //!< 各関数に渡されるユーザーデータ.
+
+    //! デバイスを開きます. 失敗した場合はnullptrを返却します.
+    void*   (*Open)(void* pContext, const char* devicePath);
+
+    //! デバイスを閉じます.
+    void    (*Close)(void* pContext, void* pDevice);
+
+    //! 入力レポートを1つ読み取ります(timeout はミリ秒, 負値で無制限).
+    //! 読み取ったバイト数, タイムアウトした場合は0, 切断された場合は負値を返却します.
+    int32_t (*Read)(void* pContext, void* pDevice, uint8_t* pBytes, uint32_t size, int32_t timeout);
+
+    //! 出力レポートを書き込みます. 書き込んだバイト数, 失敗した場合は負値を返却します.
+    int32_t (*Write)(void* pContext, void* pDevice, const uint8_t* pBytes, uint32_t size);
+
+    //! フィーチャーレポートを読み取ります(pBytes[0] はレポートID).
+    //! 読み取ったバイト数, 失敗した場合は負値を返却します.
+    int32_t (*GetFeature)(void* pContext, void* pDevice, uint8_t* pBytes, uint32_t size);
+};
+
+//-----------------------------------------------------------------------------
+//! @brief      以降に開くパッドの入出力を差し替えます.
+//!
+//! @param[in]      pTransport  入出力の関数テーブル. nullptrの場合はOSのデバイスに戻します.
+//! @retval true    変更に成功.
+//! @retval false   変更に失敗(関数が不足している, またはパッドを開いている).
+//! @note   テストやベンチマークでハードウェア無しにパッドを模擬するためのものです.
+//!         パッドを開いている間は差し替えられません.
+//!         差し替えた入出力では接続タイプ(PAD_CONNECTION_NONE 以外)が必要で,
+//!         MACアドレスはフィーチャーレポート 0x12 から取得します. PadManagerAdd() には追加できません.
+//-----------------------------------------------------------------------------
+bool PadSetTransport(const PadTransport* pTransport);